@@ -190,6 +190,8 @@ void devmode_render(void) {
 		DISPLAY_TEXT2("  streams: %u", s_stats->stream_count);
 		DISPLAY_TEXT2("  pl. samples: %u", s_stats->playing_samples);
 		DISPLAY_TEXT2("  pl. streams: %u", s_stats->playing_streams);
+		DISPLAY_TEXT2("  underruns: %u", s_stats->stream_underruns);
+		DISPLAY_TEXT2("  starved: %u", s_stats->stream_starved);
 		stats_cursor.y += 8.0f;
 	}
 	cursor.y += 20.0f;
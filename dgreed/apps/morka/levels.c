@@ -32,11 +32,8 @@ void levels_init(const char* filename){
 
 	levels_descs = darray_create(sizeof(LevelDesc), 0);
 
-	const char* mml_text = txtfile_read(filename);
-
-	if(!mml_deserialize(&mml, mml_text))
+	if(!mml_load(&mml, filename))
 		LOG_ERROR("Unable to parse levels desc %s",filename);
-	MEM_FREE(mml_text);
 
 	NodeIdx root = mml_root(&mml);
 	if(strcmp(mml_get_name(&mml, root), "levels") != 0)
@@ -286,12 +286,9 @@ static uint _parse_ruleset(MMLObject* mml, NodeIdx rs_node, Ruleset* rs, uint* n
 }
 
 static void _mchains_load_desc(const char* desc) {
-	const char* mml_text = txtfile_read(desc);
-
 	MMLObject mml;
-	if(!mml_deserialize(&mml, mml_text))
+	if(!mml_load(&mml, desc))
 		LOG_ERROR("Unable to parse mchains desc %s", desc);
-	MEM_FREE(mml_text);
 
 	NodeIdx root = mml_root(&mml);
 	if(strcmp(mml_get_name(&mml, root), "mchains") != 0)
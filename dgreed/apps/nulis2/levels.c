@@ -132,10 +132,8 @@ void levels_reset(const char* desc) {
 	assert(level_defs_allocated);
 
 	// Parse mml
-	char* mml_text = txtfile_read(desc);
-	if(!mml_deserialize(&level_mml, mml_text))
+	if(!mml_load(&level_mml, desc))
 		LOG_ERROR("Unable to parse levels desc");
-	MEM_FREE(mml_text);
 
 	// Check if root has correct name
 	NodeIdx root = mml_root(&level_mml);
@@ -0,0 +1,96 @@
+#include "anim.h"
+
+static const char* anim_desc = 
+	"(anims test\n"
+	"	(anim rabbit\n"
+	"		(fps 10)\n"
+	"		(start_seq land)\n"
+	"		(seq run\n"
+	"			(frames \"0 1 2 3\")\n"
+	"			(on_finish loop)\n"
+	"		)\n"
+	"		(seq land\n"
+	"			(frames \"11 12\")\n"
+	"			(on_finish play.jump)\n"
+	"		)\n"
+	"		(seq jump\n"
+	"			(frames \"5 6 7\")\n"
+	"			(on_finish play.run)\n"
+	"		)\n"
+	"		(seq die\n"
+	"			(frames \"8 9\")\n"
+	"			(on_finish stop)\n"
+	"		)\n"
+	"	)\n"
+	"	(anim bird\n"
+	"		(fps 5)\n"
+	"		(start_seq fly)\n"
+	"		(seq fly\n"
+	"			(frames \"1 2\")\n"
+	"			(on_finish loop)\n"
+	"		)\n"
+	"	)\n"
+	")";
+
+TEST_(play_chain) {
+	txtfile_write("test_anims.mml", anim_desc);
+	anim_init("test_anims.mml");
+
+	// land -> jump -> run loop, 0.1s per frame
+	const uint expected[] = {11, 12, 5, 6, 7, 0, 1, 2, 3, 0, 1};
+	Anim* a = anim_new_ex("rabbit", 0.0f);
+	for(uint i = 0; i < ARRAY_SIZE(expected); ++i)
+		ASSERT_(anim_frame_ex(a, (float)i * 0.1f + 0.05f) == expected[i]);
+
+	anim_play_ex(a, "die", 2.0f);
+	ASSERT_(anim_frame_ex(a, 2.05f) == 8);
+	ASSERT_(anim_frame_ex(a, 5.0f) == 9);
+
+	anim_del(a);
+	anim_close();
+	file_remove("test_anims.mml");
+}
+
+TEST_(handles) {
+	txtfile_write("test_anims.mml", anim_desc);
+	anim_init("test_anims.mml");
+
+	AnimHandle rabbit = anim_get_handle("rabbit");
+	AnimHandle bird = anim_get_handle("bird");
+	ASSERT_(rabbit != bird);
+	AnimSeqHandle run = anim_get_seq_handle("rabbit", "run");
+	AnimSeqHandle die = anim_get_seq_handle("rabbit", "die");
+	ASSERT_(run != die);
+
+	// Contiguous array of instances, every third one is a bird
+	Anim anims[300];
+	uint out[300];
+	for(uint i = 0; i < 300; ++i) {
+		anim_reset_h(&anims[i], i % 3 ? rabbit : bird, 0.0f);
+		if(i % 3 == 1)
+			anim_play_h_ex(&anims[i], run, 0.0f);
+		if(i % 3 == 2)
+			anim_play_h_ex(&anims[i], die, 0.0f);
+	}
+
+	anim_update_all(anims, 300, 0.65f, out);
+	for(uint i = 0; i < 300; ++i) {
+		const uint expected[] = {2, 2, 9};
+		ASSERT_(out[i] == expected[i % 3]);
+		ASSERT_(out[i] == anim_frame_ex(&anims[i], 0.65f));
+	}
+
+	// Handle and string lookups must agree
+	Anim* a = anim_new_h_ex(rabbit, 0.0f);
+	Anim* b = anim_new_ex("rabbit", 0.0f);
+	anim_play_h_ex(a, run, 1.0f);
+	anim_play_ex(b, "run", 1.0f);
+	ASSERT_(strcmp(a->name, "rabbit") == 0);
+	ASSERT_(a->seq == b->seq);
+	ASSERT_(anim_frame_ex(a, 1.25f) == anim_frame_ex(b, 1.25f));
+
+	anim_del(a);
+	anim_del(b);
+	anim_close();
+	file_remove("test_anims.mml");
+}
@@ -85,6 +85,30 @@ TEST_(stress) {
 	ASSERT_(counter == 1000);
 }
 
+TEST_(wait) {
+	TaskId taskids[100];
+	int counter = 0;
+	for(uint i = 0; i < 100; ++i) {
+		taskids[i] = async_run(inc_counter, &counter);
+	}
+
+	// Wait in reverse order, most tasks should be done on this thread
+	for(int i = 99; i >= 0; --i) {
+		async_wait(taskids[i]);
+		ASSERT_(async_is_finished(taskids[i]));
+	}
+
+	ASSERT_(counter == 100);
+
+	int ar = 0;
+	TaskId a = async_run(task_a, &ar);
+	async_wait(a);
+	ASSERT_(ar == fib(10));
+
+	// Waiting for a finished task returns immediately
+	async_wait(a);
+}
+
 
 char* io_test_message = "kukutis";
 char io_test_reversed[10];
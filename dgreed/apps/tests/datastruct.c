@@ -295,6 +295,37 @@ TEST_(aatree_remove_stress) {
 	aatree_free(&t);
 }
 
+TEST_(aatree_interleaved) {
+	AATree t;
+	bool present[512];
+	uint count = 0;
+
+	aatree_init(&t);
+	memset(present, 0, sizeof(present));
+
+	// Toggle pseudo-random keys, mixing inserts and removes
+	uint r = 1;
+	for(uint i = 0; i < 20000; ++i) {
+		r = r * 1103515245 + 12345;
+		int key = (r >> 16) % 512;
+		if(present[key]) {
+			ASSERT_(aatree_remove(&t, key) == &present[key]);
+			count--;
+		}
+		else {
+			ASSERT_(aatree_insert(&t, key, &present[key]) == true);
+			count++;
+		}
+		present[key] = !present[key];
+	}
+
+	ASSERT_(aatree_size(&t) == count);
+	for(int key = 0; key < 512; ++key)
+		ASSERT_((aatree_find(&t, key) != NULL) == present[key]);
+
+	aatree_free(&t);
+}
+
 TEST_(dict_empty) {
 	Dict d;
 
@@ -0,0 +1,145 @@
+#include <image.h>
+
+static void _fill_rgba(Color* pixels, uint w, uint h) {
+	for(uint y = 0; y < h; ++y) {
+		for(uint x = 0; x < w; ++x)
+			pixels[y * w + x] = COLOR_RGBA(x & 0xFF, y & 0xFF, (x ^ y) & 0x0F, 0xFF);
+	}
+}
+
+static void _fill_rgb565(uint16* pixels, uint w, uint h) {
+	for(uint y = 0; y < h; ++y) {
+		for(uint x = 0; x < w; ++x)
+			pixels[y * w + x] = ((x / 16) & 0x1f) << 11 | ((y / 8) & 0x3f) << 5 | 7;
+	}
+}
+
+TEST_(dig_small) {
+	const uint w = 64, h = 32;
+	Color* pixels = malloc(w * h * sizeof(Color));
+	_fill_rgba(pixels, w, h);
+
+	image_write_dig("test.dig", w, h, PF_RGBA8888, pixels);
+
+	uint rw, rh;
+	PixelFormat format;
+	Color* loaded = image_load("test.dig", &rw, &rh, &format);
+	ASSERT_(loaded);
+	ASSERT_(rw == w && rh == h);
+	ASSERT_(format == PF_RGBA8888);
+	ASSERT_(memcmp(loaded, pixels, w * h * sizeof(Color)) == 0);
+
+	free(loaded);
+	free(pixels);
+	file_remove("test.dig");
+}
+
+TEST_(dig_strips) {
+	// Large enough to be written in strips, last strip is partial
+	const uint w = 512, h = 300;
+	Color* pixels = malloc(w * h * sizeof(Color));
+	_fill_rgba(pixels, w, h);
+
+	image_write_dig("test.dig", w, h, PF_RGBA8888, pixels);
+
+	uint rw, rh;
+	PixelFormat format;
+	Color* loaded = image_load("test.dig", &rw, &rh, &format);
+	ASSERT_(loaded);
+	ASSERT_(rw == w && rh == h);
+	ASSERT_(memcmp(loaded, pixels, w * h * sizeof(Color)) == 0);
+	free(loaded);
+
+	// Decode straight into provided buffer
+	Color* dest = malloc(w * h * sizeof(Color));
+	ASSERT_(!image_load_into("test.dig", dest, 16, &rw, &rh, &format));
+	ASSERT_(rw == w && rh == h);
+	ASSERT_(image_load_into("test.dig", dest, w * h * sizeof(Color),
+		&rw, &rh, &format));
+	ASSERT_(memcmp(dest, pixels, w * h * sizeof(Color)) == 0);
+
+	free(dest);
+	free(pixels);
+	file_remove("test.dig");
+}
+
+TEST_(dig_delta) {
+	// Smooth RGB565 gradient compresses better with delta coding
+	const uint w = 512, h = 512;
+	uint16* pixels = malloc(w * h * 2);
+	_fill_rgb565(pixels, w, h);
+
+	image_write_dig("test.dig", w, h, PF_RGB565, pixels);
+
+	uint rw, rh;
+	PixelFormat format;
+	uint16* loaded = image_load("test.dig", &rw, &rh, &format);
+	ASSERT_(loaded);
+	ASSERT_(rw == w && rh == h);
+	ASSERT_(format == PF_RGB565);
+	ASSERT_(memcmp(loaded, pixels, w * h * 2) == 0);
+
+	free(loaded);
+	free(pixels);
+	file_remove("test.dig");
+}
+
+TEST_(decode_dxt) {
+	// Red and blue endpoints, texel i uses colour i % 4
+	const byte dxt1[] = {0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4};
+	Color* out = image_decode_dxt(dxt1, 4, 4, PF_DXT1);
+	for(uint i = 0; i < 16; i += 4) {
+		ASSERT_(out[i] == COLOR_RGBA(255, 0, 0, 255));
+		ASSERT_(out[i+1] == COLOR_RGBA(0, 0, 255, 255));
+		ASSERT_(out[i+2] == COLOR_RGBA(170, 0, 85, 255));
+		ASSERT_(out[i+3] == COLOR_RGBA(85, 0, 170, 255));
+	}
+	free(out);
+
+	// Same colours with alpha going from 255 to 0 in 7 steps,
+	// texel i uses alpha i % 8
+	const byte dxt5[] = {
+		0xFF, 0x00, 0x88, 0xC6, 0xFA, 0x88, 0xC6, 0xFA,
+		0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4
+	};
+	out = image_decode_dxt(dxt5, 4, 4, PF_DXT5);
+	ASSERT_(out[0] == COLOR_RGBA(255, 0, 0, 255));
+	ASSERT_(out[1] == COLOR_RGBA(0, 0, 255, 0));
+	ASSERT_(out[2] >> 24 == 218);
+	ASSERT_(out[9] == COLOR_RGBA(0, 0, 255, 0));
+	free(out);
+}
+
+TEST_(dig_mipmaps) {
+	const uint w = 512, h = 256;
+	ASSERT_(image_mip_levels(w, h, PF_RGBA8888) == 1);
+	ASSERT_(image_mip_levels(w, h, PF_RGBA8888 | PF_MASK_MIPMAPS) == 10);
+	ASSERT_(image_level_size(2, 1, PF_DXT1) == 8);
+
+	// Fill level 0 and smaller levels with different values
+	size_t size = 0;
+	for(uint i = 0; i < 10; ++i)
+		size += image_level_size(MAX(1, w >> i), MAX(1, h >> i), PF_RGBA8888);
+	ASSERT_(size == (w * h + w * h / 4 + w * h / 16 + w * h / 64 + 
+		w * h / 256 + w * h / 1024 + 32 + 8 + 2 + 1) * sizeof(Color));
+
+	Color* pixels = malloc(size);
+	_fill_rgba(pixels, w, h);
+	for(uint i = w * h; i < size / sizeof(Color); ++i)
+		pixels[i] = COLOR_RGBA(i & 0xFF, 0, 0, 0x80);
+
+	// Large enough to be split into strips
+	PixelFormat format = PF_RGBA8888 | PF_MASK_MIPMAPS;
+	image_write_dig("test.dig", w, h, format, pixels);
+
+	uint rw, rh;
+	Color* loaded = image_load("test.dig", &rw, &rh, &format);
+	ASSERT_(loaded);
+	ASSERT_(rw == w && rh == h);
+	ASSERT_(format == (PF_RGBA8888 | PF_MASK_MIPMAPS));
+	ASSERT_(memcmp(loaded, pixels, size) == 0);
+
+	free(loaded);
+	free(pixels);
+	file_remove("test.dig");
+}
@@ -0,0 +1,51 @@
+#include "maxrects.h"
+
+static bool _overlaps(uint ax, uint ay, uint aw, uint ah,
+	uint bx, uint by, uint bw, uint bh) {
+	return ax < bx + bw && bx < ax + aw && ay < by + bh && by < ay + ah;
+}
+
+TEST_(insert) {
+	MaxRects packer;
+	maxrects_init(&packer, 64, 64);
+
+	// Four quarters fill the bin exactly
+	uint x[4], y[4];
+	for(uint i = 0; i < 4; ++i)
+		ASSERT_(maxrects_insert(&packer, 32, 32, &x[i], &y[i]));
+	for(uint i = 0; i < 4; ++i) {
+		ASSERT_(x[i] + 32 <= 64 && y[i] + 32 <= 64);
+		for(uint j = i+1; j < 4; ++j)
+			ASSERT_(!_overlaps(x[i], y[i], 32, 32, x[j], y[j], 32, 32));
+	}
+
+	uint tx, ty;
+	ASSERT_(!maxrects_insert(&packer, 1, 1, &tx, &ty));
+	ASSERT_(packer.free_rects.size == 0);
+
+	maxrects_free(&packer);
+}
+
+TEST_(pack) {
+	const uint n = 200;
+	uint w[200], h[200], x[200], y[200];
+	uint area = 0;
+	for(uint i = 0; i < n; ++i) {
+		w[i] = 4 + (i * 7) % 29;
+		h[i] = 4 + (i * 13) % 23;
+		area += w[i] * h[i];
+	}
+
+	ASSERT_(!maxrects_pack(64, 64, n, w, h, x, y));
+	ASSERT_(maxrects_pack(512, 512, n, w, h, x, y));
+
+	for(uint i = 0; i < n; ++i) {
+		ASSERT_(x[i] + w[i] <= 512 && y[i] + h[i] <= 512);
+		for(uint j = i+1; j < n; ++j)
+			ASSERT_(!_overlaps(x[i], y[i], w[i], h[i], x[j], y[j], w[j], h[j]));
+	}
+
+	// Rects take about 60% of 256x256, all of them should fit
+	ASSERT_(area < 256 * 256);
+	ASSERT_(maxrects_pack(256, 256, n, w, h, x, y));
+}
@@ -727,3 +727,191 @@ TEST_(long_string) {
 	mml_free(&mml);
 }
 
+
+TEST_(binary) {
+	const char* str = 
+	"(root _\n"
+	"	(kai 0)\n"
+	"	(sirpsta \"1 2\"\n"
+	"		(vysnios 1.0 (_ _))\n"
+	"	)\n"
+	")\n";
+
+	MMLObject mml;
+	ASSERT_(mml_deserialize(&mml, str));
+
+	size_t size;
+	void* bin = mml_serialize_binary(&mml, &size);
+	ASSERT_(bin);
+	ASSERT_(size % 4 == 0);
+	ASSERT_(((MMLBinHeader*)bin)->magic == MML_BIN_MAGIC);
+
+	char* text = mml_serialize_compact(&mml);
+	mml_free(&mml);
+
+	// Binary data is detected by mml_deserialize_ex, plain
+	// mml_deserialize does not know its size and rejects it
+	MMLObject mml2;
+	ASSERT_(!mml_deserialize(&mml2, bin));
+	ASSERT_(mml_deserialize_ex(&mml2, bin, size));
+	ASSERT_(mml2.static_pools == false);
+	char* text2 = mml_serialize_compact(&mml2);
+	ASSERT_(strcmp(text, text2) == 0);
+	MEM_FREE(text2);
+
+	// Copy is independent from binary data and can be modified
+	NodeIdx kai = mml_get_child(&mml2, mml_root(&mml2), "kai");
+	ASSERT_(kai);
+	mml_setval_str(&mml2, kai, "long new value");
+	ASSERT_(strcmp(mml_getval_str(&mml2, kai), "long new value") == 0);
+	mml_setval_str(&mml2, kai, "0");
+
+	// Static object uses binary data in place
+	MMLObject mml3;
+	ASSERT_(mml_deserialize_static(&mml3, bin, size));
+	ASSERT_(mml3.static_pools == true);
+	NodeIdx sirpsta = mml_get_child(&mml3, mml_root(&mml3), "sirpsta");
+	ASSERT_(sirpsta);
+	ASSERT_(strcmp(mml_getval_str(&mml3, sirpsta), "1 2") == 0);
+	text2 = mml_serialize_compact(&mml3);
+	ASSERT_(strcmp(text, text2) == 0);
+	MEM_FREE(text2);
+	mml_free(&mml3);
+
+	// Truncated data and text are rejected
+	ASSERT_(!mml_deserialize_static(&mml3, bin, size / 2));
+	ASSERT_(!mml_deserialize_ex(&mml3, bin, size / 2));
+	ASSERT_(!mml_deserialize_static(&mml3, text, strlen(text)));
+
+	// So are out of range headers, links and string offsets
+	MMLBinHeader* hdr = bin;
+	MMLNode* nodes = bin + sizeof(MMLBinHeader);
+	uint n_nodes = hdr->n_nodes;
+	hdr->n_nodes = ~0;
+	ASSERT_(!mml_deserialize_ex(&mml3, bin, size));
+	hdr->n_nodes = n_nodes + 1;
+	ASSERT_(!mml_deserialize_ex(&mml3, bin, size));
+	hdr->n_nodes = n_nodes;
+	hdr->str_size = ~0;
+	ASSERT_(!mml_deserialize_ex(&mml3, bin, size));
+	MEM_FREE(bin);
+	bin = mml_serialize_binary(&mml2, &size);
+	nodes = bin + sizeof(MMLBinHeader);
+	nodes[1].next_idx = 1000;
+	ASSERT_(!mml_deserialize_ex(&mml3, bin, size));
+	nodes[1].next_idx = 0;
+	nodes[1].value_start = 100000;
+	ASSERT_(!mml_deserialize_static(&mml3, bin, size));
+	MEM_FREE(bin);
+
+	// Cyclic or shared links would hang tree walks
+	bin = mml_serialize_binary(&mml2, &size);
+	nodes = bin + sizeof(MMLBinHeader);
+	uint next = nodes[2].next_idx;
+	nodes[2].next_idx = 1;
+	ASSERT_(!mml_deserialize_static(&mml3, bin, size));
+	nodes[2].next_idx = next;
+	next = nodes[1].next_idx;
+	nodes[1].next_idx = 1;
+	ASSERT_(!mml_deserialize_ex(&mml3, bin, size));
+	nodes[1].next_idx = next;
+
+	// Nodes unreachable from root are ignored
+	nodes[0].first_child_idx = 0;
+	ASSERT_(mml_deserialize_static(&mml3, bin, size));
+	ASSERT_(mml_get_first_child(&mml3, mml_root(&mml3)) == 0);
+	mml_free(&mml3);
+	MEM_FREE(bin);
+
+	// mml_load reads both formats, binary is used in place
+	bin = mml_serialize_binary(&mml2, &size);
+	FileHandle f = file_create("mml_bin_test.mml");
+	file_write(f, bin, size);
+	file_close(f);
+	ASSERT_(mml_load(&mml3, "mml_bin_test.mml"));
+	ASSERT_(mml3.static_pools && mml3.blob);
+	text2 = mml_serialize_compact(&mml3);
+	ASSERT_(strcmp(text, text2) == 0);
+	MEM_FREE(text2);
+	mml_free(&mml3);
+	txtfile_write("mml_bin_test.mml", text);
+	ASSERT_(mml_load(&mml3, "mml_bin_test.mml"));
+	ASSERT_(!mml3.static_pools);
+	mml_free(&mml3);
+	file_remove("mml_bin_test.mml");
+
+	mml_free(&mml2);
+	MEM_FREE(text);
+	MEM_FREE(bin);
+}
+
+TEST_(child_index) {
+	MMLObject mml;
+	mml_empty(&mml);
+
+	NodeIdx root = mml_root(&mml);
+	char name[16];
+	for(uint i = 0; i < 1000; ++i) {
+		sprintf(name, "n%u", i % 100);
+		NodeIdx node = mml_node(&mml, name, "_");
+		mml_setval_uint(&mml, node, i);
+		mml_append(&mml, root, node);
+		mml_append(&mml, node, mml_node(&mml, "c", "_"));
+	}
+	ASSERT_(mml.index == NULL);
+
+	mml_cleanup(&mml);
+	ASSERT_(mml.index);
+
+	NodeIdx n42 = mml_get_child(&mml, root, "n42");
+	ASSERT_(n42);
+	ASSERT_(mml_getval_uint(&mml, n42) == 42);
+	ASSERT_(mml_get_child(&mml, root, "n100") == 0);
+	ASSERT_(mml_get_child(&mml, n42, "c"));
+	ASSERT_(mml_get_child(&mml, n42, "n42") == 0);
+
+	// Same name siblings
+	NodeIdx next = mml_get_sibling(&mml, n42, "n42");
+	ASSERT_(mml_getval_uint(&mml, next) == 142);
+
+	// Different name sibling, must come after starting node
+	NodeIdx n7 = mml_get_sibling(&mml, next, "n7");
+	ASSERT_(mml_getval_uint(&mml, n7) == 207);
+	n7 = mml_get_sibling(&mml, n42, "n7");
+	ASSERT_(mml_getval_uint(&mml, n7) == 107);
+
+	uint count = 0;
+	NodeIdx node = mml_get_child(&mml, root, "n99");
+	for(; node; node = mml_get_sibling(&mml, node, "n99"))
+		count++;
+	ASSERT_(count == 10);
+
+	// Changing tree drops index, results must stay correct
+	mml_remove_child(&mml, root, "n42");
+	ASSERT_(mml.index == NULL);
+	n42 = mml_get_child(&mml, root, "n42");
+	ASSERT_(mml_getval_uint(&mml, n42) == 142);
+
+	// Lookups never build index, mml_cleanup does
+	for(uint i = 0; i < 100; ++i)
+		mml_get_child(&mml, root, "n99");
+	ASSERT_(mml.index == NULL);
+	mml_cleanup(&mml);
+	ASSERT_(mml.index);
+	n42 = mml_get_child(&mml, root, "n42");
+	ASSERT_(mml_getval_uint(&mml, n42) == 142);
+
+	// Deserialized objects are not indexed until mml_cleanup
+	char* text = mml_serialize(&mml);
+	MMLObject mml2;
+	ASSERT_(mml_deserialize(&mml2, text));
+	ASSERT_(mml2.index == NULL);
+	mml_cleanup(&mml2);
+	ASSERT_(mml2.index);
+	n42 = mml_get_child(&mml2, mml_root(&mml2), "n42");
+	ASSERT_(mml_getval_uint(&mml2, n42) == 142);
+	mml_free(&mml2);
+	MEM_FREE(text);
+
+	mml_free(&mml);
+}
@@ -402,3 +402,70 @@ TEST_(contexts) {
 	uidesc_close();
 }
 
+TEST_(relayout) {
+	uidesc_init_str(
+		"(uidesc def"
+		"	(def title"
+		"		(add <- (middle <- (get_rect screen)) (vec2 0,-100))"
+		"	)"
+		"	(def fixed"
+		"		(rect 0,0,10,10)"
+		"		(vec2 5,5)"
+		"	)"
+		"	(def panel"
+		"		(def button"
+		"			(radd <- (get_rect fixed) (get_vec2 title))"
+		"		)"
+		"		(br <- (get_rect button))"
+		"	)"
+		")",
+		vec2(480.0f, 320.0f)
+	);
+
+	UIElement* title = uidesc_get("title");
+	UIElement* fixed = uidesc_get("fixed");
+	UIElement* panel = uidesc_get("panel");
+	UIElement* button = uidesc_get_child(panel, "button");
+	ASSERT_(title && fixed && panel && button);
+
+	ASSERT_(title->vec2.x == 240.0f && title->vec2.y == 60.0f);
+	ASSERT_(panel->vec2.x == 250.0f && panel->vec2.y == 70.0f);
+
+	// title -> button -> panel, fixed is untouched
+	ASSERT_(uidesc_set_screen(vec2(1024.0f, 768.0f)) == 3);
+	ASSERT_(title->vec2.x == 512.0f && title->vec2.y == 284.0f);
+	ASSERT_(button->rect.left == 512.0f && button->rect.bottom == 294.0f);
+	ASSERT_(panel->vec2.x == 522.0f && panel->vec2.y == 294.0f);
+	ASSERT_(fixed->vec2.x == 5.0f);
+
+	// Same size changes nothing
+	ASSERT_(uidesc_set_screen(vec2(1024.0f, 768.0f)) == 0);
+
+	ASSERT_(uidesc_set_rect(fixed, rectf(0.0f, 0.0f, 20.0f, 20.0f)) == 2);
+	ASSERT_(panel->vec2.x == 532.0f && panel->vec2.y == 304.0f);
+
+	uidesc_close();
+}
+
+TEST_(too_deep) {
+	// Each nesting level keeps one more value on eval stack
+	char desc[4096] = "(uidesc deep (def el ";
+	for(uint i = 0; i < 40; ++i)
+		strcat(desc, "(add <- (vec2 1,1) ");
+	strcat(desc, "(vec2 1,1)");
+	for(uint i = 0; i < 40; ++i)
+		strcat(desc, ")");
+	strcat(desc, ") (def ok (add <- (vec2 1,1) (add <- (vec2 2,2) (vec2 3,3)))))");
+
+	uidesc_init_str(desc, vec2(0.0f, 0.0f));
+
+	UIElement* el = uidesc_get("el");
+	ASSERT_(el);
+	ASSERT_(el->vec2.x == 0.0f && el->vec2.y == 0.0f);
+
+	UIElement* ok = uidesc_get("ok");
+	ASSERT_(ok);
+	ASSERT_(ok->vec2.x == 6.0f && ok->vec2.y == 6.0f);
+
+	uidesc_close();
+}
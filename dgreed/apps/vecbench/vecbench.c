@@ -0,0 +1,10 @@
+#include <malka/malka.h>
+
+int dgreed_main(int argc, const char** argv) {
+	// Same allocator setup as games use
+	malka_init_ex(true);
+	malka_params(argc, argv);
+	int res = malka_run_ex("vecbench_scripts/main.lua");
+	malka_close();
+	return res;
+}
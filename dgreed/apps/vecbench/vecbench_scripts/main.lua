@@ -0,0 +1,96 @@
+-- Moves 10k entities around for a number of frames and reports how much
+-- time is spent in script update and how much in the garbage collector.
+-- GC is stopped during update and a full collection is done at the end of
+-- every frame, so the collection time shows the cost of generated garbage.
+
+local n_entities = 10000
+local n_frames = 60
+local dt = 1 / 60
+
+-- Old style vectors - tables with metatable, same as vec2 used to be
+local tvec_mt = {}
+local function tvec(x, y)
+	return setmetatable({x, y}, tvec_mt)
+end
+tvec_mt.__add = function(a, b) return tvec(a[1] + b[1], a[2] + b[2]) end
+tvec_mt.__mul = function(a, s) return tvec(a[1] * s, a[2] * s) end
+tvec_mt.__unm = function(a) return tvec(-a[1], -a[2]) end
+
+local function make_entities(vec, rect)
+	local ents = {}
+	for i = 1,n_entities do
+		ents[i] = {
+			pos = vec(i % 100, math.floor(i / 100)),
+			vel = vec(math.cos(i) * 60, math.sin(i) * 60),
+			bbox = rect(0, 0, 8, 8)
+		}
+	end
+	return ents
+end
+
+local function update_tables(ents)
+	for i,e in ipairs(ents) do
+		e.pos = e.pos + e.vel * dt
+		local p = e.pos
+		if p[1]*p[1] + p[2]*p[2] > 10000 then
+			e.vel = -e.vel
+		end
+		e.bbox = {p[1], p[2], p[1] + 8, p[2] + 8}
+	end
+end
+
+-- Same code as above, with vec2/rect values
+local function update_values(ents)
+	for i,e in ipairs(ents) do
+		e.pos = e.pos + e.vel * dt
+		local p = e.pos
+		if length_sq(p) > 10000 then
+			e.vel = -e.vel
+		end
+		e.bbox = rect(p.x, p.y, p.x + 8, p.y + 8)
+	end
+end
+
+-- In-place mutation, produces no garbage
+local function update_inplace(ents)
+	for i,e in ipairs(ents) do
+		local p, v = e.pos, e.vel
+		p.x = p.x + v.x * dt
+		p.y = p.y + v.y * dt
+		if length_sq(p) > 10000 then
+			v:scale(-1)
+		end
+		e.bbox:set(p.x, p.y, p.x + 8, p.y + 8)
+	end
+end
+
+local function run(name, update, vec, rect)
+	local ents = make_entities(vec, rect)
+	collectgarbage('collect')
+
+	local t_update, t_gc, garbage = 0, 0, 0
+	for f = 1,n_frames do
+		collectgarbage('stop')
+		local mem = collectgarbage('count')
+		local t = os.clock()
+		update(ents)
+		t_update = t_update + os.clock() - t
+		garbage = garbage + collectgarbage('count') - mem
+
+		t = os.clock()
+		collectgarbage('collect')
+		t_gc = t_gc + os.clock() - t
+	end
+	collectgarbage('restart')
+
+	print(string.format('%-8s update %6.2f ms, gc %6.2f ms, garbage %8.1f kb per frame',
+		name, t_update * 1000 / n_frames, t_gc * 1000 / n_frames,
+		garbage / n_frames))
+end
+
+print(string.format('%d entities, %d frames', n_entities, n_frames))
+run('tables', update_tables, tvec, function(...) return {...} end)
+run('values', update_values, vec2, rect)
+if vec2().set then
+	run('inplace', update_inplace, vec2, rect)
+end
@@ -130,12 +130,9 @@ static uint _parse_seq(MMLObject* mml, NodeIdx seq_node,
 }
 
 static void _anim_load_desc(const char* desc) {
-	const char* mml_text = txtfile_read(desc);
-
 	MMLObject mml;
-	if(!mml_deserialize(&mml, mml_text))
+	if(!mml_load(&mml, desc))
 		LOG_ERROR("Unable to parse anim desc %s", desc);
-	MEM_FREE(mml_text);
 
 	NodeIdx root = mml_root(&mml);
 	if(strcmp(mml_get_name(&mml, root), "anims") != 0)
@@ -180,6 +177,7 @@ static void _anim_load_desc(const char* desc) {
 		// Put name into str blob
 		strcpy(str_dest, mml_getval_str(&mml, anim));
 		const char* anim_name = str_dest;
+		desc->name = anim_name;
 	
 		// Pair name and desc together in anim_dict
 		bool unique = dict_insert(&anim_dict, str_dest, desc);
@@ -271,6 +269,8 @@ void anim_close(void) {
 
 	if(str_blob)
 		MEM_FREE(str_blob);
+
+	str_blob_size = n_seqs = n_frames = n_descs = 0;
 	
 	/*
 	if(frames)
@@ -289,24 +289,57 @@ Anim* anim_new(const char* name) {
 }
 
 Anim* anim_new_ex(const char* name, float current_time) {
-	DictEntry* ent = dict_entry(&anim_dict, name);
-	assert(ent);
-	const AnimDesc* desc = ent->data;
-	assert(desc);
+	return anim_new_h_ex(anim_get_handle(name), current_time);
+}
 
-	Anim* new = mempool_alloc(&anim_pool);
-	new->name = ent->key;
-	new->desc = desc;
-	new->seq = desc->start_seq;
-	new->play_t = time_s();
+void anim_del(Anim* anim) {
+	assert(anim);
+
+	mempool_free(&anim_pool, anim);
+}
+
+AnimHandle anim_get_handle(const char* name) {
+	assert(name);
+
+	const AnimDesc* desc = dict_get(&anim_dict, name);
+	if(!desc)
+		LOG_ERROR("No such anim %s", name);
+
+	return desc - descs;
+}
 
+AnimSeqHandle anim_get_seq_handle(const char* anim, const char* seq) {
+	assert(anim && seq);
+
+	char key[64];
+	assert(strlen(anim) + strlen(seq) + 2 < 64);
+	sprintf(key, "%s$%s", anim, seq);
+	const AnimSeq* s = dict_get(&anim_dict, key);
+	if(!s)
+		LOG_ERROR("No such seq %s", key);
+
+	return s - seqs;
+}
+
+Anim* anim_new_h(AnimHandle handle) {
+	return anim_new_h_ex(handle, time_s());
+}
+
+Anim* anim_new_h_ex(AnimHandle handle, float current_time) {
+	Anim* new = mempool_alloc(&anim_pool);
+	anim_reset_h(new, handle, current_time);
 	return new;
 }
 
-void anim_del(Anim* anim) {
+void anim_reset_h(Anim* anim, AnimHandle handle, float current_time) {
 	assert(anim);
+	assert(handle < n_descs);
 
-	mempool_free(&anim_pool, anim);
+	const AnimDesc* desc = &descs[handle];
+	anim->name = desc->name;
+	anim->desc = desc;
+	anim->seq = desc->start_seq;
+	anim->play_t = current_time;
 }
 
 void anim_play(Anim* anim, const char* seq) {
@@ -326,43 +359,72 @@ void anim_play_ex(Anim* anim, const char* seq, float current_time) {
 	anim->play_t = current_time;
 }
 
-uint anim_frame(Anim* anim) {
-	return anim_frame_ex(anim, time_s());
+void anim_play_h(Anim* anim, AnimSeqHandle seq) {
+	anim_play_h_ex(anim, seq, time_s());
 }
 
-uint anim_frame_ex(Anim* anim, float current_time) {
+void anim_play_h_ex(Anim* anim, AnimSeqHandle seq, float current_time) {
 	assert(anim);
+	assert(seq < n_seqs);
 
-	const AnimDesc* desc = anim->desc;
-	const AnimSeq* seq = anim->seq;
+	const AnimSeq* s = &seqs[seq];
+	assert(s >= anim->desc->seqs && s < anim->desc->seqs + anim->desc->n_seqs);
+
+	anim->seq = s;
+	anim->play_t = current_time;
+}
 
+uint anim_frame(Anim* anim) {
+	return anim_frame_ex(anim, time_s());
+}
+
+static uint _anim_frame(Anim* anim, float current_time) {
+	const AnimDesc* desc = anim->desc;
 	float fps = (float)desc->fps;
-	float dt = current_time - anim->play_t;
-	float fframe = dt * fps;
-	uint iframe = lrintf(fframe - 0.5f);
 
-	if(seq->on_finish == AS_LOOP) {
-		return seq->frames[iframe % seq->n_frames];
-	}
-	else if(seq->on_finish == AS_STOP) {
-		return seq->frames[MIN(seq->n_frames-1, iframe)];
-	}
-	else {
-		assert(seq->on_finish == AS_PLAY);
+	// Follow 'play' chain until we're inside of some seq
+	while(true) {
+		const AnimSeq* seq = anim->seq;
+
+		float dt = current_time - anim->play_t;
+		float fframe = dt * fps;
+		uint iframe = lrintf(fframe - 0.5f);
 
-		uint n_frames = seq->n_frames;
-		if(iframe < n_frames) {
-			return seq->frames[iframe];
+		if(seq->on_finish == AS_LOOP) {
+			return seq->frames[iframe % seq->n_frames];
+		}
+		else if(seq->on_finish == AS_STOP) {
+			return seq->frames[MIN(seq->n_frames-1, iframe)];
 		}
 		else {
+			assert(seq->on_finish == AS_PLAY);
+
+			uint n_frames = seq->n_frames;
+			if(iframe < n_frames)
+				return seq->frames[iframe];
+
 			float s_per_frame = 1.0f / fps;
 			anim->seq = seq->play_seq;
 			anim->play_t += s_per_frame * (float)n_frames;	
-			return anim_frame_ex(anim, current_time);
 		}
 	}
 }
 
+uint anim_frame_ex(Anim* anim, float current_time) {
+	assert(anim);
+
+	return _anim_frame(anim, current_time);
+}
+
+void anim_update_all(Anim* anims, uint n, float current_time, 
+		uint* out_frames) {
+	assert(anims || n == 0);
+	assert(out_frames || n == 0);
+
+	for(uint i = 0; i < n; ++i)
+		out_frames[i] = _anim_frame(&anims[i], current_time);
+}
+
 void anim_draw(Anim* anim, const char* spr, uint layer, Vector2 dest,
 		float rot, float scale, Color tint) {
 
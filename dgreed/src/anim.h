@@ -16,6 +16,10 @@
 //
 // Functions with _ex postfix allows to explicitly provide time to them,
 // otherwise real system time is used.
+//
+// Animations and sequences can be resolved to integer handles once,
+// _h functions then avoid any string lookups. Large numbers of instances
+// are best kept in a contiguous array and advanced with anim_update_all.
 
 /*
 
@@ -52,6 +56,7 @@ typedef struct FwdAnimSeq {
 } AnimSeq;
 
 typedef struct {
+	const char* name;
 	uint fps;
 	AnimSeq* start_seq;
 	AnimSeq* seqs;
@@ -65,6 +70,9 @@ typedef struct {
 	float play_t;
 } Anim;
 
+typedef uint AnimHandle;
+typedef uint AnimSeqHandle;
+
 // Init anim subsystem, load desc mml file
 void anim_init(const char* desc);
 // Close anim subsystem
@@ -76,14 +84,32 @@ Anim* anim_new_ex(const char* name, float current_time);
 // Free animation
 void anim_del(Anim* anim);
 
+// Get handles of named animation and its sequence
+AnimHandle anim_get_handle(const char* name);
+AnimSeqHandle anim_get_seq_handle(const char* anim, const char* seq);
+
+// Create instance of animation by handle
+Anim* anim_new_h(AnimHandle handle);
+Anim* anim_new_h_ex(AnimHandle handle, float current_time);
+// Reset caller owned instance to the start of animation
+void anim_reset_h(Anim* anim, AnimHandle handle, float current_time);
+
 // Play named sequence
 void anim_play(Anim* anim, const char* seq);
 void anim_play_ex(Anim* anim, const char* seq, float current_time);
+// Play sequence by handle, it must belong to animation of this instance
+void anim_play_h(Anim* anim, AnimSeqHandle seq);
+void anim_play_h_ex(Anim* anim, AnimSeqHandle seq, float current_time);
 
 // Get current animation frame
 uint anim_frame(Anim* anim);
 uint anim_frame_ex(Anim* anim, float current_time);
 
+// Advance n instances in array, writes current frame of each one
+// to out_frames
+void anim_update_all(Anim* anims, uint n, float current_time, 
+		uint* out_frames);
+
 // Animated sprite draw helpers
 
 void anim_draw(Anim* anim, const char* spr, uint layer, Vector2 dest,
@@ -187,6 +187,7 @@ static TaskId async_next_taskid = 1;
 static TaskId async_highest_finished_taskid = 0;
 static TaskId async_lowest_unfinished_taskid = 0;
 static AATree async_unfinished_taskids;
+static pthread_cond_t async_task_finished;
 
 static void _async_init_task_state(void) {
 	assert(async_initialized);
@@ -196,6 +197,7 @@ static void _async_init_task_state(void) {
 	assert(!async_task_state_initialized);
 
 	aatree_init(&async_unfinished_taskids);
+	pthread_cond_init(&async_task_finished, NULL);
 	async_task_state_initialized = true;
 
 	async_leave_cs(ASYNC_TASK_STATE_CS);
@@ -212,6 +214,7 @@ static void _async_close_task_state(void) {
 		LOG_WARNING("Closing task state tracker with unfinished tasks!");
 
 	aatree_free(&async_unfinished_taskids);
+	pthread_cond_destroy(&async_task_finished);
 	async_task_state_initialized = false;
 
 	async_leave_cs(ASYNC_TASK_STATE_CS);
@@ -265,30 +268,31 @@ static void _async_finish_taskid(TaskId id) {
 		}
 	}
 
+	// Wake up everyone in async_wait, they will recheck their tasks
+	pthread_cond_broadcast(&async_task_finished);
+
 	async_leave_cs(ASYNC_TASK_STATE_CS);
 }
 
-bool async_is_finished(TaskId id) {
-	assert(async_initialized);
-
-	bool result;
-
-	async_enter_cs(ASYNC_TASK_STATE_CS);
+// Must be called with ASYNC_TASK_STATE_CS entered
+static bool _async_is_finished(TaskId id) {
 	assert(async_task_state_initialized);
 	assert(id < async_next_taskid);
 
-	if(id < async_lowest_unfinished_taskid) {
-		result = true;
-	}
-	else if(id > async_highest_finished_taskid) {
-		result = false;
-	}
-	else {
-		// We need to check if taskid id is in unfinished set
-		void* p = aatree_find(&async_unfinished_taskids, id);
-		result = (p == NULL);
-	}
+	if(id < async_lowest_unfinished_taskid)
+		return true;
+	if(id > async_highest_finished_taskid)
+		return false;
 
+	// We need to check if taskid id is in unfinished set
+	return aatree_find(&async_unfinished_taskids, id) == NULL;
+}
+
+bool async_is_finished(TaskId id) {
+	assert(async_initialized);
+
+	async_enter_cs(ASYNC_TASK_STATE_CS);
+	bool result = _async_is_finished(id);
 	async_leave_cs(ASYNC_TASK_STATE_CS);
 
 	return result;
@@ -460,6 +464,24 @@ static bool _async_dequeue(ListHead* head, TaskDef* dest) {
 	return true;
 }
 
+// Removes not yet started task with the provided id from the queue
+static bool _async_steal(ListHead* head, TaskId id, TaskDef* dest) {
+	TaskDef* pos;
+	list_for_each_entry(pos, head, list) {
+		if(pos->id == id) {
+			list_remove(&pos->list);
+
+			uint i = ((void*)pos - taskdef_pool.data) / taskdef_pool.item_size;
+			assert(i < taskdef_pool.size);
+			heap_push(&taskdef_pool_freecells, i, NULL);
+
+			*dest = *pos;
+			return true;
+		}
+	}
+	return false;
+}
+
 // Scheduler
 
 typedef struct {
@@ -671,3 +693,28 @@ TaskId async_run_io(Task task, void* userdata) {
 	return id;
 }
 
+void async_wait(TaskId id) {
+	assert(async_initialized);
+
+	// If task is still waiting in the async queue, do it right here
+	// instead of waiting for a free worker. Io tasks are never stolen,
+	// they must be executed in-order.
+	TaskDef task;
+	pthread_mutex_lock(&tq_async.mutex);
+	bool stolen = tq_async.count > 0 && _async_steal(&tq_async.queue, id, &task);
+	if(stolen)
+		tq_async.count--;
+	pthread_mutex_unlock(&tq_async.mutex);
+
+	if(stolen) {
+		(*task.task)(task.userdata);
+		_async_finish_taskid(task.id);
+		return;
+	}
+
+	async_enter_cs(ASYNC_TASK_STATE_CS);
+	while(!_async_is_finished(id))
+		pthread_cond_wait(&async_task_finished, &critical_sections[ASYNC_TASK_STATE_CS]);
+	async_leave_cs(ASYNC_TASK_STATE_CS);
+}
+
@@ -29,4 +29,9 @@ TaskId async_schedule(Task task, uint t, void* userdata);
 // Returns true if task is finished
 bool async_is_finished(TaskId id);
 
+// Blocks until task is finished. Async task which was not picked up by
+// a worker yet is executed on the calling thread. Don't wait for scheduled
+// tasks on the main thread, they will never finish.
+void async_wait(TaskId id);
+
 #endif
@@ -234,38 +234,40 @@ static void _aatree_delete_node(AATree* tree) {
 	AATNodeIdx idx = tree->del_idx;
 	AATNodeIdx last = tree->tree.size-1;
 
-	// Copy last node to its place
-	nodes[idx] = nodes[last];	
-
-	// Relabel its children parent pointers
-	if(nodes[idx].left != INVALID_IDX) {
-		assert(nodes[idx].left < tree->tree.size-1);
-		AATNode* left = &nodes[nodes[idx].left];
-		assert(left->parent == last);
-		left->parent = idx;
-	}
-	if(nodes[idx].right != INVALID_IDX) {
-		assert(nodes[idx].right < tree->tree.size-1);
-		AATNode* right = &nodes[nodes[idx].right];
-		assert(right->parent == last);
-		right->parent = idx;
-	}
+	if(idx != last) {
+		// Find parent of the last node by its key, parent pointers
+		// are not reliable after rebalancing
+		AATNodeIdx parent = INVALID_IDX;
+		AATNodeIdx cur = tree->root;
+		int key = nodes[last].key;
+		while(cur != last) {
+			assert(cur != INVALID_IDX);
+			parent = cur;
+			cur = key < nodes[cur].key ? nodes[cur].left : nodes[cur].right;
+		}
 
-	// Relabel its parent children pointers
-	if(nodes[idx].parent != INVALID_IDX) {
-		assert(nodes[idx].parent < tree->tree.size-1);
-		AATNode* parent = &nodes[nodes[idx].parent];
-		if(parent->left == last)
-			parent->left = idx;
-		else if(parent->right == last)
-			parent->right = idx;
-		else
-			assert(0 && "Something went horribly wrong.");
-	}
+		// Copy last node to its place
+		nodes[idx] = nodes[last];	
+
+		// Relabel its children parent pointers
+		if(nodes[idx].left != INVALID_IDX)
+			nodes[nodes[idx].left].parent = idx;
+		if(nodes[idx].right != INVALID_IDX)
+			nodes[nodes[idx].right].parent = idx;
+
+		// Relabel its parent children pointers
+		nodes[idx].parent = parent;
+		if(parent != INVALID_IDX) {
+			if(nodes[parent].left == last)
+				nodes[parent].left = idx;
+			else
+				nodes[parent].right = idx;
+		}
 
-	// Relabel root if neccessary
-	if(tree->root == last)
-		tree->root = idx;
+		// Relabel root if neccessary
+		if(tree->root == last)
+			tree->root = idx;
+	}
 
 	// Decrease node count
 	tree->tree.size--;
@@ -541,8 +543,8 @@ static AATNodeIdx _aatree_remove(AATree* tree, AATNodeIdx idx, int key) {
 		_aatree_mark_delete(tree, tree->rem_last);
 		tree->did_del = true;
 	}
-	else if ((node_left && node->level-1 > node_left->level) ||
-			 (node_right && node->level-1 > node_right->level)) {
+	else if ((node_left ? node_left->level : 0) < node->level-1 ||
+			 (node_right ? node_right->level : 0) < node->level-1) {
 
 		// Perform rebalancing choreography on the way back
 		assert(tree->did_del);
@@ -1,6 +1,7 @@
 #include "font.h"
 
 #include "memory.h"
+#include "darray.h"
 #include "lib9-utf/utf.h"
 #include "gfx_utils.h"
 
@@ -18,13 +19,22 @@ typedef struct {
 	float x_advance;
 } Char;	
 
+// Codepoints are looked up in two levels: page table indexed by
+// codepoint >> 8, then 256 entry page with index+1 into chars array.
+// Only pages which have glyphs are allocated.
+#define GLYPH_PAGE_BITS 8
+#define GLYPH_PAGE_SIZE (1 << GLYPH_PAGE_BITS)
+
 typedef struct {
 	TexHandle tex;
 	float height;
 	float y_gap;
 	uint n_chars;
 	Char* chars;
+	uint n_pages;
+	uint16** pages;
 	bool active;
+	bool sdf;
 	float scale;
 } FontDesc;
 
@@ -32,6 +42,16 @@ typedef struct {
 FontDesc fonts[MAX_FONTS];
 uint font_count = 0;
 
+typedef struct {
+	FontHandle font;
+	uint n_quads;
+	FontQuad* quads;
+	float width;
+} CachedLayout;
+
+// Free slots have font == ~0, live layouts of empty strings have NULL quads
+static DArray layouts = {.data = NULL};
+
 static int _cmp_char(const void *a, const void *b) {
 	Char* ca = (Char*)a;
 	Char* cb = (Char*)b;
@@ -39,26 +59,45 @@ static int _cmp_char(const void *a, const void *b) {
 }
 
 static Char* _get_char(FontDesc* desc, Rune codepoint) {
-	// Binary search
-	uint idx = ~0;
-	uint low = 0, high = desc->n_chars;
-	while(high > low) {
-		uint mid = (low + high) / 2;
-		if(codepoint < desc->chars[mid].codepoint)
-			high = mid;
-		else if(codepoint > desc->chars[mid].codepoint)
-			low = mid;
-		else {
-			idx = mid;
-			break;
-		}
-	}
+	uint page = (uint)codepoint >> GLYPH_PAGE_BITS;
+	if(page >= desc->n_pages || !desc->pages[page])
+		return NULL;
 
-	if(idx == ~0) 
+	uint16 idx = desc->pages[page][codepoint & (GLYPH_PAGE_SIZE-1)];
+	if(idx == 0)
 		return NULL;
 
-	assert(idx < desc->n_chars);
-	return &desc->chars[idx];
+	assert(idx <= desc->n_chars);
+	return &desc->chars[idx-1];
+}
+
+static void _build_pages(FontDesc* desc) {
+	// Chars are sorted, last one has the largest codepoint
+	assert(desc->n_chars);
+	Rune max_codepoint = desc->chars[desc->n_chars-1].codepoint;
+	desc->n_pages = ((uint)max_codepoint >> GLYPH_PAGE_BITS) + 1;
+	desc->pages = MEM_ALLOC(desc->n_pages * sizeof(uint16*));
+	memset(desc->pages, 0, desc->n_pages * sizeof(uint16*));
+
+	for(uint i = 0; i < desc->n_chars; ++i) {
+		Rune codepoint = desc->chars[i].codepoint;
+		uint page = (uint)codepoint >> GLYPH_PAGE_BITS;
+		if(!desc->pages[page]) {
+			size_t size = GLYPH_PAGE_SIZE * sizeof(uint16);
+			desc->pages[page] = MEM_ALLOC(size);
+			memset(desc->pages[page], 0, size);
+		}
+		desc->pages[page][codepoint & (GLYPH_PAGE_SIZE-1)] = i + 1;
+	}
+}
+
+// Decodes one codepoint, ascii doesn't go through utf decoder
+static uint _next_rune(const char* s, Rune* codepoint) {
+	if((byte)*s < Runeself) {
+		*codepoint = (byte)*s;
+		return 1;
+	}
+	return chartorune(codepoint, s);
 }
 
 FontHandle font_load(const char* filename) {
@@ -95,12 +134,14 @@ FontHandle font_load_exp(const char* filename, float scale, const char* prefix)
 
 	FileHandle font_file = file_open(filename);
 
-	// Confirm file id
+	// Confirm file id, distance field fonts have their own id
+	// but otherwise identical layout
 	uint id = file_read_uint32(font_file);
-	if(id != FOURCC('F', 'O', 'N', 'T')) {
+	if(id != FOURCC('F', 'O', 'N', 'T') && id != FOURCC('F', 'S', 'D', 'F')) {
 		file_close(font_file);
 		LOG_ERROR("Trying to load invalid font file");
 	}	
+	fonts[result].sdf = id == FOURCC('F', 'S', 'D', 'F');
 
 	// Read font height
 	fonts[result].height = (float)file_read_uint16(font_file);
@@ -123,6 +164,8 @@ FontHandle font_load_exp(const char* filename, float scale, const char* prefix)
 	}
 	strcat(tex_path, tex_filename);
 	fonts[result].tex = tex_load(tex_path);
+	if(fonts[result].sdf)
+		tex_set_sdf(fonts[result].tex, true);
 
 	// Read number of chars
 	uint16 chars = file_read_uint16(font_file);
@@ -178,6 +221,8 @@ FontHandle font_load_exp(const char* filename, float scale, const char* prefix)
 	if(needs_sort)
 		sort_heapsort(chr, n, sizeof(Char), _cmp_char);
 
+	_build_pages(&fonts[result]);
+
 	// If space glyph has 0 x_advance, use 'a' glyph x_advance
 	Char* space = _get_char(&fonts[result], ' ');
 	assert(space);
@@ -198,6 +243,11 @@ void font_free(FontHandle font) {
 	assert(fonts[font].active);
 
 	MEM_FREE(fonts[font].chars);
+	for(uint i = 0; i < fonts[font].n_pages; ++i) {
+		if(fonts[font].pages[i])
+			MEM_FREE(fonts[font].pages[i]);
+	}
+	MEM_FREE(fonts[font].pages);
 
 	fonts[font].active = false;
 	tex_free(fonts[font].tex);
@@ -211,16 +261,13 @@ float font_width(FontHandle font, const char* string) {
 
 	Rune codepoint;
 	float width = 0.0f;
-	uint n = strlen(string);
-	uint i = 0;
+	const char* c = string;
 	
-	while(i < n) {
-		i += chartorune(&codepoint, string + i);  
-		if(codepoint != 0) {
-			Char* c = _get_char(&fonts[font], codepoint);
-			if(c)
-				width += c->x_advance;
-		}
+	while(*c) {
+		c += _next_rune(c, &codepoint);
+		Char* chr = _get_char(&fonts[font], codepoint);
+		if(chr)
+			width += chr->x_advance;
 	}
 
 	return width * fonts[font].scale;
@@ -233,36 +280,98 @@ float font_height(FontHandle font) {
 	return fonts[font].height * fonts[font].scale;
 }
 
-void font_draw(FontHandle font, const char* string, uint layer,
-	const Vector2* topleft, Color tint) {
+bool font_is_sdf(FontHandle font) {
 	assert(font < MAX_FONTS);
 	assert(fonts[font].active);
 
-	Rune codepoint;
+	return fonts[font].sdf;
+}
+
+uint font_layout(FontHandle font, const char* string, float scale,
+	FontQuad* out, uint max_quads, float* width) {
+	assert(font < MAX_FONTS);
+	assert(fonts[font].active);
+	assert(out || max_quads == 0);
+
+	FontDesc* desc = &fonts[font];
+	float s = desc->scale * scale;
 	float cursor_x = 0.0f;
-	uint n = strlen(string);
-	uint i = 0;
-	float s = fonts[font].scale;
-
-	while(i < n) {
-		i += chartorune(&codepoint, string + i);
-		if(codepoint != 0) {
-			const Char* chr = _get_char(&fonts[font], codepoint);
-			if(!chr)
-				continue;
-
-			RectF dest = rectf(topleft->x + cursor_x, topleft->y, 0.0f, 0.0f);
-			dest.left += chr->x_offset * s;
-			dest.top += chr->y_offset * s;
-			dest.right = dest.left + rectf_width(&chr->source) * s;
-			dest.bottom = dest.top + rectf_height(&chr->source) * s;
-
-			if(chr->codepoint != ' ')
-				video_draw_rect(fonts[font].tex, layer, &chr->source, &dest, tint);
-
-			cursor_x += chr->x_advance * s;
+	uint n_quads = 0;
+
+	Rune codepoint;
+	const char* c = string;
+	while(*c) {
+		c += _next_rune(c, &codepoint);
+		const Char* chr = _get_char(desc, codepoint);
+		if(!chr)
+			continue;
+
+		if(chr->codepoint != ' ') {
+			if(n_quads < max_quads) {
+				FontQuad* q = &out[n_quads];
+				q->source = chr->source;
+				q->dest.left = cursor_x + chr->x_offset * s;
+				q->dest.top = chr->y_offset * s;
+				q->dest.right = q->dest.left + rectf_width(&chr->source) * s;
+				q->dest.bottom = q->dest.top + rectf_height(&chr->source) * s;
+			}
+			n_quads++;
 		}
+
+		cursor_x += chr->x_advance * s;
+	}
+
+	if(width)
+		*width = cursor_x;
+
+	return n_quads;
+}
+
+// Small strings are laid out on stack, large ones in temporary buffer
+#define LAYOUT_STACK_QUADS 64
+
+static FontQuad* _layout_tmp(FontHandle font, const char* string, 
+	float scale, FontQuad* stack, uint* n_quads, float* width) {
+
+	uint n = font_layout(font, string, scale, 
+		stack, LAYOUT_STACK_QUADS, width);
+	if(n <= LAYOUT_STACK_QUADS) {
+		*n_quads = n;
+		return stack;
 	}
+
+	FontQuad* quads = MEM_ALLOC(n * sizeof(FontQuad));
+	*n_quads = font_layout(font, string, scale, quads, n, width);
+	return quads;
+}
+
+static void _draw_quads(TexHandle tex, const FontQuad* quads, uint n,
+	uint layer, float x, float y, Color tint) {
+
+	for(uint i = 0; i < n; ++i) {
+		RectF dest = quads[i].dest;
+		dest.left += x;
+		dest.top += y;
+		dest.right += x;
+		dest.bottom += y;
+		video_draw_rect(tex, layer, &quads[i].source, &dest, tint);
+	}
+}
+
+void font_draw(FontHandle font, const char* string, uint layer,
+	const Vector2* topleft, Color tint) {
+	assert(font < MAX_FONTS);
+	assert(fonts[font].active);
+
+	FontQuad stack[LAYOUT_STACK_QUADS];
+	uint n;
+	FontQuad* quads = _layout_tmp(font, string, 1.0f, stack, &n, NULL);
+
+	_draw_quads(fonts[font].tex, quads, n, layer, 
+		topleft->x, topleft->y, tint);
+
+	if(quads != stack)
+		MEM_FREE(quads);
 }	
 
 RectF font_rect_ex(FontHandle font, const char* string, 
@@ -282,37 +391,17 @@ void font_draw_ex(FontHandle font, const char* string, uint layer,
 	assert(font < MAX_FONTS);
 	assert(fonts[font].active);
 
-	float s = fonts[font].scale * scale;
-	float width = font_width(font, string) * scale;
+	FontQuad stack[LAYOUT_STACK_QUADS];
+	uint n;
+	float width;
+	FontQuad* quads = _layout_tmp(font, string, scale, stack, &n, &width);
 	float height = font_height(font) * scale;
 
-	Vector2 topleft = vec2(
-		floorf(center->x - width/2.0f), 
-		floorf(center->y - height/2.0f)
-	);
-	float cursor_x = 0.0f;
-	Rune codepoint;
-	uint n = strlen(string);
-	uint i = 0;
-	while(i < n) {
-		i += chartorune(&codepoint, string + i);
-		if(codepoint != 0) {
-			const Char* chr = _get_char(&fonts[font], codepoint);
-			if(!chr)
-				continue;
-
-			RectF dest = rectf(topleft.x + cursor_x, topleft.y, 0.0f, 0.0f);
-			dest.left += chr->x_offset * s;
-			dest.top += chr->y_offset * s;
-			dest.right = dest.left + rectf_width(&chr->source) * s;
-			dest.bottom = dest.top + rectf_height(&chr->source) * s;
-
-			if(chr->codepoint != ' ')
-				video_draw_rect(fonts[font].tex, layer, &chr->source, &dest, tint);
-
-			cursor_x += chr->x_advance * s;
-		}
-	}	
+	_draw_quads(fonts[font].tex, quads, n, layer, 
+		floorf(center->x - width/2.0f), floorf(center->y - height/2.0f), tint);
+
+	if(quads != stack)
+		MEM_FREE(quads);
 }	
 
 void font_draw_rot(FontHandle font, const char* string, uint layer,
@@ -320,48 +409,93 @@ void font_draw_rot(FontHandle font, const char* string, uint layer,
 	assert(font < MAX_FONTS);
 	assert(fonts[font].active);
 
-	float s = fonts[font].scale * scale;
-	float width = font_width(font, string) * scale;
+	FontQuad stack[LAYOUT_STACK_QUADS];
+	uint n;
+	float width;
+	FontQuad* quads = _layout_tmp(font, string, scale, stack, &n, &width);
 	float height = font_height(font) * scale;
+	float s = fonts[font].scale * scale;
 
-	Vector2 topleft = vec2_add(*center, 
-		vec2_rotate(vec2(-width/2.0f, -height/2.0f), rot)
-	);
-
-	Vector2 cursor = vec2(0.0f, 0.0f);
+	// Rotate quad centers around text center
+	Vector2 half = vec2(width/2.0f, height/2.0f);
+	for(uint i = 0; i < n; ++i) {
+		Vector2 c = vec2(
+			(quads[i].dest.left + quads[i].dest.right) / 2.0f,
+			(quads[i].dest.top + quads[i].dest.bottom) / 2.0f
+		);
+		Vector2 dest = vec2_add(*center, vec2_rotate(vec2_sub(c, half), rot));
+		gfx_draw_textured_rect(fonts[font].tex, layer, &quads[i].source,
+			&dest, rot, s, tint);
+	}
 
-	Rune codepoint;
-	uint n = strlen(string);
-	uint i = 0;
-	while(i < n) {
-		i += chartorune(&codepoint, string + i);
-		if(codepoint != 0) {
-			const Char* chr = _get_char(&fonts[font], codepoint);
-			if(!chr)
-				continue;
-
-			Vector2 dest = vec2_add(cursor, topleft); 
-			dest = vec2_add(dest, vec2_rotate(vec2(
-				(chr->x_offset + rectf_width(&chr->source)/2.0f) * s,
-				(chr->y_offset + rectf_height(&chr->source)/2.0f) * s
-			), rot));
-
-			/*
-			RectF dest = rectf(topleft.x + cursor_x, topleft.y, 0.0f, 0.0f);
-			dest.left += chr->x_offset * s;
-			dest.top += chr->y_offset * s;
-			dest.right = dest.left + rectf_width(&chr->source) * s;
-			dest.bottom = dest.top + rectf_height(&chr->source) * s;
-			*/
-
-			if(chr->codepoint != ' ')
-				gfx_draw_textured_rect(fonts[font].tex, layer, &chr->source, 
-						&dest, rot, s, tint);
-
-			cursor = vec2_add(cursor, 
-				vec2_rotate(vec2(chr->x_advance * s, 0.0f), rot)
-			);
-		}
-	}	
+	if(quads != stack)
+		MEM_FREE(quads);
 }	
 
+static CachedLayout* _get_layout(FontLayoutHandle handle) {
+	assert(layouts.data && handle < layouts.size);
+	CachedLayout* layout = darray_get(&layouts, handle);
+	assert(layout->font < MAX_FONTS && fonts[layout->font].active);
+	return layout;
+}
+
+FontLayoutHandle font_layout_cache(FontHandle font, const char* string,
+	float scale) {
+	assert(font < MAX_FONTS);
+	assert(fonts[font].active);
+
+	if(!layouts.data)
+		layouts = darray_create(sizeof(CachedLayout), 0);
+
+	// Find free slot
+	FontLayoutHandle handle;
+	CachedLayout* layout = NULL;
+	for(handle = 0; handle < layouts.size; ++handle) {
+		layout = darray_get(&layouts, handle);
+		if(layout->font == ~0)
+			break;
+	}
+	if(handle == layouts.size) {
+		CachedLayout empty = {.font = ~0};
+		darray_append(&layouts, &empty);
+	}
+	layout = darray_get(&layouts, handle);
+
+	uint n = font_layout(font, string, scale, NULL, 0, NULL);
+	layout->font = font;
+	layout->quads = n ? MEM_ALLOC(n * sizeof(FontQuad)) : NULL;
+	layout->n_quads = font_layout(font, string, scale, 
+		layout->quads, n, &layout->width);
+
+	return handle;
+}
+
+void font_layout_free(FontLayoutHandle handle) {
+	CachedLayout* layout = _get_layout(handle);
+	if(layout->quads)
+		MEM_FREE(layout->quads);
+	layout->quads = NULL;
+	layout->n_quads = 0;
+	layout->font = ~0;
+
+	// Release storage when last layout is freed
+	for(uint i = 0; i < layouts.size; ++i) {
+		layout = darray_get(&layouts, i);
+		if(layout->font != ~0)
+			return;
+	}
+	darray_free(&layouts);
+	layouts.data = NULL;
+}
+
+float font_layout_width(FontLayoutHandle handle) {
+	return _get_layout(handle)->width;
+}
+
+void font_draw_layout(FontLayoutHandle handle, uint layer,
+	const Vector2* topleft, Color tint) {
+	CachedLayout* layout = _get_layout(handle);
+	_draw_quads(fonts[layout->font].tex, layout->quads, layout->n_quads,
+		layer, topleft->x, topleft->y, tint);
+}
+
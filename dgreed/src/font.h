@@ -5,7 +5,9 @@
 #include "system.h"
 
 // Fast and simple text renderer,
-// uses atlases generated by mkfnt or fnt2btf.py
+// uses atlases generated by mkfnt or fnt2btf.py.
+// Distance field atlases (mkfnt -s) stay sharp at any scale,
+// so one small atlas can serve all text sizes.
 
 typedef uint FontHandle;
 
@@ -21,6 +23,8 @@ void font_free(FontHandle font);
 float font_width(FontHandle font, const char* string);
 // Returns height of font characters in pixels
 float font_height(FontHandle font);
+// Returns true if font atlas is a signed distance field
+bool font_is_sdf(FontHandle font);
 
 // Draws string with specified font
 void font_draw(FontHandle font, const char* string, uint layer,
@@ -38,4 +42,30 @@ void font_draw_ex(FontHandle font, const char* string, uint layer,
 void font_draw_rot(FontHandle font, const char* string, uint layer,
 	const Vector2* center, float scale, float angle, Color tint);
 
+// Glyph quad of laid out text, dest is relative to text topleft
+typedef struct {
+	RectF source;
+	RectF dest;
+} FontQuad;
+
+// Measures string and lays out its glyphs in one pass. Writes at most
+// max_quads quads to out, returns number of quads whole string needs.
+// Width of string is written to width if it is not NULL.
+uint font_layout(FontHandle font, const char* string, float scale,
+	FontQuad* out, uint max_quads, float* width);
+
+typedef uint FontLayoutHandle;
+
+// Lays out a static string once, drawing it later skips decoding and
+// glyph lookup. Free layouts before freeing their font.
+FontLayoutHandle font_layout_cache(FontHandle font, const char* string,
+	float scale);
+// Frees cached layout
+void font_layout_free(FontLayoutHandle layout);
+// Returns width of cached layout
+float font_layout_width(FontLayoutHandle layout);
+// Draws cached layout
+void font_draw_layout(FontLayoutHandle layout, uint layer,
+	const Vector2* topleft, Color tint);
+
 #endif
@@ -257,6 +257,67 @@ Color* gfx_downscale(const Color* img, uint w, uint h) {
 	return new_img;
 }
 
+// sRGB <-> linear conversion tables, linear values have 12 bits
+static uint16 srgb_to_linear[256];
+static byte linear_to_srgb[4096];
+static bool srgb_tables_ready = false;
+
+static void _init_srgb_tables(void) {
+	for(uint i = 0; i < 256; ++i) {
+		float c = (float)i / 255.0f;
+		float l = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		srgb_to_linear[i] = (uint16)lrintf(l * 4095.0f);
+	}
+	for(uint i = 0; i < 4096; ++i) {
+		float l = (float)i / 4095.0f;
+		float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+		linear_to_srgb[i] = (byte)lrintf(c * 255.0f);
+	}
+	srgb_tables_ready = true;
+}
+
+Color* gfx_downscale_srgb(const Color* img, uint w, uint h) {
+	assert(img);
+	assert(w && h);
+
+	if(!srgb_tables_ready)
+		_init_srgb_tables();
+
+	uint nw = MAX(1, w/2), nh = MAX(1, h/2);
+	Color* new_img = (Color*)MEM_ALLOC(sizeof(Color) * nw * nh);
+
+	for(uint y = 0; y < nh; ++y) {
+		uint y0 = MIN(y*2, h-1), y1 = MIN(y*2+1, h-1);
+		for(uint x = 0; x < nw; ++x) {
+			uint x0 = MIN(x*2, w-1), x1 = MIN(x*2+1, w-1);
+			uint r = 0, g = 0, b = 0, a = 0;
+
+			Color samples[4];
+			samples[0] = img[IDX_2D(x0, y0, w)];
+			samples[1] = img[IDX_2D(x1, y0, w)];
+			samples[2] = img[IDX_2D(x0, y1, w)];
+			samples[3] = img[IDX_2D(x1, y1, w)];
+
+			for(uint i = 0; i < 4; ++i) {
+				uint sr, sg, sb, sa;
+				COLOR_DECONSTRUCT(samples[i], sr, sg, sb, sa);
+				r += srgb_to_linear[sr];
+				g += srgb_to_linear[sg];
+				b += srgb_to_linear[sb];
+				a += sa;
+			}
+			r = linear_to_srgb[(r + 2) / 4];
+			g = linear_to_srgb[(g + 2) / 4];
+			b = linear_to_srgb[(b + 2) / 4];
+			a = (a + 2) / 4;
+
+			new_img[IDX_2D(x, y, nw)] = COLOR_RGBA(r, g, b, a);
+		}
+	}
+
+	return new_img;
+}
+
 void gfx_blit(Color* dest, uint dest_w, uint dest_h,
 	const Color* src, uint src_w, uint src_h, int x, int y) {
 	gfx_blit_ex(dest, dest_w, dest_h, src, src_w, src_h, x, y, 0, 0);
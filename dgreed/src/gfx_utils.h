@@ -43,6 +43,10 @@ Color gfx_blend(Color a, Color b);
 
 // Resizes image to one half its linear dimensions
 Color* gfx_downscale(const Color* img, uint w, uint h);
+// Same as above, but averages colours in linear space, treating them as sRGB.
+// Odd or 1 pixel wide dimensions are rounded down (but not below 1),
+// suitable for building mip chains.
+Color* gfx_downscale_srgb(const Color* img, uint w, uint h);
 
 // Blits source image to destination, using alpha blending
 void gfx_blit(Color* dest, uint dest_w, uint dest_h,
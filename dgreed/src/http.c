@@ -361,8 +361,7 @@ static void _http_close(void) {
 	TaskId task = async_run_io(_io_http_close, NULL);
 
 	// Wait for task to complete
-	while(!async_is_finished(task)) {
-	};
+	async_wait(task);
 
 	async_process_schedule();
 
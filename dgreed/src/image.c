@@ -8,6 +8,8 @@
 
 #include "darray.h"
 #include "datastruct.h"
+#include "async.h"
+#include "memory.h"
 
 #define MINIZ_HEADER_FILE_ONLY
 #include "miniz.c"
@@ -17,9 +19,18 @@ typedef enum {
 	DC_LZ4 = 1,
 	DC_DELTA = 2,
 	DC_DEFLATE = 4,
-    DC_PALETTIZE = 8
+    DC_PALETTIZE = 8,
+	DC_STRIPS = 16,
+	DC_MIPMAPS = 32
 } DIGCompression;
 
+// Strips are groups of rows, compressed independently so that they
+// can be decoded in parallel. Layout after DIGHeader:
+// uint32 n_strips, uint32 strip_rows, uint32 compressed_size[n_strips],
+// followed by compressed strip data. Delta coding restarts every strip.
+// Mip levels follow level 0 and are split into strips of the same byte size.
+#define DIG_STRIP_SIZE (128 * 1024)
+
 #pragma pack(1)
 typedef struct {
 	char id[2];
@@ -55,50 +66,35 @@ typedef struct {
 #define RGB565_ENCODE(r, g, b) \
 	(((r)&0x1f)<<11)|(((g)&0x3f)<<5)|(((b)&0x1f))
 
-#if 0
+// Top bit of every channel, lets all three channels
+// be added or subtracted at once without carries leaking
+#define RGB565_HIGH_BITS 0x8410
+
+static uint16 _add_rgb565(uint16 a, uint16 b) {
+	const uint16 hb = RGB565_HIGH_BITS;
+	return (((a & ~hb) + (b & ~hb)) ^ ((a ^ b) & hb)) & 0xFFFF;
+}
+
+static uint16 _sub_rgb565(uint16 a, uint16 b) {
+	const uint16 hb = RGB565_HIGH_BITS;
+	return (((a | hb) - (b & ~hb)) ^ ((a ^ ~b) & hb)) & 0xFFFF;
+}
 
-static void _enc_delta_rgb565(void* data, uint w, uint h) {
+static void _enc_delta_rgb565(void* data, uint n) {
 	uint16* img = data;
 	uint16 prev = img[0], curr;
-	byte pr, pg, pb, cr, cg, cb, dr, dg, db;
-	for(uint i = 1; i < w * h; ++i) {
+	for(uint i = 1; i < n; ++i) {
 		curr = img[i];
-		RGB565_DECODE(curr, cr, cg, cb);
-		RGB565_DECODE(prev, pr, pg, pb);
-
-		if(cr >= pr)
-			dr = cr - pr;
-		else
-			dr = (0x20 + (cr - pr)) &  0x1f;
-
-		if(cg >= pg)
-			dg = cg - pg;
-		else
-			dg = (0x40 + (cg - pg)) &  0x3f;
-
-		if(cb >= pb)
-			db = cb - pb;
-		else
-			db = (0x20 + (cb - pb)) &  0x1f;
-
+		img[i] = _sub_rgb565(curr, prev);
 		prev = curr;
-		img[i] = RGB565_ENCODE(dr, dg, db);
 	}
 }
 
-#endif
-
-static void _dec_delta_rgb565(void* data, uint w, uint h) {
+static void _dec_delta_rgb565(void* data, uint n) {
 	uint16* img = data;
-	uint16 prev = img[0], curr;
-	byte dr, dg, db, r, g, b;
-	for(uint i = 1; i < w * h; ++i) {
-		curr = img[i];
-		RGB565_DECODE(curr, dr, dg, db);
-		RGB565_DECODE(prev, r, g, b);
-		curr = RGB565_ENCODE((r+dr), (g+dg), (b+db));
-		img[i] = prev = curr;
-	}
+	uint16 prev = img[0];
+	for(uint i = 1; i < n; ++i)
+		img[i] = prev = _add_rgb565(prev, img[i]);
 }
 
 typedef struct {
@@ -202,7 +198,11 @@ static int _format_bpp(PixelFormat format) {
 		case PF_RGBA5551:
 		case PF_LA88:
 			return 16;
+		case PF_DXT3:
+		case PF_DXT5:
+			return 8;
 		case PF_PVRTC4:
+		case PF_DXT1:
 			return 4;
 		case PF_PVRTC2:
 			return 2;
@@ -212,7 +212,286 @@ static int _format_bpp(PixelFormat format) {
 	return 0;
 }
 
-static void* _load_dig(FileHandle f, uint* w, uint* h, PixelFormat* format) {
+size_t image_level_size(uint w, uint h, PixelFormat format) {
+	PixelFormat pf = format & PF_MASK_PIXEL_FORMAT;
+	if(pf == PF_DXT1 || pf == PF_DXT3 || pf == PF_DXT5) {
+		uint block_size = pf == PF_DXT1 ? 8 : 16;
+		return ((w + 3) / 4) * ((h + 3) / 4) * block_size;
+	}
+	return (w * h * _format_bpp(format)) / 8;
+}
+
+uint image_mip_levels(uint w, uint h, PixelFormat format) {
+	if(!(format & PF_MASK_MIPMAPS))
+		return 1;
+
+	uint levels = 1;
+	while(w > 1 || h > 1) {
+		w = MAX(1, w / 2);
+		h = MAX(1, h / 2);
+		levels++;
+	}
+	return levels;
+}
+
+// Size of all mip levels
+static size_t _image_size(uint w, uint h, PixelFormat format) {
+	size_t size = 0;
+	uint levels = image_mip_levels(w, h, format);
+	for(uint i = 0; i < levels; ++i)
+		size += image_level_size(MAX(1, w >> i), MAX(1, h >> i), format);
+	return size;
+}
+
+static Color _expand_rgb565(uint16 c, byte a) {
+	byte r = (c >> 11) & 0x1f;
+	byte g = (c >> 5) & 0x3f;
+	byte b = c & 0x1f;
+	return COLOR_RGBA((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), a);
+}
+
+// Decodes 8 byte colour part of dxt block. Only DXT1 has 3 colour mode
+// with transparent black
+static void _decode_dxt_colour(const byte* block, bool dxt1, Color* out) {
+	uint16 c0 = block[0] | (block[1] << 8);
+	uint16 c1 = block[2] | (block[3] << 8);
+
+	Color palette[4];
+	palette[0] = _expand_rgb565(c0, 0xFF);
+	palette[1] = _expand_rgb565(c1, 0xFF);
+
+	byte r0, g0, b0, r1, g1, b1;
+	byte a0 __attribute__ ((unused)), a1 __attribute__ ((unused));
+	COLOR_DECONSTRUCT(palette[0], r0, g0, b0, a0);
+	COLOR_DECONSTRUCT(palette[1], r1, g1, b1, a1);
+
+	if(c0 > c1 || !dxt1) {
+		palette[2] = COLOR_RGBA((2*r0 + r1) / 3, (2*g0 + g1) / 3, (2*b0 + b1) / 3, 0xFF);
+		palette[3] = COLOR_RGBA((r0 + 2*r1) / 3, (g0 + 2*g1) / 3, (b0 + 2*b1) / 3, 0xFF);
+	}
+	else {
+		palette[2] = COLOR_RGBA((r0 + r1) / 2, (g0 + g1) / 2, (b0 + b1) / 2, 0xFF);
+		palette[3] = COLOR_RGBA(0, 0, 0, 0);
+	}
+
+	uint32 indices = block[4] | (block[5] << 8) | (block[6] << 16) | (block[7] << 24);
+	for(uint i = 0; i < 16; ++i, indices >>= 2)
+		out[i] = palette[indices & 3];
+}
+
+// Decodes 8 byte interpolated alpha part of DXT5 block
+static void _decode_dxt5_alpha(const byte* block, byte* out) {
+	byte palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+	if(palette[0] > palette[1]) {
+		for(uint i = 1; i < 7; ++i)
+			palette[i+1] = ((7-i) * palette[0] + i * palette[1]) / 7;
+	}
+	else {
+		for(uint i = 1; i < 5; ++i)
+			palette[i+1] = ((5-i) * palette[0] + i * palette[1]) / 5;
+		palette[6] = 0;
+		palette[7] = 0xFF;
+	}
+
+	uint64 indices = 0;
+	for(uint i = 0; i < 6; ++i)
+		indices |= (uint64)block[2+i] << (i * 8);
+	for(uint i = 0; i < 16; ++i, indices >>= 3)
+		out[i] = palette[indices & 7];
+}
+
+void* image_decode_dxt(const void* data, uint w, uint h, PixelFormat format) {
+	assert(data);
+	assert(w % 4 == 0 && h % 4 == 0);
+
+	PixelFormat pf = format & PF_MASK_PIXEL_FORMAT;
+	assert(pf == PF_DXT1 || pf == PF_DXT3 || pf == PF_DXT5);
+
+	const byte* block = data;
+	uint block_size = pf == PF_DXT1 ? 8 : 16;
+
+	// (use malloc to behave just like image_load)
+	Color* out = malloc(w * h * sizeof(Color));
+
+	Color colours[16];
+	byte alphas[16];
+	for(uint by = 0; by < h; by += 4) {
+		for(uint bx = 0; bx < w; bx += 4, block += block_size) {
+			if(pf == PF_DXT1) {
+				_decode_dxt_colour(block, true, colours);
+			}
+			else {
+				_decode_dxt_colour(block + 8, false, colours);
+				if(pf == PF_DXT3) {
+					for(uint i = 0; i < 16; ++i) {
+						byte a = (block[i/2] >> ((i & 1) * 4)) & 0xF;
+						alphas[i] = a | (a << 4);
+					}
+				}
+				else {
+					_decode_dxt5_alpha(block, alphas);
+				}
+				for(uint i = 0; i < 16; ++i)
+					colours[i] = (colours[i] & 0xFFFFFF) | ((Color)alphas[i] << 24);
+			}
+
+			for(uint y = 0; y < 4; ++y)
+				memcpy(&out[(by + y) * w + bx], &colours[y * 4], 4 * sizeof(Color));
+		}
+	}
+
+	return out;
+}
+
+static CriticalSection dig_cs;
+static bool dig_cs_created = false;
+
+// Must be called on the main thread before any dig can be decoded
+static void _dig_init(void) {
+	if(!dig_cs_created) {
+		dig_cs = async_make_cs();
+		dig_cs_created = true;
+	}
+}
+
+// Shared state of one strip decoding job. Strips are claimed one by one
+// by the loading thread and helper tasks, until none are left.
+typedef struct {
+	const byte* src;
+	uint32* offsets;
+	byte* dest;
+	uint n_strips, strip_size, total_size;
+	uint8 compression;
+
+	uint next_strip;
+	bool failed;
+} DigStrips;
+
+static bool _dig_decode_strip(DigStrips* s, uint i) {
+	const byte* src = s->src + s->offsets[i];
+	uint src_size = s->offsets[i+1] - s->offsets[i];
+	byte* dest = s->dest + i * s->strip_size;
+	uint size = MIN(s->strip_size, s->total_size - i * s->strip_size);
+
+	if(s->compression & DC_LZ4) {
+		if(LZ4_uncompress((const char*)src, (char*)dest, size) != src_size)
+			return false;
+	}
+	else if(s->compression & DC_DEFLATE) {
+		mz_ulong processed = size;
+		if(mz_uncompress(dest, &processed, src, src_size) != MZ_OK)
+			return false;
+		if(processed != size)
+			return false;
+	}
+	else {
+		if(src_size != size)
+			return false;
+		memcpy(dest, src, size);
+	}
+
+	if(s->compression & DC_DELTA)
+		_dec_delta_rgb565(dest, size / 2);
+
+	return true;
+}
+
+static void _dig_decode_strips(DigStrips* s) {
+	while(true) {
+		async_enter_cs(dig_cs);
+		uint i = s->next_strip++;
+		async_leave_cs(dig_cs);
+
+		if(i >= s->n_strips)
+			break;
+
+		bool ok = _dig_decode_strip(s, i);
+
+		if(!ok) {
+			async_enter_cs(dig_cs);
+			s->failed = true;
+			async_leave_cs(dig_cs);
+		}
+	}
+}
+
+static void _dig_strips_task(void* userdata) {
+	_dig_decode_strips(userdata);
+}
+
+#define MAX_DIG_HELPERS 8
+
+static bool _load_dig_strips(void* data, size_t size, uint8 compression,
+	size_t row_size, size_t total_size, void* dest) {
+
+	if(size < 8)
+		return false;
+
+	uint32 n_strips = ((uint32*)data)[0];
+	uint32 strip_rows = ((uint32*)data)[1];
+#if SOPHIST_endian == SOPHIST_big_endian
+	n_strips = endian_swap4(n_strips);
+	strip_rows = endian_swap4(strip_rows);
+#endif
+	if(!n_strips || !strip_rows || size < 8 + n_strips * 4)
+		return false;
+	size_t strip_size = strip_rows * row_size;
+	if((total_size + strip_size - 1) / strip_size != n_strips)
+		return false;
+
+	// (use malloc, this might run on a worker thread)
+	DigStrips* s = malloc(sizeof(DigStrips) + (n_strips+1) * sizeof(uint32));
+	s->offsets = (void*)s + sizeof(DigStrips);
+	s->src = data + 8 + n_strips * 4;
+	s->dest = dest;
+	s->n_strips = n_strips;
+	s->strip_size = strip_size;
+	s->total_size = total_size;
+	s->compression = compression;
+	s->next_strip = 0;
+	s->failed = false;
+
+	// Turn compressed sizes into offsets
+	uint32* sizes = data + 8;
+	s->offsets[0] = 0;
+	for(uint i = 0; i < n_strips; ++i) {
+		uint32 strip_size = sizes[i];
+#if SOPHIST_endian == SOPHIST_big_endian
+		strip_size = endian_swap4(strip_size);
+#endif
+		s->offsets[i+1] = s->offsets[i] + strip_size;
+	}
+	if(8 + n_strips * 4 + s->offsets[n_strips] > size) {
+		free(s);
+		return false;
+	}
+
+	// Let workers help out, decoding on this thread too. Helpers which
+	// did not start yet are run here by async_wait, so this is safe to
+	// call from a worker thread.
+	TaskId tasks[MAX_DIG_HELPERS];
+	uint helpers = MIN(n_strips - 1, MAX(1, async_cpu_count()) - 1);
+	helpers = MIN(helpers, MAX_DIG_HELPERS);
+	for(uint i = 0; i < helpers; ++i)
+		tasks[i] = async_run(_dig_strips_task, s);
+
+	_dig_decode_strips(s);
+
+	// Wait for strips claimed by helpers
+	for(uint i = 0; i < helpers; ++i)
+		async_wait(tasks[i]);
+
+	bool ok = !s->failed;
+	free(s);
+	return ok;
+}
+
+// Decodes into dest if it is not NULL and at least dest_size bytes large,
+// otherwise into a new malloced buffer
+static void* _load_dig(FileHandle f, uint* w, uint* h, PixelFormat* format,
+	void* dest, size_t dest_size) {
 	assert(sizeof(DIGHeader) == 8);
 
 	DIGHeader hdr;
@@ -234,18 +513,52 @@ static void* _load_dig(FileHandle f, uint* w, uint* h, PixelFormat* format) {
 	*w = hdr.width;
 	*h = hdr.height;
     *format = hdr.format;
+	if(hdr.compression & DC_MIPMAPS)
+		*format |= PF_MASK_MIPMAPS;
 
 	// Determine bits per pixel
 	uint bpp = _format_bpp(hdr.format);
+	size_t image_size = _image_size(*w, *h, *format);
+	size_t decompr_size = image_size;
 
-	// Read the rest of the data
 	// (use malloc to behave just like stb_image)
+	void* out = dest && dest_size >= decompr_size ? dest : NULL;
 	size_t s = file_size(f) - sizeof(DIGHeader);
+
+	// Uncompressed pixels are read straight into the output
+	if(!(hdr.compression & (DC_LZ4 | DC_DEFLATE | DC_STRIPS))) {
+		if(s != decompr_size)
+			return NULL;
+		if(!out)
+			out = malloc(decompr_size);
+		file_read(f, out, s);
+		if(hdr.compression & DC_DELTA) {
+			assert((hdr.format & PF_MASK_PIXEL_FORMAT) == PF_RGB565);
+			_dec_delta_rgb565(out, image_size / 2);
+		}
+		return out;
+	}
+
+	// Read the rest of the data
 	void* pixdata = malloc(s);
 	file_read(f, pixdata, s);
 
+	if(hdr.compression & DC_STRIPS) {
+		assert(!(hdr.compression & DC_PALETTIZE));
+		assert(!(hdr.compression & DC_DELTA) ||
+			(hdr.format & PF_MASK_PIXEL_FORMAT) == PF_RGB565);
+
+		void* strips_out = out ? out : malloc(decompr_size);
+		bool ok = _load_dig_strips(pixdata, s, hdr.compression,
+			(*w * bpp) / 8, image_size, strips_out);
+		free(pixdata);
+
+		if(!ok && strips_out != dest)
+			free(strips_out);
+		return ok ? strips_out : NULL;
+	}
+
 	// Decompress if neccessary
-	size_t decompr_size = (*w * *h * bpp) / 8;
 	if((hdr.compression & DC_LZ4) || (hdr.compression & DC_DEFLATE)) {
 		if(hdr.compression & DC_PALETTIZE) {
 			// Override decompressed size if palettized
@@ -253,7 +566,8 @@ static void* _load_dig(FileHandle f, uint* w, uint* h, PixelFormat* format) {
 			pixdata += 4;
 			s -= 4;
 		}
-		void* decompr_data = malloc(decompr_size);
+		void* decompr_data = out && !(hdr.compression & DC_PALETTIZE) ?
+			out : malloc(decompr_size);
 
 		mz_ulong processed = decompr_size;
 		if(hdr.compression & DC_LZ4)
@@ -270,7 +584,8 @@ static void* _load_dig(FileHandle f, uint* w, uint* h, PixelFormat* format) {
 
 		if(processed != s) {
 			// Compressed data was malformed, back out
-			free(decompr_data);
+			if(decompr_data != dest)
+				free(decompr_data);
 			return NULL;
 		}
 		else {
@@ -287,18 +602,25 @@ static void* _load_dig(FileHandle f, uint* w, uint* h, PixelFormat* format) {
 		free(pixdata);
 		pixdata = rawpix;
         s = (*w * *h * 2);
+
+		if(out) {
+			memcpy(out, pixdata, s);
+			free(pixdata);
+			pixdata = out;
+		}
 	}
 
 	// Check if size is right
-	if(s != (*w * *h * bpp) / 8) {
-		free(pixdata);
+	if(s != image_size) {
+		if(pixdata != dest)
+			free(pixdata);
 		return NULL;
 	}
 
 	// Undo delta coding
 	if(hdr.compression & DC_DELTA) {
 		assert((hdr.format & PF_MASK_PIXEL_FORMAT) == PF_RGB565);
-		_dec_delta_rgb565(pixdata, *w, *h);
+		_dec_delta_rgb565(pixdata, image_size / 2);
 	}
 
 	return pixdata;
@@ -326,7 +648,8 @@ static int _stbi_eof(void* user) {
 
 #endif
 
-void* image_load(const char* filename, uint* w, uint* h, PixelFormat* format) {
+static void* _image_load(const char* filename, uint* w, uint* h,
+	PixelFormat* format, void* dest, size_t dest_size) {
 	assert(filename && w && h && format);
 
 	void* data = NULL;
@@ -340,7 +663,7 @@ void* image_load(const char* filename, uint* w, uint* h, PixelFormat* format) {
 	FileHandle f;
 	if(file_exists(filename_dig)) {
 		f = file_open(filename_dig);
-		data = _load_dig(f, w, h, format);
+		data = _load_dig(f, w, h, format, dest, dest_size);
 		file_close(f);
 	}
 	else {
@@ -399,6 +722,83 @@ void* image_load(const char* filename, uint* w, uint* h, PixelFormat* format) {
 	return data;
 }
 
+void* image_load(const char* filename, uint* w, uint* h, PixelFormat* format) {
+	_dig_init();
+	return _image_load(filename, w, h, format, NULL, 0);
+}
+
+bool image_load_into(const char* filename, void* dest, size_t dest_size,
+	uint* w, uint* h, PixelFormat* format) {
+	assert(dest);
+
+	_dig_init();
+	void* data = _image_load(filename, w, h, format, dest, dest_size);
+	if(data == dest)
+		return true;
+
+	// Not a dig or dest too small, copy over if possible
+	size_t size = _image_size(*w, *h, *format);
+	bool fits = data && size <= dest_size;
+	if(fits)
+		memcpy(dest, data, size);
+	if(data)
+		free(data);
+	return fits;
+}
+
+static void _image_load_task(void* userdata) {
+	ImageLoadJob* job = userdata;
+	job->data = _image_load(job->filename, &job->w, &job->h, &job->format,
+		NULL, 0);
+
+	if(job->filter && job->data) {
+		if((job->format & PF_MASK_PIXEL_FORMAT) != PF_RGBA8888)
+			LOG_ERROR("%s: Only RGBA8888 images can be filtered", job->filename);
+		// Filters only see level 0, drop the rest of mip chain
+		job->format &= ~PF_MASK_MIPMAPS;
+		(*job->filter)((Color*)job->data, job->w, job->h);
+	}
+}
+
+ImageLoadJob* image_load_async(const char* filename, 
+	void (*filter)(Color* texels, uint w, uint h)) {
+	assert(filename);
+
+	_dig_init();
+
+	ImageLoadJob* job = MEM_ALLOC(sizeof(ImageLoadJob));
+	job->filename = strclone(filename);
+	job->filter = filter;
+	job->data = NULL;
+	job->w = job->h = 0;
+	job->format = 0;
+	job->task = async_run(_image_load_task, job);
+
+	return job;
+}
+
+bool image_load_ready(ImageLoadJob* job) {
+	assert(job);
+	return async_is_finished(job->task);
+}
+
+void image_load_wait(ImageLoadJob* job) {
+	assert(job);
+	async_wait(job->task);
+}
+
+void image_load_free(ImageLoadJob* job) {
+	assert(job);
+
+	image_load_wait(job);
+
+	// image_load data is malloced, see image_load
+	if(job->data)
+		free(job->data);
+	MEM_FREE(job->filename);
+	MEM_FREE(job);
+}
+
 void image_write_tga(const char* filename, uint w, uint h, const Color* pixels) {
 	// Fill up header
 	TGAHeader hdr = {
@@ -453,26 +853,98 @@ void image_write_png(const char* filename, uint w, uint h, const Color* pixels)
 	free(pix);
 }
 
+// Compresses every strip independently with lz4, optionally delta coding
+// it first. Returns malloced strip table followed by compressed data.
+static void* _compress_dig_strips(void* pixels, size_t total_size,
+	size_t row_size, uint strip_rows, bool delta, size_t* out_size) {
+
+	size_t strip_size = strip_rows * row_size;
+	uint n_strips = (total_size + strip_size - 1) / strip_size;
+	size_t table_size = 8 + n_strips * 4;
+
+	byte* out = malloc(table_size + n_strips * LZ4_compressBound(strip_size));
+	uint32* table = (uint32*)out;
+	table[0] = n_strips;
+	table[1] = strip_rows;
+
+	void* temp = delta ? malloc(strip_size) : NULL;
+
+	size_t size = table_size;
+	for(uint i = 0; i < n_strips; ++i) {
+		void* src = pixels + i * strip_size;
+		uint src_size = MIN(strip_size, total_size - i * strip_size);
+		if(delta) {
+			memcpy(temp, src, src_size);
+			_enc_delta_rgb565(temp, src_size / 2);
+			src = temp;
+		}
+		uint compr_size = LZ4_compressHC(src, (char*)out + size, src_size);
+		table[2 + i] = compr_size;
+		size += compr_size;
+	}
+
+#if SOPHIST_endian == SOPHIST_big_endian
+	for(uint i = 0; i < n_strips + 2; ++i)
+		table[i] = endian_swap4(table[i]);
+#endif
+
+	if(temp)
+		free(temp);
+
+	*out_size = size;
+	return out;
+}
+
 void image_write_dig(const char* filename, uint w, uint h, PixelFormat format, void* pixels) {
 	assert(filename && pixels);
 	assert(w > 0 && w <= 8192);
 	assert(h > 0 && h <= 8192);
 
 	// Simply try to compress pixels with lz4,
-	// or output raw if savings are less than 1k
+	// or output raw if savings are less than 1k.
+	// Large uncompressed formats are split into strips
+	// for parallel decoding, RGB565 is also tried with delta coding.
 
 	uint bpp = _format_bpp(format);
-	size_t size_uncompr = (w * h * bpp) / 8;
-
-	void* pixels_lz4 = malloc(LZ4_compressBound(size_uncompr));
-	size_t size_lz4 = LZ4_compressHC(pixels, pixels_lz4, size_uncompr);
+	size_t size_uncompr = _image_size(w, h, format);
+	size_t row_size = (w * bpp) / 8;
+
+	void* pixels_lz4;
+	size_t size_lz4;
+	uint8 compression_lz4 = DC_LZ4;
+
+	if(!(format & PF_MASK_COMPRESSED) && size_uncompr >= 2 * DIG_STRIP_SIZE) {
+		uint strip_rows = MAX(1, DIG_STRIP_SIZE / row_size);
+		pixels_lz4 = _compress_dig_strips(pixels, size_uncompr, row_size,
+			strip_rows, false, &size_lz4);
+		compression_lz4 |= DC_STRIPS;
+
+		if((format & PF_MASK_PIXEL_FORMAT) == PF_RGB565) {
+			size_t size_delta;
+			void* pixels_delta = _compress_dig_strips(pixels, size_uncompr,
+				row_size, strip_rows, true, &size_delta);
+			if(size_delta < size_lz4) {
+				free(pixels_lz4);
+				pixels_lz4 = pixels_delta;
+				size_lz4 = size_delta;
+				compression_lz4 |= DC_DELTA;
+			}
+			else {
+				free(pixels_delta);
+			}
+		}
+	}
+	else {
+		pixels_lz4 = malloc(LZ4_compressBound(size_uncompr));
+		size_lz4 = LZ4_compressHC(pixels, pixels_lz4, size_uncompr);
+	}
 
 	void* out_pixels;
 	size_t out_size;
 	uint8 compression = 0;
 
 	if(size_lz4 + 1024 < size_uncompr) {
-		compression = DC_LZ4;
+		compression = compression_lz4;
 		out_pixels = pixels_lz4;
 		out_size = size_lz4;
 	}
@@ -481,12 +953,15 @@ void image_write_dig(const char* filename, uint w, uint h, PixelFormat format, v
 		out_size = size_uncompr;
 	}
 
+	if(format & PF_MASK_MIPMAPS)
+		compression |= DC_MIPMAPS;
+
 	// Fill up header
 	DIGHeader hdr = {
 		.id = "DI",
 		.width = w,
 		.height = h,
-		.format = format,
+		.format = format & (PF_MASK_PIXEL_FORMAT | PF_MASK_PREMUL_ALPHA),
 		.compression = compression
 	};
 
@@ -511,8 +986,7 @@ void image_write_dig_quick(const char* filename, uint w, uint h, PixelFormat for
 
 	// Output uncompressed dig
         
-	uint bpp = _format_bpp(format);
-	size_t size_uncompr = (w * h * bpp) / 8;
+	size_t size_uncompr = _image_size(w, h, format);
 
 	void* out_pixels;
 	size_t out_size;
@@ -521,12 +995,15 @@ void image_write_dig_quick(const char* filename, uint w, uint h, PixelFormat for
     out_pixels = pixels;
     out_size = size_uncompr;
 
+	if(format & PF_MASK_MIPMAPS)
+		compression |= DC_MIPMAPS;
+
 	// Fill up header
 	DIGHeader hdr = {
 		.id = "DI",
 		.width = w,
 		.height = h,
-		.format = format,
+		.format = format & (PF_MASK_PIXEL_FORMAT | PF_MASK_PREMUL_ALPHA),
 		.compression = compression
 	};
 
@@ -554,8 +1031,7 @@ void image_write_dig_hc(const char* filename, uint w, uint h, PixelFormat format
 	//
 	// Choose the smaller.
 
-	uint bpp = _format_bpp(format);
-	size_t size_uncompr = (w * h * bpp) / 8;
+	size_t size_uncompr = _image_size(w, h, format);
 
 	void* pixels_defl = malloc(size_uncompr);
 	mz_ulong size_defl = size_uncompr;
@@ -565,7 +1041,8 @@ void image_write_dig_hc(const char* filename, uint w, uint h, PixelFormat format
         LOG_ERROR("miniz error %d\n", err);
     }
 
-	bool palettize = (format & PF_MASK_PIXEL_FORMAT) == PF_RGB565;
+	bool palettize = (format & PF_MASK_PIXEL_FORMAT) == PF_RGB565 &&
+		!(format & PF_MASK_MIPMAPS);
     uint pixels_dc_size = 0;
 	if(palettize) {
 		void* pixels_dc = _palettize_rgb565(pixels, w*h, &pixels_dc_size);
@@ -602,12 +1079,15 @@ void image_write_dig_hc(const char* filename, uint w, uint h, PixelFormat format
 		out_size = size_uncompr;
 	}
 
+	if(format & PF_MASK_MIPMAPS)
+		compression |= DC_MIPMAPS;
+
 	// Fill up header
 	DIGHeader hdr = {
 		.id = "DI",
 		.width = w,
 		.height = h,
-		.format = format,
+		.format = format & (PF_MASK_PIXEL_FORMAT | PF_MASK_PREMUL_ALPHA),
 		.compression = compression
 	};
 
@@ -2,6 +2,7 @@
 #define IMAGE_H
 
 #include <utils.h>
+#include "async.h"
 
 // Loads images from files
 // Supported formats:
@@ -32,11 +33,52 @@ typedef enum {
 	PF_MASK_PVRTC = 0x70,
 	PF_MASK_RGBA = 0x0F,
 	PF_MASK_PIXEL_FORMAT = 0x7F,
-	PF_MASK_PREMUL_ALPHA = 0x80
+	PF_MASK_PREMUL_ALPHA = 0x80,
+	// Image data is followed by mip chain down to 1x1
+	PF_MASK_MIPMAPS = 0x100
 } PixelFormat;
 
+// Returned format can have PF_MASK_MIPMAPS and PF_MASK_PREMUL_ALPHA bits set,
+// mask with PF_MASK_PIXEL_FORMAT before comparing.
 void* image_load(const char* filename, uint* w, uint* h, PixelFormat* format);
 
+// Decodes image straight into caller provided buffer. If dest is too small
+// returns false, only w, h and format are filled then.
+bool image_load_into(const char* filename, void* dest, size_t dest_size,
+	uint* w, uint* h, PixelFormat* format);
+
+// Background image loading - file is read, decoded and optionally
+// filtered on async worker threads. Job fields must not be touched
+// until image_load_ready returns true.
+typedef struct {
+	char* filename;
+	void (*filter)(Color* texels, uint w, uint h);
+	TaskId task;
+
+	void* data;
+	uint w, h;
+	PixelFormat format;
+} ImageLoadJob;
+
+ImageLoadJob* image_load_async(const char* filename, 
+	void (*filter)(Color* texels, uint w, uint h));
+// Returns true if job is finished
+bool image_load_ready(ImageLoadJob* job);
+// Blocks until job is finished
+void image_load_wait(ImageLoadJob* job);
+// Waits for job to finish, frees it and its image data
+void image_load_free(ImageLoadJob* job);
+
+// Returns number of levels in mip chain, 1 if image has no mipmaps.
+// Level i is max(1, w >> i) by max(1, h >> i) pixels.
+uint image_mip_levels(uint w, uint h, PixelFormat format);
+// Returns size of a single mip level in bytes
+size_t image_level_size(uint w, uint h, PixelFormat format);
+
+// Decodes DXT1/3/5 block compressed pixels to RGBA8888,
+// for when gpu doesn't support them. Result must be freed with free().
+void* image_decode_dxt(const void* data, uint w, uint h, PixelFormat format);
+
 void image_write_tga(const char* filename, uint w, uint h, const Color* pixels);
 
 void image_write_png(const char* filename, uint w, uint h, const Color* pixels);
@@ -5,6 +5,7 @@
 #include "memory.h"
 #include "mempool.h"
 #include "system.h"
+#include "vfs.h"
 
 #include <stdarg.h>
 #ifdef MACOSX_BUNDLE
@@ -21,10 +22,22 @@ static bool ml_prepped = false;
 
 extern bool fs_devmode;
 static bool profiling = false;
+static bool sampling = false;
+static uint sampling_period = 1000;
+
+// Precompiled scripts bundle, made by mkluab
+static VfsBlob scripts_bundle;
+static bool bundle_mounted = false;
+
+// Vectors are userdata with 2 doubles, rects and colors - with 4
+#define VEC2_UDATA_SIZE (sizeof(Udata) + 2 * sizeof(double))
+#define RECT_UDATA_SIZE (sizeof(Udata) + 4 * sizeof(double))
 
 static MemPool table_pool;
 static MemPool vector_pool;
 static MemPool rect_pool;
+static MemPool vec2_udata_pool;
+static MemPool rect_udata_pool;
 static bool pools_allocated = false;
 
 bool _endswith(const char* str, const char* tail) {
@@ -64,52 +77,51 @@ int malka_run(const char* luafile) {
 extern int luaopen_bit(lua_State* l);
 extern int luaopen_libluautf8(lua_State* l);
 
-static void* malka_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
-    (void)ud;
-    if (osize == 0 && nsize != 0) {
-        if(nsize == sizeof(Table))
-            return mempool_alloc(&table_pool);
-        if(nsize == sizeof(Node) * 2)
-            return mempool_alloc(&vector_pool);
-        if(nsize == sizeof(Node) * 4)
-            return mempool_alloc(&rect_pool);
-    }    
-    if (nsize == 0) {
-        if(osize == sizeof(Table) && mempool_owner(&table_pool, ptr))
-            mempool_free(&table_pool, ptr);
-        else if(osize == sizeof(Node) * 2 && mempool_owner(&vector_pool, ptr))
-            mempool_free(&vector_pool, ptr);
-        else if(osize == sizeof(Node) * 4 && mempool_owner(&rect_pool, ptr))
-            mempool_free(&rect_pool, ptr);
-        else
-            free(ptr);
-        return NULL;
-    }
-    else {
-		MemPool* pool = NULL;
-        if(osize == sizeof(Table) && mempool_owner(&table_pool, ptr)) {
-			pool = &table_pool;
-			goto promote;
-		}
-		if(osize == sizeof(Node) * 2 && mempool_owner(&vector_pool, ptr)) {
-			pool = &vector_pool;
-			goto promote;
-		}
-		if(osize == sizeof(Node) * 4 && mempool_owner(&rect_pool, ptr)) {
-			pool = &rect_pool;
-			goto promote;
-		}
+// Returns pool for chunks of given size, if ptr is not NULL - only if
+// that pool owns ptr
+static MemPool* _pool_of(size_t size, void* ptr) {
+	MemPool* pool = NULL;
+	if(size == sizeof(Table))
+		pool = &table_pool;
+	else if(size == sizeof(Node) * 2)
+		pool = &vector_pool;
+	else if(size == sizeof(Node) * 4)
+		pool = &rect_pool;
+	else if(size == VEC2_UDATA_SIZE)
+		pool = &vec2_udata_pool;
+	else if(size == RECT_UDATA_SIZE)
+		pool = &rect_udata_pool;
+
+	if(pool && ptr && !mempool_owner(pool, ptr))
+		return NULL;
+	return pool;
+}
 
-        return realloc(ptr, nsize);
+static void* malka_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+	(void)ud;
+	MemPool* pool = NULL;
+	if (ptr == NULL) {
+		if (nsize != 0 && (pool = _pool_of(nsize, NULL)))
+			return mempool_alloc(pool);
+		return nsize ? malloc(nsize) : NULL;
+	}
 
-promote:
-		// Promote pool allocated chunk to heap
-		assert(pool);
-		void* new = malloc(nsize);
-		memcpy(new, ptr, MIN(osize, nsize));
-		mempool_free(pool, ptr);
-		return new;
-    }
+	pool = _pool_of(osize, ptr);
+	if (nsize == 0) {
+		if(pool)
+			mempool_free(pool, ptr);
+		else
+			free(ptr);
+		return NULL;
+	}
+	if (!pool)
+		return realloc(ptr, nsize);
+
+	// Promote pool allocated chunk to heap
+	void* new = malloc(nsize);
+	memcpy(new, ptr, MIN(osize, nsize));
+	mempool_free(pool, ptr);
+	return new;
 }
 
 static int malka_panic (lua_State *L) {
@@ -156,6 +168,8 @@ void malka_init_ex(bool use_pools) {
 		mempool_init_ex(&table_pool, sizeof(Table), 128*1024);
 		mempool_init_ex(&vector_pool, sizeof(Node)*2, 128*1024);
 		mempool_init_ex(&rect_pool, sizeof(Node)*4, 256*1024);
+		mempool_init_ex(&vec2_udata_pool, VEC2_UDATA_SIZE, 128*1024);
+		mempool_init_ex(&rect_udata_pool, RECT_UDATA_SIZE, 128*1024);
 		
 		l = malka_newstate();
 		pools_allocated = true;
@@ -203,10 +217,19 @@ void malka_close(void) {
 
 	if(profiling)
 		profiler_close(l);
+	else if(sampling)
+		profiler_sampling_close(l, "profile_time.folded", "profile_alloc.folded");
 
 	lua_close(l);
+
+	if(bundle_mounted) {
+		vfs_close(&scripts_bundle);
+		bundle_mounted = false;
+	}
     
 	if(pools_allocated) {
+		mempool_drain(&rect_udata_pool);
+		mempool_drain(&vec2_udata_pool);
 		mempool_drain(&rect_pool);
 		mempool_drain(&vector_pool);
 		mempool_drain(&table_pool);
@@ -214,6 +237,66 @@ void malka_close(void) {
 	}
 }
 
+// package.loaders entry, resolves require against scripts bundle
+static int _bundle_loader(lua_State* l) {
+	const char* name = luaL_checkstring(l, 1);
+
+	size_t size;
+	const char* chunk = vfs_get(&scripts_bundle, name, &size);
+	if(!chunk) {
+		lua_pushfstring(l, "\n\tno module '%s' in scripts bundle", name);
+		return 1;
+	}
+
+	if(luaL_loadbuffer(l, chunk, size, name) != 0)
+		return luaL_error(l, "error loading module '%s' from scripts bundle:\n\t%s",
+			name, lua_tostring(l, -1));
+	return 1;
+}
+
+// Mounts <scripts folder>.vfs if it exists, bundled modules
+// take precedence over loose files
+static void _mount_bundle(const char* luafile) {
+	if(bundle_mounted)
+		return;
+
+	char* folder = path_get_folder(luafile);
+	size_t len = strlen(folder);
+	if(len && (folder[len-1] == '/' || folder[len-1] == '\\'))
+		folder[--len] = '\0';
+
+	char bundle[256];
+	if(len == 0 || strcmp(folder, ".") == 0)
+		strcpy(bundle, "scripts.vfs");
+	else
+		snprintf(bundle, sizeof(bundle), "%s.vfs", folder);
+	MEM_FREE(folder);
+
+	if(!file_exists(bundle))
+		return;
+
+	vfs_open(&scripts_bundle, bundle);
+	if(scripts_bundle.n_files == 0) {
+		vfs_close(&scripts_bundle);
+		return;
+	}
+	bundle_mounted = true;
+	LOG_INFO("Mounted scripts bundle %s, %u modules", bundle,
+		scripts_bundle.n_files);
+
+	// Insert right after package.preload searcher
+	lua_getglobal(l, "package");
+	lua_getfield(l, -1, "loaders");
+	int loaders = lua_gettop(l);
+	for(int i = lua_objlen(l, loaders); i >= 2; --i) {
+		lua_rawgeti(l, loaders, i);
+		lua_rawseti(l, loaders, i+1);
+	}
+	lua_pushcfunction(l, _bundle_loader);
+	lua_rawseti(l, loaders, 2);
+	lua_pop(l, 2);
+}
+
 int malka_register(bind_fun_ptr fun) {
 	return (*fun)(l);
 }
@@ -284,6 +367,11 @@ static void _malka_prep(const char* luafile) {
 				fs_devmode = true;
 			if(strcmp(ml_argv[i], "-profile") == 0)
 				profiling = true;
+			if(strcmp(ml_argv[i], "-profile-sample") == 0) {
+				sampling = true;
+				if(i+1 < ml_argc && atoi(ml_argv[i+1]) > 0)
+					sampling_period = atoi(ml_argv[i+1]);
+			}
 			lua_pushstring(l, ml_argv[i]);
 			lua_rawseti(l, t, i+1);
 		}
@@ -293,8 +381,14 @@ static void _malka_prep(const char* luafile) {
 	}
 	lua_setfield(l, LUA_GLOBALSINDEX, "argv");
 
+	// Loose files are edited live in fs dev mode, bundle would shadow them
+	if(!fs_devmode)
+		_mount_bundle(luafile);
+
 	if(profiling)
 		profiler_init(l);
+	else if(sampling)
+		profiler_sampling_init(l, sampling_period);
 
 	ml_prepped = true;
 }
@@ -310,7 +404,22 @@ int malka_run_ex(const char* luafile) {
 
 	_malka_prep(file);
 
-	if(luaL_dofile(l, file)) {
+	// Main script comes from the bundle too, if it's there
+	int res;
+	char* name = strclone(path_get_file(luafile));
+	char* ext = strrchr(name, '.');
+	if(ext)
+		*ext = '\0';
+	size_t size;
+	const char* chunk = bundle_mounted ?
+		vfs_get(&scripts_bundle, name, &size) : NULL;
+	if(chunk)
+		res = luaL_loadbuffer(l, chunk, size, name) || lua_pcall(l, 0, LUA_MULTRET, 0);
+	else
+		res = luaL_dofile(l, file);
+	MEM_FREE(name);
+
+	if(res) {
 		const char* err = luaL_checkstring(l, -1);
 		LOG_WARNING("error in lua script:\n%s\n", err);
 		printf("An error occured:\n%s\n", err);
@@ -411,6 +520,104 @@ void malka_full_gc(void) {
     lua_gc(l, LUA_GCCOLLECT, 0);
 }
 
+#define GC_MIN_LIVE_KB 512
+
+static float gc_target_ms = 0.0f;
+static float gc_cap_ms = 0.0f;
+static uint gc_live_kb = 0;
+static MalkaGCStats gc_stats;
+
+// Moves collector threshold to hard limit, keeping it as a safety net only.
+// It is well above the point where malka_gc_frame does a full gc itself.
+static void _gc_park(void) {
+	global_State* g = l->l_G;
+	size_t hard = MAX(gc_live_kb, GC_MIN_LIVE_KB) * 8 * 1024;
+	g->GCthreshold = MAX(hard, g->totalbytes + 1024);
+}
+
+void malka_gc_pacing(float target_ms, float cap_ms) {
+	assert(l);
+	assert(target_ms >= 0.0f && cap_ms >= 0.0f);
+
+	gc_target_ms = target_ms;
+	gc_cap_ms = cap_ms;
+	memset(&gc_stats, 0, sizeof(gc_stats));
+
+	if(target_ms > 0.0f)
+		_gc_park();
+	else
+		lua_gc(l, LUA_GCRESTART, 0);
+}
+
+void malka_gc_frame(float work_ms) {
+	if(gc_target_ms <= 0.0f)
+		return;
+
+	global_State* g = l->l_G;
+	uint live_kb = MAX(gc_live_kb, GC_MIN_LIVE_KB);
+	uint mem_kb = g->totalbytes / 1024;
+	size_t before = g->totalbytes;
+	double t = profiler_time_micros();
+
+	gc_stats.steps = 0;
+	gc_stats.escalation = 0;
+
+	if(mem_kb > live_kb * 4) {
+		lua_gc(l, LUA_GCCOLLECT, 0);
+		gc_live_kb = g->totalbytes / 1024;
+		gc_stats.escalation = 2;
+		gc_stats.steps = 1;
+	}
+	else {
+		float budget = MIN(gc_target_ms - work_ms, gc_cap_ms);
+		if(gc_live_kb == 0 || mem_kb > live_kb * 2) {
+			budget = gc_cap_ms;
+			gc_stats.escalation = 1;
+		}
+
+		double end = t + budget * 1000.0;
+		while(budget > 0.0f) {
+			gc_stats.steps++;
+			if(lua_gc(l, LUA_GCSTEP, 0)) {
+				// Cycle finished, everything left is live
+				gc_live_kb = g->totalbytes / 1024;
+				break;
+			}
+			if(profiler_time_micros() >= end)
+				break;
+		}
+	}
+
+	_gc_park();
+
+	gc_stats.ms = (profiler_time_micros() - t) / 1000.0;
+	gc_stats.freed = before > g->totalbytes ? before - g->totalbytes : 0;
+	gc_stats.mem_kb = g->totalbytes / 1024;
+	gc_stats.live_kb = gc_live_kb;
+}
+
+const MalkaGCStats* malka_gc_stats(void) {
+	return &gc_stats;
+}
+
+void malka_read_numbers(lua_State* l, int i, uint start, uint n, float* out) {
+	assert(lua_istable(l, i));
+
+	const Table* t = lua_topointer(l, i);
+	uint k = start;
+	for(uint j = 0; j < n; ++j, ++k) {
+		if(k < t->sizearray) {
+			const TValue* v = &t->array[k];
+			out[j] = ttisnumber(v) ? nvalue(v) : 0.0f;
+		}
+		else {
+			lua_rawgeti(l, i, k+1);
+			out[j] = lua_tonumber(l, -1);
+			lua_pop(l, 1);
+		}
+	}
+}
+
 lua_State* malka_lua_state(void) {
 	return l;
 }
@@ -53,4 +53,36 @@ void malka_gc(uint ms);
 // Performs full gc
 void malka_full_gc(void);
 
+// Automatic gc pacing for malka_states_step. Frame slack (target_ms minus
+// time spent updating and rendering, and on gc after previous frame) is
+// spent on incremental gc steps after video_present, never more than
+// cap_ms per frame.
+// Lua collector only runs on its own as a safety net past 8x of the last
+// live set. When memory grows past 2x whole cap is spent regardless of
+// slack, past 4x - full gc is performed.
+// target_ms = 0 turns pacing off.
+void malka_gc_pacing(float target_ms, float cap_ms);
+
+// Spends slack of a frame which took work_ms on gc, states call this
+void malka_gc_frame(float work_ms);
+
+typedef struct {
+	float ms;
+	uint freed;
+	uint steps;
+	uint mem_kb;
+	uint live_kb;
+	// 0 - slack, 1 - whole cap, 2 - full gc
+	uint escalation;
+} MalkaGCStats;
+
+// Stats of the last paced frame
+const MalkaGCStats* malka_gc_stats(void);
+
+// Reads n numbers from table at stack index i, starting with 0-based
+// array index start. Array part of the table is read straight from
+// VM internals, skipping Lua API for every number; the rest goes through
+// lua_rawgeti. Non-number entries are read as 0.
+void malka_read_numbers(lua_State* l, int i, uint start, uint n, float* out);
+
 #endif
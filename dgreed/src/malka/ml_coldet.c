@@ -16,11 +16,20 @@ extern bool _check_rect(lua_State* l, int i, RectF* r);
 #define checkcdworld(l, i) \
 	(CDWorld*)luaL_checkudata(l, i, "_CDWorld.mt")
 
+// Every world has a table as its environment, which maps CDObj pointers
+// to userdata wrappers. Wrapper is created once per object, callbacks and
+// queries push the cached one.
+static void _new_cdcache(lua_State* l) {
+	lua_newtable(l);
+	lua_setfenv(l, -2);
+}
+
 static void _new_cdworld(lua_State* l, float max_obj_size) {
 	CDWorld* new = (CDWorld*)lua_newuserdata(l, sizeof(CDWorld));
 	coldet_init(new, max_obj_size);
 	luaL_getmetatable(l, "_CDWorld.mt");
 	lua_setmetatable(l, -2);
+	_new_cdcache(l);
 }
 
 static void _new_cdworld_ex(lua_State* l, float max_obj_size,
@@ -29,6 +38,7 @@ static void _new_cdworld_ex(lua_State* l, float max_obj_size,
 	coldet_init_ex(new, max_obj_size, width, height, horiz_wrap, vert_wrap);
 	luaL_getmetatable(l, "_CDWorld.mt");
 	lua_setmetatable(l, -2);
+	_new_cdcache(l);
 }
 
 #define checkcdobj(l, i) \
@@ -41,6 +51,25 @@ static void _new_cdobj(lua_State* l, CDObj* obj) {
 	lua_setmetatable(l, -2);
 }
 
+// Pushes wrapper of obj, cache is stack index of world cache table
+static void _push_cdobj(lua_State* l, int cache, CDObj* obj) {
+	lua_pushlightuserdata(l, obj);
+	lua_rawget(l, cache);
+	if(lua_isnil(l, -1)) {
+		lua_pop(l, 1);
+		_new_cdobj(l, obj);
+		lua_pushlightuserdata(l, obj);
+		lua_pushvalue(l, -2);
+		lua_rawset(l, cache);
+	}
+}
+
+// Pushes cache table of world at stack index i, returns its index
+static int _get_cdcache(lua_State* l, int i) {
+	lua_getfenv(l, i);
+	return lua_gettop(l);
+}
+
 static int ml_coldet_init(lua_State* l) {
 	int n = lua_gettop(l);
 
@@ -90,7 +119,7 @@ static int ml_coldet_new_circle(lua_State* l) {
 		userdata = (void*)(size_t)(lua_ref(l, 1));	
 
 	CDObj* obj = coldet_new_circle(cd, center, radius, mask, userdata);
-	_new_cdobj(l, obj);
+	_push_cdobj(l, _get_cdcache(l, 1), obj);
 
 	return 1;
 
@@ -110,14 +139,14 @@ static int ml_coldet_new_aabb(lua_State* l) {
 
 	uint mask = 0xFFFFFFFF;
 	if(n == 3 || n == 4)
-		mask = luaL_checkinteger(l, 4);
+		mask = luaL_checkinteger(l, 3);
 
 	void* userdata = NULL;
 	if(n == 4) 
 		userdata = (void*)(size_t)(lua_ref(l, 1));	
 
 	CDObj* obj = coldet_new_aabb(cd, &rect, mask, userdata);
-	_new_cdobj(l, obj);
+	_push_cdobj(l, _get_cdcache(l, 1), obj);
 
 	return 1;
 
@@ -131,16 +160,39 @@ static int ml_coldet_remove(lua_State* l) {
 	CDWorld* cd = checkcdworld(l, 1);
 	CDObj** obj = checkcdobj(l, 2);
 
+	int cache = _get_cdcache(l, 1);
+	lua_pushlightuserdata(l, *obj);
+	lua_pushnil(l);
+	lua_rawset(l, cache);
+
 	coldet_remove_obj(cd, *obj);
 
 	return 0;
 }
 
-static lua_State* _ml_query_cb_l;
+// State for C callbacks, indices point to Lua callback function and
+// world cache table. Callbacks can query world again, so it's saved
+// and restored around every coldet call.
+typedef struct {
+	lua_State* l;
+	int fun, cache;
+	int pairs;
+	uint n_pairs;
+} MLCallbackState;
+
+static MLCallbackState ml_cb;
+
 static void _ml_query_cb(CDObj* obj) {
-	lua_pushvalue(_ml_query_cb_l, -1);
-	_new_cdobj(_ml_query_cb_l, obj);
-	lua_call(_ml_query_cb_l, 1, 0);
+	lua_pushvalue(ml_cb.l, ml_cb.fun);
+	_push_cdobj(ml_cb.l, ml_cb.cache, obj);
+	lua_call(ml_cb.l, 1, 0);
+}
+
+static void _ml_cb_prep(lua_State* l, bool fun) {
+	assert(!fun || lua_isfunction(l, -1));
+	ml_cb.l = l;
+	ml_cb.fun = fun ? lua_gettop(l) : 0;
+	ml_cb.cache = _get_cdcache(l, 1);
 }
 
 static int ml_coldet_query_circle(lua_State* l) {
@@ -165,9 +217,10 @@ static int ml_coldet_query_circle(lua_State* l) {
 	
 	int res;
 	if(n == 4 || n == 5) {
-		_ml_query_cb_l = l;
-		assert(lua_isfunction(l, -1));
+		MLCallbackState saved = ml_cb;
+		_ml_cb_prep(l, true);
 		res = coldet_query_circle(cd, center, radius, mask, _ml_query_cb);
+		ml_cb = saved;
 	}
 	else {
 		res = coldet_query_circle(cd, center, radius, mask, NULL);
@@ -201,9 +254,10 @@ static int ml_coldet_query_aabb(lua_State* l) {
 	
 	int res;
 	if(n == 3 || n == 4) {
-		_ml_query_cb_l = l;
-		assert(lua_isfunction(l, -1));
+		MLCallbackState saved = ml_cb;
+		_ml_cb_prep(l, true);
 		res = coldet_query_aabb(cd, &rect, mask, _ml_query_cb);
+		ml_cb = saved;
 	}
 	else {
 		res = coldet_query_aabb(cd, &rect, mask, NULL);
@@ -238,7 +292,8 @@ static int ml_coldet_cast_segment(lua_State* l) {
 	_new_vec2(l, hitp.x, hitp.y);
 
 	if(obj) {
-		_new_cdobj(l, obj);
+		_push_cdobj(l, _get_cdcache(l, 1), obj);
+		lua_remove(l, -2);
 		return 2;
 	}
 
@@ -249,10 +304,10 @@ error:
 }
 
 static void _ml_collide_cb(CDObj* a, CDObj* b) {
-	lua_pushvalue(_ml_query_cb_l, -1);
-	_new_cdobj(_ml_query_cb_l, a);
-	_new_cdobj(_ml_query_cb_l, b);
-	lua_call(_ml_query_cb_l, 2, 0);
+	lua_pushvalue(ml_cb.l, ml_cb.fun);
+	_push_cdobj(ml_cb.l, ml_cb.cache, a);
+	_push_cdobj(ml_cb.l, ml_cb.cache, b);
+	lua_call(ml_cb.l, 2, 0);
 }
 
 static int ml_coldet_process(lua_State* l) {
@@ -263,9 +318,10 @@ static int ml_coldet_process(lua_State* l) {
 	CDWorld* cd = checkcdworld(l, 1);
 
 	if(n == 2) {
-		_ml_query_cb_l = l;
-		assert(lua_isfunction(l, -1));
+		MLCallbackState saved = ml_cb;
+		_ml_cb_prep(l, true);
 		coldet_process(cd, _ml_collide_cb);
+		ml_cb = saved;
 	}
 	else {
 		coldet_process(cd, NULL);
@@ -277,6 +333,46 @@ error:
 	return luaL_error(l, "bad args to coldet.process");
 }
 
+static void _ml_pairs_cb(CDObj* a, CDObj* b) {
+	_push_cdobj(ml_cb.l, ml_cb.cache, a);
+	lua_rawseti(ml_cb.l, ml_cb.pairs, ++ml_cb.n_pairs);
+	_push_cdobj(ml_cb.l, ml_cb.cache, b);
+	lua_rawseti(ml_cb.l, ml_cb.pairs, ++ml_cb.n_pairs);
+}
+
+static int ml_coldet_process_pairs(lua_State* l) {
+	checkargs(1, "coldet.process_pairs");
+
+	CDWorld* cd = checkcdworld(l, 1);
+
+	MLCallbackState saved = ml_cb;
+	_ml_cb_prep(l, false);
+
+	// Pairs table is kept in world cache and reused every step
+	lua_getfield(l, ml_cb.cache, "pairs");
+	if(lua_isnil(l, -1)) {
+		lua_pop(l, 1);
+		lua_newtable(l);
+		lua_pushvalue(l, -1);
+		lua_setfield(l, ml_cb.cache, "pairs");
+	}
+	ml_cb.pairs = lua_gettop(l);
+	ml_cb.n_pairs = 0;
+	uint old_size = lua_objlen(l, ml_cb.pairs);
+
+	coldet_process(cd, _ml_pairs_cb);
+
+	// Clear leftovers from previous step
+	for(uint i = ml_cb.n_pairs + 1; i <= old_size; ++i) {
+		lua_pushnil(l);
+		lua_rawseti(l, ml_cb.pairs, i);
+	}
+
+	lua_pushinteger(l, ml_cb.n_pairs / 2);
+	ml_cb = saved;
+	return 2;
+}
+
 static int ml_cdobj_is_circle(lua_State* l) {
 	checkargs(1, "cdobj.is_circle");
 
@@ -465,6 +561,7 @@ static const luaL_Reg coldet_fun[] = {
 	{"query_aabb", ml_coldet_query_aabb},
 	{"cast_segment", ml_coldet_cast_segment},
 	{"process", ml_coldet_process},
+	{"process_pairs", ml_coldet_process_pairs},
 	{NULL, NULL}
 };
 
@@ -76,7 +76,7 @@ static int ml_img_pixel(lua_State* l) {
 
 	if(x < 0 || x >= img->width || y < 0 || y >= img->height)
 		return luaL_error(l, "pixel coordinates out of image bounds");
-	if(img->format != PF_RGBA8888)
+	if((img->format & PF_MASK_PIXEL_FORMAT) != PF_RGBA8888)
 		return luaL_error(l, "unsupported image pixel format");
 
 	Color* img_color = (Color*)img->pixels;
@@ -67,12 +67,9 @@ static NodeIdx _table_to_node(lua_State* l, int table, MMLObject* obj, bool root
 static int ml_mml_read(lua_State* l) {
 	checkargs(1, "mml.read");
 
-	char* text = txtfile_read(luaL_checkstring(l, 1));
 	MMLObject obj;
-	if(!mml_deserialize(&obj, text))
+	if(!mml_load(&obj, luaL_checkstring(l, 1)))
 		return luaL_error(l, "Unable to read mml from file");
-
-	MEM_FREE(text);
 	_node_to_table(l, &obj, mml_root(&obj));
 	
 	mml_free(&obj);
@@ -83,8 +80,10 @@ static int ml_mml_read(lua_State* l) {
 static int ml_mml_read_str(lua_State* l) {
 	checkargs(1, "mml.read_str");
 
+	size_t len;
+	const char* str = luaL_checklstring(l, 1, &len);
 	MMLObject obj;
-	if(!mml_deserialize(&obj, luaL_checkstring(l, 1)))
+	if(!mml_deserialize_ex(&obj, str, len))
 		return luaL_error(l, "Unable to read mml from string");
 
 	_node_to_table(l, &obj, mml_root(&obj));
@@ -15,6 +15,9 @@ extern void _new_rect(lua_State* l, double _l, double t,
 extern bool _check_vec2(lua_State* l, int i, Vector2* v);
 extern bool _check_rect(lua_State* l, int i, RectF* r);
 extern bool _check_color(lua_State* l, int i, Color* c);
+extern uint _check_batch(lua_State* l, int i, int c, uint stride);
+extern void _read_batch(lua_State* l, int i, uint item, uint stride,
+		float* out);
 
 static void _new_sprhandle(lua_State* l, SprHandle h) {
 	SprHandle* s = (SprHandle*)lua_newuserdata(l, sizeof(SprHandle));
@@ -322,6 +325,57 @@ error:
 	return luaL_error(l, "bad arguments to sprsheet.draw_anim_centered");
 }
 
+// Each item is frame, center x, y, rotation and scale
+#define SPR_BATCH_STRIDE 5
+
+static int ml_sprsheet_draw_batch(lua_State* l) {
+	int n = lua_gettop(l);
+	if(n < 3 || n > 5)
+		goto error;
+
+	const char* name;
+	SprHandle* h;
+	resolvespr(l, 1, name, h);
+	SprHandle handle = name ? sprsheet_get_handle(name) : *h;
+
+	uint layer = luaL_checkinteger(l, 2);
+	if(layer > 15)
+		goto error;
+	uint count = _check_batch(l, 3, 4, SPR_BATCH_STRIDE);
+
+	Color tint = COLOR_WHITE;
+	if(n == 5)
+		if(!_check_color(l, 5, &tint))
+			goto error;
+
+	// Items are forwarded to spr_draw_batch in chunks
+	SprDrawItem items[64];
+	uint n_items = 0;
+	for(uint i = 0; i < count; ++i) {
+		float v[SPR_BATCH_STRIDE];
+		_read_batch(l, 3, i, SPR_BATCH_STRIDE, v);
+
+		SprDrawItem* item = &items[n_items++];
+		item->handle = handle;
+		item->frame = v[0] > 0.0f ? (uint)v[0] : 0;
+		item->pos = vec2(v[1], v[2]);
+		item->rot = v[3];
+		item->scale = v[4];
+		item->tint = tint;
+
+		if(n_items == ARRAY_SIZE(items)) {
+			spr_draw_batch(items, n_items, layer);
+			n_items = 0;
+		}
+	}
+	if(n_items)
+		spr_draw_batch(items, n_items, layer);
+
+	return 0;
+error:
+	return luaL_error(l, "bad arguments to sprsheet.draw_batch");
+}
+
 static const luaL_Reg sprsheet_fun[] = {
 	{"init", ml_sprsheet_init},
 	{"close", ml_sprsheet_close},
@@ -333,6 +387,7 @@ static const luaL_Reg sprsheet_fun[] = {
 	{"draw_anim", ml_sprsheet_draw_anim},
 	{"draw_centered", ml_sprsheet_draw_centered},
 	{"draw_anim_centered", ml_sprsheet_draw_anim_centered},
+	{"draw_batch", ml_sprsheet_draw_batch},
 	{NULL, NULL}
 };
 
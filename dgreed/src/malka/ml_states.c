@@ -1,5 +1,7 @@
+#include "malka.h"
 #include "ml_states.h"
 #include "ml_common.h"
+#include "profiler.h"
 
 #include "lua/lauxlib.h"
 #include "lua/lualib.h"
@@ -486,6 +488,31 @@ static int ml_states_prerender_callback(lua_State* l) {
 	return 0;
 }
 
+static int ml_states_gc_pacing(lua_State* l) {
+	int n = lua_gettop(l);
+	if(n != 1 && n != 2)
+		return luaL_error(l, "wrong number of arguments provided to states.gc_pacing");
+
+	double target = luaL_checknumber(l, 1);
+	double cap = n == 2 ? luaL_checknumber(l, 2) : 2.0;
+	if(target < 0.0 || cap < 0.0)
+		return luaL_error(l, "negative time provided to states.gc_pacing");
+
+	malka_gc_pacing(target, cap);
+	return 0;
+}
+
+static int ml_states_gc_stats(lua_State* l) {
+	checkargs(0, "states.gc_stats");
+
+	const MalkaGCStats* s = malka_gc_stats();
+	lua_pushnumber(l, s->ms);
+	lua_pushinteger(l, s->freed);
+	lua_pushinteger(l, s->mem_kb);
+	lua_pushinteger(l, s->escalation);
+	return 4;
+}
+
 static int ml_states_size(lua_State* l) {
 	checkargs(0, "states.size");
 
@@ -584,6 +611,8 @@ static const luaL_Reg states_fun[] = {
 	{"pop_multi", ml_states_pop_multi},
 	{"replace", ml_states_replace},
 	{"prerender_callback", ml_states_prerender_callback},
+	{"gc_pacing", ml_states_gc_pacing},
+	{"gc_stats", ml_states_gc_stats},
 	{"size", ml_states_size},
 	{"top", ml_states_top},
 	{"at", ml_states_at},
@@ -774,10 +803,31 @@ void malka_states_end(void) {
 		_call_state_func(l, _names_get(i), "close", NULL, NULL, NULL);
 }
 
+// Presents frame and spends what's left of it on gc
+static void _present(double step_t) {
+	profiler_zone_enter("present");
+	if(pre_render_cb)
+		(*pre_render_cb)();
+
+	// Measured before present, time blocked on vsync is slack. Gc of the
+	// previous frame ran after its present, so it was taken from this
+	// frame and counts as work too.
+	float work_ms = (profiler_time_micros() - step_t) / 1000.0;
+	work_ms += malka_gc_stats()->ms;
+
+	video_present();
+	profiler_zone_leave();
+
+	profiler_zone_enter("gc");
+	malka_gc_frame(work_ms);
+	profiler_zone_leave();
+}
+
 bool dgreed_sleeping = false;
 bool malka_states_step(void) {
 	assert(states_in_mainloop);
 	lua_State* l = malka_lua_state();
+	double step_t = profiler_time_micros();
 
 	if(dgreed_sleeping) {
 		// Do nothing
@@ -804,31 +854,34 @@ bool malka_states_step(void) {
 			float tt = -1.0f + t;
 			_call_state_func(l, _names_get(states_from), "render", &t, NULL, NULL);
 			_call_state_func(l, _names_get(states_to), "render", &tt, NULL, NULL);
-			if(pre_render_cb)
-				(*pre_render_cb)();
-			video_present();
+			_present(step_t);
 		}
 	}
 	else {
 		if(_stack_size()) {
 			top_name = _names_get(_stack_get(_stack_size()-1));
-			if(!_call_state_func(l, top_name, "update", NULL, NULL, NULL)) {
+			profiler_zone_enter("update");
+			bool updated = _call_state_func(l, top_name, "update", NULL, NULL, NULL);
+			profiler_zone_leave();
+			if(!updated) {
 				breakout = true;
 			}
 			else {
 				// Update may have made stack empty, check again
 				if(_stack_size()) {
 					float zero = 0.0f;
+					profiler_zone_enter("render");
 					breakout = !_call_state_func(l, top_name, "render", &zero, NULL, NULL);
-					if(pre_render_cb)
-						(*pre_render_cb)();
-					video_present();
+					profiler_zone_leave();
+					_present(step_t);
 				}
 			}	
 		}
 	}
+	profiler_zone_enter("system_update");
 	if(!system_update())
 		breakout = true;
+	profiler_zone_leave();
 
 	return !breakout && (_stack_size() || _in_transition());
 }
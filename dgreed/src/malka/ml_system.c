@@ -1,3 +1,4 @@
+#include "malka.h"
 #include "ml_common.h"
 
 #include "lua/lauxlib.h"
@@ -18,6 +19,11 @@ extern void _new_rect(lua_State* l, double _l, double t,
 	double r, double b);
 extern void _new_rgba(lua_State* l, double r, double g,
 	double b, double a);
+extern bool _get_vec2(lua_State* l, int i, double* out);
+extern bool _get_rect(lua_State* l, int i, double* out);
+extern bool _get_rgba(lua_State* l, int i, double* out);
+
+bool _check_vec2(lua_State* l, int i, Vector2* v);
 
 // time
 
@@ -185,13 +191,10 @@ static int ml_font_rect(lua_State* l) {
 	FontHandle* h = checkfonthandle(l, 1);
 	const char* text = luaL_checkstring(l, 2);
 
-	lua_getfield(l, 3, "x");
-	lua_getfield(l, 3, "y");
-
-	double x = luaL_checknumber(l, 4);
-	double y = luaL_checknumber(l, 5);
+	Vector2 p;
+	if(!_check_vec2(l, 3, &p))
+		return luaL_error(l, "bad position provided to font.rect");
 
-	Vector2 p = vec2((float)x, (float)y);
 	RectF r = font_rect_ex(*h, text, &p, (float)scale);
 
 	_new_rect(l, (float)r.left, (float)r.top, 
@@ -294,25 +297,16 @@ static int ml_video_close(lua_State* l) {
 }	
 
 bool _check_color(lua_State* l, int i, Color* c) {
-	lua_getfield(l, i, "r");
-	lua_getfield(l, i, "g");
-	lua_getfield(l, i, "b");
-	lua_getfield(l, i, "a");
-
-	if(lua_isnumber(l, -1) && lua_isnumber(l, -2) 
-		&& lua_isnumber(l, -3) && lua_isnumber(l, -4)) {
-		uint r = lrintf(lua_tonumber(l, -4)*255.0) & 0xFF;
-		uint g = lrintf(lua_tonumber(l, -3)*255.0) & 0xFF;
-		uint b = lrintf(lua_tonumber(l, -2)*255.0) & 0xFF;
-		uint a = lrintf(lua_tonumber(l, -1)*255.0) & 0xFF;
-		*c = COLOR_RGBA(r, g, b, a);
-		lua_pop(l, 4);
-		return true;
-	}
-	else {
-		lua_pop(l, 4);
+	double rgba[4];
+	if(!_get_rgba(l, i, rgba))
 		return false;
-	}
+
+	uint r = lrint(rgba[0]*255.0) & 0xFF;
+	uint g = lrint(rgba[1]*255.0) & 0xFF;
+	uint b = lrint(rgba[2]*255.0) & 0xFF;
+	uint a = lrint(rgba[3]*255.0) & 0xFF;
+	*c = COLOR_RGBA(r, g, b, a);
+	return true;
 }
 
 static int ml_video_clear_color(lua_State* l) {
@@ -335,37 +329,22 @@ static int ml_video_present(lua_State* l) {
 }
 
 bool _check_vec2(lua_State* l, int i, Vector2* v) {
-	if(lua_objlen(l, i) == 2) {
-		lua_rawgeti(l, i, 1);
-		lua_rawgeti(l, i, 2);
-
-		v->x = lua_tonumber(l, -2);
-		v->y = lua_tonumber(l, -1);
-		lua_pop(l, 2);
-		return true;
-	}
-	else {
+	double xy[2];
+	if(!_get_vec2(l, i, xy))
 		return false;
-	}
+
+	v->x = xy[0];
+	v->y = xy[1];
+	return true;
 }
 
 bool _check_rect(lua_State* l, int i, RectF* r) {
-	if(lua_objlen(l, i) == 4) {
-		lua_rawgeti(l, i, 1);
-		lua_rawgeti(l, i, 2);
-		lua_rawgeti(l, i, 3);
-		lua_rawgeti(l, i, 4);
-
-		r->left = lua_tonumber(l, -4);
-		r->top = lua_tonumber(l, -3);
-		r->right = lua_tonumber(l, -2);
-		r->bottom = lua_tonumber(l, -1);
-		lua_pop(l, 4);
-		return true;
-	}
-	else {
+	double ltrb[4];
+	if(!_get_rect(l, i, ltrb))
 		return false;
-	}
+
+	*r = rectf(ltrb[0], ltrb[1], ltrb[2], ltrb[3]);
+	return true;
 }
 
 static bool _get_dest(lua_State* l, int i, RectF* dest) {
@@ -382,6 +361,29 @@ static bool _get_dest(lua_State* l, int i, RectF* dest) {
 	return false;
 }
 
+// Batches are flat arrays of numbers, stride numbers per item.
+
+// Returns number of items in batch at index i,
+// count can be optionally provided at index c
+uint _check_batch(lua_State* l, int i, int c, uint stride) {
+	luaL_checktype(l, i, LUA_TTABLE);
+	uint len = lua_objlen(l, i);
+	if(lua_isnoneornil(l, c))
+		return len / stride;
+
+	int count = luaL_checkinteger(l, c);
+	if(count < 0)
+		luaL_error(l, "negative batch item count %d", count);
+	if((uint)count > len / stride)
+		luaL_error(l, "batch has less than %d items", count);
+	return count;
+}
+
+// Reads numbers of item-th entry of batch at index i
+void _read_batch(lua_State* l, int i, uint item, uint stride, float* out) {
+	malka_read_numbers(l, i, item * stride, stride, out);
+}
+
 static int ml_video_draw_rect(lua_State* l) {
 	TexHandle* h = checktexhandle(l, 1);
 	uint layer = luaL_checkinteger(l, 2);
@@ -785,6 +787,40 @@ static int ml_video_set_transform(lua_State* l) {
 	return 0;
 }
 
+// Each item is source l, t, r, b, destination l, t, r, b and rotation
+#define RECT_BATCH_STRIDE 9
+
+static int ml_video_draw_rect_batch(lua_State* l) {
+	int n = lua_gettop(l);
+	if(n < 3 || n > 5)
+		return luaL_error(l, "wrong number of arguments provided to video.draw_rect_batch");
+
+	TexHandle* h = checktexhandle(l, 1);
+	uint layer = luaL_checkinteger(l, 2);
+	if(layer > 15)
+		return luaL_error(l, "bad argument provided to video.draw_rect_batch");
+
+	uint count = _check_batch(l, 3, 4, RECT_BATCH_STRIDE);
+
+	Color c = COLOR_WHITE;
+	if(n == 5 && !_check_color(l, 5, &c))
+		return luaL_error(l, "bad argument provided to video.draw_rect_batch");
+
+	for(uint i = 0; i < count; ++i) {
+		float v[RECT_BATCH_STRIDE];
+		_read_batch(l, 3, i, RECT_BATCH_STRIDE, v);
+
+		RectF src = rectf(v[0], v[1], v[2], v[3]);
+		RectF dest = rectf(v[4], v[5], v[6], v[7]);
+		if(v[8] == 0.0f)
+			video_draw_rect(*h, layer, &src, &dest, c);
+		else
+			video_draw_rect_rotated(*h, layer, &src, &dest, v[8], c);
+	}
+
+	return 0;
+}
+
 static const luaL_Reg video_fun[] = {
 	{"native_resolution", ml_video_native_resolution},
 	{"init", ml_video_init},
@@ -795,6 +831,7 @@ static const luaL_Reg video_fun[] = {
 	{"present", ml_video_present},
 	{"draw_rect", ml_video_draw_rect},
 	{"draw_rect_centered", ml_video_draw_rect_centered},
+	{"draw_rect_batch", ml_video_draw_rect_batch},
 	{"draw_seg", ml_video_draw_seg},
 	{"draw_text", ml_video_draw_text},
 	{"draw_text_centered", ml_video_draw_text_centered},
@@ -7,265 +7,532 @@
 #include <memory.h>
 #include <time.h>
 
-// 2d vectors
+// Value types - vectors, rectangles and colors.
+// Each one is a small full userdata with double components instead of
+// a table: one allocation without array/hash parts, and bindings can read
+// the components directly. Plain tables ({x, y}/{l, t, r, b} arrays or
+// tables with named fields) are still accepted wherever a value is read.
+
+enum {
+	ML_VEC2 = 0,
+	ML_RECT,
+	ML_RGBA,
+	ML_HSVA
+};
 
-void _new_vec2(lua_State* l, double x, double y) {
-	lua_createtable(l, 2, 0);
-	int table = lua_gettop(l);
-	lua_pushnumber(l, y);
-	lua_pushnumber(l, x);
-	lua_rawseti(l, table, 1);
-	lua_rawseti(l, table, 2);
-	luaL_getmetatable(l, "_vec2.mt");
+typedef struct {
+	const char* name;
+	const char* mt_name;
+	uint n;
+	const char* fields[4];
+	// Accept {x, y}/{l, t, r, b} arrays; colors are read by field names
+	// only, otherwise a rect would pass as a color
+	bool array_fallback;
+	// Metatable, filled when type is registered
+	const void* mt;
+	int mt_ref;
+} MLValueType;
+
+static MLValueType ml_types[] = {
+	{"vec2", "_vec2.mt", 2, {"x", "y"}, true, NULL, LUA_NOREF},
+	{"rect", "_rect.mt", 4, {"l", "t", "r", "b"}, true, NULL, LUA_NOREF},
+	{"rgba", "_color_rgba.mt", 4, {"r", "g", "b", "a"}, false, NULL, LUA_NOREF},
+	{"hsva", "_color_hsva.mt", 4, {"h", "s", "v", "a"}, false, NULL, LUA_NOREF}
+};
+
+static double* _new_value(lua_State* l, uint type) {
+	const MLValueType* t = &ml_types[type];
+	double* v = lua_newuserdata(l, t->n * sizeof(double));
+	lua_rawgeti(l, LUA_REGISTRYINDEX, t->mt_ref);
 	lua_setmetatable(l, -2);
+	return v;
 }
 
-static int ml_vec2(lua_State* l) {
-	int n = lua_gettop(l);
-	if(n == 0) {
-		_new_vec2(l, 0.0, 0.0);
+// Returns components of value at index i, if it is userdata of given type
+static double* _value_ptr(lua_State* l, int i, uint type) {
+	if(lua_type(l, i) != LUA_TUSERDATA || !lua_getmetatable(l, i))
+		return NULL;
+	const void* mt = lua_topointer(l, -1);
+	lua_pop(l, 1);
+	return mt == ml_types[type].mt ? lua_touserdata(l, i) : NULL;
+}
+
+static bool _read_value(lua_State* l, int i, uint type, double* out) {
+	const MLValueType* t = &ml_types[type];
+
+	double* v = _value_ptr(l, i, type);
+	if(v) {
+		memcpy(out, v, t->n * sizeof(double));
+		return true;
 	}
-	else if(n == 2) {
-		double x = luaL_checknumber(l, 1);
-		double y = luaL_checknumber(l, 2);
-		_new_vec2(l, x, y);
+
+	if(!lua_istable(l, i))
+		return false;
+
+	if(i < 0 && i > LUA_REGISTRYINDEX)
+		i = lua_gettop(l) + i + 1;
+
+	if(t->array_fallback && lua_objlen(l, i) == t->n) {
+		for(uint j = 0; j < t->n; ++j) {
+			lua_rawgeti(l, i, j+1);
+			out[j] = lua_tonumber(l, -1);
+			lua_pop(l, 1);
+		}
+		return true;
 	}
-	else if(n == 1) {
-		luaL_checktype(l, 1, LUA_TTABLE);
-		lua_rawgeti(l, 1, 1);
-		lua_rawgeti(l, 1, 2);
-		double x = luaL_checknumber(l, 2);
-		double y = luaL_checknumber(l, 3);
-		_new_vec2(l, x, y);
+
+	bool res = true;
+	for(uint j = 0; j < t->n && res; ++j) {
+		lua_getfield(l, i, t->fields[j]);
+		res = lua_isnumber(l, -1);
+		out[j] = lua_tonumber(l, -1);
+		lua_pop(l, 1);
 	}
-	else
-		return luaL_error(l, "wrong number of arguments provided to vec2");
-	return 1;	
+	return res;
 }
 
-static int ml_vec2_from_str(lua_State* l) {
-	checkargs(1, "vec2_from_str");
+static void _arg_value(lua_State* l, int i, uint type, double* out) {
+	if(!_read_value(l, i, type, out))
+		luaL_typerror(l, i, ml_types[type].name);
+}
 
-	const char* str = luaL_checkstring(l, 1);
+static double* _arg_self(lua_State* l, uint type) {
+	double* v = _value_ptr(l, 1, type);
+	if(!v)
+		luaL_typerror(l, 1, ml_types[type].name);
+	return v;
+}
 
-	double x, y;
-	sscanf(str, "%lf,%lf", &x, &y);
-	_new_vec2(l, x, y);
+// Used by other bindings to read values without going through Lua tables
+bool _get_vec2(lua_State* l, int i, double* out) {
+	return _read_value(l, i, ML_VEC2, out);
+}
 
-	return 1;
+bool _get_rect(lua_State* l, int i, double* out) {
+	return _read_value(l, i, ML_RECT, out);
 }
 
-static int ml_dot(lua_State* l) {
-	checkargs(2, "dot");
-	
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
+bool _get_rgba(lua_State* l, int i, double* out) {
+	return _read_value(l, i, ML_RGBA, out);
+}
+
+// Maps field name or 1-based index at stack index k to component,
+// returns -1 if there is no such component
+static int _field_index(lua_State* l, int k, uint type) {
+	const MLValueType* t = &ml_types[type];
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
+	if(lua_type(l, k) == LUA_TNUMBER) {
+		int i = lua_tointeger(l, k) - 1;
+		return i >= 0 && i < t->n ? i : -1;
+	}
+
+	size_t len;
+	const char* key = lua_tolstring(l, k, &len);
+	if(key && len == 1) {
+		for(uint i = 0; i < t->n; ++i) {
+			if(t->fields[i][0] == key[0])
+				return i;
+		}
+	}
+	return -1;
+}
 
-	double x1 = luaL_checknumber(l, 3);
-	double y1 = luaL_checknumber(l, 4);
-	double x2 = luaL_checknumber(l, 5);
-	double y2 = luaL_checknumber(l, 6);
+// Generic metamethods and methods, type is upvalue 1,
+// methods table is upvalue 2
 
-	lua_pushnumber(l, x1*x2 + y1*y2);
+#define value_type() ((uint)lua_tointeger(l, lua_upvalueindex(1)))
+
+static int ml_value_index(lua_State* l) {
+	uint type = value_type();
+	double* v = lua_touserdata(l, 1);
+
+	int i = _field_index(l, 2, type);
+	if(i >= 0) {
+		lua_pushnumber(l, v[i]);
+		return 1;
+	}
+
+	lua_pushvalue(l, 2);
+	lua_rawget(l, lua_upvalueindex(2));
 	return 1;
 }
 
-static int ml_length(lua_State* l) {
-	checkargs(1, "length");
+static int ml_value_newindex(lua_State* l) {
+	uint type = value_type();
+	double* v = lua_touserdata(l, 1);
+
+	int i = _field_index(l, 2, type);
+	if(i >= 0)
+		v[i] = luaL_checknumber(l, 3);
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-#endif
+	return 0;
+}
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+static int ml_value_len(lua_State* l) {
+	lua_pushinteger(l, ml_types[value_type()].n);
+	return 1;
+}
 
-	double x = luaL_checknumber(l, 2);
-	double y = luaL_checknumber(l, 3);
+static int ml_value_eq(lua_State* l) {
+	uint type = value_type();
+	double* a = _value_ptr(l, 1, type);
+	double* b = _value_ptr(l, 2, type);
 
-	lua_pushnumber(l, sqrt(x*x + y*y));
+	bool res = a && b;
+	for(uint i = 0; i < ml_types[type].n && res; ++i)
+		res = a[i] == b[i];
+
+	lua_pushboolean(l, res);
 	return 1;
 }
 
-static int ml_length_sq(lua_State* l) {
-	checkargs(1, "length_sq");
+static int ml_value_tostring(lua_State* l) {
+	uint type = value_type();
+	const char* name = ml_types[type].name;
+	double* v = lua_touserdata(l, 1);
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-#endif
+	if(ml_types[type].n == 2)
+		lua_pushfstring(l, "%s(%f, %f)", name, v[0], v[1]);
+	else
+		lua_pushfstring(l, "%s(%f, %f, %f, %f)", name, v[0], v[1], v[2], v[3]);
+	return 1;
+}
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+// Component-wise arithmetic, scalar operand is allowed for * and /
+static int _value_arith(lua_State* l, char op) {
+	uint type = value_type();
+	uint n = ml_types[type].n;
+	bool scalar_ok = op == '*' || op == '/';
 
-	double x = luaL_checknumber(l, 2);
-	double y = luaL_checknumber(l, 3);
+	double a[4], b[4];
+	if(op == '*' && lua_isnumber(l, 1)) {
+		for(uint i = 0; i < n; ++i)
+			a[i] = lua_tonumber(l, 1);
+		_arg_value(l, 2, type, b);
+	}
+	else {
+		_arg_value(l, 1, type, a);
+		if(scalar_ok && lua_isnumber(l, 2)) {
+			for(uint i = 0; i < n; ++i)
+				b[i] = lua_tonumber(l, 2);
+		}
+		else {
+			_arg_value(l, 2, type, b);
+		}
+	}
 
-	lua_pushnumber(l, x*x + y*y);
+	double* r = _new_value(l, type);
+	for(uint i = 0; i < n; ++i) {
+		switch(op) {
+			case '+': r[i] = a[i] + b[i]; break;
+			case '-': r[i] = a[i] - b[i]; break;
+			case '*': r[i] = a[i] * b[i]; break;
+			case '/': r[i] = a[i] / b[i]; break;
+		}
+	}
 	return 1;
 }
 
-static int ml_normalize(lua_State* l) {
-	checkargs(1, "normalize"); 
+static int ml_value_add(lua_State* l) {
+	return _value_arith(l, '+');
+}
+
+static int ml_value_sub(lua_State* l) {
+	return _value_arith(l, '-');
+}
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-#endif
+static int ml_value_mul(lua_State* l) {
+	return _value_arith(l, '*');
+}
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+static int ml_value_div(lua_State* l) {
+	return _value_arith(l, '/');
+}
 
-	double x = luaL_checknumber(l, 2);
-	double y = luaL_checknumber(l, 3);
-	double inv_len = 1.0 / sqrt(x*x + y*y);
+static int ml_value_unm(lua_State* l) {
+	uint type = value_type();
+	double a[4];
+	_arg_value(l, 1, type, a);
 
-	_new_vec2(l, x * inv_len, y * inv_len);
+	double* r = _new_value(l, type);
+	for(uint i = 0; i < ml_types[type].n; ++i)
+		r[i] = -a[i];
 	return 1;
 }
 
-static int ml_rotate(lua_State* l) {
-	checkargs(2, "rotate");
+// In-place methods, all of them return self to allow chaining
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-#endif
+static int ml_value_set(lua_State* l) {
+	uint type = value_type();
+	uint n = ml_types[type].n;
+	double* v = _arg_self(l, type);
 
-	double angle = luaL_checknumber(l, 2);
+	if(lua_gettop(l) == 2) {
+		_arg_value(l, 2, type, v);
+	}
+	else {
+		for(uint i = 0; i < n; ++i)
+			v[i] = luaL_checknumber(l, i+2);
+	}
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+	lua_settop(l, 1);
+	return 1;
+}
 
-	double x = luaL_checknumber(l, 3);
-	double y = luaL_checknumber(l, 4);
-	double s = sin(angle);
-	double c = cos(angle);
+static int ml_value_copy(lua_State* l) {
+	uint type = value_type();
+	double* v = _arg_self(l, type);
 
-	_new_vec2(l, c*x - s*y, s*x + c*y);
+	double* r = _new_value(l, type);
+	memcpy(r, v, ml_types[type].n * sizeof(double));
 	return 1;
 }
 
-static int ml_add(lua_State* l) {
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-#endif
+static int ml_value_unpack(lua_State* l) {
+	uint type = value_type();
+	uint n = ml_types[type].n;
+	double* v = _arg_self(l, type);
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
+	for(uint i = 0; i < n; ++i)
+		lua_pushnumber(l, v[i]);
+	return n;
+}
 
-	double x1 = luaL_checknumber(l, 3);
-	double y1 = luaL_checknumber(l, 4);
-	double x2 = luaL_checknumber(l, 5);
-	double y2 = luaL_checknumber(l, 6);
+static int _value_arith_self(lua_State* l, char op) {
+	uint type = value_type();
+	uint n = ml_types[type].n;
+	double* v = _arg_self(l, type);
+
+	double o[4];
+	if(op == '*')
+		for(uint i = 0; i < n; ++i)
+			o[i] = luaL_checknumber(l, 2);
+	else
+		_arg_value(l, 2, type, o);
+
+	for(uint i = 0; i < n; ++i) {
+		switch(op) {
+			case '+': v[i] += o[i]; break;
+			case '-': v[i] -= o[i]; break;
+			case '*': v[i] *= o[i]; break;
+		}
+	}
 
-	_new_vec2(l, x1+x2, y1+y2);
+	lua_settop(l, 1);
 	return 1;
 }
 
-static int ml_sub(lua_State* l) {
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-#endif
+static int ml_value_add_self(lua_State* l) {
+	return _value_arith_self(l, '+');
+}
+
+static int ml_value_sub_self(lua_State* l) {
+	return _value_arith_self(l, '-');
+}
+
+static int ml_value_scale_self(lua_State* l) {
+	return _value_arith_self(l, '*');
+}
+
+double _lerp(double a, double b, double t) {
+	return a + (b-a)*t;
+}
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
+static int ml_value_lerp_self(lua_State* l) {
+	uint type = value_type();
+	double* v = _arg_self(l, type);
 
-	double x1 = luaL_checknumber(l, 3);
-	double y1 = luaL_checknumber(l, 4);
-	double x2 = luaL_checknumber(l, 5);
-	double y2 = luaL_checknumber(l, 6);
+	double o[4];
+	_arg_value(l, 2, type, o);
+	double t = luaL_checknumber(l, 3);
+
+	for(uint i = 0; i < ml_types[type].n; ++i)
+		v[i] = _lerp(v[i], o[i], t);
 
-	_new_vec2(l, x1-x2, y1-y2);
+	lua_settop(l, 1);
 	return 1;
 }
 
-static int ml_mul(lua_State* l) {
-	double s = luaL_checknumber(l, 2);
+static const luaL_Reg value_mt[] = {
+	{"__index", ml_value_index},
+	{"__newindex", ml_value_newindex},
+	{"__len", ml_value_len},
+	{"__eq", ml_value_eq},
+	{"__tostring", ml_value_tostring},
+	{NULL, NULL}
+};
+
+static const luaL_Reg value_arith_mt[] = {
+	{"__add", ml_value_add},
+	{"__sub", ml_value_sub},
+	{"__mul", ml_value_mul},
+	{"__div", ml_value_div},
+	{"__unm", ml_value_unm},
+	{NULL, NULL}
+};
+
+static const luaL_Reg value_methods[] = {
+	{"set", ml_value_set},
+	{"copy", ml_value_copy},
+	{"unpack", ml_value_unpack},
+	{NULL, NULL}
+};
+
+static const luaL_Reg value_arith_methods[] = {
+	{"add", ml_value_add_self},
+	{"sub", ml_value_sub_self},
+	{"scale", ml_value_scale_self},
+	{"lerp", ml_value_lerp_self},
+	{NULL, NULL}
+};
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+// Registers metatable for type, every function from the lists gets type
+// and methods table as upvalues
+static void _open_value_type(lua_State* l, uint type, bool arith,
+	const luaL_Reg* methods) {
+	MLValueType* t = &ml_types[type];
 
-	double x = luaL_checknumber(l, 3);
-	double y = luaL_checknumber(l, 4);
+	luaL_newmetatable(l, t->mt_name);
+	int meta = lua_gettop(l);
+	lua_newtable(l);
+	int funs = lua_gettop(l);
 
-	_new_vec2(l, x*s, y*s);
+	const luaL_Reg* lists[] = {
+		value_mt, arith ? value_arith_mt : NULL,
+		value_methods, arith ? value_arith_methods : NULL, methods
+	};
+	for(uint i = 0; i < ARRAY_SIZE(lists); ++i) {
+		if(!lists[i])
+			continue;
+		lua_pushvalue(l, i < 2 ? meta : funs);
+		lua_pushinteger(l, type);
+		lua_pushvalue(l, funs);
+		luaL_openlib(l, NULL, lists[i], 2);
+		lua_pop(l, 1);
+	}
+	lua_pop(l, 1);
+
+	t->mt = lua_topointer(l, meta);
+	t->mt_ref = luaL_ref(l, LUA_REGISTRYINDEX);
+}
+
+// 2d vectors
+
+void _new_vec2(lua_State* l, double x, double y) {
+	double* v = _new_value(l, ML_VEC2);
+	v[0] = x;
+	v[1] = y;
+}
+
+static int ml_vec2(lua_State* l) {
+	int n = lua_gettop(l);
+	if(n == 0) {
+		_new_vec2(l, 0.0, 0.0);
+	}
+	else if(n == 2) {
+		double x = luaL_checknumber(l, 1);
+		double y = luaL_checknumber(l, 2);
+		_new_vec2(l, x, y);
+	}
+	else if(n == 1) {
+		double v[2];
+		_arg_value(l, 1, ML_VEC2, v);
+		_new_vec2(l, v[0], v[1]);
+	}
+	else
+		return luaL_error(l, "wrong number of arguments provided to vec2");
 	return 1;
 }
 
-static int ml_div(lua_State* l) {
-	double s = luaL_checknumber(l, 2);
+static int ml_vec2_from_str(lua_State* l) {
+	checkargs(1, "vec2_from_str");
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+	const char* str = luaL_checkstring(l, 1);
 
-	double x = luaL_checknumber(l, 3);
-	double y = luaL_checknumber(l, 4);
+	double x, y;
+	sscanf(str, "%lf,%lf", &x, &y);
+	_new_vec2(l, x, y);
 
-	_new_vec2(l, x/s, y/s);
 	return 1;
 }
 
-static int ml_negate(lua_State* l) {
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+static int ml_dot(lua_State* l) {
+	checkargs(2, "dot");
 
-	// Why the hell 3, 4 works and 2, 3 doesn't?
-	double x = luaL_checknumber(l, 3);
-	double y = luaL_checknumber(l, 4);
+	double a[2], b[2];
+	_arg_value(l, 1, ML_VEC2, a);
+	_arg_value(l, 2, ML_VEC2, b);
 
-	_new_vec2(l, -x, -y);
+	lua_pushnumber(l, a[0]*b[0] + a[1]*b[1]);
 	return 1;
 }
 
-static int ml_vec2_tostring(lua_State* l) {
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
+static int ml_length(lua_State* l) {
+	checkargs(1, "length");
+
+	double v[2];
+	_arg_value(l, 1, ML_VEC2, v);
 
-	double x = luaL_checknumber(l, 2);
-	double y = luaL_checknumber(l, 3);
-	lua_pushfstring(l, "vec2(%f, %f)", x, y);
+	lua_pushnumber(l, sqrt(v[0]*v[0] + v[1]*v[1]));
 	return 1;
 }
 
-static int ml_vec2_index(lua_State* l) {
-	const char* key = luaL_checkstring(l, 2);
-	assert(strlen(key) == 1);
+static int ml_length_sq(lua_State* l) {
+	checkargs(1, "length_sq");
 
-	if(key[0] == 'x') {
-		lua_rawgeti(l, 1, 1);
-		return 1;
-	}
+	double v[2];
+	_arg_value(l, 1, ML_VEC2, v);
 
-	if(key[0] == 'y') {
-		lua_rawgeti(l, 1, 2);
-		return 1;
-	}
+	lua_pushnumber(l, v[0]*v[0] + v[1]*v[1]);
+	return 1;
+}
 
-	return 0;
+static void _normalize(double* v) {
+	double inv_len = 1.0 / sqrt(v[0]*v[0] + v[1]*v[1]);
+	v[0] *= inv_len;
+	v[1] *= inv_len;
+}
+
+static void _rotate(double* v, double angle) {
+	double s = sin(angle);
+	double c = cos(angle);
+	double x = v[0], y = v[1];
+	v[0] = c*x - s*y;
+	v[1] = s*x + c*y;
 }
 
-static int ml_vec2_newindex(lua_State* l) {
-	const char* key = luaL_checkstring(l, 2);
-	assert(strlen(key) == 1);
+static int ml_normalize(lua_State* l) {
+	checkargs(1, "normalize");
 
-	if(key[0] == 'x') {
-		lua_rawseti(l, 1, 1);
-	}
+	double v[2];
+	_arg_value(l, 1, ML_VEC2, v);
+	_normalize(v);
 
-	if(key[0] == 'y') {
-		lua_rawseti(l, 1, 2);
-	}
+	_new_vec2(l, v[0], v[1]);
+	return 1;
+}
 
-	return 0;
+static int ml_rotate(lua_State* l) {
+	checkargs(2, "rotate");
+
+	double v[2];
+	_arg_value(l, 1, ML_VEC2, v);
+	_rotate(v, luaL_checknumber(l, 2));
+
+	_new_vec2(l, v[0], v[1]);
+	return 1;
+}
+
+static int ml_vec2_normalize_self(lua_State* l) {
+	_normalize(_arg_self(l, ML_VEC2));
+	lua_settop(l, 1);
+	return 1;
+}
+
+static int ml_vec2_rotate_self(lua_State* l) {
+	_rotate(_arg_self(l, ML_VEC2), luaL_checknumber(l, 2));
+	lua_settop(l, 1);
+	return 1;
 }
 
 static const luaL_Reg vec2_fun[] = {
@@ -279,26 +546,15 @@ static const luaL_Reg vec2_fun[] = {
 	{NULL, NULL}
 };
 
-static const luaL_Reg vec2_mt[] = {
-	{"__add", ml_add},
-	{"__sub", ml_sub},
-	{"__mul", ml_mul},
-	{"__div", ml_div},
-	{"__unm", ml_negate},
-	{"__tostring", ml_vec2_tostring},
-	{"__index", ml_vec2_index},
-	{"__newindex", ml_vec2_newindex},
+static const luaL_Reg vec2_methods[] = {
+	{"normalize", ml_vec2_normalize_self},
+	{"rotate", ml_vec2_rotate_self},
 	{NULL, NULL}
 };
 
 int malka_open_vec2(lua_State* l) {
 	// metatable
-	luaL_newmetatable(l, "_vec2.mt");
-	//lua_pushvalue(l, -1);
-	//lua_setfield(l, -2, "__index");
-	luaL_register(l, NULL, vec2_mt);
-
-	lua_pop(l, 1);
+	_open_value_type(l, ML_VEC2, true, vec2_methods);
 
 	// functions
 	// register manually, to appear globally
@@ -315,18 +571,23 @@ int malka_open_vec2(lua_State* l) {
 
 void _new_rect(lua_State* l, double _l, double t,
 	double r, double b) {
-	lua_createtable(l, 4, 0);
-	int table = lua_gettop(l);
-	lua_pushnumber(l, b);
-	lua_pushnumber(l, r);
-	lua_pushnumber(l, t);
-	lua_pushnumber(l, _l);
-	lua_rawseti(l, table, 1);
-	lua_rawseti(l, table, 2);
-	lua_rawseti(l, table, 3);
-	lua_rawseti(l, table, 4);
-	luaL_getmetatable(l, "_rect.mt");
-	lua_setmetatable(l, -2);
+	double* v = _new_value(l, ML_RECT);
+	v[0] = _l;
+	v[1] = t;
+	v[2] = r;
+	v[3] = b;
+}
+
+static void _arg_rectf(lua_State* l, int i, RectF* r) {
+	double v[4];
+	_arg_value(l, i, ML_RECT, v);
+	*r = rectf(v[0], v[1], v[2], v[3]);
+}
+
+static void _arg_vector2(lua_State* l, int i, Vector2* p) {
+	double v[2];
+	_arg_value(l, i, ML_VEC2, v);
+	*p = vec2(v[0], v[1]);
 }
 
 static int ml_rect(lua_State* l) {
@@ -347,20 +608,13 @@ static int ml_rect(lua_State* l) {
 		_new_rect(l, _l, t, r, b);
 	}
 	else if(n == 1) {
-		luaL_checktype(l, 1, LUA_TTABLE);
-		lua_rawgeti(l, 1, 1);
-		lua_rawgeti(l, 1, 2);
-		lua_rawgeti(l, 1, 3);
-		lua_rawgeti(l, 1, 4);
-		double _l = luaL_checknumber(l, 2);
-		double t = luaL_checknumber(l, 3);
-		double r = luaL_checknumber(l, 4);
-		double b = luaL_checknumber(l, 5);
-		_new_rect(l, _l, t, r, b);
+		double v[4];
+		_arg_value(l, 1, ML_RECT, v);
+		_new_rect(l, v[0], v[1], v[2], v[3]);
 	}
 	else
 		return luaL_error(l, "wrong number of arguments provided to rect");
-	return 1;	
+	return 1;
 }
 
 static int ml_rect_from_str(lua_State* l) {
@@ -383,17 +637,10 @@ static int ml_rect_from_str(lua_State* l) {
 static int ml_width(lua_State* l) {
 	checkargs(1, "width");
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-#endif
+	double v[4];
+	_arg_value(l, 1, ML_RECT, v);
 
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 3);
-
-	double _l = luaL_checknumber(l, 2);
-	double r = luaL_checknumber(l, 3);
-
-	lua_pushnumber(l, r - _l);
+	lua_pushnumber(l, v[2] - v[0]);
 
 	return 1;
 }
@@ -401,116 +648,46 @@ static int ml_width(lua_State* l) {
 static int ml_height(lua_State* l) {
 	checkargs(1, "height");
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-#endif
-
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 4);
+	double v[4];
+	_arg_value(l, 1, ML_RECT, v);
 
-	double t = luaL_checknumber(l, 2);
-	double b = luaL_checknumber(l, 3);
-
-	lua_pushnumber(l, b - t);
+	lua_pushnumber(l, v[3] - v[1]);
 
 	return 1;
 }
 
 static int ml_rect_rect_collision(lua_State* l) {
 	checkargs(2, "rect_rect_collision");
-	
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-#endif
-
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 3);
-	lua_rawgeti(l, 1, 4);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
-	lua_rawgeti(l, 2, 3);
-	lua_rawgeti(l, 2, 4);
-
-	RectF rect1 = {
-		luaL_checknumber(l, 3),
-		luaL_checknumber(l, 4),
-		luaL_checknumber(l, 5),
-		luaL_checknumber(l, 6)
-	};
 
-	RectF rect2 = {
-		luaL_checknumber(l, 7),
-		luaL_checknumber(l, 8),
-		luaL_checknumber(l, 9),
-		luaL_checknumber(l, 10)
-	};
+	RectF rect1, rect2;
+	_arg_rectf(l, 1, &rect1);
+	_arg_rectf(l, 2, &rect2);
 
 	lua_pushboolean(l, rectf_rectf_collision(&rect1, &rect2));
 	return 1;
 }
 
 static int ml_rect_point_collision(lua_State* l) {
-	checkargs(2, "rect_point_collision");	
-
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-#endif
-
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 3);
-	lua_rawgeti(l, 1, 4);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
-
-	RectF rect = {
-		luaL_checknumber(l, 3),
-		luaL_checknumber(l, 4),
-		luaL_checknumber(l, 5),
-		luaL_checknumber(l, 6)
-	};
+	checkargs(2, "rect_point_collision");
 
-	Vector2 point = {
-		luaL_checknumber(l, 7),
-		luaL_checknumber(l, 8)
-	};
+	RectF rect;
+	Vector2 point;
+	_arg_rectf(l, 1, &rect);
+	_arg_vector2(l, 2, &point);
 
 	lua_pushboolean(l, rectf_contains_point(&rect, &point));
 	return 1;
 }
 
 static int ml_rect_circle_collision(lua_State* l) {
-	checkargs(3, "rect_circle_collision");	
-
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-#endif
-
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 3);
-	lua_rawgeti(l, 1, 4);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
+	checkargs(3, "rect_circle_collision");
 
+	RectF rect;
+	Vector2 point;
+	_arg_rectf(l, 1, &rect);
+	_arg_vector2(l, 2, &point);
 	float r = luaL_checknumber(l, 3);
 
-	RectF rect = {
-		luaL_checknumber(l, 4),
-		luaL_checknumber(l, 5),
-		luaL_checknumber(l, 6),
-		luaL_checknumber(l, 7)
-	};
-
-	Vector2 point = {
-		luaL_checknumber(l, 8),
-		luaL_checknumber(l, 9)
-	};
-
 	lua_pushboolean(l, rectf_circle_collision(&rect, &point, r));
 	return 1;
 }
@@ -518,47 +695,13 @@ static int ml_rect_circle_collision(lua_State* l) {
 static int ml_rect_tri_collision(lua_State* l) {
 	checkargs(4, "rect_tri_collision");
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-	luaL_checktype(l, 3, LUA_TTABLE);
-	luaL_checktype(l, 4, LUA_TTABLE);
-#endif
-
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 3);
-	lua_rawgeti(l, 1, 4);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
-	lua_rawgeti(l, 3, 1);
-	lua_rawgeti(l, 3, 2);
-	lua_rawgeti(l, 4, 1);
-	lua_rawgeti(l, 4, 2);
-
-	RectF rect = {
-		luaL_checknumber(l, 5),
-		luaL_checknumber(l, 6),
-		luaL_checknumber(l, 7),
-		luaL_checknumber(l, 8)
-	};
-
-	Vector2 a = {
-		luaL_checknumber(l, 9),
-		luaL_checknumber(l, 10)
-	};
+	RectF rect;
+	Triangle tri;
+	_arg_rectf(l, 1, &rect);
+	_arg_vector2(l, 2, &tri.p1);
+	_arg_vector2(l, 3, &tri.p2);
+	_arg_vector2(l, 4, &tri.p3);
 
-	Vector2 b = {
-		luaL_checknumber(l, 11),
-		luaL_checknumber(l, 12)
-	};
-
-	Vector2 c = {
-		luaL_checknumber(l, 13),
-		luaL_checknumber(l, 14)
-	};
-
-	Triangle tri = {a, b, c};
 	lua_pushboolean(l, tri_rectf_collision(&tri, &rect));
 	return 1;
 }
@@ -566,39 +709,13 @@ static int ml_rect_tri_collision(lua_State* l) {
 static int ml_rect_raycast(lua_State* l) {
 	checkargs(3, "rect_raycast");
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-	luaL_checktype(l, 3, LUA_TTABLE);
-#endif
-
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 3);
-	lua_rawgeti(l, 1, 4);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
-	lua_rawgeti(l, 3, 1);
-	lua_rawgeti(l, 3, 2);
-
-	RectF rect = {
-		luaL_checknumber(l, 4),
-		luaL_checknumber(l, 5),
-		luaL_checknumber(l, 6),
-		luaL_checknumber(l, 7)
-	};
-
-	Vector2 start = {
-		luaL_checknumber(l, 8),
-		luaL_checknumber(l, 9)
-	};
-
-	Vector2 end = {
-		luaL_checknumber(l, 10),
-		luaL_checknumber(l, 11)
-	};
+	RectF rect;
+	Vector2 start, end;
+	_arg_rectf(l, 1, &rect);
+	_arg_vector2(l, 2, &start);
+	_arg_vector2(l, 3, &end);
 
-	Vector2 hit = rectf_raycast(&rect, &start, &end);	
+	Vector2 hit = rectf_raycast(&rect, &start, &end);
 
 	_new_vec2(l, hit.x, hit.y);
 
@@ -608,41 +725,11 @@ static int ml_rect_raycast(lua_State* l) {
 static int ml_rect_rect_sweep(lua_State* l) {
 	checkargs(3, "rect_rect_sweep");
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-	luaL_checktype(l, 3, LUA_TTABLE);
-#endif
-
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 3);
-	lua_rawgeti(l, 1, 4);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
-	lua_rawgeti(l, 2, 3);
-	lua_rawgeti(l, 2, 4);
-	lua_rawgeti(l, 3, 1);
-	lua_rawgeti(l, 3, 2);
-
-	RectF a = {
-		luaL_checknumber(l, 4),
-		luaL_checknumber(l, 5),
-		luaL_checknumber(l, 6),
-		luaL_checknumber(l, 7)
-	};
-
-	RectF b = {
-		luaL_checknumber(l, 8),
-		luaL_checknumber(l, 9),
-		luaL_checknumber(l, 10),
-		luaL_checknumber(l, 11)
-	};
-
-	Vector2 offset = {
-		luaL_checknumber(l, 12),
-		luaL_checknumber(l, 13)
-	};
+	RectF a, b;
+	Vector2 offset;
+	_arg_rectf(l, 1, &a);
+	_arg_rectf(l, 2, &b);
+	_arg_vector2(l, 3, &offset);
 
 	Vector2 off = rectf_sweep(&a, &b, &offset);
 
@@ -651,115 +738,18 @@ static int ml_rect_rect_sweep(lua_State* l) {
 	return 1;
 }
 
-static int ml_rect_tostring(lua_State* l) {
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 1, 3);
-	lua_rawgeti(l, 1, 4);
-
-	double _l = luaL_checknumber(l, 2);
-	double t = luaL_checknumber(l, 3);
-	double r = luaL_checknumber(l, 4);
-	double b = luaL_checknumber(l, 5);
-
-	lua_pushfstring(l, "rect(%f, %f, %f, %f)", _l, t, r, b);
-	return 1;
-}
-
-static int ml_rect_index(lua_State* l) {
-	const char* key = luaL_checkstring(l, 2);
-	assert(strlen(key) == 1);
-
-	if(key[0] == 'l') {
-		lua_rawgeti(l, 1, 1);
-		return 1;
-	}
-
-	if(key[0] == 't') {
-		lua_rawgeti(l, 1, 2);
-		return 1;
-	}
-
-	if(key[0] == 'r') {
-		lua_rawgeti(l, 1, 3);
-		return 1;
-	}
-
-	if(key[0] == 'b') {
-		lua_rawgeti(l, 1, 4);
-		return 1;
-	}
-
-	return 0;
-}
-
-static int ml_rect_newindex(lua_State* l) {
-	const char* key = luaL_checkstring(l, 2);
-	assert(strlen(key) == 1);
-
-	if(key[0] == 'l') {
-		lua_rawseti(l, 1, 1);
-	}
-
-	if(key[0] == 't') {
-		lua_rawseti(l, 1, 2);
-	}
-
-	if(key[0] == 'r') {
-		lua_rawseti(l, 1, 3);
-	}
-
-	if(key[0] == 'b') {
-		lua_rawseti(l, 1, 4);
-	}
-
-	return 0;
-}
-
 static int ml_segment_intersect(lua_State* l) {
 	checkargs(4, "segment_intersect");
-	
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-	luaL_checktype(l, 3, LUA_TTABLE);
-	luaL_checktype(l, 4, LUA_TTABLE);
-#endif
-	
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
-	lua_rawgeti(l, 3, 1);
-	lua_rawgeti(l, 3, 2);
-	lua_rawgeti(l, 4, 1);
-	lua_rawgeti(l, 4, 2);
-
-	Vector2 a1 = {
-		luaL_checknumber(l, 5),
-		luaL_checknumber(l, 6)
-	};
-
-	Vector2 a2 = {
-		luaL_checknumber(l, 7),
-		luaL_checknumber(l, 8)
-	};
-
-	Vector2 b1 = {
-		luaL_checknumber(l, 9),
-		luaL_checknumber(l, 10)
-	};
 
-	Vector2 b2 = {
-		luaL_checknumber(l, 11),
-		luaL_checknumber(l, 12)
-	};
+	Segment seg1, seg2;
+	_arg_vector2(l, 1, &seg1.p1);
+	_arg_vector2(l, 2, &seg1.p2);
+	_arg_vector2(l, 3, &seg2.p1);
+	_arg_vector2(l, 4, &seg2.p2);
 
-	Segment seg1 = {a1, a2};
-	Segment seg2 = {b1, b2};
 	Vector2 hit;
 
-	if(segment_intersect(seg1, seg2, &hit)) 
+	if(segment_intersect(seg1, seg2, &hit))
 		_new_vec2(l, hit.x, hit.y);
 	else
 		lua_pushnil(l);
@@ -770,38 +760,28 @@ static int ml_segment_intersect(lua_State* l) {
 static int ml_segment_to_point(lua_State* l) {
 	checkargs(3, "segment_to_point");
 
-#if _DEBUG
-	luaL_checktype(l, 1, LUA_TTABLE);
-	luaL_checktype(l, 2, LUA_TTABLE);
-	luaL_checktype(l, 3, LUA_TTABLE);
-#endif
-	
-	lua_rawgeti(l, 1, 1);
-	lua_rawgeti(l, 1, 2);
-	lua_rawgeti(l, 2, 1);
-	lua_rawgeti(l, 2, 2);
-	lua_rawgeti(l, 3, 1);
-	lua_rawgeti(l, 3, 2);
-
-	Vector2 a1 = {
-		luaL_checknumber(l, 4),
-		luaL_checknumber(l, 5)
-	};
+	Segment seg;
+	Vector2 p;
+	_arg_vector2(l, 1, &seg.p1);
+	_arg_vector2(l, 2, &seg.p2);
+	_arg_vector2(l, 3, &p);
 
-	Vector2 a2 = {
-		luaL_checknumber(l, 6),
-		luaL_checknumber(l, 7)
-	};
+	lua_pushnumber(l, segment_point_dist(seg, p));
 
-	Vector2 p = {
-		luaL_checknumber(l, 8),
-		luaL_checknumber(l, 9)
-	};
+	return 1;
+}
 
-	Segment seg = {a1, a2};
+static int ml_rect_move_self(lua_State* l) {
+	double* r = _arg_self(l, ML_RECT);
 
-	lua_pushnumber(l, segment_point_dist(seg, p));
+	double off[2];
+	_arg_value(l, 2, ML_VEC2, off);
+	r[0] += off[0];
+	r[1] += off[1];
+	r[2] += off[0];
+	r[3] += off[1];
 
+	lua_settop(l, 1);
 	return 1;
 }
 
@@ -821,19 +801,14 @@ static const luaL_Reg rect_fun[] = {
 	{NULL, NULL}
 };
 
-static const luaL_Reg rect_mt[] = {
-	{"__tostring", ml_rect_tostring},
-	{"__index", ml_rect_index},
-	{"__newindex", ml_rect_newindex},
+static const luaL_Reg rect_methods[] = {
+	{"move", ml_rect_move_self},
 	{NULL, NULL}
-};	
+};
 
 int malka_open_rect(lua_State* l) {
 	// metatable
-	luaL_newmetatable(l, "_rect.mt");
-	luaL_register(l, NULL, rect_mt);
-
-	lua_pop(l, 1);
+	_open_value_type(l, ML_RECT, false, rect_methods);
 
 	//functions
 	int i = 0;
@@ -850,34 +825,20 @@ int malka_open_rect(lua_State* l) {
 
 void _new_rgba(lua_State* l, double r, double g,
 	double b, double a) {
-	lua_createtable(l, 0, 4);
-	int table = lua_gettop(l);
-	lua_pushnumber(l, a);
-	lua_pushnumber(l, b);
-	lua_pushnumber(l, g);
-	lua_pushnumber(l, r);
-	lua_setfield(l, table, "r");
-	lua_setfield(l, table, "g");
-	lua_setfield(l, table, "b");
-	lua_setfield(l, table, "a");
-	luaL_getmetatable(l, "_color_rgba.mt");
-	lua_setmetatable(l, -2);
+	double* v = _new_value(l, ML_RGBA);
+	v[0] = r;
+	v[1] = g;
+	v[2] = b;
+	v[3] = a;
 }
 
 static void _new_hsva(lua_State* l, double h, double s,
 	double v, double a) {
-	lua_createtable(l, 0, 4);
-	int table = lua_gettop(l);
-	lua_pushnumber(l, a);
-	lua_pushnumber(l, v);
-	lua_pushnumber(l, s);
-	lua_pushnumber(l, h);
-	lua_setfield(l, table, "h");
-	lua_setfield(l, table, "s");
-	lua_setfield(l, table, "v");
-	lua_setfield(l, table, "a");
-	luaL_getmetatable(l, "_color_hsva.mt");
-	lua_setmetatable(l, -2);
+	double* c = _new_value(l, ML_HSVA);
+	c[0] = h;
+	c[1] = s;
+	c[2] = v;
+	c[3] = a;
 }
 
 static int ml_rgba(lua_State* l) {
@@ -910,8 +871,8 @@ static void _hsv_to_rgb(double h, double s, double v,
 	if(s == 0.0) {
 		*r = *g = *b = v;
 		return;
-	}	
-	
+	}
+
 	h *= 6.0;
 	uint i = (uint)floor(h);
 	double f = h - (double)i;
@@ -995,267 +956,29 @@ static int ml_hsva(lua_State* l) {
 
 static int ml_to_rgba(lua_State* l) {
 	checkargs(1, "to_rgba");
-	
-	luaL_checktype(l, 1, LUA_TTABLE);
 
-	lua_getfield(l, 1, "h");
-	lua_getfield(l, 1, "s");
-	lua_getfield(l, 1, "v");
-	lua_getfield(l, 1, "a");
-
-	double h = luaL_checknumber(l, 2);
-	double s = luaL_checknumber(l, 3);
-	double v = luaL_checknumber(l, 4);
-	double a = luaL_checknumber(l, 5);
+	double c[4];
+	_arg_value(l, 1, ML_HSVA, c);
 
 	double r, g, b;
 
-	_hsv_to_rgb(h, s, v, &r, &g, &b);
-	_new_rgba(l, r, g, b, a);
+	_hsv_to_rgb(c[0], c[1], c[2], &r, &g, &b);
+	_new_rgba(l, r, g, b, c[3]);
 
 	return 1;
 }
 
 static int ml_to_hsva(lua_State* l) {
 	checkargs(1, "to_hsva");
-	
-	luaL_checktype(l, 1, LUA_TTABLE);
-
-	lua_getfield(l, 1, "r");
-	lua_getfield(l, 1, "g");
-	lua_getfield(l, 1, "b");
-	lua_getfield(l, 1, "a");
 
-	double r = luaL_checknumber(l, 2);
-	double g = luaL_checknumber(l, 3);
-	double b = luaL_checknumber(l, 4);
-	double a = luaL_checknumber(l, 5);
+	double c[4];
+	_arg_value(l, 1, ML_RGBA, c);
 
 	double h, s, v;
 
-	_rgb_to_hsv(r, g, b, &h, &s, &v);
-	_new_hsva(l, h, s, v, a);
-
-	return 1;
-}
-
-static int ml_color_add_rgba(lua_State* l) {
-	luaL_checktype(l, 2, LUA_TTABLE);
-
-	lua_getfield(l, 1, "r");
-	lua_getfield(l, 1, "g");
-	lua_getfield(l, 1, "b");
-	lua_getfield(l, 1, "a");
-	lua_getfield(l, 2, "r");
-	lua_getfield(l, 2, "g");
-	lua_getfield(l, 2, "b");
-	lua_getfield(l, 2, "a");
-
-	double r = luaL_checknumber(l, 3) + luaL_checknumber(l, 7);
-	double g = luaL_checknumber(l, 4) + luaL_checknumber(l, 8);
-	double b = luaL_checknumber(l, 5) + luaL_checknumber(l, 9);
-	double a = luaL_checknumber(l, 6) + luaL_checknumber(l, 10);
-
-	_new_rgba(l, r, g, b, a);
-	return 1;
-}
-
-static int ml_color_add_hsva(lua_State* l) {
-	luaL_checktype(l, 2, LUA_TTABLE);
-
-	lua_getfield(l, 1, "h");
-	lua_getfield(l, 1, "s");
-	lua_getfield(l, 1, "v");
-	lua_getfield(l, 1, "a");
-	lua_getfield(l, 2, "h");
-	lua_getfield(l, 2, "s");
-	lua_getfield(l, 2, "v");
-	lua_getfield(l, 2, "a");
-
-	double h = luaL_checknumber(l, 3) + luaL_checknumber(l, 7);
-	double s = luaL_checknumber(l, 4) + luaL_checknumber(l, 8);
-	double v = luaL_checknumber(l, 5) + luaL_checknumber(l, 9);
-	double a = luaL_checknumber(l, 6) + luaL_checknumber(l, 10);
-
-	_new_hsva(l, h, s, v, a);
-	return 1;
-}
-
-static int ml_color_sub_rgba(lua_State* l) {
-	luaL_checktype(l, 2, LUA_TTABLE);
-
-	lua_getfield(l, 1, "r");
-	lua_getfield(l, 1, "g");
-	lua_getfield(l, 1, "b");
-	lua_getfield(l, 1, "a");
-	lua_getfield(l, 2, "r");
-	lua_getfield(l, 2, "g");
-	lua_getfield(l, 2, "b");
-	lua_getfield(l, 2, "a");
-
-	double r = luaL_checknumber(l, 3) - luaL_checknumber(l, 7);
-	double g = luaL_checknumber(l, 4) - luaL_checknumber(l, 8);
-	double b = luaL_checknumber(l, 5) - luaL_checknumber(l, 9);
-	double a = luaL_checknumber(l, 6) - luaL_checknumber(l, 10);
-
-	_new_rgba(l, r, g, b, a);
-	return 1;
-}
-
-static int ml_color_sub_hsva(lua_State* l) {
-	luaL_checktype(l, 2, LUA_TTABLE);
-
-	lua_getfield(l, 1, "h");
-	lua_getfield(l, 1, "s");
-	lua_getfield(l, 1, "v");
-	lua_getfield(l, 1, "a");
-	lua_getfield(l, 2, "h");
-	lua_getfield(l, 2, "s");
-	lua_getfield(l, 2, "v");
-	lua_getfield(l, 2, "a");
-
-	double h = luaL_checknumber(l, 3) - luaL_checknumber(l, 7);
-	double s = luaL_checknumber(l, 4) - luaL_checknumber(l, 8);
-	double v = luaL_checknumber(l, 5) - luaL_checknumber(l, 9);
-	double a = luaL_checknumber(l, 6) - luaL_checknumber(l, 10);
-
-	_new_hsva(l, h, s, v, a);
-	return 1;
-}
-
-static int ml_color_mul_rgba(lua_State* l) {
-	double r, g, b, a;
-
-	if(lua_istable(l, 2)) {
-		lua_getfield(l, 1, "r");
-		lua_getfield(l, 1, "g");
-		lua_getfield(l, 1, "b");
-		lua_getfield(l, 1, "a");
-		lua_getfield(l, 2, "r");
-		lua_getfield(l, 2, "g");
-		lua_getfield(l, 2, "b");
-		lua_getfield(l, 2, "a");
-
-		r = luaL_checknumber(l, 3) * luaL_checknumber(l, 7);
-		g = luaL_checknumber(l, 4) * luaL_checknumber(l, 8);
-		b = luaL_checknumber(l, 5) * luaL_checknumber(l, 9);
-		a = luaL_checknumber(l, 6) * luaL_checknumber(l, 10);
-	}
-	else {
-		double k = luaL_checknumber(l, 2);
-
-		lua_getfield(l, 1, "r");
-		lua_getfield(l, 1, "g");
-		lua_getfield(l, 1, "b");
-		lua_getfield(l, 1, "a");
-
-		r = luaL_checknumber(l, 3) * k;
-		g = luaL_checknumber(l, 4) * k;
-		b = luaL_checknumber(l, 5) * k;
-		a = luaL_checknumber(l, 6) * k;
-	}
-
-	_new_rgba(l, r, g, b, a);
-	return 1;
-}
-
-static int ml_color_mul_hsva(lua_State* l) {
-	double h, s, v, a;
-
-	if(lua_istable(l, 2)) {
-		lua_getfield(l, 1, "h");
-		lua_getfield(l, 1, "s");
-		lua_getfield(l, 1, "v");
-		lua_getfield(l, 1, "a");
-		lua_getfield(l, 2, "h");
-		lua_getfield(l, 2, "s");
-		lua_getfield(l, 2, "v");
-		lua_getfield(l, 2, "a");
-
-		h = luaL_checknumber(l, 3) * luaL_checknumber(l, 7);
-		s = luaL_checknumber(l, 4) * luaL_checknumber(l, 8);
-		v = luaL_checknumber(l, 5) * luaL_checknumber(l, 9);
-		a = luaL_checknumber(l, 6) * luaL_checknumber(l, 10);
-	}
-	else {
-		double k = luaL_checknumber(l, 2);
-
-		lua_getfield(l, 1, "h");
-		lua_getfield(l, 1, "s");
-		lua_getfield(l, 1, "v");
-		lua_getfield(l, 1, "a");
-
-		h = luaL_checknumber(l, 3) * k;
-		s = luaL_checknumber(l, 4) * k;
-		v = luaL_checknumber(l, 5) * k;
-		a = luaL_checknumber(l, 6) * k;
-	}
-
-	_new_hsva(l, h, s, v, a);
-	return 1;
-}
-
-static int ml_color_div_rgba(lua_State* l) {
-	double k = luaL_checknumber(l, 2);
-
-	lua_getfield(l, 1, "r");
-	lua_getfield(l, 1, "g");
-	lua_getfield(l, 1, "b");
-	lua_getfield(l, 1, "a");
-
-	double r = luaL_checknumber(l, 3) / k;
-	double g = luaL_checknumber(l, 4) / k;
-	double b = luaL_checknumber(l, 5) / k;
-	double a = luaL_checknumber(l, 6) / k;
-
-	_new_rgba(l, r, g, b, a);
-	return 1;
-}
-
-static int ml_color_div_hsva(lua_State* l) {
-	double k = luaL_checknumber(l, 2);
-
-	lua_getfield(l, 1, "h");
-	lua_getfield(l, 1, "s");
-	lua_getfield(l, 1, "v");
-	lua_getfield(l, 1, "a");
-
-	double h = luaL_checknumber(l, 3) / k;
-	double s = luaL_checknumber(l, 4) / k;
-	double v = luaL_checknumber(l, 5) / k;
-	double a = luaL_checknumber(l, 6) / k;
-
-	_new_hsva(l, h, s, v, a);
-	return 1;
-}
-
-static int ml_color_tostring_rgba(lua_State* l) {
-	lua_getfield(l, 1, "r");
-	lua_getfield(l, 1, "g");
-	lua_getfield(l, 1, "b");
-	lua_getfield(l, 1, "a");
-
-	double r = luaL_checknumber(l, 2);
-	double g = luaL_checknumber(l, 3);
-	double b = luaL_checknumber(l, 4);
-	double a = luaL_checknumber(l, 5);
-
-	lua_pushfstring(l, "rgba(%f, %f, %f, %f)", r, g, b, a);
-	return 1;
-}
-
-static int ml_color_tostring_hsva(lua_State* l) {
-	lua_getfield(l, 1, "h");
-	lua_getfield(l, 1, "s");
-	lua_getfield(l, 1, "v");
-	lua_getfield(l, 1, "a");
-
-	double h = luaL_checknumber(l, 2);
-	double s = luaL_checknumber(l, 3);
-	double v = luaL_checknumber(l, 4);
-	double a = luaL_checknumber(l, 5);
+	_rgb_to_hsv(c[0], c[1], c[2], &h, &s, &v);
+	_new_hsva(l, h, s, v, c[3]);
 
-	lua_pushfstring(l, "hsva(%f, %f, %f, %f)", h, s, v, a);
 	return 1;
 }
 
@@ -1265,34 +988,12 @@ static const luaL_Reg colors_fun[] = {
 	{"to_rgba", ml_to_rgba},
 	{"to_hsva", ml_to_hsva},
 	{NULL, NULL}
-};	
-
-static const luaL_Reg color_rgba_mt[] = {
-	{"__add", ml_color_add_rgba},
-	{"__sub", ml_color_sub_rgba},
-	{"__mul", ml_color_mul_rgba},
-	{"__div", ml_color_div_rgba},
-	{"__tostring", ml_color_tostring_rgba},
-	{NULL, NULL}
-};	
-
-static const luaL_Reg color_hsva_mt[] = {
-	{"__add", ml_color_add_hsva},
-	{"__sub", ml_color_sub_hsva},
-	{"__mul", ml_color_mul_hsva},
-	{"__div", ml_color_div_hsva},
-	{"__tostring", ml_color_tostring_hsva},
-	{NULL, NULL}
 };
 
 int malka_open_colors(lua_State* l) {
 	// metatables
-	luaL_newmetatable(l, "_color_rgba.mt");
-	luaL_register(l, NULL, color_rgba_mt);
-	luaL_newmetatable(l, "_color_hsva.mt");
-	luaL_register(l, NULL, color_hsva_mt);
-	
-	lua_pop(l, 2);
+	_open_value_type(l, ML_RGBA, true, NULL);
+	_open_value_type(l, ML_HSVA, true, NULL);
 
 	// functions
 	int i = 0;
@@ -1306,113 +1007,26 @@ int malka_open_colors(lua_State* l) {
 
 // misc
 
-double _lerp(double a, double b, double t) {
-	return a + (b-a)*t;
-}
-
-// This is the most evil lerp I've ever seen!
+// Numbers, vectors, rects, colors in either color space or plain tables
+// with corresponding fields can be interpolated
 static int _ml_lerp_internal(lua_State* l, double t) {
 	if(lua_isnumber(l, 1) && lua_isnumber(l, 2)) {
 		double a = lua_tonumber(l, 1);
 		double b = lua_tonumber(l, 2);
-		lua_pushnumber(l, _lerp(a, b, t)); 
+		lua_pushnumber(l, _lerp(a, b, t));
 		return 1;
 	}
-	else {
-		if(lua_istable(l, 1) && lua_istable(l, 2)) {
-			lua_getfield(l, 1, "x");
-			lua_getfield(l, 1, "y");
-			lua_getfield(l, 2, "x");
-			lua_getfield(l, 2, "y");
-
-			for(int i = -1; i >= -4; --i) {
-				if(lua_isnil(l, i)) {
-					lua_pop(l, 4);
-					goto color_rgba;
-				}
-			}	
-
-			double by = lua_tonumber(l, -1);
-			double bx = lua_tonumber(l, -2);
-			double ay = lua_tonumber(l, -3);
-			double ax = lua_tonumber(l, -4);
-
-			_new_vec2(l, 
-				_lerp(ax, bx, t),
-				_lerp(ay, by, t)
-			);	
-			return 1;
-			
-		color_rgba:
-			lua_getfield(l, 1, "r");
-			lua_getfield(l, 1, "g");
-			lua_getfield(l, 1, "b");
-			lua_getfield(l, 1, "a");
-			lua_getfield(l, 2, "r");
-			lua_getfield(l, 2, "g");
-			lua_getfield(l, 2, "b");
-			lua_getfield(l, 2, "a");
-
-			for(int i = -1; i >= -8; --i) {
-				if(lua_isnil(l, i)) {
-					lua_pop(l, 8);
-					goto color_hsva;
-				}
-			}	
-
-			double ba = lua_tonumber(l, -1);
-			double bb = lua_tonumber(l, -2);
-			double bg = lua_tonumber(l, -3);
-			double br = lua_tonumber(l, -4);
-			double aa = lua_tonumber(l, -5);
-			double ab = lua_tonumber(l, -6);
-			double ag = lua_tonumber(l, -7);
-			double ar = lua_tonumber(l, -8);
-
-			_new_rgba(l, 
-				_lerp(ar, br, t),
-				_lerp(ag, bg, t),
-				_lerp(ab, bb, t),
-				_lerp(aa, ba, t)
-			);
-			return 1;
 
-		color_hsva:
-			lua_getfield(l, 1, "h");
-			lua_getfield(l, 1, "s");
-			lua_getfield(l, 1, "v");
-			lua_getfield(l, 1, "a");
-			lua_getfield(l, 2, "h");
-			lua_getfield(l, 2, "s");
-			lua_getfield(l, 2, "v");
-			lua_getfield(l, 2, "a");
-
-			for(int i = -1; i >= -8; --i) {
-				if(lua_isnil(l, i)) {
-					lua_pop(l, 8);
-					goto error;
-				}
-			}	
-
-			/*double*/ ba = lua_tonumber(l, -1);
-			double bv = lua_tonumber(l, -2);
-			double bs = lua_tonumber(l, -3);
-			double bh = lua_tonumber(l, -4);
-			/*double*/ aa = lua_tonumber(l, -5);
-			double av = lua_tonumber(l, -6);
-			double as = lua_tonumber(l, -7);
-			double ah = lua_tonumber(l, -8);
-
-			_new_hsva(l, 
-				_lerp(ah, bh, t),
-				_lerp(as, bs, t),
-				_lerp(av, bv, t),
-				_lerp(aa, ba, t)
-			);
+	double a[4], b[4];
+	for(uint type = 0; type < ARRAY_SIZE(ml_types); ++type) {
+		if(_read_value(l, 1, type, a) && _read_value(l, 2, type, b)) {
+			double* r = _new_value(l, type);
+			for(uint i = 0; i < ml_types[type].n; ++i)
+				r[i] = _lerp(a[i], b[i], t);
 			return 1;
 		}
 	}
-error:
+
 	return luaL_error(l, "bad arguments provided for lerp/smoothstep");
 }
 
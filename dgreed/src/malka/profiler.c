@@ -1,3 +1,8 @@
+#ifdef __linux__
+// clock_gettime and CLOCK_MONOTONIC are POSIX, hidden by -std=c99
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include "profiler.h"
 
 // Timing code, from luatrace
@@ -8,8 +13,8 @@
 typedef uint64_t hook_time_t;
 #define CLOCK_FUNCTION mach_absolute_time
 #elif __linux__
-#include <sys/time.h>
-typedef long hook_time_t;
+#include <time.h>
+typedef uint64 hook_time_t;
 #define CLOCK_FUNCTION lclock
 #ifdef CLOCK_MONOTONIC_RAW
 #define LINUX_CLOCK CLOCK_MONOTONIC_RAW
@@ -47,15 +52,15 @@ static void get_microseconds_info(void)
 #elif __linux__
 static void get_microseconds_info(void)
 {
-  microseconds_numerator = 1000;
-  microseconds_denominator = 1;
+  microseconds_numerator = 1;
+  microseconds_denominator = 1000;
 }
 
 static hook_time_t lclock()
 {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  return tv.tv_sec * 1000L + tv.tv_usec;
+  struct timespec t;
+  clock_gettime(LINUX_CLOCK, &t);
+  return (hook_time_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
 }
 #elif _WIN32
 static void get_microseconds_info(void)
@@ -98,7 +103,7 @@ static void get_microseconds_info(void)
 }
 #endif
 
-static double time_micros() {
+double profiler_time_micros(void) {
 	static bool init = false;
 	if(!init) {
 		get_microseconds_info();
@@ -144,7 +149,7 @@ static void _hook(lua_State* l, lua_Debug* d) {
 
 	// Sample current time and memory
 	uint mem = lua_gc(l, LUA_GCCOUNT, 0);
-	double t = time_micros();
+	double t = profiler_time_micros();
 
 	// Get FunctionStats
 	DictEntry* e = dict_entry(&stats, sig);
@@ -308,3 +313,201 @@ const char* profiler_results(void) {
 }
 
 
+
+/*============================================================================*/
+
+// Sampling profiler
+
+#define MAX_ZONES 16
+#define MAX_FRAMES 48
+#define MAX_STACK_LEN 2048
+
+typedef struct {
+	double time;
+	uint64 alloc;
+	uint n_samples;
+} StackSamples;
+
+static lua_State* sampling_l = NULL;
+static Dict samples;
+
+static const char* zones[MAX_ZONES];
+static uint n_zones = 0;
+
+static double last_sample_t;
+static uint64 alloc_acc;
+
+static lua_Alloc orig_alloc;
+static void* orig_alloc_ud;
+
+static void* _alloc_hook(void* ud, void* ptr, size_t osize, size_t nsize) {
+	if(nsize > osize)
+		alloc_acc += nsize - osize;
+	return (*orig_alloc)(ud, ptr, osize, nsize);
+}
+
+// Appends src to collapsed stack, replacing separators and spaces
+static uint _append_frame(char* stack, uint len, const char* src) {
+	if(len && len < MAX_STACK_LEN-1)
+		stack[len++] = ';';
+	while(*src && len < MAX_STACK_LEN-1) {
+		char c = *src++;
+		stack[len++] = (c == ';' || c == ' ') ? '_' : c;
+	}
+	stack[len] = '\0';
+	return len;
+}
+
+// Builds root-first collapsed stack of open zones and lua frames
+static void _collapse_stack(lua_State* l, char* stack) {
+	uint len = 0;
+	stack[0] = '\0';
+
+	for(uint i = 0; i < n_zones; ++i)
+		len = _append_frame(stack, len, zones[i]);
+
+	if(!l)
+		return;
+
+	lua_Debug d;
+	int depth = 0;
+	while(depth < MAX_FRAMES && lua_getstack(l, depth, &d))
+		depth++;
+
+	char frame[256];
+	for(int i = depth-1; i >= 0; --i) {
+		lua_getstack(l, i, &d);
+		lua_getinfo(l, "Sn", &d);
+		if(d.what[0] == 'C')
+			snprintf(frame, sizeof(frame), "%s", d.name ? d.name : "[C]");
+		else if(d.what[0] == 'm')
+			snprintf(frame, sizeof(frame), "main@%s", d.short_src);
+		else
+			snprintf(frame, sizeof(frame), "%s@%s:%d",
+				d.name ? d.name : "?", d.short_src, d.linedefined);
+		len = _append_frame(stack, len, frame);
+	}
+}
+
+// Attributes time and memory since previous sample to current stack
+static void _take_sample(lua_State* l) {
+	double t = profiler_time_micros();
+
+	char stack[MAX_STACK_LEN];
+	_collapse_stack(l, stack);
+	if(stack[0] == '\0')
+		strcpy(stack, "[native]");
+
+	StackSamples* s = (StackSamples*)dict_get(&samples, stack);
+	if(!s) {
+		s = MEM_ALLOC(sizeof(StackSamples));
+		memset(s, 0, sizeof(StackSamples));
+		dict_set(&samples, strclone(stack), s);
+	}
+
+	s->time += t - last_sample_t;
+	s->alloc += alloc_acc;
+	s->n_samples++;
+
+	// Don't bill profiler itself to the next sample
+	last_sample_t = profiler_time_micros();
+	alloc_acc = 0;
+}
+
+static void _sample_hook(lua_State* l, lua_Debug* d) {
+	(void)d;
+	_take_sample(l);
+}
+
+void profiler_sampling_init(lua_State* l, uint period) {
+	assert(l);
+	assert(!sampling_l);
+
+	dict_init(&samples);
+	sampling_l = l;
+	n_zones = 0;
+	alloc_acc = 0;
+
+	orig_alloc = lua_getallocf(l, &orig_alloc_ud);
+	lua_setallocf(l, _alloc_hook, orig_alloc_ud);
+
+	last_sample_t = profiler_time_micros();
+	lua_sethook(l, _sample_hook, LUA_MASKCOUNT, period ? period : 1000);
+}
+
+static bool _write_collapsed(const char* filename, bool alloc) {
+	FILE* f = fopen(filename, "w");
+	if(!f) {
+		LOG_WARNING("Unable to write profile to %s", filename);
+		return false;
+	}
+
+	for(uint i = 0; i < samples.mask+1; ++i) {
+		DictEntry* e = &samples.map[i];
+		if(e->key && e->data) {
+			const StackSamples* s = e->data;
+			if(alloc && s->alloc)
+				fprintf(f, "%s %llu\n", e->key, (unsigned long long)s->alloc);
+			if(!alloc && s->time >= 1.0)
+				fprintf(f, "%s %llu\n", e->key, (unsigned long long)s->time);
+		}
+	}
+
+	fclose(f);
+	return true;
+}
+
+void profiler_sampling_close(lua_State* l, const char* time_file,
+	const char* alloc_file) {
+	assert(l == sampling_l);
+
+	lua_sethook(l, _sample_hook, 0, 0);
+	lua_setallocf(l, orig_alloc, orig_alloc_ud);
+	sampling_l = NULL;
+
+	uint n = 0;
+	for(uint i = 0; i < samples.mask+1; ++i) {
+		DictEntry* e = &samples.map[i];
+		if(e->key && e->data)
+			n += ((const StackSamples*)e->data)->n_samples;
+	}
+
+	if(time_file && _write_collapsed(time_file, false))
+		LOG_INFO("%u samples written to %s", n, time_file);
+	if(alloc_file)
+		_write_collapsed(alloc_file, true);
+
+	for(uint i = 0; i < samples.mask+1; ++i) {
+		DictEntry* e = &samples.map[i];
+		if(e->key && e->data) {
+			MEM_FREE(e->key);
+			MEM_FREE(e->data);
+		}
+	}
+
+	dict_free(&samples);
+}
+
+void profiler_zone_enter(const char* name) {
+	assert(name);
+	if(!sampling_l)
+		return;
+
+	// Close interval which was running outside of this zone
+	_take_sample(sampling_l);
+
+	assert(n_zones < MAX_ZONES);
+	zones[n_zones++] = name;
+}
+
+void profiler_zone_leave(void) {
+	if(!sampling_l)
+		return;
+
+	// Native time spent inside the zone goes to the zone itself
+	_take_sample(sampling_l);
+
+	assert(n_zones > 0);
+	n_zones--;
+}
+
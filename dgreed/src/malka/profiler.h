@@ -14,5 +14,23 @@ void profiler_close(lua_State* l);
 
 const char* profiler_results(void);
 
+// Precise monotonic clock, in microseconds
+double profiler_time_micros(void);
+
+// Sampling profiler. Instead of hooking every call, lua stack is
+// snapshotted every period vm instructions, with open native zones
+// as root frames. Time and bytes allocated since previous snapshot
+// are billed to it. Results are written in collapsed-stack format
+// ("frame;frame;frame value" per line), ready for flamegraph.pl.
+
+void profiler_sampling_init(lua_State* l, uint period);
+void profiler_sampling_close(lua_State* l, const char* time_file,
+	const char* alloc_file);
+
+// Native instrumentation zones, must nest properly.
+// Cost nothing when sampling is off.
+void profiler_zone_enter(const char* name);
+void profiler_zone_leave(void);
+
 #endif
 
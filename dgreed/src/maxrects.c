@@ -0,0 +1,160 @@
+#include "maxrects.h"
+#include "memory.h"
+
+typedef struct {
+	uint x, y, w, h;
+} PackRect;
+
+void maxrects_init(MaxRects* packer, uint width, uint height) {
+	assert(packer);
+	assert(width && height);
+
+	packer->width = width;
+	packer->height = height;
+	packer->free_rects = darray_create(sizeof(PackRect), 16);
+
+	PackRect all = {0, 0, width, height};
+	darray_append(&packer->free_rects, &all);
+}
+
+void maxrects_free(MaxRects* packer) {
+	assert(packer);
+
+	darray_free(&packer->free_rects);
+}
+
+static bool _intersects(const PackRect* a, const PackRect* b) {
+	return a->x < b->x + b->w && b->x < a->x + a->w &&
+		a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+static bool _contains(const PackRect* a, const PackRect* b) {
+	return b->x >= a->x && b->y >= a->y &&
+		b->x + b->w <= a->x + a->w && b->y + b->h <= a->y + a->h;
+}
+
+// Splits free rect around used one into up to 4 maximal rects
+static void _split(DArray* out, const PackRect* fr, const PackRect* used) {
+	PackRect r;
+
+	if(used->x > fr->x) {
+		r = *fr;
+		r.w = used->x - fr->x;
+		darray_append(out, &r);
+	}
+	if(used->x + used->w < fr->x + fr->w) {
+		r = *fr;
+		r.x = used->x + used->w;
+		r.w = fr->x + fr->w - r.x;
+		darray_append(out, &r);
+	}
+	if(used->y > fr->y) {
+		r = *fr;
+		r.h = used->y - fr->y;
+		darray_append(out, &r);
+	}
+	if(used->y + used->h < fr->y + fr->h) {
+		r = *fr;
+		r.y = used->y + used->h;
+		r.h = fr->y + fr->h - r.y;
+		darray_append(out, &r);
+	}
+}
+
+// Removes free rects which are fully inside other free rects
+static void _prune(DArray* rects) {
+	PackRect* r = DARRAY_DATA_PTR(*rects, PackRect);
+	for(uint i = 0; i < rects->size; ++i) {
+		for(uint j = i+1; j < rects->size; ++j) {
+			if(_contains(&r[j], &r[i])) {
+				darray_remove_fast(rects, i);
+				i--;
+				break;
+			}
+			if(_contains(&r[i], &r[j])) {
+				darray_remove_fast(rects, j);
+				j--;
+			}
+		}
+	}
+}
+
+bool maxrects_insert(MaxRects* packer, uint w, uint h, uint* x, uint* y) {
+	assert(packer);
+	assert(x && y);
+
+	if(w == 0 || h == 0) {
+		*x = *y = 0;
+		return true;
+	}
+
+	// Best short side fit
+	PackRect* fr = DARRAY_DATA_PTR(packer->free_rects, PackRect);
+	uint best_short = ~0, best_long = ~0;
+	PackRect used = {0, 0, w, h};
+	for(uint i = 0; i < packer->free_rects.size; ++i) {
+		if(fr[i].w < w || fr[i].h < h)
+			continue;
+
+		uint dw = fr[i].w - w, dh = fr[i].h - h;
+		uint short_side = MIN(dw, dh), long_side = MAX(dw, dh);
+		if(short_side < best_short ||
+			(short_side == best_short && long_side < best_long)) {
+			best_short = short_side;
+			best_long = long_side;
+			used.x = fr[i].x;
+			used.y = fr[i].y;
+		}
+	}
+
+	if(best_short == ~0)
+		return false;
+
+	// Split all free rects which overlap with newly used area. Going
+	// backwards, so that new rects appended to the end are not visited.
+	for(int i = packer->free_rects.size - 1; i >= 0; --i) {
+		fr = DARRAY_DATA_PTR(packer->free_rects, PackRect);
+		if(!_intersects(&fr[i], &used))
+			continue;
+
+		PackRect f = fr[i];
+		darray_remove_fast(&packer->free_rects, i);
+		_split(&packer->free_rects, &f, &used);
+	}
+	_prune(&packer->free_rects);
+
+	*x = used.x;
+	*y = used.y;
+	return true;
+}
+
+bool maxrects_pack(uint width, uint height, uint n,
+	const uint* widths, const uint* heights, uint* xs, uint* ys) {
+	assert(widths && heights && xs && ys);
+
+	// Sort indices by area, largest first
+	uint* order = MEM_ALLOC(n * sizeof(uint));
+	for(uint i = 0; i < n; ++i) {
+		uint j = i;
+		uint area = widths[i] * heights[i];
+		while(j > 0 && widths[order[j-1]] * heights[order[j-1]] < area) {
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = i;
+	}
+
+	MaxRects packer;
+	maxrects_init(&packer, width, height);
+
+	bool res = true;
+	for(uint i = 0; i < n && res; ++i) {
+		uint k = order[i];
+		res = maxrects_insert(&packer, widths[k], heights[k], &xs[k], &ys[k]);
+	}
+
+	maxrects_free(&packer);
+	MEM_FREE(order);
+
+	return res;
+}
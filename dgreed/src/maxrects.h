@@ -0,0 +1,28 @@
+#ifndef MAXRECTS_H
+#define MAXRECTS_H
+
+#include "utils.h"
+#include "darray.h"
+
+// MaxRects rectangle bin packer.
+// Keeps a list of maximal free rectangles, new rect is placed into the
+// free rectangle where it leaves the shortest side (best short side fit).
+
+typedef struct {
+	uint width, height;
+	DArray free_rects;
+} MaxRects;
+
+void maxrects_init(MaxRects* packer, uint width, uint height);
+void maxrects_free(MaxRects* packer);
+
+// Finds place for a w x h rect and marks it used,
+// returns false if it does not fit anywhere
+bool maxrects_insert(MaxRects* packer, uint w, uint h, uint* x, uint* y);
+
+// Packs n rects into width x height bin, largest first.
+// Returns false if not all of them fit.
+bool maxrects_pack(uint width, uint height, uint n,
+	const uint* widths, const uint* heights, uint* xs, uint* ys);
+
+#endif
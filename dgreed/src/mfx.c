@@ -19,6 +19,7 @@ typedef enum {
 typedef struct {
 	SubEffectType type;
 	const char* name;
+	size_t target; // Resolved SndDefIdx or MetaEffectIdx, ~0 if missing
 	float delay;
 	float dir_offset;
 	float weight;
@@ -27,6 +28,8 @@ typedef struct {
 
 typedef size_t SubEffectIdx;
 
+typedef size_t LiveSubEffectIdx;
+
 typedef struct {
 	bool remove;
 	float dir;
@@ -35,13 +38,23 @@ typedef struct {
 	const Vector2* follow_pos;
 	ParticleSystem* psystem;
 	SubEffectIdx sub;
-} LiveSubEffect;
 
-typedef size_t LiveSubEffectIdx;
+	// Timing wheel slot list
+	uint fire_tick;
+	LiveSubEffectIdx next;
+} LiveSubEffect;
 
 typedef struct {
 	uint sub_start, sub_count, rnd_count;
 	float rnd_total_weight;
+
+	// Per-frame deduplication and rate limiting, 0 means no limit
+	uint max_per_frame;
+	uint frame, frame_count;
+	Vector2 last_pos;
+	float last_dir;
+	const Vector2* last_follow_pos;
+	const float* last_follow_dir;
 } MetaEffect;
 
 typedef size_t MetaEffectIdx;
@@ -53,6 +66,7 @@ typedef enum {
 
 typedef struct {
 	SndType type;
+	const char* name;
 	SoundHandle handle;
 	bool loaded;
 	float volume;
@@ -83,8 +97,27 @@ static DArray parse_queue;
 static DArray meta_effects;
 static DArray sub_effects;
 static DArray live_sub_effects;
+static DArray live_sub_effects_free;
 static DArray follower_live_sub_effects;
-static Heap live_sub_effects_pq;
+static uint mfx_frame;
+
+// Delayed sub effects are kept in a timing wheel, each slot is a
+// list of live sub effects. Effects which are more than one
+// revolution away stay in their slot until their tick comes.
+#define WHEEL_SLOTS 256
+#define WHEEL_TICK_MS 16
+#define WHEEL_NONE (~(LiveSubEffectIdx)0)
+
+static LiveSubEffectIdx wheel[WHEEL_SLOTS];
+static uint wheel_tick;
+
+#ifndef NO_DEVMODE
+static MfxStats m_stats;
+
+const MfxStats* mfx_stats(void) {
+	return &m_stats;
+}
+#endif
 
 static Dict snd_dict;
 static DArray snd_defs;
@@ -129,10 +162,12 @@ static void _psystem_die(const void* d) {
 }
 
 static void _mfx_trigger(
-	const char* name, Vector2 pos, float dir,
+	MetaEffectIdx idx, Vector2 pos, float dir,
 	const Vector2* pos_follow, const float* dir_follow
 );
 
+static void _snd_play(SndDefIdx idx);
+
 static void _perform_sub_effect(LiveSubEffect* sf) {
 	assert(sf);
 	assert(!sf->remove);
@@ -142,7 +177,8 @@ static void _perform_sub_effect(LiveSubEffect* sf) {
 	SubEffect* sub = _get_sub_effect(sf->sub);
 
 	if(sub->type == SUB_SOUND) {
-		mfx_snd_play(sub->name);
+		if(sub->target != ~0)
+			_snd_play(sub->target);
 	}
 	else if (sub->type == SUB_PARTICLES) {
 		Vector2 p = vec2_add(sf->pos, sub->pos_offset);
@@ -164,7 +200,7 @@ static void _perform_sub_effect(LiveSubEffect* sf) {
 	}
 	else {
 		// Random
-		_mfx_trigger(sub->name, sf->pos, sf->dir, NULL, NULL);
+		_mfx_trigger(sub->target, sf->pos, sf->dir, NULL, NULL);
 	}
 }
 
@@ -199,6 +235,7 @@ static void _load_sounds(NodeIdx node) {
 
 		SndDef new = {
 			.type = SND_EVENT,
+			.name = snd_name,
 			.handle = 0,
 			.loaded = false,
 			.volume = 1.0f,
@@ -264,7 +301,10 @@ static const char* _parse_effect(NodeIdx mfx_node, const char* mfx_name) {
 		.sub_start = sub_effects.size,
 		.sub_count = 0,
 		.rnd_count = 0,
-		.rnd_total_weight = 0.0f
+		.rnd_total_weight = 0.0f,
+		.max_per_frame = 0,
+		.frame = ~0,
+		.frame_count = 0
 	};
 
 	if(!mfx_name)
@@ -285,6 +325,10 @@ static const char* _parse_effect(NodeIdx mfx_node, const char* mfx_name) {
 	// Sub effects
 	NodeIdx sub_node = mml_get_first_child(&mfx_mml, mfx_node);
 	for(; sub_node != 0; sub_node = mml_get_next(&mfx_mml, sub_node)) {
+		if(strcmp("max_per_frame", mml_get_name(&mfx_mml, sub_node)) == 0) {
+			pnew->max_per_frame = mml_getval_uint(&mfx_mml, sub_node);
+			continue;
+		}
 		_parse_sub(sub_node, pnew, mfx_name);
 	}
 
@@ -334,6 +378,7 @@ static void _parse_sub(NodeIdx sub_node, MetaEffect* new, const char* parent_nam
 	SubEffect sub = {
 		.type = type,
 		.name = NULL,
+		.target = ~0,
 		.delay = 0.0f,
 		.dir_offset = 0.0f,
 		.weight = 1.0f,
@@ -402,10 +447,9 @@ static void _load_effects(NodeIdx node) {
 static void _load_desc(const char* filename) {
 	assert(filename);
 
-	char* mml_text = txtfile_read(filename);
-	if(!mml_deserialize(&mfx_mml, mml_text))
+	if(!mml_load(&mfx_mml, filename))
 		LOG_ERROR("Unable to parse mfx desc %s", filename);
-	MEM_FREE(mml_text);
+	mml_cleanup(&mfx_mml);
 
 	NodeIdx root = mml_root(&mfx_mml);
 	if(strcmp("mfx", mml_get_name(&mfx_mml, root)) != 0)
@@ -437,6 +481,28 @@ static void _perform_queued_tasks(void) {
 	}
 }
 
+// Resolves names of sounds and random effects to indices,
+// so that triggering does no string lookups
+static void _resolve_subs(void) {
+	SubEffect* subs = DARRAY_DATA_PTR(sub_effects, SubEffect);
+	for(uint i = 0; i < sub_effects.size; ++i) {
+		SubEffect* sub = &subs[i];
+		if(sub->type == SUB_SOUND) {
+			DictEntry* e = dict_entry(&snd_dict, sub->name);
+			if(e)
+				sub->target = (SndDefIdx)e->data;
+			else
+				LOG_WARNING("Effect uses undefined sound %s", sub->name);
+		}
+		else if(sub->type == SUB_RANDOM) {
+			MetaEffectIdx idx = (MetaEffectIdx)dict_get(&meta_effect_dict, sub->name);
+			if(idx == 0)
+				LOG_ERROR("Random sub effect %s does not exist", sub->name);
+			sub->target = idx-1;
+		}
+	}
+}
+
 void mfx_init(const char* desc) {
 	assert(desc);
 
@@ -444,11 +510,11 @@ void mfx_init(const char* desc) {
 
 	dict_init(&meta_effect_dict);
 	dict_init(&snd_dict);
-	heap_init(&live_sub_effects_pq);
 
 	meta_effects = darray_create(sizeof(MetaEffect), 16);
 	sub_effects = darray_create(sizeof(SubEffect), 0);
 	live_sub_effects = darray_create(sizeof(LiveSubEffect), 8);
+	live_sub_effects_free = darray_create(sizeof(LiveSubEffectIdx), 8);
 	follower_live_sub_effects = darray_create(sizeof(LiveSubEffect), 8);
 	snd_defs = darray_create(sizeof(SndDef), 0);
 	snd_live = darray_create(sizeof(LiveSnd), 8);
@@ -459,8 +525,18 @@ void mfx_init(const char* desc) {
 	_load_desc(desc);
 	_perform_queued_tasks();
 	darray_free(&parse_queue);
+	_resolve_subs();
 
 	mml_free(&mfx_mml);
+
+	for(uint i = 0; i < WHEEL_SLOTS; ++i)
+		wheel[i] = WHEEL_NONE;
+	wheel_tick = lrintf(time_s() * 1000.0f) / WHEEL_TICK_MS;
+	mfx_frame = 0;
+
+#ifndef NO_DEVMODE
+	memset(&m_stats, 0, sizeof(m_stats));
+#endif
 }
 
 void mfx_close(void) {
@@ -480,11 +556,11 @@ void mfx_close(void) {
 	darray_free(&snd_live);
 	darray_free(&snd_defs);
 	darray_free(&follower_live_sub_effects);
+	darray_free(&live_sub_effects_free);
 	darray_free(&live_sub_effects);
 	darray_free(&sub_effects);
 	darray_free(&meta_effects);
 
-	heap_free(&live_sub_effects_pq);
 	dict_free(&snd_dict);
 	dict_free(&meta_effect_dict);
 
@@ -493,35 +569,80 @@ void mfx_close(void) {
 
 static void _snd_update(void);
 
+static void _wheel_insert(LiveSubEffectIdx idx) {
+	LiveSubEffect* live = _get_live_sub_effect(idx);
+
+	// Effects due now are performed on next update
+	uint tick = MAX(live->fire_tick, wheel_tick + 1);
+	uint slot = tick % WHEEL_SLOTS;
+	live->next = wheel[slot];
+	wheel[slot] = idx;
+}
+
+static void _wheel_advance(uint tick) {
+	// When more than one revolution passed, visit every slot once
+	uint n = MIN(tick - wheel_tick, WHEEL_SLOTS);
+	uint start = tick - n + 1;
+	for(uint t = start; t <= tick; ++t) {
+		wheel_tick = t;
+
+		// Detach slot list, performed effects might insert new ones
+		uint slot = t % WHEEL_SLOTS;
+		LiveSubEffectIdx idx = wheel[slot];
+		wheel[slot] = WHEEL_NONE;
+
+		while(idx != WHEEL_NONE) {
+			LiveSubEffect* live = _get_live_sub_effect(idx);
+			LiveSubEffectIdx next = live->next;
+			assert(!live->remove);
+
+			if(live->fire_tick <= tick) {
+				// Copy out, live storage might get reallocated
+				LiveSubEffect sf = *live;
+				live->remove = true;
+				darray_append(&live_sub_effects_free, &idx);
+#ifndef NO_DEVMODE
+				m_stats.live_delayed--;
+#endif
+				_perform_sub_effect(&sf);
+			}
+			else {
+				// Not this revolution
+				live->next = wheel[slot];
+				wheel[slot] = idx;
+			}
+
+			idx = next;
+		}
+	}
+	wheel_tick = tick;
+}
+
 void mfx_update(void) {
 	float t = time_s();
 	uint ms = lrintf(t * 1000.0f);
 
+	mfx_frame++;
+#ifndef NO_DEVMODE
+	m_stats.frame_triggered = m_stats.frame_coalesced = 0;
+#endif
+
 	// Update follower particle effects
 	LiveSubEffect* sf = follower_live_sub_effects.data;
 	uint n = follower_live_sub_effects.size;
 	for(uint i = 0; i < n; ++i) {
 		SubEffect* sub = _get_sub_effect(sf[i].sub);
 		ParticleSystem* p = sf[i].psystem;
-		if(sf->follow_pos)
+		if(sf[i].follow_pos)
 			p->pos = vec2_add(*sf[i].follow_pos, sub->pos_offset);
-		if(sf->follow_dir)
+		if(sf[i].follow_dir)
 			p->direction = *sf[i].follow_dir + sub->dir_offset;
 	}
 
-	// Check live sub effects priority queue
-	while(	heap_size(&live_sub_effects_pq) > 0 &&
-			heap_peek(&live_sub_effects_pq, NULL) <= ms) {
-		void* top;
-		heap_pop(&live_sub_effects_pq, &top);
-
-		LiveSubEffect* sub = _get_live_sub_effect((LiveSubEffectIdx)top);
-		assert(!sub->remove);
-
-		_perform_sub_effect(sub);
-
-		sub->remove = true;
-	}
+	// Perform delayed sub effects which are due
+	uint tick = ms / WHEEL_TICK_MS;
+	if(tick > wheel_tick)
+		_wheel_advance(tick);
 
 
 	// Update ambient sounds
@@ -529,16 +650,11 @@ void mfx_update(void) {
 }
 
 static void _mfx_trigger(
-		const char* name, Vector2 pos, float dir, 
+		MetaEffectIdx idx, Vector2 pos, float dir, 
 		const Vector2* pos_follow, const float* dir_follow) {
-	assert(name);
 
-	MetaEffectIdx idx = (MetaEffectIdx)dict_get(&meta_effect_dict, name);
-#ifdef _DEBUG
-	if(idx == 0)
-		LOG_ERROR("Trying to trigger non-existing metaeffect %s", name);
-#endif
-	MetaEffect* mfx = _get_meta_effect(idx-1);
+	MetaEffect* mfx = _get_meta_effect(idx);
+	uint delay_base = lrintf(time_s() * 1000.0f);
 
 	// If there are random subs - choose which one to perform
 	uint random_effect = ~0;
@@ -581,41 +697,110 @@ static void _mfx_trigger(
 			_perform_sub_effect(&live);
 		}
 		else {
-			// Find a removed live effect, or add new one
-			LiveSubEffectIdx dest = ~0;
-			LiveSubEffect* lives = darray_get(&live_sub_effects, 0);
-			for(uint j = 0; j < live_sub_effects.size; ++j) {
-                LiveSubEffect* l = &lives[j];
-				if(l->remove) {
-					dest = j;
-					break;
-				}
-			}
-			if(dest != ~0) {
-				lives[dest] = live;
+			// Round up, so that effect is never performed too early
+			uint fire_ms = delay_base + lrintf(sub->delay * 1000.0f);
+			live.fire_tick = (fire_ms + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS;
+
+			// Reuse a removed live effect, or add new one
+			LiveSubEffectIdx dest;
+			if(live_sub_effects_free.size) {
+				LiveSubEffectIdx* free_idx = DARRAY_DATA_PTR(
+					live_sub_effects_free, LiveSubEffectIdx
+				);
+				dest = free_idx[--live_sub_effects_free.size];
+				*_get_live_sub_effect(dest) = live;
 			}
 			else {
 				darray_append(&live_sub_effects, &live);
 				dest = live_sub_effects.size-1;
 			}
 
-			// Add it to the priority queue
-			uint t = lrintf((time_s() + sub->delay) * 1000.0f);
-			heap_push(&live_sub_effects_pq, t, (void*)dest);
+			_wheel_insert(dest);
+#ifndef NO_DEVMODE
+			m_stats.live_delayed++;
+#endif
+		}
+	}
+}
+
+// Coalesces identical triggers and enforces max_per_frame,
+// returns false if effect should not be performed
+static bool _mfx_admit(MetaEffect* mfx, Vector2 pos, float dir,
+		const Vector2* pos_follow, const float* dir_follow) {
+
+	if(mfx->frame != mfx_frame) {
+		mfx->frame = mfx_frame;
+		mfx->frame_count = 0;
+	}
+	else {
+		if(mfx->last_pos.x == pos.x && mfx->last_pos.y == pos.y &&
+			mfx->last_dir == dir && mfx->last_follow_pos == pos_follow &&
+			mfx->last_follow_dir == dir_follow) {
+#ifndef NO_DEVMODE
+			m_stats.coalesced++;
+			m_stats.frame_coalesced++;
+#endif
+			return false;
+		}
+
+		if(mfx->max_per_frame && mfx->frame_count >= mfx->max_per_frame) {
+#ifndef NO_DEVMODE
+			m_stats.rate_limited++;
+#endif
+			return false;
 		}
 	}
+
+	mfx->frame_count++;
+	mfx->last_pos = pos;
+	mfx->last_dir = dir;
+	mfx->last_follow_pos = pos_follow;
+	mfx->last_follow_dir = dir_follow;
+
+#ifndef NO_DEVMODE
+	m_stats.triggered++;
+	m_stats.frame_triggered++;
+#endif
+	return true;
+}
+
+static void _mfx_trigger_h(
+		MfxHandle handle, Vector2 pos, float dir,
+		const Vector2* pos_follow, const float* dir_follow) {
+
+	MetaEffect* mfx = _get_meta_effect(handle);
+	if(_mfx_admit(mfx, pos, dir, pos_follow, dir_follow))
+		_mfx_trigger(handle, pos, dir, pos_follow, dir_follow);
+}
+
+MfxHandle mfx_get_handle(const char* name) {
+	assert(name);
+
+	MetaEffectIdx idx = (MetaEffectIdx)dict_get(&meta_effect_dict, name);
+	if(idx == 0)
+		LOG_ERROR("Trying to get non-existing metaeffect %s", name);
+
+	return idx-1;
 }
 
 void mfx_trigger(const char* name) {
-	_mfx_trigger(name, vec2(0.0f, 0.0f), 0.0f, NULL, NULL);
+	_mfx_trigger_h(mfx_get_handle(name), vec2(0.0f, 0.0f), 0.0f, NULL, NULL);
 }
 
 void mfx_trigger_ex(const char* name, Vector2 pos, float dir) {
-	_mfx_trigger(name, pos, dir, NULL, NULL);
+	_mfx_trigger_h(mfx_get_handle(name), pos, dir, NULL, NULL);
 }
 
 void mfx_trigger_follow(const char* name, const Vector2* pos, const float* dir) {
-	_mfx_trigger(name, vec2(0.0f, 0.0f), 0.0f, pos, dir);
+	_mfx_trigger_h(mfx_get_handle(name), vec2(0.0f, 0.0f), 0.0f, pos, dir);
+}
+
+void mfx_trigger_h(MfxHandle handle, Vector2 pos, float dir) {
+	_mfx_trigger_h(handle, pos, dir, NULL, NULL);
+}
+
+void mfx_trigger_follow_h(MfxHandle handle, const Vector2* pos, const float* dir) {
+	_mfx_trigger_h(handle, vec2(0.0f, 0.0f), 0.0f, pos, dir);
 }
 
 // ---
@@ -679,10 +864,14 @@ static LiveSnd* _get_playing(SndDefIdx idx) {
 
 void mfx_snd_play(const char* name) {
 	SndDefIdx idx = (SndDefIdx)dict_get(&snd_dict, name);
+	_snd_play(idx);
+}
+
+static void _snd_play(SndDefIdx idx) {
 	SndDef* def = _get_snd_def(idx);
 
 	if(!def->loaded)
-		_snd_load(def, name);
+		_snd_load(def, def->name);
 
 	if(def->type == SND_AMBIENT) {
 		LiveSnd* live = _get_playing(idx);
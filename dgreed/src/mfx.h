@@ -28,6 +28,8 @@ Example desc:
 
 	(effects _
 		(e collide
+			(max_per_frame 4) # identical triggers in a frame are always
+			                  # coalesced, this limits distinct ones
 			(sound hit.wav)
 			(sound hit_echo.wav
 				(delay 0.4)
@@ -72,13 +74,34 @@ Example desc:
 
 */
 
+#ifndef NO_DEVMODE
+typedef struct {
+	uint triggered;
+	uint coalesced;
+	uint rate_limited;
+	uint live_delayed;
+
+	// Per-frame stats
+	uint frame_triggered;
+	uint frame_coalesced;
+} MfxStats;
+
+const MfxStats* mfx_stats(void);
+#endif
+
+typedef uint MfxHandle;
+
 void mfx_init(const char* desc);
 void mfx_close(void);
 void mfx_update(void);
 
+MfxHandle mfx_get_handle(const char* name);
+
 void mfx_trigger(const char* name);
 void mfx_trigger_ex(const char* name, Vector2 pos, float dir);
 void mfx_trigger_follow(const char* name, const Vector2* pos, const float* dir);
+void mfx_trigger_h(MfxHandle handle, Vector2 pos, float dir);
+void mfx_trigger_follow_h(MfxHandle handle, const Vector2* pos, const float* dir);
 
 float mfx_snd_volume(void);
 void mfx_snd_set_volume(float volume);
@@ -28,6 +28,7 @@ bool _is_whitespace(char c) {
 StrIdx _alloc_str(MMLObject* mml, uint length) {
 	assert(mml);
 	assert(length);
+	assert(!mml->static_pools);
 	
 	uint new_size, req_size = mml->str_pool.size + length;
 	if(req_size <= mml->str_pool.reserved)
@@ -48,6 +49,7 @@ end:
 // Allocates new node in node pool
 NodeIdx _alloc_node(MMLObject* mml) {
 	assert(mml);
+	assert(!mml->static_pools);
 
 	if(mml->node_pool.size + 1 <= mml->node_pool.reserved)
 		goto end;
@@ -64,6 +66,9 @@ void mml_empty(MMLObject* mml) {
 
 	mml->node_pool = darray_create(sizeof(MMLNode), 0);
 	mml->str_pool = darray_create(sizeof(char), 0);
+	mml->static_pools = false;
+	mml->blob = NULL;
+	mml->index = NULL;
 
 	// This code produces warning in release mode:
 	//NodeIdx root = mml_node(mml, "root", "_");
@@ -71,13 +76,116 @@ void mml_empty(MMLObject* mml) {
 	mml_node(mml, "root", "_");
 }	
 
+static void _drop_index(MMLObject* mml);
+
+static bool _is_binary(const char* string) {
+	// Checked char by char to never read past null char of short strings
+	return string[0] == 'M' && string[1] == 'M' && 
+		string[2] == 'L' && string[3] == 'B';
+}
+
+// Validates binary mml of given size, every index and string
+// offset must be inside the pools and nodes reachable from root
+// must form a tree
+static bool _check_binary(MMLObject* mml, const void* data, size_t size) {
+	const MMLBinHeader* hdr = data;
+	if(size < sizeof(MMLBinHeader) || hdr->magic != MML_BIN_MAGIC) {
+		sprintf(mml->last_error, "BINARY: Data is not binary mml");
+		LOG_WARNING(mml->last_error);
+		return false;
+	}
+	if(hdr->version != MML_BIN_VERSION) {
+		sprintf(mml->last_error, "BINARY: Unsupported version %u",
+			hdr->version);
+		LOG_WARNING(mml->last_error);
+		return false;
+	}
+	size_t data_size = size - sizeof(MMLBinHeader);
+	if(hdr->n_nodes == 0 || hdr->str_size == 0 || 
+		hdr->n_nodes > data_size / sizeof(MMLNode) ||
+		hdr->str_size > data_size - hdr->n_nodes * sizeof(MMLNode)) {
+		sprintf(mml->last_error, "BINARY: Truncated data");
+		LOG_WARNING(mml->last_error);
+		return false;
+	}
+
+	const MMLNode* nodes = data + sizeof(MMLBinHeader);
+	const char* strs = (const char*)(nodes + hdr->n_nodes);
+	bool valid = strs[hdr->str_size-1] == '\0';
+	for(uint i = 0; i < hdr->n_nodes && valid; ++i) {
+		valid = nodes[i].name_start < hdr->str_size &&
+			nodes[i].value_start < hdr->str_size &&
+			nodes[i].first_child_idx < hdr->n_nodes &&
+			nodes[i].next_idx < hdr->n_nodes;
+	}
+	if(valid) {
+		// Walk the tree, entering any node twice means links have a cycle
+		// or are shared. Every node is pushed at most once.
+		byte* visited = MEM_ALLOC(hdr->n_nodes);
+		NodeIdx* stack = MEM_ALLOC(hdr->n_nodes * sizeof(NodeIdx));
+		memset(visited, 0, hdr->n_nodes);
+		uint sp = 0;
+		stack[sp++] = 0;
+		visited[0] = 1;
+		while(sp && valid) {
+			const MMLNode* node = &nodes[stack[--sp]];
+			NodeIdx links[] = {node->first_child_idx, node->next_idx};
+			for(uint j = 0; j < ARRAY_SIZE(links) && valid; ++j) {
+				if(links[j] == 0)
+					continue;
+				valid = !visited[links[j]];
+				visited[links[j]] = 1;
+				stack[sp++] = links[j];
+			}
+		}
+		MEM_FREE(stack);
+		MEM_FREE(visited);
+	}
+	if(!valid) {
+		sprintf(mml->last_error, "BINARY: Corrupt data");
+		LOG_WARNING(mml->last_error);
+		return false;
+	}
+	return true;
+}
+
+static bool _deserialize_binary(MMLObject* mml, const void* data,
+	size_t size) {
+	if(!_check_binary(mml, data, size))
+		return false;
+
+	const MMLBinHeader* hdr = data;
+	const void* nodes = data + sizeof(MMLBinHeader);
+	const void* strs = nodes + hdr->n_nodes * sizeof(MMLNode);
+
+	mml->node_pool = darray_create(sizeof(MMLNode), hdr->n_nodes);
+	mml->str_pool = darray_create(sizeof(char), hdr->str_size);
+	darray_append_multi(&mml->node_pool, nodes, hdr->n_nodes);
+	darray_append_multi(&mml->str_pool, strs, hdr->str_size);
+	mml->static_pools = false;
+	mml->blob = NULL;
+	mml->index = NULL;
+
+	return true;
+}
+
 // TODO: Use some magic here to allocate right size pools
 bool mml_deserialize(MMLObject* mml, const char* string) {
 	assert(mml);
 	assert(string);
 
+	if(_is_binary(string)) {
+		sprintf(mml->last_error, 
+			"BINARY: Size unknown, use mml_deserialize_ex or mml_load");
+		LOG_WARNING(mml->last_error);
+		return false;
+	}
+
 	mml->node_pool = darray_create(sizeof(MMLNode), 0);
 	mml->str_pool = darray_create(sizeof(char), 0);
+	mml->static_pools = false;
+	mml->blob = NULL;
+	mml->index = NULL;
 
 	// Tokenize
 	DArray tokens;
@@ -101,9 +209,85 @@ bool mml_deserialize(MMLObject* mml, const char* string) {
 	return true;
 }	
 
+bool mml_deserialize_ex(MMLObject* mml, const void* data, size_t size) {
+	assert(mml);
+	assert(data);
+
+	if(size >= 4 && _is_binary(data))
+		return _deserialize_binary(mml, data, size);
+
+	return mml_deserialize(mml, data);
+}
+
+bool mml_deserialize_static(MMLObject* mml, const void* data, size_t size) {
+	assert(mml);
+	assert(data);
+	assert(((size_t)data & 3) == 0);
+
+	if(!_check_binary(mml, data, size))
+		return false;
+
+	const MMLBinHeader* hdr = data;
+	void* nodes = (void*)data + sizeof(MMLBinHeader);
+	void* strs = nodes + hdr->n_nodes * sizeof(MMLNode);
+
+	mml->node_pool.data = nodes;
+	mml->node_pool.item_size = sizeof(MMLNode);
+	mml->node_pool.size = mml->node_pool.reserved = hdr->n_nodes;
+
+	mml->str_pool.data = strs;
+	mml->str_pool.item_size = sizeof(char);
+	mml->str_pool.size = mml->str_pool.reserved = hdr->str_size;
+
+	mml->static_pools = true;
+	mml->blob = NULL;
+	mml->index = NULL;
+
+	return true;
+}
+
+bool mml_load(MMLObject* mml, const char* filename) {
+	assert(mml);
+	assert(filename);
+
+	FileHandle file = file_open(filename);
+	uint size = file_size(file);
+	char* data = MEM_ALLOC(size+1);
+	data[size] = '\0';
+	file_read(file, data, size);
+	file_close(file);
+
+	bool res;
+	if(size >= 4 && _is_binary(data)) {
+		// Binary mml is used in place, object owns the buffer
+		res = mml_deserialize_static(mml, data, size);
+		if(res)
+			mml->blob = data;
+		else
+			MEM_FREE(data);
+	}
+	else {
+		res = mml_deserialize(mml, data);
+		MEM_FREE(data);
+	}
+	return res;
+}
+
+
 void mml_free(MMLObject* mml) {
 	assert(mml);
 
+	_drop_index(mml);
+
+	if(mml->static_pools) {
+		if(mml->blob)
+			MEM_FREE(mml->blob);
+		mml->blob = NULL;
+		mml->node_pool.data = mml->str_pool.data = NULL;
+		mml->static_pools = false;
+		return;
+	}
+
 	darray_free(&(mml->node_pool));
 	darray_free(&(mml->str_pool));
 }
@@ -193,6 +377,35 @@ char* mml_serialize_compact(MMLObject* mml) {
 	return (char*)out.data;
 }	
 
+void* mml_serialize_binary(MMLObject* mml, size_t* size) {
+	assert(mml);
+	assert(size);
+
+	size_t nodes_size = mml->node_pool.size * sizeof(MMLNode);
+	size_t strs_size = mml->str_pool.size;
+
+	MMLBinHeader hdr = {
+		.magic = MML_BIN_MAGIC,
+		.version = MML_BIN_VERSION,
+		.n_nodes = mml->node_pool.size,
+		.str_size = strs_size
+	};
+
+	// Pad strings, so that binary blobs can be concatenated
+	// without breaking alignment
+	size_t padded_strs_size = align_padding(strs_size, 4);
+	*size = sizeof(hdr) + nodes_size + padded_strs_size;
+
+	void* out = MEM_ALLOC(*size);
+	memcpy(out, &hdr, sizeof(hdr));
+	memcpy(out + sizeof(hdr), mml->node_pool.data, nodes_size);
+	memcpy(out + sizeof(hdr) + nodes_size, mml->str_pool.data, strs_size);
+	memset(out + sizeof(hdr) + nodes_size + strs_size, 0, 
+		padded_strs_size - strs_size);
+
+	return out;
+}
+
 NodeIdx mml_root(MMLObject* mml) {
 	// Root is always at index 0
 	return 0;
@@ -233,6 +446,7 @@ const char* mml_get_name(MMLObject* mml, NodeIdx node) {
 
 StrIdx _set_str(MMLObject* mml, StrIdx str_idx, const char* new_str) {
 	assert(mml);
+	assert(!mml->static_pools);
 	assert(new_str);
 	assert(str_idx < mml->str_pool.size);
 
@@ -259,6 +473,8 @@ void mml_set_name(MMLObject* mml, NodeIdx node, const char* name) {
 	assert(name);
 	assert(node < mml->node_pool.size);
 
+	_drop_index(mml);
+
 	MMLNode* node_ptr = mml_get_nodeptr(mml, node);
 	node_ptr->name_start = _set_str(mml, node_ptr->name_start, name);
 }
@@ -290,33 +506,176 @@ uint mml_count_children(MMLObject* mml, NodeIdx parent) {
 	return count;
 }	
 
+// Child index - open addressing hash table, keyed by parent node and
+// child name, pointing to first child with that name. Further children
+// with the same name are chained through next_same.
+
+#define NO_PARENT MAX_UINT32
+
+typedef struct {
+	uint hash;
+	NodeIdx parent;
+	NodeIdx first;
+	NodeIdx last;
+} MMLIndexEntry;
+
+typedef struct {
+	NodeIdx parent;
+	uint ordinal;
+	NodeIdx next_same;
+} MMLIndexNode;
+
+typedef struct MMLChildIndex {
+	uint n_nodes;
+	uint mask;
+	MMLIndexNode* nodes;
+	MMLIndexEntry* entries;
+} MMLChildIndex;
+
+static void _drop_index(MMLObject* mml) {
+	if(mml->index) {
+		MEM_FREE(mml->index);
+		mml->index = NULL;
+	}
+}
+
+static uint _hash_name(const char* name, NodeIdx parent) {
+	return hash_murmur(name, strlen(name), parent);
+}
+
+// Returns entry for parent/name pair, or empty slot where it belongs
+static MMLIndexEntry* _index_slot(MMLObject* mml, NodeIdx parent, 
+	const char* name, uint hash) {
+	MMLChildIndex* index = mml->index;
+	uint i = hash & index->mask;
+	while(true) {
+		MMLIndexEntry* e = &index->entries[i];
+		if(e->first == 0)
+			return e;
+		if(e->hash == hash && e->parent == parent &&
+			strcmp(name, mml_get_name(mml, e->first)) == 0)
+			return e;
+		i = (i + 1) & index->mask;
+	}
+}
+
+static void _index_children(MMLObject* mml, NodeIdx parent) {
+	MMLChildIndex* index = mml->index;
+	uint ordinal = 0;
+	NodeIdx child = mml_get_first_child(mml, parent);
+	for(; child != 0; child = mml_get_next(mml, child)) {
+		MMLIndexNode* node = &index->nodes[child];
+		node->parent = parent;
+		node->ordinal = ordinal++;
+
+		const char* name = mml_get_name(mml, child);
+		uint hash = _hash_name(name, parent);
+		MMLIndexEntry* e = _index_slot(mml, parent, name, hash);
+		if(e->first == 0) {
+			e->hash = hash;
+			e->parent = parent;
+			e->first = child;
+		}
+		else {
+			index->nodes[e->last].next_same = child;
+		}
+		e->last = child;
+	}
+}
+
+static void _build_index(MMLObject* mml) {
+	assert(!mml->index);
+
+	uint n_nodes = mml->node_pool.size;
+	uint n_entries = next_pow2(n_nodes * 2);
+	size_t nodes_size = n_nodes * sizeof(MMLIndexNode);
+	size_t entries_size = n_entries * sizeof(MMLIndexEntry);
+
+	MMLChildIndex* index = MEM_ALLOC(sizeof(MMLChildIndex) + 
+		nodes_size + entries_size);
+	index->n_nodes = n_nodes;
+	index->mask = n_entries - 1;
+	index->nodes = (void*)index + sizeof(MMLChildIndex);
+	index->entries = (void*)index->nodes + nodes_size;
+	memset(index->entries, 0, entries_size);
+	for(uint i = 0; i < n_nodes; ++i) {
+		index->nodes[i].parent = NO_PARENT;
+		index->nodes[i].next_same = 0;
+	}
+	mml->index = index;
+
+	// Index children of every node reachable from root, breadth-first
+	NodeIdx* queue = MEM_ALLOC(n_nodes * sizeof(NodeIdx));
+	uint head = 0, tail = 0;
+	queue[tail++] = mml_root(mml);
+	while(head < tail) {
+		NodeIdx parent = queue[head++];
+		_index_children(mml, parent);
+		NodeIdx child = mml_get_first_child(mml, parent);
+		for(; child != 0 && tail < n_nodes; child = mml_get_next(mml, child))
+			queue[tail++] = child;
+	}
+	MEM_FREE(queue);
+}
+
+// Returns true if children of node are in the index
+static bool _is_indexed(MMLObject* mml, NodeIdx node) {
+	MMLChildIndex* index = mml->index;
+	return node == 0 || 
+		(node < index->n_nodes && index->nodes[node].parent != NO_PARENT);
+}
+
+static NodeIdx _index_get_child(MMLObject* mml, NodeIdx parent,
+	const char* name) {
+	uint hash = _hash_name(name, parent);
+	return _index_slot(mml, parent, name, hash)->first;
+}
+
 NodeIdx mml_get_child(MMLObject* mml, NodeIdx parent, const char* name) {
 	assert(mml);
 	assert(name);
 	assert(parent < mml->node_pool.size);
 
+	if(mml->index && _is_indexed(mml, parent))
+		return _index_get_child(mml, parent, name);
+
 	NodeIdx child = mml_get_first_child(mml, parent);
 	while(child) {
 		if(strcmp(name, mml_get_name(mml, child)) == 0)
-			return child;
+			break;
 		child = mml_get_next(mml, child);	
 	}
-	return 0;
+	return child;
 }	
 
+static NodeIdx _index_get_sibling(MMLObject* mml, NodeIdx node,
+	const char* name) {
+	MMLIndexNode* nodes = mml->index->nodes;
+	if(strcmp(name, mml_get_name(mml, node)) == 0)
+		return nodes[node].next_same;
+
+	NodeIdx sibling = _index_get_child(mml, nodes[node].parent, name);
+	while(sibling && nodes[sibling].ordinal < nodes[node].ordinal)
+		sibling = nodes[sibling].next_same;
+	return sibling;
+}
+
 NodeIdx mml_get_sibling(MMLObject* mml, NodeIdx node, const char* name) {
 	assert(mml);
 	assert(name);
 	assert(node);
 	assert(node < mml->node_pool.size);
 
+	if(mml->index && _is_indexed(mml, node))
+		return _index_get_sibling(mml, node, name);
+
 	node = mml_get_next(mml, node);
 	while(node) {
 		if(strcmp(name, mml_get_name(mml, node)) == 0)
-			return node;
+			break;
 		node = mml_get_next(mml, node);	
 	}
-	return 0;
+	return node;
 }
 
 bool mml_remove_child(MMLObject* mml, NodeIdx parent, const char* name) {
@@ -324,6 +683,8 @@ bool mml_remove_child(MMLObject* mml, NodeIdx parent, const char* name) {
 	assert(name);
 	assert(parent < mml->node_pool.size);
 
+	_drop_index(mml);
+
 	NodeIdx last_child = 0;
 	NodeIdx child = mml_get_first_child(mml, parent);
 	while(child) {
@@ -355,6 +716,8 @@ bool mml_insert_after(MMLObject* mml, NodeIdx parent, NodeIdx new,
 	assert(parent < mml->node_pool.size);
 	assert(new < mml->node_pool.size);
 
+	_drop_index(mml);
+
 	NodeIdx child = mml_get_first_child(mml, parent);
 	while(child) {
 		if(strcmp(name, mml_get_name(mml, child)) == 0) {
@@ -374,6 +737,8 @@ void mml_append(MMLObject* mml, NodeIdx parent, NodeIdx new) {
 	assert(parent < mml->node_pool.size);
 	assert(new < mml->node_pool.size);
 
+	_drop_index(mml);
+
 	NodeIdx last_child = 0;
 	NodeIdx child = mml_get_first_child(mml, parent);
 
@@ -396,7 +761,10 @@ void mml_append(MMLObject* mml, NodeIdx parent, NodeIdx new) {
 }	
 
 void mml_cleanup(MMLObject* mml) {
-	// TODO: implement this
+	assert(mml);
+
+	_drop_index(mml);
+	_build_index(mml);
 }	
 
 const char* mml_getval_str(MMLObject* mml, NodeIdx node) {
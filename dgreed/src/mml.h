@@ -37,14 +37,49 @@ typedef struct {
 typedef struct {
 	DArray node_pool;
 	DArray str_pool;
+	// True if pools point to external binary mml data
+	// (see mml_deserialize_static), such objects must not be modified.
+	bool static_pools;
+	// Binary data owned by static object, freed by mml_free (see mml_load)
+	void* blob;
+	// Optional hashed child index, used by mml_get_child and 
+	// mml_get_sibling. Built only by mml_cleanup, getters never modify
+	// the object. Any change to tree structure or names drops it,
+	// lookups fall back to linear scans.
+	struct MMLChildIndex* index;
 	char last_error[MML_ERROR_SIZE];
 } MMLObject;	
 
+// Binary mml is a header followed by raw node_pool and str_pool contents.
+// All links are pool indexes, so data is position-independent and can be
+// used straight from mmapped file or vfs blob.
+#define MML_BIN_MAGIC FOURCC('M', 'M', 'L', 'B')
+#define MML_BIN_VERSION 1
+
+// 16 bytes
+typedef struct {
+	uint32 magic;
+	uint32 version;
+	uint32 n_nodes;
+	uint32 str_size;
+} MMLBinHeader;
+
 // Creates new, empty MMLObject (it has single node - root) 
 void mml_empty(MMLObject* mml);
 // Parses string and constructs MMLObject representing it.
 // Returns false on error, mml_last_error returns its description.
 bool mml_deserialize(MMLObject* mml, const char* string);
+// Same as mml_deserialize, but also accepts binary mml (produced by
+// mml_serialize_binary or tools/mml.py -c) of given size - pools are
+// validated and copied without any parsing. Text must be null-terminated.
+bool mml_deserialize_ex(MMLObject* mml, const void* data, size_t size);
+// Constructs MMLObject which uses binary mml data in place, nothing is
+// copied. Data must be 4-byte aligned and must outlive the object,
+// object itself must not be modified.
+bool mml_deserialize_static(MMLObject* mml, const void* data, size_t size);
+// Reads text or binary mml file. Binary files are used in place with
+// mml_deserialize_static, such objects must not be modified.
+bool mml_load(MMLObject* mml, const char* filename);
 // Frees all memory used by MMLObject
 void mml_free(MMLObject* mml);
 
@@ -54,6 +89,9 @@ char* mml_serialize(MMLObject* mml);
 // Mostly the same as mml_serialize, returns not nicely formatted but
 // shortest possible string.
 char* mml_serialize_compact(MMLObject* mml);
+// Converts MMLObject to binary mml, returns its size in 'size'.
+// Free returned buffer yourself!
+void* mml_serialize_binary(MMLObject* mml, size_t* size);
 
 // Returns root node.
 NodeIdx mml_root(MMLObject* mml);
@@ -91,9 +129,10 @@ bool mml_insert_after(MMLObject* mml, NodeIdx parent, NodeIdx new,
 // Always succeeds, even if parent node is not attached to tree.
 void mml_append(MMLObject* mml, NodeIdx parent, NodeIdx new);
 
-// Removes all unattached nodes from pool, reorders them to improve
-// locality-of-reference when iterating over children lists.
-// This is costly operation, call only when tree will no longer change.
+// Builds hashed child index, making mml_get_child and mml_get_sibling
+// constant time. Index is dropped when tree structure changes.
+// This is costly operation and index takes memory, call only for large
+// trees which will be queried a lot and will no longer change.
 void mml_cleanup(MMLObject* mml);
 
 // Converts node values to some common types.
@@ -65,16 +65,10 @@ void particles_init_ex(const char* assets_prefix, const char* filename, uint lay
 	}
 	strcat(desc_path, filename);
 
-	char* desc_text = txtfile_read(desc_path);
-	if(!desc_text)
-		LOG_ERROR("Unable to read particle description file");
-
 	MMLObject desc;
-	if(!mml_deserialize(&desc, desc_text))
+	if(!mml_load(&desc, desc_path))
 		LOG_ERROR("Failed to deserialize particle description file");
 
-	MEM_FREE(desc_text);	
-
 	NodeIdx root = mml_root(&desc);
 	if(strcmp(mml_get_name(&desc, root), "particles") != 0)
 		LOG_ERROR("Invalid particle description file");
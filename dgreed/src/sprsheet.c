@@ -5,9 +5,11 @@
 #include "darray.h"
 #include "memory.h"
 #include "gfx_utils.h"
+#include "image.h"
+#include "maxrects.h"
 
 typedef struct {
-	// Common
+	// Common, tex_name is NULL for sprites in runtime atlases
 	const char* tex_name;
 	TexHandle tex;
 	RectF src;
@@ -19,6 +21,14 @@ typedef struct {
 	uint grid_w, grid_h;
 	Vector2 tex_size;
 	Vector2 offset;
+
+	// Precomputed on first use: source rect of every frame and
+	// half of the scaled destination size
+	RectF* frame_src;
+	Vector2 half_size;
+
+	// Frame when sprite was last drawn or queried
+	uint last_use;
 } SprDesc;
 
 // Global state
@@ -31,6 +41,33 @@ static Dict sprsheet_dict;
 static MMLObject sprsheet_mml;
 static DArray sprsheet_descs;
 
+// Runtime atlases for sprites added with sprsheet_add_img
+#define SPRSHEET_ATLAS_SIZE 1024
+#define SPRSHEET_ATLAS_PADDING 1
+
+typedef struct {
+	TexHandle tex;
+	MaxRects packer;
+} RuntimeAtlas;
+
+static DArray sprsheet_atlases;
+static DArray sprsheet_added_names;
+
+// Residency of sheet textures, least recently used ones are unloaded
+// when total size goes over budget. Budget of 0 means no limit.
+// Textures whose handles were handed out by sprsheet_get* are
+// pinned, callers might keep the handle around.
+typedef struct {
+	TexHandle tex;
+	uint bytes;
+	uint last_use;
+	bool pinned;
+} ResidentTex;
+
+static uint sprsheet_budget;
+static uint sprsheet_evictions;
+static DArray sprsheet_resident;
+
 static void _parse_img(NodeIdx node) {
 	const char* name = mml_getval_str(&sprsheet_mml, node);
 
@@ -83,7 +120,9 @@ static void _parse_img(NodeIdx node) {
 		.grid_w = 0,
 		.grid_h = 0,
 		.tex_size = {0.0f, 0.0f},
-		.offset = {0.0f, 0.0f}
+		.offset = {0.0f, 0.0f},
+		.frame_src = NULL,
+		.last_use = 0
 	};
 
 	darray_append(&sprsheet_descs, &new);
@@ -145,7 +184,9 @@ static void _parse_anim(NodeIdx node) {
 		.grid_w = grid_w,
 		.grid_h = grid_h,
 		.tex_size = {0.0f, 0.0f},
-		.offset = offset 
+		.offset = offset,
+		.frame_src = NULL,
+		.last_use = 0
 	};
 
 	darray_append(&sprsheet_descs, &new);
@@ -171,6 +212,14 @@ static SprDesc* _sprsheet_get(const char* name) {
 static RectF _sprsheet_animframe(SprDesc* desc, uint i) {
 	assert(desc);
 	assert(desc->frames > 1);
+	assert(desc->loaded);
+
+	// Get texture size lazily, preloaded texture might still be decoding
+	if(desc->tex_size.x == 0.0f) {
+		uint tex_w, tex_h;
+		tex_size(desc->tex, &tex_w, &tex_h);
+		desc->tex_size = vec2((float)tex_w, (float)tex_h);
+	}
 	assert(desc->tex_size.x > 0.0f && desc->tex_size.y > 0.0f);
 
 	if(i >= desc->frames)
@@ -203,7 +252,117 @@ static RectF _sprsheet_animframe(SprDesc* desc, uint i) {
 	return src;
 }
 
-static void _sprsheet_load(SprDesc* desc) {
+// Returns source rects of all frames, computing them once
+static RectF* _sprsheet_frames(SprDesc* desc) {
+	assert(desc->loaded);
+
+	if(!desc->frame_src) {
+		RectF src = desc->src;
+
+		desc->frame_src = MEM_ALLOC(sizeof(RectF) * desc->frames);
+		if(desc->frames > 1) {
+			for(uint i = 0; i < desc->frames; ++i)
+				desc->frame_src[i] = _sprsheet_animframe(desc, i);
+		}
+		else {
+			// Img without src is the whole texture, 
+			// same as in gfx_draw_textured_rect
+			if(src.right == 0.0f && src.bottom == 0.0f) {
+				uint tex_w, tex_h;
+				tex_size(desc->tex, &tex_w, &tex_h);
+				src = rectf(0.0f, 0.0f, (float)tex_w, (float)tex_h);
+			}
+			desc->frame_src[0] = src;
+		}
+
+		desc->half_size = vec2(
+			rectf_width(&src) * sprsheet_scale * 0.5f,
+			rectf_height(&src) * sprsheet_scale * 0.5f
+		);
+	}
+
+	return desc->frame_src;
+}
+
+static void _sprsheet_unload_tex(TexHandle tex) {
+	for(uint i = 0; i < sprsheet_descs.size; ++i) {
+		SprDesc* d = darray_get(&sprsheet_descs, i);
+		if(d->loaded && d->tex_name && d->tex == tex) {
+			d->loaded = false;
+			tex_free(d->tex);
+		}
+	}
+
+	ResidentTex* res = DARRAY_DATA_PTR(sprsheet_resident, ResidentTex);
+	for(uint i = 0; i < sprsheet_resident.size; ++i) {
+		if(res[i].tex == tex) {
+			darray_remove_fast(&sprsheet_resident, i);
+			break;
+		}
+	}
+}
+
+// Unloads least recently used textures until resident textures fit 
+// into budget. Textures used this frame, still loading, pinned or 
+// pointed to by keep stay.
+static void _sprsheet_enforce_budget(const TexHandle* keep) {
+	ResidentTex* res = DARRAY_DATA_PTR(sprsheet_resident, ResidentTex);
+
+	// Size is known only after background loading is done,
+	// assume 32bpp - compressed textures are overestimated
+	uint total = 0;
+	for(uint i = 0; i < sprsheet_resident.size; ++i) {
+		if(res[i].bytes == 0 && tex_is_ready(res[i].tex)) {
+			uint w, h;
+			tex_size(res[i].tex, &w, &h);
+			res[i].bytes = w * h * 4;
+		}
+		total += res[i].bytes;
+	}
+
+	if(sprsheet_budget && total > sprsheet_budget) {
+		// Gather last use frames from sprites
+		SprDesc* descs = DARRAY_DATA_PTR(sprsheet_descs, SprDesc);
+		for(uint i = 0; i < sprsheet_descs.size; ++i) {
+			if(!descs[i].loaded || !descs[i].tex_name)
+				continue;
+			for(uint j = 0; j < sprsheet_resident.size; ++j) {
+				if(res[j].tex == descs[i].tex) {
+					res[j].last_use = MAX(res[j].last_use, descs[i].last_use);
+					break;
+				}
+			}
+		}
+
+		uint frame = video_get_frame();
+		while(total > sprsheet_budget) {
+			int lru = -1;
+			for(uint i = 0; i < sprsheet_resident.size; ++i) {
+				if(res[i].last_use >= frame || res[i].bytes == 0 || res[i].pinned)
+					continue;
+				if(keep && res[i].tex == *keep)
+					continue;
+				if(lru < 0 || res[i].last_use < res[lru].last_use)
+					lru = i;
+			}
+
+			if(lru < 0)
+				break;
+
+			total -= res[lru].bytes;
+			_sprsheet_unload_tex(res[lru].tex);
+			sprsheet_evictions++;
+		}
+	}
+
+#ifndef NO_DEVMODE
+	video_stats_residency(total, sprsheet_evictions);
+#endif
+}
+
+// Preloaded textures are loaded in the background, sprites using them
+// are not drawn until they're ready
+static void _sprsheet_load(SprDesc* desc, bool async) {
 	assert(desc);
 	assert(!desc->loaded);
 
@@ -227,24 +386,70 @@ static void _sprsheet_load(SprDesc* desc) {
 #endif
 
 	// Load
-	desc->tex = tex_load(path);
+	desc->tex = async ? tex_load_async(path) : tex_load(path);
 
-	// Get texture size for animations
-	if(desc->frames > 1) {
-		uint tex_w, tex_h;
-		tex_size(desc->tex, &tex_w, &tex_h);
-		desc->tex_size = vec2((float)tex_w, (float)tex_h);
+	desc->loaded = true;
+	desc->last_use = video_get_frame();
+
+	// Same texture can be shared by many sprites
+	ResidentTex* res = DARRAY_DATA_PTR(sprsheet_resident, ResidentTex);
+	for(uint i = 0; i < sprsheet_resident.size; ++i) {
+		if(res[i].tex == desc->tex)
+			return;
 	}
 
-	desc->loaded = true;
+	ResidentTex new = {
+		.tex = desc->tex,
+		.bytes = 0,
+		.last_use = desc->last_use,
+		.pinned = false
+	};
+	darray_append(&sprsheet_resident, &new);
+
+	_sprsheet_enforce_budget(&desc->tex);
+}
+
+// Texture handle is given to the caller, never unload it for budget
+static void _sprsheet_pin(TexHandle tex) {
+	ResidentTex* res = DARRAY_DATA_PTR(sprsheet_resident, ResidentTex);
+	for(uint i = 0; i < sprsheet_resident.size; ++i) {
+		if(res[i].tex == tex) {
+			res[i].pinned = true;
+			return;
+		}
+	}
+}
+
+// Starts loading all sprites in comma separated list
+static void _sprsheet_preload(const char* list) {
+	char* pre_list = strclone(list);
+	const char* sprite = strtok(pre_list, ",");
+	uint frame = video_get_frame();
+	while(sprite) {
+		SprDesc* desc = _sprsheet_get(sprite);
+		if(!desc) {
+			LOG_ERROR("Item %s in preload list is undefined!", sprite);
+		}
+		else {
+			// Load
+			if(!desc->loaded) 
+				_sprsheet_load(desc, true);
+
+			// Protect from eviction until next frame
+			desc->last_use = frame;
+		
+			// Continue to next preload list item
+			sprite = strtok(NULL, ",");
+		}
+	}
+	MEM_FREE(pre_list);
 }
 
 static void _sprsheet_load_desc(const char* desc) {
     // Read mml
-	char* mml_text = txtfile_read(desc); 
-	if(!mml_deserialize(&sprsheet_mml, mml_text))
+	if(!mml_load(&sprsheet_mml, desc))
 		LOG_ERROR("Unable to parse sprsheet desc %s", desc);
-	MEM_FREE(mml_text);
+	mml_cleanup(&sprsheet_mml);
 
 	NodeIdx root = mml_root(&sprsheet_mml);
 	if(strcmp(mml_get_name(&sprsheet_mml, root), "sprsheet") != 0)
@@ -277,26 +482,8 @@ static void _sprsheet_load_desc(const char* desc) {
 
 	// Do preloading
 	NodeIdx preload = mml_get_child(&sprsheet_mml, root, "preload");	
-	if(preload) {
-		const char* immutable_pre_list = mml_getval_str(&sprsheet_mml, preload);
-		char* pre_list = strclone(immutable_pre_list);
-		const char* sprite = strtok(pre_list, ",");
-		while(sprite) {
-			SprDesc* desc = _sprsheet_get(sprite);
-			if(!desc) {
-				LOG_ERROR("Item %s in preload list is undefined!", sprite);
-            }
-            else {
-                // Load
-                if(!desc->loaded) 
-                    _sprsheet_load(desc);
-			
-                // Continue to next preload list item
-                sprite = strtok(NULL, ",");
-            }
-		}
-		MEM_FREE(pre_list);
-	}
+	if(preload)
+		_sprsheet_preload(mml_getval_str(&sprsheet_mml, preload));
 }
 
 void sprsheet_init(const char* desc) {
@@ -307,8 +494,14 @@ void sprsheet_init(const char* desc) {
 	//sprsheet_descs = darray_create(sizeof(SprDesc), 0);
 	sprsheet_prefix[0] = '\0';
 	sprsheet_scale = 1.0f;
+	sprsheet_budget = 0;
+	sprsheet_evictions = 0;
+	sprsheet_resident = darray_create(sizeof(ResidentTex), 0);
 	_sprsheet_load_desc(desc);
 
+	sprsheet_atlases = darray_create(sizeof(RuntimeAtlas), 0);
+	sprsheet_added_names = darray_create(sizeof(char*), 0);
+
 	sprsheet_initialized = true;
 }
 
@@ -318,11 +511,27 @@ void sprsheet_close(void) {
 	// Free textures
 	SprDesc* descs = DARRAY_DATA_PTR(sprsheet_descs, SprDesc);
 	for(uint i = 0; i < sprsheet_descs.size; ++i) {
-		if(descs[i].loaded) 
+		if(descs[i].loaded && descs[i].tex_name) 
 			tex_free(descs[i].tex);
+		if(descs[i].frame_src)
+			MEM_FREE(descs[i].frame_src);
+	}
+
+	// Free runtime atlases
+	RuntimeAtlas* atlases = DARRAY_DATA_PTR(sprsheet_atlases, RuntimeAtlas);
+	for(uint i = 0; i < sprsheet_atlases.size; ++i) {
+		tex_free(atlases[i].tex);
+		maxrects_free(&atlases[i].packer);
 	}
+	darray_free(&sprsheet_atlases);
+
+	char** names = DARRAY_DATA_PTR(sprsheet_added_names, char*);
+	for(uint i = 0; i < sprsheet_added_names.size; ++i)
+		MEM_FREE(names[i]);
+	darray_free(&sprsheet_added_names);
 
 	// Deinit global state
+	darray_free(&sprsheet_resident);
 	mml_free(&sprsheet_mml);
 	darray_free(&sprsheet_descs);
 	dict_free(&sprsheet_dict);
@@ -367,7 +576,10 @@ void sprsheet_get_ex_h(SprHandle handle, TexHandle* tex, RectF* src, Vector2* cn
 		LOG_ERROR("Sprite is an animation");
 
 	if(!desc->loaded)
-		_sprsheet_load(desc);
+		_sprsheet_load(desc, false);
+	desc->last_use = video_get_frame();
+
+	_sprsheet_pin(desc->tex);
 
 	*tex = desc->tex;
 	*src = desc->src;
@@ -388,10 +600,16 @@ void sprsheet_get_anim_h(SprHandle handle, uint frame, TexHandle* tex, RectF* sr
 		LOG_ERROR("Anim is a sprite");
 
 	if(!desc->loaded)
-		_sprsheet_load(desc);
+		_sprsheet_load(desc, false);
+	desc->last_use = video_get_frame();
+
+	if(frame >= desc->frames)
+		LOG_ERROR("Trying to get %u frame out of %u", frame, desc->frames); 
+
+	_sprsheet_pin(desc->tex);
 
 	*tex = desc->tex;
-	*src = _sprsheet_animframe(desc, frame);
+	*src = _sprsheet_frames(desc)[frame];
 }
 
 uint sprsheet_get_anim_frames(const char* name) {
@@ -425,15 +643,103 @@ void sprsheet_unload(const char* name) {
 void sprsheet_unload_h(SprHandle handle) {
 	SprDesc* desc = _get_desc(handle);
 
-	for(uint i = 0; i < sprsheet_descs.size; ++i) {
-		SprDesc* d = darray_get(&sprsheet_descs, i);
-		if(d->tex == desc->tex) {
-			d->loaded = false;
-			tex_free(d->tex);
+	// Runtime atlases live until sprsheet_close
+	if(!desc->tex_name || !desc->loaded)
+		return;
+
+	_sprsheet_unload_tex(desc->tex);
+}
+
+void sprsheet_set_budget(uint bytes) {
+	sprsheet_budget = bytes;
+	_sprsheet_enforce_budget(NULL);
+}
+
+void sprsheet_prefetch(const char* names) {
+	assert(names);
+	_sprsheet_preload(names);
+}
+
+SprHandle sprsheet_add_img(const char* name, const char* filename) {
+	assert(sprsheet_initialized);
+	assert(name && filename);
+
+	if(dict_get(&sprsheet_dict, name))
+		LOG_ERROR("Sprite %s already exists", name);
+
+	char path[128];
+	assert(strlen(sprsheet_prefix) + strlen(filename) < 128);
+	strcpy(path, sprsheet_prefix);
+	strcat(path, filename);
+
+	uint w, h;
+	PixelFormat format;
+	Color* pixels = image_load(path, &w, &h, &format);
+	if((format & PF_MASK_PIXEL_FORMAT) != PF_RGBA8888)
+		LOG_ERROR("Sprite image %s must be RGBA8888", path);
+
+	// Pad with edge pixels, so that filtering doesn't bleed neighbours in
+	const int p = SPRSHEET_ATLAS_PADDING;
+	uint pw = w + p * 2, ph = h + p * 2;
+	if(pw > SPRSHEET_ATLAS_SIZE || ph > SPRSHEET_ATLAS_SIZE)
+		LOG_ERROR("Sprite image %s is too large for runtime atlas", path);
+
+	Color* padded = MEM_ALLOC(pw * ph * sizeof(Color));
+	for(int y = 0; y < (int)ph; ++y) {
+		int sy = MIN(MAX(y - p, 0), (int)h - 1);
+		for(int x = 0; x < (int)pw; ++x) {
+			int sx = MIN(MAX(x - p, 0), (int)w - 1);
+			padded[IDX_2D(x, y, pw)] = pixels[IDX_2D(sx, sy, w)];
 		}
 	}
-}
+	free(pixels);
+
+	// Find atlas with enough space, make a new one if all are full
+	uint x, y;
+	RuntimeAtlas* atlas = NULL;
+	for(uint i = 0; i < sprsheet_atlases.size && !atlas; ++i) {
+		RuntimeAtlas* a = darray_get(&sprsheet_atlases, i);
+		if(maxrects_insert(&a->packer, pw, ph, &x, &y))
+			atlas = a;
+	}
+	if(!atlas) {
+		RuntimeAtlas new = {
+			.tex = tex_create(SPRSHEET_ATLAS_SIZE, SPRSHEET_ATLAS_SIZE)
+		};
+		maxrects_init(&new.packer, SPRSHEET_ATLAS_SIZE, SPRSHEET_ATLAS_SIZE);
+		darray_append(&sprsheet_atlases, &new);
+		atlas = darray_get(&sprsheet_atlases, sprsheet_atlases.size-1);
+
+		bool fits = maxrects_insert(&atlas->packer, pw, ph, &x, &y);
+		assert(fits);
+	}
+
+	tex_blit(atlas->tex, padded, x, y, pw, ph);
+	MEM_FREE(padded);
+
+	SprDesc new = {
+		.tex_name = NULL,
+		.tex = atlas->tex,
+		.src = rectf(x + p, y + p, x + p + w, y + p + h),
+		.cntr_off = vec2(0.0f, 0.0f),
+		.loaded = true,
+		.frames = 1,
+		.grid_w = 0,
+		.grid_h = 0,
+		.tex_size = {0.0f, 0.0f},
+		.offset = {0.0f, 0.0f},
+		.frame_src = NULL,
+		.last_use = 0
+	};
+	darray_append(&sprsheet_descs, &new);
 
+	// Dict doesn't own keys
+	char* key = strclone(name);
+	darray_append(&sprsheet_added_names, &key);
+	dict_insert(&sprsheet_dict, key, (void*)(NULL+sprsheet_descs.size));
+
+	return sprsheet_descs.size - 1;
+}
 
 // Rendering helpers
 
@@ -487,49 +793,76 @@ void spr_draw_anim_h(SprHandle handle, uint frame, uint layer, RectF dest, Color
 
 void spr_draw_cntr(const char* name, uint layer, Vector2 dest, float rot,
 		float scale, Color tint) {
-	TexHandle tex;
-	RectF src;
-	Vector2 cntr_off;
+	spr_draw_cntr_h(sprsheet_get_handle(name), layer, dest, rot, scale, tint);
+}
 
-	sprsheet_get_ex(name, &tex, &src, &cntr_off);
+// Draws precomputed frame of loaded desc centered at dest
+static void _draw_frame(SprDesc* desc, uint frame, uint layer, Vector2 dest,
+		float rot, float scale, Color tint) {
+	RectF* src = &_sprsheet_frames(desc)[frame];
+	desc->last_use = video_get_frame();
+	float hw = desc->half_size.x * scale;
+	float hh = desc->half_size.y * scale;
 
-	if(cntr_off.x != 0.0f || cntr_off.y != 0.0f)
-		dest = vec2_add(dest, vec2_rotate(cntr_off, rot));
+	if(desc->cntr_off.x != 0.0f || desc->cntr_off.y != 0.0f)
+		dest = vec2_add(dest, vec2_rotate(desc->cntr_off, rot));
 
-	gfx_draw_textured_rect(tex, layer, &src, &dest, rot, scale * sprsheet_scale, tint); 
+	RectF dst = rectf(dest.x - hw, dest.y - hh, dest.x + hw, dest.y + hh);
+	video_draw_rect_rotated(desc->tex, layer, src, &dst, rot, tint);
 }
 
 void spr_draw_cntr_h(SprHandle handle, uint layer, Vector2 dest, float rot,
 		float scale, Color tint) {
-	TexHandle tex;
-	RectF src;
-	Vector2 cntr_off;
-
-	sprsheet_get_ex_h(handle, &tex, &src, &cntr_off);
+	SprDesc* desc = _get_desc(handle);
+	if(desc->frames > 1)
+		LOG_ERROR("Sprite is an animation");
 
-	if(cntr_off.x != 0.0f || cntr_off.y != 0.0f)
-		dest = vec2_add(dest, vec2_rotate(cntr_off, rot));
+	if(!desc->loaded)
+		_sprsheet_load(desc, false);
 
-	gfx_draw_textured_rect(tex, layer, &src, &dest, rot, scale * sprsheet_scale, tint);
+	_draw_frame(desc, 0, layer, dest, rot, scale, tint);
 }
 
 void spr_draw_anim_cntr(const char* name, uint frame, uint layer, Vector2 dest, 
 		float rot, float scale, Color tint) {
-	TexHandle tex;
-	RectF src;
-
-	sprsheet_get_anim(name, frame, &tex, &src);
-
-	gfx_draw_textured_rect(tex, layer, &src, &dest, rot, scale * sprsheet_scale, tint);
+	spr_draw_anim_cntr_h(sprsheet_get_handle(name), frame, layer, dest, 
+		rot, scale, tint);
 }
 
 void spr_draw_anim_cntr_h(SprHandle handle, uint frame, uint layer, Vector2 dest, 
 		float rot, float scale, Color tint) {
-	TexHandle tex;
-	RectF src;
+	SprDesc* desc = _get_desc(handle);
+	if(desc->frames < 2)
+		LOG_ERROR("Anim is a sprite");
 
-	sprsheet_get_anim_h(handle, frame, &tex, &src);
+	if(!desc->loaded)
+		_sprsheet_load(desc, false);
+
+	if(frame >= desc->frames)
+		LOG_ERROR("Trying to get %u frame out of %u", frame, desc->frames); 
 
-	gfx_draw_textured_rect(tex, layer, &src, &dest, rot, scale * sprsheet_scale, tint);
+	_draw_frame(desc, frame, layer, dest, rot, scale, tint);
+}
+
+void spr_draw_batch(const SprDrawItem* items, uint n, uint layer) {
+	assert(items || n == 0);
+
+	SprDesc* descs = DARRAY_DATA_PTR(sprsheet_descs, SprDesc);
+	for(uint i = 0; i < n; ++i) {
+		const SprDrawItem* item = &items[i];
+		assert(item->handle < sprsheet_descs.size);
+		SprDesc* desc = &descs[item->handle];
+
+		if(!desc->loaded)
+			_sprsheet_load(desc, false);
+
+		// Sprites only have frame 0, anims wrap around
+		uint frame = item->frame;
+		if(frame >= desc->frames)
+			frame %= desc->frames;
+
+		_draw_frame(desc, frame, layer, item->pos, item->rot,
+			item->scale, item->tint);
+	}
 }
 
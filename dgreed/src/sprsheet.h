@@ -66,6 +66,22 @@ Vector2 sprsheet_get_size_h(SprHandle handle);
 void sprsheet_unload(const char* name);
 void sprsheet_unload_h(SprHandle handle);
 
+// Sets how many bytes of sheet textures can be resident, when loading
+// goes over it least recently used textures are unloaded. They are
+// loaded again on next draw or get call. Textures whose handles were
+// returned by sprsheet_get* functions are never unloaded for budget,
+// since callers might keep the handle. 0 (default) means no limit.
+void sprsheet_set_budget(uint bytes);
+// Starts loading textures of sprites in comma separated list in the 
+// background, same as preload field in sheet description
+void sprsheet_prefetch(const char* names);
+
+// Loads image and packs it into a shared runtime atlas, so that
+// dynamically loaded sprites batch together. Registers it as img with
+// given name. Atlas textures are freed in sprsheet_close.
+// Sheets with many loose textures can be packed offline with mkatlas.
+SprHandle sprsheet_add_img(const char* name, const char* filename);
+
 // Helper rendering methods:
 
 void spr_draw(const char* name, uint layer, RectF dest, Color tint);
@@ -81,4 +97,18 @@ void spr_draw_anim_cntr(const char* name, uint frame, uint layer, Vector2 dest,
 void spr_draw_anim_cntr_h(SprHandle handle, uint frame, uint layer, Vector2 dest, 
 		float rot, float scale, Color tint);
 
+typedef struct {
+	SprHandle handle;
+	uint frame;
+	Vector2 pos;
+	float rot;
+	float scale;
+	Color tint;
+} SprDrawItem;
+
+// Draws many sprites and anim frames in one call, same as calling
+// spr_draw_cntr_h/spr_draw_anim_cntr_h for each item. Frame is ignored
+// for sprites and wraps around for anims.
+void spr_draw_batch(const SprDrawItem* items, uint n, uint layer);
+
 #endif
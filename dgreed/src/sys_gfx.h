@@ -27,9 +27,14 @@ typedef struct {
 	uint n_layers;
 	uint* layer_rects;
 	uint* layer_lines;
+
+	// Texture residency, reported by sprsheet
+	uint resident_bytes;
+	uint evictions;
 } VideoStats;
 
 const VideoStats* video_stats(void);
+void video_stats_residency(uint resident_bytes, uint evictions);
 #endif
 
 typedef enum {
@@ -63,6 +68,9 @@ void video_set_blendmode(uint layer, BlendMode bmode);
 // Sets a custom 3x2 affine transform matrix for a layer,
 // NULL means identity.
 void video_set_transform(uint layer, float* matrix);
+// Makes textures with mipmaps loaded after this call use trilinear
+// filtering instead of sampling only the nearest mip level
+void video_set_trilinear(bool enable);
 
 typedef size_t TexHandle;
 typedef void (*TexFilter)(Color* texels, uint w, uint h);
@@ -73,6 +81,17 @@ TexHandle tex_create(uint width, uint height);
 TexHandle tex_load(const char* filename);
 // Loads texture and applies custom filtering
 TexHandle tex_load_filter(const char* filename, TexFilter filter);
+// Starts loading texture in the background and returns immediately.
+// File is read and decoded on async workers, uploading is spread over
+// multiple frames in video_present. Handle is valid right away, but
+// nothing is drawn with it until texture is ready. tex_size and tex_blit
+// block until image is decoded.
+TexHandle tex_load_async(const char* filename);
+// Returns true if texture is fully loaded and uploaded
+bool tex_is_ready(TexHandle tex);
+// Sets how many bytes of background loaded textures can be uploaded
+// to the gpu per frame
+void tex_set_upload_budget(uint bytes);
 // Blits image into texture. You are responsible for clipping!
 void tex_blit(TexHandle tex, Color* data, uint x, uint y, uint w, uint h);
 // Returns width and height of texture in pixels
@@ -81,6 +100,10 @@ void tex_size(TexHandle tex, uint* width, uint* height);
 void tex_free(TexHandle tex);
 // Pretend that texture is s times bigger than it actually is
 void tex_scale(TexHandle tex, float s);
+// Marks texture as a signed distance field stored in the alpha channel.
+// GLES2 renders it with a distance field shader, fixed function backends
+// fall back to alpha testing.
+void tex_set_sdf(TexHandle tex, bool sdf);
 
 // Draws textured rectangle. Source can be null rectangle,
 // destination can have 0 for right and bottom.
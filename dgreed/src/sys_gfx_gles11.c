@@ -26,6 +26,7 @@ typedef struct {
 	uint gl_id;
 	float scale;
 	bool active;
+	bool sdf;
 } Texture;
 
 typedef struct {
@@ -82,6 +83,11 @@ VideoStats v_stats;
 const VideoStats* video_stats(void) {
 	return &v_stats;
 }
+
+void video_stats_residency(uint resident_bytes, uint evictions) {
+	v_stats.resident_bytes = resident_bytes;
+	v_stats.evictions = evictions;
+}
 #endif
 
 void _insertion_sort(DArray rect_bucket) {
@@ -228,6 +234,7 @@ void video_init_ex(uint width, uint height, uint v_width, uint v_height,
 
 	glEnable(GL_BLEND);
     glDisable(GL_ALPHA_TEST);
+	glAlphaFunc(GL_GEQUAL, 0.5f);
 	_set_blendmode(BM_NORMAL);
 	last_blend_mode = BM_NORMAL;
 
@@ -387,6 +394,7 @@ void video_present(void) {
 	// Render loop
 	Texture* texs = DARRAY_DATA_PTR(textures, Texture);
 	uint active_tex = ~0;
+	bool alpha_test = false;
 	byte r, g, b, a;
 	Color c;
 	for(i = 0; i < bucket_count; ++i) {
@@ -422,6 +430,15 @@ void video_present(void) {
 				}
 				active_tex = rects[j].tex;
 				glBindTexture(GL_TEXTURE_2D, texs[active_tex].gl_id);
+
+				// Distance fields are cut at 0.5 with alpha test
+				if(texs[active_tex].sdf != alpha_test) {
+					alpha_test = texs[active_tex].sdf;
+					if(alpha_test)
+						glEnable(GL_ALPHA_TEST);
+					else
+						glDisable(GL_ALPHA_TEST);
+				}
 #ifndef NO_DEVMODE
 				v_stats.frame_texture_switches++;
 #endif
@@ -495,6 +512,12 @@ void video_present(void) {
 
 		// Draw lines
 		if(line_buckets[i].size) {
+			// Lines are not textured, don't cut them
+			if(alpha_test) {
+				glDisable(GL_ALPHA_TEST);
+				alpha_test = false;
+				active_tex = ~0;
+			}
 			glDisable(GL_TEXTURE_2D);
 			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 
@@ -545,6 +568,9 @@ void video_present(void) {
 	#endif
 	}
 
+	if(alpha_test)
+		glDisable(GL_ALPHA_TEST);
+
     _sys_present();
 
 	/*
@@ -626,6 +652,7 @@ TexHandle tex_create(uint width, uint height) {
 		.file = NULL,
 		.retain_count = 1,
 		.active = true,
+		.sdf = false,
 		.scale = 1.0f,
         .width = width,
         .height = height
@@ -661,6 +688,8 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 
     PixelFormat fmt;
 	void* data = image_load(filename, &new_tex.width, &new_tex.height, &fmt);
+	if((fmt & PF_MASK_PIXEL_FORMAT) != PF_RGBA8888)
+		LOG_ERROR("Legacy renderer can only load RGBA8888 textures (%s)", filename);
 
 	if(filter)
 		(*filter)((Color*)data, new_tex.width, new_tex.height);
@@ -671,6 +700,7 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 	new_tex.file = strclone(filename);
 	new_tex.retain_count = 1;
 	new_tex.active = true;
+	new_tex.sdf = false;
 	new_tex.scale = 1.0f;
 
 	darray_append(&textures, &new_tex);
@@ -678,6 +708,22 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 	return textures.size-1;
 }
 
+// Legacy renderer ignores mipmaps
+void video_set_trilinear(bool enable) {
+}
+
+// Legacy renderer loads everything synchronously
+TexHandle tex_load_async(const char* filename) {
+	return tex_load_filter(filename, NULL);
+}
+
+bool tex_is_ready(TexHandle tex) {
+	return true;
+}
+
+void tex_set_upload_budget(uint bytes) {
+}
+
 void tex_blit(TexHandle tex, Color* data, uint x, uint y, uint w, uint h) {
 	assert(tex < textures.size);
 	Texture* t = DARRAY_DATA_PTR(textures, Texture);
@@ -737,6 +783,14 @@ void tex_scale(TexHandle tex, float s) {
 	t[tex].scale = s;
 }
 
+void tex_set_sdf(TexHandle tex, bool sdf) {
+	assert(tex < textures.size);
+	Texture* t = DARRAY_DATA_PTR(textures, Texture);
+	assert(t[tex].active);
+
+	t[tex].sdf = sdf;
+}
+
 // Fast integer log2 when n is a power of two
 static uint _ilog2(uint v) {
 	static const uint b[] = {0xAAAAAAAA, 0xCCCCCCCC, 0xF0F0F0F0, 0xFF00FF00, 0xFFFF0000};
@@ -15,7 +15,7 @@
 
 // Types
 
-// 52 bytes
+// 64 bytes
 typedef struct {
 	char* file;
 	char file_storage[16];
@@ -23,6 +23,11 @@ typedef struct {
 	uint gl_id;
 	uint scale;
 	ListHead list;
+	bool sdf;
+
+	// Background loading state, job is NULL when texture is ready
+	ImageLoadJob* job;
+	uint uploaded_rows;
 } Texture;
 
 // 32 bytes
@@ -61,6 +66,17 @@ typedef struct {
 	float* transform;
 } LayerTag;
 
+typedef struct {
+	uint id;
+	int screen_size;
+	int tform0;
+	int tform1;
+	int texture;
+
+	// Transform which is currently uploaded to uniforms
+	float* transform;
+} Program;
+
 bool draw_gfx_debug = false;
 
 // Main renderer data
@@ -84,19 +100,32 @@ Color clear_color;
 static int32 screen_width, screen_height;
 static uint frame = 0;
 static bool filter_textures = true;
+static bool trilinear = false;
 static bool drawing_lines = false;
 static bool drawing_rects = false;
 static BlendMode blend_mode = ~0;
 static float* transform = NULL;
 static Texture* active_texture = NULL;
+static uint upload_budget = 512 * 1024;
 static int vert_shader_id;
 static int frag_shader_id;
-static int program_id;
+static int sdf_shader_id;
+static Program program;
+static Program sdf_program;
+static Program* active_program = NULL;
 
-static int glsl_screen_size;
-static int glsl_tform0;
-static int glsl_tform1;
-static int glsl_texture;
+#ifndef NO_DEVMODE
+static VideoStats v_stats;
+
+const VideoStats* video_stats(void) {
+	return &v_stats;
+}
+
+void video_stats_residency(uint resident_bytes, uint evictions) {
+	v_stats.resident_bytes = resident_bytes;
+	v_stats.evictions = evictions;
+}
+#endif
 
 // Shaders
 
@@ -155,6 +184,29 @@ const char* frag_shader =
 "	gl_FragColor = v_tint * texture2D(texture, v_uv);\n"
 "}";
 
+// Distance is stored in alpha, edge is at 0.5. Antialiasing ramp
+// follows screen space derivatives when they are available.
+const char* frag_shader_sdf_derivatives = 
+"#extension GL_OES_standard_derivatives : enable\n"
+"#define SDF_DERIVATIVES\n";
+
+const char* frag_shader_sdf = 
+"precision mediump float;\n"
+"uniform sampler2D texture;\n"
+"\n"
+"varying vec2 v_uv;\n"
+"varying vec4 v_tint;\n"
+"\n"
+"void main() {\n"
+"	float d = texture2D(texture, v_uv).a;\n"
+"#ifdef SDF_DERIVATIVES\n"
+"	float w = clamp(fwidth(d) * 0.75, 0.01, 0.5);\n"
+"#else\n"
+"	float w = 0.0625;\n"
+"#endif\n"
+"	gl_FragColor = v_tint * smoothstep(0.5 - w, 0.5 + w, d);\n"
+"}";
+
 static bool _check_extension(const char* name) {
     static const char* exts = NULL;
     if(exts == NULL)
@@ -201,7 +253,7 @@ static void _free_shader(uint id) {
 	glDeleteShader(id);
 }
 
-static uint _link_program(uint vert, uint frag) {
+static void _link_program(uint vert, uint frag, Program* p) {
 	uint t = time_ms_current();
 
 	uint gl_id = glCreateProgram();
@@ -220,16 +272,44 @@ static uint _link_program(uint vert, uint frag) {
 		LOG_ERROR("Can't link glsl program");
 	}
 
-	glsl_screen_size = glGetUniformLocation(gl_id, "screen_size");
-	glsl_tform0 = glGetUniformLocation(gl_id, "tform_0");
-	glsl_tform1 = glGetUniformLocation(gl_id, "tform_1");
-	glsl_texture = glGetUniformLocation(gl_id, "texture");
+	p->id = gl_id;
+	p->screen_size = glGetUniformLocation(gl_id, "screen_size");
+	p->tform0 = glGetUniformLocation(gl_id, "tform_0");
+	p->tform1 = glGetUniformLocation(gl_id, "tform_1");
+	p->texture = glGetUniformLocation(gl_id, "texture");
+	p->transform = NULL;
+
+	glUseProgram(gl_id);
+	glUniform2f(p->screen_size, (float)screen_width, (float)screen_height);
+	glUniform3f(p->tform0, 1.0f, 0.0f, 0.0f);
+	glUniform3f(p->tform1, 0.0f, 1.0f, 0.0f);
 
 	_check_error();
 
 	LOG_INFO("Linked glsl program in %ums", time_ms_current() - t);
+}
 
-	return gl_id;
+static void _set_transform(Program* p, float* tform) {
+	if(tform) {
+		float* m = tform;
+		glUniform3f(p->tform0, m[0], m[1], m[2]);
+		glUniform3f(p->tform1, m[3], m[4], m[5]);
+	}
+	else {
+		glUniform3f(p->tform0, 1.0f, 0.0f, 0.0f);
+		glUniform3f(p->tform1, 0.0f, 1.0f, 0.0f);
+	}
+	p->transform = tform;
+}
+
+static void _use_program(Program* p) {
+	assert(p != active_program);
+
+	glUseProgram(p->id);
+	if(p->transform != transform)
+		_set_transform(p, transform);
+
+	active_program = p;
 }
 
 static void _free_program(uint id) {
@@ -328,12 +408,19 @@ static void _video_init(uint width, uint height, uint v_width, uint v_height,
 
 	vert_shader_id = _compile_shader(vert_shader, GL_VERTEX_SHADER);
 	frag_shader_id = _compile_shader(frag_shader, GL_FRAGMENT_SHADER);
-	program_id = _link_program(vert_shader_id, frag_shader_id);
+	_link_program(vert_shader_id, frag_shader_id, &program);
 
-    glUseProgram(program_id);
-	glUniform2f(glsl_screen_size, (float)screen_width, (float)screen_height);
-	glUniform3f(glsl_tform0, 1.0f, 0.0f, 0.0f);
-	glUniform3f(glsl_tform1, 0.0f, 1.0f, 0.0f);
+	char sdf_source[1024] = "";
+	if(_check_extension("GL_OES_standard_derivatives"))
+		strcat(sdf_source, frag_shader_sdf_derivatives);
+	assert(strlen(sdf_source) + strlen(frag_shader_sdf) < sizeof(sdf_source));
+	strcat(sdf_source, frag_shader_sdf);
+	sdf_shader_id = _compile_shader(sdf_source, GL_FRAGMENT_SHADER);
+	_link_program(vert_shader_id, sdf_shader_id, &sdf_program);
+
+	transform = NULL;
+	active_program = NULL;
+	_use_program(&program);
 
     _check_error();
 
@@ -364,7 +451,9 @@ void video_close(void) {
 
 	_free_shader(vert_shader_id);
 	_free_shader(frag_shader_id);
-	_free_program(program_id);
+	_free_shader(sdf_shader_id);
+	_free_program(program.id);
+	_free_program(sdf_program.id);
 
 	if(!list_empty(&textures))
 		LOG_WARNING("There stil are active textures!");
@@ -444,6 +533,10 @@ static void _draw_rects(uint* count) {
 		GL_UNSIGNED_SHORT, indices.data
 	);
 
+#ifndef NO_DEVMODE
+	v_stats.frame_batches++;
+#endif
+
 	_check_error();
 
 	*count = 0;
@@ -503,7 +596,23 @@ fix16_t fix16_cos(fix16_t inAngle)
     return fix16_sin(inAngle + (fix16_pi >> 1));
 }
 
+// Forward def for video_present
+static void _upload_pending_textures(void);
+
 void video_present(void) {
+	_upload_pending_textures();
+
+#ifndef NO_DEVMODE
+	// Layers are not bucketed here, per-layer stats are not kept
+	v_stats.frame = frame+1;
+	v_stats.frame_layer_sorts = rects.size > 4 ? 1 : 0;
+	v_stats.frame_batches = 0;
+	v_stats.frame_rects = rects.size;
+	v_stats.frame_lines = lines.size;
+	v_stats.frame_texture_switches = 0;
+	v_stats.n_layers = 0;
+	v_stats.layer_rects = v_stats.layer_lines = NULL;
+#endif
 
 	// Sort rects by layer and then by texture
 	if(rects.size > 4) {
@@ -570,15 +679,7 @@ void video_present(void) {
 			if(l_ready)
 				_draw_lines(&l_ready);
 
-			if(tform) {
-				float* m = tform;
-				glUniform3f(glsl_tform0, m[0], m[1], m[2]);
-				glUniform3f(glsl_tform1, m[3], m[4], m[5]);
-			}
-			else {
-				glUniform3f(glsl_tform0, 1.0f, 0.0f, 0.0f);
-				glUniform3f(glsl_tform1, 0.0f, 1.0f, 0.0f);
-			}
+			_set_transform(active_program, tform);
 			transform = tform;
 		}
 
@@ -595,6 +696,14 @@ void video_present(void) {
 				
 				glBindTexture(GL_TEXTURE_2D, tex->gl_id);
 				active_texture = tex;
+
+#ifndef NO_DEVMODE
+				v_stats.frame_texture_switches++;
+#endif
+
+				Program* p = tex->sdf ? &sdf_program : &program;
+				if(p != active_program)
+					_use_program(p);
 			}
 
 			// Fill up vbuffer
@@ -773,20 +882,27 @@ static void _pf_to_gles(PixelFormat format, GLenum* fmt, GLenum* type) {
 	}
 }
 
-static uint _make_gl_texture(
-	void* data, uint width, uint height, PixelFormat format) {
-
-	assert(data);
-
-	uint gl_id;
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glGenTextures(1, &gl_id);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gl_id);
+void video_set_trilinear(bool enable) {
+	trilinear = enable;
+}
 
+// Sets filtering of currently bound texture
+static void _set_gl_filter(bool mipmapped) {
 	uint filter = filter_textures ? GL_LINEAR : GL_NEAREST;
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	uint min_filter = filter;
+	if(mipmapped) {
+		if(!filter_textures)
+			min_filter = GL_NEAREST_MIPMAP_NEAREST;
+		else
+			min_filter = trilinear ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_NEAREST;
+	}
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+}
+
+// Uploads single mip level to currently bound texture
+static void _tex_image(
+	uint level, const void* data, uint width, uint height, PixelFormat format) {
 
 	GLenum fmt;
 	GLenum type;
@@ -805,28 +921,64 @@ static uint _make_gl_texture(
 #endif
     
     if(image_size) {
+		assert(data);
         glCompressedTexImage2D(
-            GL_TEXTURE_2D, 0, fmt, width, height, 
+            GL_TEXTURE_2D, level, fmt, width, height, 
             0, image_size, data
         );
     }
     else {
         glTexImage2D(
-            GL_TEXTURE_2D, 0, fmt, width, height, 
+            GL_TEXTURE_2D, level, fmt, width, height, 
             0, fmt, type, data
         );
     }
+}
+
+static uint _make_gl_texture(
+	void* data, uint width, uint height, PixelFormat format) {
+
+	uint gl_id;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glGenTextures(1, &gl_id);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gl_id);
+
+	_set_gl_filter(false);
+	_tex_image(0, data, width, height, format);
 
 	_check_error();
 
 	return gl_id;
 }
 
+// Uploads mip levels which follow level 0 in data to bound texture
+static void _upload_mip_levels(
+	const void* data, uint width, uint height, PixelFormat format) {
+
+	uint levels = image_mip_levels(width, height, format);
+	if(levels == 1)
+		return;
+
+	const void* level = data + image_level_size(width, height, format);
+	for(uint i = 1; i < levels; ++i) {
+		uint w = MAX(1, width >> i), h = MAX(1, height >> i);
+		_tex_image(i, level, w, h, format);
+		level += image_level_size(w, h, format);
+	}
+	_set_gl_filter(true);
+
+	_check_error();
+}
+
 static Texture* _new_texture( 
 		const char* filename, uint width, uint height, 
 		uint gl_id, uint scale) {
 
 	Texture* new = mempool_alloc(&texture_pool);
+#ifndef NO_DEVMODE
+	v_stats.active_textures++;
+#endif
 
 	if(filename) {
 		// Try to save malloc by fitting filename directly into
@@ -850,12 +1002,125 @@ static Texture* _new_texture(
 	new->hscale = (height * scale) >> 15;
 	new->gl_id = gl_id;
 	new->scale = scale;
+	new->job = NULL;
+	new->uploaded_rows = 0;
+	new->sdf = false;
 
 	list_push_front(&textures, &new->list);
 
 	return new;
 }
 
+// Returns size of one pixel in bytes, 0 for compressed formats
+static uint _pf_pixel_size(PixelFormat format) {
+	switch(format & PF_MASK_PIXEL_FORMAT) {
+		case PF_RGB888:
+			return 3;
+		case PF_RGBA8888:
+			return 4;
+		case PF_RGB565:
+		case PF_RGBA4444:
+		case PF_RGBA5551:
+		case PF_LA88:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+// Uploads up to max_rows of decoded pixels, frees load job when done
+static void _tex_upload_rows(Texture* t, uint max_rows) {
+	assert(t->job && t->gl_id);
+
+	ImageLoadJob* job = t->job;
+	uint rows = MIN(max_rows, t->height - t->uploaded_rows);
+	uint row_size = t->width * _pf_pixel_size(job->format);
+
+	GLenum fmt;
+	GLenum type;
+	_pf_to_gles(job->format, &fmt, &type);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D, t->gl_id);
+	glTexSubImage2D(
+			GL_TEXTURE_2D, 0,
+			0, t->uploaded_rows, t->width, rows,
+			fmt, type, job->data + t->uploaded_rows * row_size
+	);
+	_check_error();
+
+	t->uploaded_rows += rows;
+	if(t->uploaded_rows == t->height) {
+		_upload_mip_levels(job->data, t->width, t->height, job->format);
+		image_load_free(job);
+		t->job = NULL;
+		LOG_INFO("Loaded texture from file %s in background", t->file);
+	}
+}
+
+// Makes gl texture for decoded image of background loaded texture.
+// Compressed formats can't be uploaded in parts and are finished here.
+static void _tex_decoded(Texture* t) {
+	assert(t->job && t->gl_id == 0);
+
+	ImageLoadJob* job = t->job;
+	image_load_wait(job);
+
+	t->width = job->w;
+	t->height = job->h;
+	t->wscale = (t->width * t->scale) >> 15;
+	t->hscale = (t->height * t->scale) >> 15;
+	t->uploaded_rows = 0;
+
+	if(_pf_pixel_size(job->format) == 0) {
+		t->gl_id = _make_gl_texture(job->data, t->width, t->height, job->format);
+		_upload_mip_levels(job->data, t->width, t->height, job->format);
+		image_load_free(job);
+		t->job = NULL;
+	}
+	else {
+		t->gl_id = _make_gl_texture(NULL, t->width, t->height, job->format);
+	}
+}
+
+// Blocks until background loaded texture is fully uploaded
+static void _tex_finish(Texture* t) {
+	if(!t->job)
+		return;
+
+	if(t->gl_id == 0)
+		_tex_decoded(t);
+	if(t->job)
+		_tex_upload_rows(t, t->height);
+}
+
+static void _upload_pending_textures(void) {
+	uint budget = upload_budget;
+	Texture* t = NULL;
+	list_for_each_entry(t, &textures, list) {
+		if(!budget)
+			break;
+		if(!t->job || !image_load_ready(t->job))
+			continue;
+
+		if(t->gl_id == 0) {
+			_tex_decoded(t);
+			if(!t->job) {
+				// Compressed texture was uploaded whole, assume 4bpp
+				budget -= MIN(budget, t->width * t->height / 2);
+				continue;
+			}
+		}
+
+		// Always upload at least one row to guarantee progress
+		uint row_size = t->width * _pf_pixel_size(t->job->format);
+		uint rows = MAX(1, budget / row_size);
+		rows = MIN(rows, t->height - t->uploaded_rows);
+		_tex_upload_rows(t, rows);
+		budget -= MIN(budget, rows * row_size);
+	}
+}
+
 TexHandle tex_create(uint width, uint height) {
 	assert(width && height);
 
@@ -901,6 +1166,8 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 	list_for_each_entry(texture, &textures, list) {
 		if(texture->file && strcmp(texture->file, filename) == 0) {
 			texture->retain_count++;
+			// Texture might still be loading in the background
+			_tex_finish(texture);
 			return (TexHandle)texture;
 		}
 	}
@@ -910,12 +1177,15 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 	PixelFormat format;
 	void* data = image_load(filename, &width, &height, &format);
 
-	// Apply pixel filter
-	if(filter)
+	// Apply pixel filter, it only sees level 0 so drop the rest of mip chain
+	if(filter) {
 		(*filter)((Color*)data, width, height);
+		format &= ~PF_MASK_MIPMAPS;
+	}
 
 	// Make gl texture
 	uint gl_id = _make_gl_texture(data, width, height, format);
+	_upload_mip_levels(data, width, height, format);
 	// image_load doesn't use MEM_ALLOC because the memory might
 	// be actually allocated by some external library
 	free(data); 
@@ -929,8 +1199,35 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 	return (TexHandle)texture;
 }
 
+TexHandle tex_load_async(const char* filename) {
+	assert(filename);
+
+	Texture* texture = NULL;
+	list_for_each_entry(texture, &textures, list) {
+		if(texture->file && strcmp(texture->file, filename) == 0) {
+			texture->retain_count++;
+			return (TexHandle)texture;
+		}
+	}
+
+	texture = _new_texture(filename, 0, 0, 0, tex_scale_1);
+	texture->job = image_load_async(filename, NULL);
+
+	return (TexHandle)texture;
+}
+
+bool tex_is_ready(TexHandle tex) {
+	Texture* t = (Texture*)tex;
+	return t->job == NULL;
+}
+
+void tex_set_upload_budget(uint bytes) {
+	upload_budget = bytes;
+}
+
 void tex_blit(TexHandle tex, Color* data, uint x, uint y, uint w, uint h) {
 	Texture* t = (Texture*)tex;
+	_tex_finish(t);
 	assert((x + w <= t->width) && (y + h <= t->height));
 
 	glBindTexture(GL_TEXTURE_2D, t->gl_id);
@@ -954,6 +1251,8 @@ void tex_blit(TexHandle tex, Color* data, uint x, uint y, uint w, uint h) {
 
 void tex_size(TexHandle tex, uint* width, uint* height) {
 	Texture* t = (Texture*)tex;
+	if(t->job && t->gl_id == 0)
+		_tex_decoded(t);
     	*width = t->width;
 	*height = t->height;
 }
@@ -963,11 +1262,17 @@ void tex_free(TexHandle tex) {
 
 	t->retain_count--;
 	if(t->retain_count == 0) {
-		glDeleteTextures(1, &t->gl_id);
+		if(t->job)
+			image_load_free(t->job);
+		if(t->gl_id)
+			glDeleteTextures(1, &t->gl_id);
 		if(t->file && strlen(t->file) >= 16)
 			MEM_FREE(t->file);
 		list_remove(&t->list);
 		mempool_free(&texture_pool, t);
+#ifndef NO_DEVMODE
+		v_stats.active_textures--;
+#endif
 	}
 }
 
@@ -978,6 +1283,11 @@ void tex_scale(TexHandle tex, float s) {
     t->hscale = (t->height * t->scale) >> 15;
 }
 
+void tex_set_sdf(TexHandle tex, bool sdf) {
+	Texture* t = (Texture*)tex;
+	t->sdf = sdf;
+}
+
 void video_draw_rect(TexHandle tex, uint layer,
 	const RectF* source, const RectF* dest, Color tint) {
 	video_draw_rect_rotated(tex, layer, source, dest, 0.0f, tint);
@@ -988,6 +1298,10 @@ void video_draw_rect_rotated(TexHandle tex, uint layer, const RectF* source,
 
 	Texture* texture = (Texture*)tex;
 
+	// Texture is still loading in the background, draw nothing
+	if(texture->job)
+		return;
+
 	TexturedRect rect = {
 		.layer = layer,
 		.tex = texture,
@@ -26,6 +26,12 @@ typedef struct {
 	uint gl_id;
 	float scale;
 	bool active;
+	bool compressed;
+	bool sdf;
+
+	// Background loading state, job is NULL when texture is ready
+	ImageLoadJob* job;
+	uint uploaded_rows;
 } Texture;
 
 typedef struct {
@@ -56,8 +62,15 @@ static DArray rects_out;
 
 static uint frame;
 
+static uint upload_budget = 512 * 1024;
+
+// S3TC textures are decoded in software if gpu doesn't support them
+static bool s3tc_supported = false;
+static PFNGLCOMPRESSEDTEXIMAGE2DPROC gl_compressed_tex_image_2d = NULL;
+
 
 static bool retro = false;
+static bool trilinear = false;
 
 static bool sdl_initialized = false;
 static uint native_width, native_height;
@@ -69,6 +82,11 @@ VideoStats v_stats;
 const VideoStats* video_stats(void) {
 	return &v_stats;
 }
+
+void video_stats_residency(uint resident_bytes, uint evictions) {
+	v_stats.resident_bytes = resident_bytes;
+	v_stats.evictions = evictions;
+}
 #endif
 
 extern void _async_init(void);
@@ -260,11 +278,20 @@ void video_init_ex(uint width, uint height, uint v_width, uint v_height, const
 	if(SDL_SetVideoMode(width, height, 32, flags) == NULL)
 		LOG_ERROR("Unable to set video mode");
 
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	gl_compressed_tex_image_2d = (PFNGLCOMPRESSEDTEXIMAGE2DPROC)
+		SDL_GL_GetProcAddress("glCompressedTexImage2D");
+	s3tc_supported = gl_compressed_tex_image_2d && extensions &&
+		strstr(extensions, "GL_EXT_texture_compression_s3tc");
+	if(!s3tc_supported)
+		LOG_INFO("No S3TC support, DXT textures will be decoded in software");
+
 	glEnable(GL_TEXTURE_2D);
 	glShadeModel(GL_SMOOTH);
 	glClearDepth(1.0f);
 	glViewport(0, 0, width, height);
 	glEnable(GL_BLEND);
+	glAlphaFunc(GL_GEQUAL, 0.5f);
 	_set_blendmode(BM_NORMAL);
 	last_blend_mode = BM_NORMAL;
 	video_clear_color(clear_color);
@@ -356,12 +383,15 @@ void video_clear_color(Color c) {
 	}
 }
 
-// Forward def for video_present
+// Forward defs for video_present
 uint _get_gl_id(TexHandle tex);
+static void _upload_pending_textures(void);
 
 void video_present(void) {
 	uint i, j;
 
+	_upload_pending_textures();
+
 	#ifndef NO_DEVMODE
 	v_stats.frame = frame+1;
 	v_stats.active_textures = textures.size;
@@ -388,6 +418,7 @@ void video_present(void) {
 	// Not a typo
 	uint active_tex = -1;
 	bool drawing = false;
+	bool alpha_test = false;
 	float r, g, b, a;
 	for(i = 0; i < BUCKET_COUNT; ++i) {
 		// Switch blend modes if neccessary
@@ -421,6 +452,16 @@ void video_present(void) {
 				glBindTexture(GL_TEXTURE_2D, _get_gl_id(rect.tex));
 				active_tex = rect.tex;
 
+				// Distance fields are cut at 0.5 with alpha test
+				Texture* t = DARRAY_DATA_PTR(textures, Texture);
+				if(t[active_tex].sdf != alpha_test) {
+					alpha_test = t[active_tex].sdf;
+					if(alpha_test)
+						glEnable(GL_ALPHA_TEST);
+					else
+						glDisable(GL_ALPHA_TEST);
+				}
+
 				#ifndef NO_DEVMODE
 				v_stats.frame_texture_switches++;
 				#endif
@@ -475,6 +516,12 @@ void video_present(void) {
 		}
 
 		if(line_buckets[i].size || draw_gfx_debug) {
+			// Lines are not textured, don't cut them
+			if(alpha_test) {
+				glDisable(GL_ALPHA_TEST);
+				alpha_test = false;
+				active_tex = -1;
+			}
 			glDisable(GL_TEXTURE_2D);
 			glBegin(GL_LINES);
 			glColor4f(0.5f, 0.5f, 0.5f, 0.5f);
@@ -538,6 +585,9 @@ void video_present(void) {
 		#endif
 	}
 
+	if(alpha_test)
+		glDisable(GL_ALPHA_TEST);
+
 	SDL_GL_SwapBuffers();
 	frame++;
 
@@ -563,6 +613,24 @@ void video_set_transform(uint layer, float* matrix) {
 	transform[layer] = matrix;
 }
 
+void video_set_trilinear(bool enable) {
+	trilinear = enable;
+}
+
+// Sets filtering of currently bound texture
+static void _set_gl_filter(bool mipmapped) {
+	GLuint tfilter = retro ? GL_NEAREST : GL_LINEAR;
+	GLuint min_filter = tfilter;
+	if(mipmapped) {
+		if(retro)
+			min_filter = GL_NEAREST_MIPMAP_NEAREST;
+		else
+			min_filter = trilinear ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_NEAREST;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tfilter);
+}
+
 static uint _make_gl_texture(void* data, uint width, uint height) {
 	// Make gl texture
 	uint gl_id;
@@ -570,9 +638,7 @@ static uint _make_gl_texture(void* data, uint width, uint height) {
 	glBindTexture(GL_TEXTURE_2D, gl_id);
 	glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0, GL_RGBA,
 			GL_UNSIGNED_BYTE, data);
-	GLuint tfilter = retro ? GL_NEAREST : GL_LINEAR;
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tfilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, tfilter);
+	_set_gl_filter(false);
 
 	uint error = glGetError();
 	if(error != GL_NO_ERROR)
@@ -581,6 +647,83 @@ static uint _make_gl_texture(void* data, uint width, uint height) {
 	return gl_id;
 }
 
+// Returns gl format of block compressed pixel format, 0 for other formats
+static GLenum _dxt_gl_format(PixelFormat format) {
+	switch(format & PF_MASK_PIXEL_FORMAT) {
+		case PF_DXT1:
+			return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case PF_DXT3:
+			return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		case PF_DXT5:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		default:
+			return 0;
+	}
+}
+
+// Decodes DXT pixels in software if they can't be uploaded as is.
+// Returns true if pixels are left compressed.
+static bool _prep_dxt(void** data, uint w, uint h, PixelFormat* format,
+	bool force_decode) {
+	if(!_dxt_gl_format(*format))
+		return false;
+
+	if(s3tc_supported && !force_decode)
+		return true;
+
+	void* decoded = image_decode_dxt(*data, w, h, *format);
+	free(*data);
+	*data = decoded;
+	*format = PF_RGBA8888;
+	return false;
+}
+
+static uint _make_gl_texture_dxt(void* data, uint width, uint height,
+	PixelFormat format) {
+	assert(data);
+
+	uint block_size = (format & PF_MASK_PIXEL_FORMAT) == PF_DXT1 ? 8 : 16;
+	uint size = MAX(1, width / 4) * MAX(1, height / 4) * block_size;
+
+	uint gl_id;
+	glGenTextures(1, &gl_id);
+	glBindTexture(GL_TEXTURE_2D, gl_id);
+	(*gl_compressed_tex_image_2d)(GL_TEXTURE_2D, 0, _dxt_gl_format(format),
+		width, height, 0, size, data);
+	_set_gl_filter(false);
+
+	uint error = glGetError();
+	if(error != GL_NO_ERROR)
+		LOG_ERROR("OpenGL error while loading compressed texture, id %u", error);
+
+	return gl_id;
+}
+
+// Uploads mip levels which follow level 0 in data to bound texture
+static void _upload_mip_levels(const void* data, uint width, uint height,
+	PixelFormat format) {
+	uint levels = image_mip_levels(width, height, format);
+	if(levels == 1)
+		return;
+
+	GLenum dxt = _dxt_gl_format(format);
+	const void* level = data + image_level_size(width, height, format);
+	for(uint i = 1; i < levels; ++i) {
+		uint w = MAX(1, width >> i), h = MAX(1, height >> i);
+		uint size = image_level_size(w, h, format);
+		if(dxt)
+			(*gl_compressed_tex_image_2d)(GL_TEXTURE_2D, i, dxt, w, h, 0, size, level);
+		else
+			glTexImage2D(GL_TEXTURE_2D, i, 4, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+		level += size;
+	}
+	_set_gl_filter(true);
+
+	uint error = glGetError();
+	if(error != GL_NO_ERROR)
+		LOG_ERROR("OpenGL error while loading mipmaps, id %u", error);
+}
+
 static Texture* _alloc_tex(const char* filename, TexHandle* handle) {
 	Texture* tex = DARRAY_DATA_PTR(textures, Texture);
 
@@ -611,6 +754,98 @@ static Texture* _alloc_tex(const char* filename, TexHandle* handle) {
 	return &tex[*handle];
 }
 
+// Validates decoded image of background loaded texture
+// and makes empty gl texture for it
+static void _tex_decoded(Texture* t) {
+	assert(t->job && t->gl_id == 0);
+
+	ImageLoadJob* job = t->job;
+	image_load_wait(job);
+
+	if(!(is_pow2(job->w) && is_pow2(job->h)))
+		LOG_ERROR("%s: Texture dimensions is not power of 2", t->file);
+
+	t->width = job->w;
+	t->height = job->h;
+	t->uploaded_rows = 0;
+
+	// Compressed textures can't be uploaded in parts
+	t->compressed = _prep_dxt(&job->data, job->w, job->h, &job->format, false);
+	if(t->compressed) {
+		t->gl_id = _make_gl_texture_dxt(job->data, t->width, t->height,
+			job->format);
+		_upload_mip_levels(job->data, t->width, t->height, job->format);
+		image_load_free(job);
+		t->job = NULL;
+		return;
+	}
+
+	if((job->format & PF_MASK_PIXEL_FORMAT) != PF_RGBA8888)
+		LOG_ERROR("%s: Only RGBA8888 pixel format is supported", t->file);
+
+	t->gl_id = _make_gl_texture(NULL, t->width, t->height);
+}
+
+// Uploads up to max_rows of decoded pixels, frees load job when done
+static void _tex_upload_rows(Texture* t, uint max_rows) {
+	assert(t->job && t->gl_id);
+
+	uint rows = MIN(max_rows, t->height - t->uploaded_rows);
+	Color* src = (Color*)t->job->data + t->uploaded_rows * t->width;
+
+	glBindTexture(GL_TEXTURE_2D, t->gl_id);
+	glTexSubImage2D(
+			GL_TEXTURE_2D, 0,
+			0, t->uploaded_rows, t->width, rows,
+			GL_RGBA, GL_UNSIGNED_BYTE, src
+	);
+	t->uploaded_rows += rows;
+
+	if(t->uploaded_rows == t->height) {
+		_upload_mip_levels(t->job->data, t->width, t->height, t->job->format);
+		image_load_free(t->job);
+		t->job = NULL;
+		LOG_INFO("Loaded texture from file %s in background", t->file);
+	}
+}
+
+// Blocks until background loaded texture is fully uploaded
+static void _tex_finish(Texture* t) {
+	if(!t->job)
+		return;
+
+	if(t->gl_id == 0)
+		_tex_decoded(t);
+	if(t->job)
+		_tex_upload_rows(t, t->height);
+}
+
+static void _upload_pending_textures(void) {
+	uint budget = upload_budget;
+	Texture* tex = DARRAY_DATA_PTR(textures, Texture);
+	for(uint i = 0; i < textures.size && budget; ++i) {
+		Texture* t = &tex[i];
+		if(!t->active || !t->job || !image_load_ready(t->job))
+			continue;
+
+		if(t->gl_id == 0) {
+			_tex_decoded(t);
+			if(!t->job) {
+				// Compressed texture was uploaded whole, 4 or 8 bpp
+				budget -= MIN(budget, t->width * t->height);
+				continue;
+			}
+		}
+
+		// Always upload at least one row to guarantee progress
+		uint row_size = t->width * sizeof(Color);
+		uint rows = MAX(1, budget / row_size);
+		rows = MIN(rows, t->height - t->uploaded_rows);
+		_tex_upload_rows(t, rows);
+		budget -= MIN(budget, rows * row_size);
+	}
+}
+
 TexHandle tex_create(uint width, uint height) {
 	assert(width && height);
 
@@ -637,6 +872,9 @@ TexHandle tex_create(uint width, uint height) {
 	new->retain_count = 1;
 	new->scale = 1.0f;
 	new->active = true;
+	new->compressed = false;
+	new->sdf = false;
+	new->job = NULL;
 
 	return result;
 }
@@ -653,19 +891,29 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 
 	TexHandle result;
 	Texture* new = _alloc_tex(filename, &result);
-	if(!new)
+	if(!new) {
+		// Texture might still be loading in the background
+		Texture* t = DARRAY_DATA_PTR(textures, Texture);
+		_tex_finish(&t[result]);
 		return result;
+	}
 
 	uint w, h;
 	PixelFormat format;
-	byte* decompr_data = image_load(filename, &w, &h, &format);
+	void* decompr_data = image_load(filename, &w, &h, &format);
 
 	if(!(is_pow2(w) && is_pow2(h))) {
 		free(decompr_data);
 		LOG_ERROR("%s: Texture dimensions is not power of 2", filename);
 	}
 
-	if(format != PF_RGBA8888) {
+	// Filters only see level 0, drop the rest of mip chain.
+	// Filtered textures must be decoded.
+	if(filter)
+		format &= ~PF_MASK_MIPMAPS;
+	bool compressed = _prep_dxt(&decompr_data, w, h, &format, filter != NULL);
+
+	if(!compressed && (format & PF_MASK_PIXEL_FORMAT) != PF_RGBA8888) {
 		free(decompr_data);
 		LOG_ERROR("%s: Only RGBA8888 pixel format is supported", filename);
 	}
@@ -675,7 +923,10 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 		(*filter)((Color*)decompr_data, w, h);
 	}
 
-	uint gl_id = _make_gl_texture(decompr_data, w, h);
+	uint gl_id = compressed ?
+		_make_gl_texture_dxt(decompr_data, w, h, format) :
+		_make_gl_texture(decompr_data, w, h);
+	_upload_mip_levels(decompr_data, w, h, format);
 
 	free(decompr_data);
 
@@ -686,17 +937,61 @@ TexHandle tex_load_filter(const char* filename, TexFilter filter) {
 	new->retain_count = 1;
 	new->scale = 1.0f;
 	new->active = true;
+	new->compressed = compressed;
+	new->sdf = false;
+	new->job = NULL;
 
 	LOG_INFO("Loaded texture from file %s in %ums", filename, time_ms_current()-t);
 
 	return result;
 }
 
+TexHandle tex_load_async(const char* filename) {
+	assert(filename);
+
+	TexHandle result;
+	Texture* new = _alloc_tex(filename, &result);
+	if(!new)
+		return result;
+
+	new->width = 0;
+	new->height = 0;
+	new->gl_id = 0;
+	new->file = strclone(filename);
+	new->retain_count = 1;
+	new->scale = 1.0f;
+	new->active = true;
+	new->compressed = false;
+	new->sdf = false;
+	new->job = image_load_async(filename, NULL);
+	new->uploaded_rows = 0;
+
+	return result;
+}
+
+bool tex_is_ready(TexHandle tex) {
+	assert(tex < textures.size);
+	Texture* t = DARRAY_DATA_PTR(textures, Texture);
+	assert(t[tex].active);
+
+	return t[tex].job == NULL;
+}
+
+void tex_set_upload_budget(uint bytes) {
+	upload_budget = bytes;
+}
+
 void tex_blit(TexHandle tex, Color* data, uint x, uint y, uint w, uint h) {
 	assert(tex < textures.size);
 	Texture* t = DARRAY_DATA_PTR(textures, Texture);
 	t = &t[tex];
 	assert(t->active);
+
+	_tex_finish(t);
+
+	if(t->compressed)
+		LOG_ERROR("Unable to blit to compressed texture %s", t->file);
+
 	assert(x + w <= t->width || y + h <= t->height);
 
 	glBindTexture(GL_TEXTURE_2D, t->gl_id);
@@ -716,6 +1011,9 @@ void tex_size(TexHandle tex, uint* width, uint* height) {
 	Texture* t = DARRAY_DATA_PTR(textures, Texture);
 	assert(t[tex].active);
 
+	if(t[tex].job && t[tex].gl_id == 0)
+		_tex_decoded(&t[tex]);
+
 	*width = t[tex].width;
 	*height = t[tex].height;
 }
@@ -728,7 +1026,12 @@ void tex_free(TexHandle tex) {
 
 	t[tex].retain_count--;
 	if(t[tex].retain_count == 0) {
-		glDeleteTextures(1, &t[tex].gl_id);
+		if(t[tex].job) {
+			image_load_free(t[tex].job);
+			t[tex].job = NULL;
+		}
+		if(t[tex].gl_id)
+			glDeleteTextures(1, &t[tex].gl_id);
 		if(t[tex].file)
 			MEM_FREE(t[tex].file);
 		t[tex].active = false;
@@ -743,6 +1046,14 @@ void tex_scale(TexHandle tex, float s) {
 	t[tex].scale = s;
 }
 
+void tex_set_sdf(TexHandle tex, bool sdf) {
+	assert(tex < textures.size);
+	Texture* t = DARRAY_DATA_PTR(textures, Texture);
+	assert(t[tex].active);
+
+	t[tex].sdf = sdf;
+}
+
 uint _get_gl_id(TexHandle tex) {
 	assert(tex < textures.size);
 	Texture* t = DARRAY_DATA_PTR(textures, Texture);
@@ -760,6 +1071,11 @@ void video_draw_rect_rotated(TexHandle tex, uint layer,
 	assert(tex < textures.size);
 	Texture* t = DARRAY_DATA_PTR(textures, Texture);
 	assert(t[tex].active);
+
+	// Texture is still loading in the background, draw nothing
+	if(t[tex].job)
+		return;
+
 	float scale = t[tex].scale;
 	uint texture_width = t[tex].width;
 	uint texture_height = t[tex].height;
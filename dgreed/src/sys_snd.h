@@ -15,6 +15,13 @@ typedef struct {
 	uint stream_count;
 	uint playing_samples;
 	uint playing_streams;
+	// Totals since sound_init
+	uint stream_underruns; // Stream queue ran dry, playback restarted
+	uint stream_starved; // Frames with played buffers left unrefilled
+	uint stolen_sources; // Sources stopped to make room for new sounds
+	uint cache_hits, cache_misses; // Plays of compressed samples
+	uint cache_decode_ms; // Time spent decoding compressed samples
+	uint cache_bytes; // Decoded pcm of compressed samples in memory
 } SoundStats;
 
 const SoundStats* sound_stats(void);
@@ -27,13 +34,23 @@ void sound_close(void);
 // Must be called once each frame
 void sound_update(void);
 
+// Handles of freed sounds stay invalid even after their slot is reused
 typedef size_t SoundHandle;
 
-// Loads sound sample from .wav file
+// Default priorities, music is not cut off by effects
+#define SOUND_PRIORITY_SAMPLE 0
+#define SOUND_PRIORITY_STREAM 100
+
+// Loads sound sample from .wav file. Samples from .ogg files are kept 
+// compressed and decoded on play into a cache of limited size.
 SoundHandle sound_load_sample(const char* filename);
 // Prepares to steam sound from .ogg file
 SoundHandle sound_load_stream(const char* filename);
 
+// Sets how many bytes of decoded compressed samples can be kept in memory,
+// least recently played ones are freed first. Default is 8MB.
+void sound_set_cache_budget(size_t bytes);
+
 // Frees resources used by sound
 void sound_free(SoundHandle handle);
 
@@ -46,6 +63,9 @@ void sound_stop(SoundHandle handle);
 void sound_set_volume(SoundHandle handle, float volume);
 // Returns volume of sound
 float sound_get_volume(SoundHandle handle);
+// Sets priority of sound. When all sources are busy, new sound replaces
+// playing one with lower or equal priority, quietest and oldest first.
+void sound_set_priority(SoundHandle handle, int priority);
 // Returns length of sound in seconds
 float sound_get_length(SoundHandle handle);
 
@@ -105,6 +105,10 @@ SoundHandle sound_load_stream(const char* filename) {
 	return (SoundHandle)playable;
 }
 
+void sound_set_cache_budget(size_t bytes) {
+	// Samples are managed by Android SoundPool
+}
+
 void sound_free(SoundHandle handle) {
 	jobject playable = (jobject)handle;
 	(*env)->CallVoidMethod(env, playable, playable_free);
@@ -130,6 +134,10 @@ float sound_get_volume(SoundHandle handle) {
 	return (*env)->CallFloatMethod(env, playable, playable_get_volume);
 }
 
+void sound_set_priority(SoundHandle handle, int priority) {
+	// Voices are managed by Android SoundPool/MediaPlayer
+}
+
 float sound_get_length(SoundHandle handle) {
 	jobject playable = (jobject)handle;
 	return (*env)->CallFloatMethod(env, playable, playable_length);
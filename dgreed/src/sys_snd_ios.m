@@ -268,6 +268,10 @@ Source* _get_source(SourceHandle handle) {
     return NULL;
 }
 
+void sound_set_cache_budget(size_t bytes) {
+	// Not supported
+}
+
 void sound_free(SoundHandle handle) {
 	uint idx;
 	Sound* s = _get_sound(handle, &idx);
@@ -328,6 +332,10 @@ float sound_get_volume(SoundHandle handle) {
 	return s->volume;
 }
 
+void sound_set_priority(SoundHandle handle, int priority) {
+	// Not supported
+}
+
 float sound_get_length(SoundHandle handle) {
 	Sound* s = _get_sound(handle, NULL);
 	assert(s);
@@ -8,6 +8,10 @@
 #include <AL/alc.h>
 #endif
 
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "darray.h"
 #include "memory.h"
 #include "wav.h"
 
@@ -20,38 +24,86 @@
 -------------
 */
 
-#define MAX_SOURCES 8
-#define MAX_SOUNDS 64
+// Upper limit of OpenAL sources, device might provide less
+#define MAX_SOURCES 32
+// Default limit of decoded pcm kept for compressed samples
+#define DEFAULT_CACHE_BUDGET (8 * 1024 * 1024)
 #define STREAM_BUFFER_SIZE 32768
+// Decoded chunks kept ahead of playback for each stream
+#define STREAM_CHUNKS 8
+// OpenAL buffers queued on each streaming source
+#define STREAM_AL_BUFFERS 4
+// How often stream thread wakes up to look for free ring space
+#define STREAM_POLL_MS 10
+
+// Sound handle is slot index in low bits and slot generation in high bits,
+// so handles of freed sounds can be told apart from reused slots
+#define SOUND_INDEX_BITS 16
+#define SOUND_INDEX_MASK ((1 << SOUND_INDEX_BITS) - 1)
+#define SOUND_HANDLE(idx, gen) (((SoundHandle)(gen) << SOUND_INDEX_BITS) | (idx))
 
 typedef struct {
 	bool is_stream;
-	void* decode_buffer; // Null for samples
 	stb_vorbis* stream; // Not used for samples
-	int stream_source_id, channels, frequency; // Not used for samples
-	ALuint buffer; // Only for samples
+	int channels, frequency; // Not used for uncompressed samples
+	ALuint buffer; // Only for samples, 0 if compressed sample is not cached
+	void* ogg; // Only for compressed samples
+	uint ogg_size, pcm_size, last_used, length;
 	float volume;
+	int priority;
+	uint generation;
 	bool active;
 } Sound;
 
+// Ring of decoded pcm chunks, filled by stream thread and drained
+// into OpenAL queue by sound_update. Single producer, single consumer -
+// only read_idx is written by main thread and only write_idx by
+// stream thread. Decoding happens outside stream_mutex, the lock is
+// held only to claim a stream and to publish write_idx/finished.
+typedef struct {
+	stb_vorbis* vorbis;
+	int channels;
+	bool loop;
+	volatile bool active; // Changed only under stream_mutex
+	volatile bool finished;
+	volatile uint write_idx, read_idx;
+	uint chunk_size[STREAM_CHUNKS];
+	void* chunks;
+} Stream;
+
 typedef struct {
 	SourceHandle handle;
 	SoundHandle sound;
-	ALuint buffers[2]; // Only for streams
+	ALuint buffers[STREAM_AL_BUFFERS]; // Only for streams
+	ALuint idle_buffers[STREAM_AL_BUFFERS]; // Only for streams
+	uint idle_count; // Only for streams
+	Stream* stream; // Only for streams
 	ALuint al_source;
-	bool loop;
+	bool loop, paused, started;
 	float volume, pos;
 } Source;
 
-Sound sounds[MAX_SOUNDS];
-uint sound_count;
+DArray sounds;
+DArray free_sounds;
 
 ALCdevice* audio_device = NULL;
 ALCcontext* audio_context = NULL;
 Source sources[MAX_SOURCES];
 uint source_count;
+uint al_source_count;
 uint source_handle_counter;
 
+static size_t cache_budget, cache_bytes;
+static uint cache_clock;
+
+static Stream streams[MAX_SOURCES];
+static pthread_t stream_thread;
+static pthread_mutex_t stream_mutex;
+static pthread_cond_t stream_cond;
+static pthread_cond_t stream_idle_cond;
+static Stream* decoding_stream; // Claimed by stream thread, under stream_mutex
+static volatile bool stream_thread_running;
+
 #ifndef NO_DEVMODE
 SoundStats s_stats;
 
@@ -60,6 +112,105 @@ const SoundStats* sound_stats(void) {
 }
 #endif
 
+static Sound* _sound_at(SoundHandle handle) {
+	return darray_get(&sounds, handle & SOUND_INDEX_MASK);
+}
+
+// Returns sound for a handle, or NULL if handle is stale
+static Sound* _get_sound(SoundHandle handle) {
+	uint idx = handle & SOUND_INDEX_MASK;
+	if(idx < sounds.size) {
+		Sound* sound = darray_get(&sounds, idx);
+		if(sound->active && 
+			SOUND_HANDLE(idx, sound->generation) == handle)
+			return sound;
+	}
+	LOG_WARNING("Invalid sound handle");
+	return NULL;
+}
+
+// Decodes next chunk into ring slot idx, returns its size in bytes
+static uint _stream_decode_chunk(Stream* s, uint idx, bool* end) {
+	short* dest = s->chunks + idx * STREAM_BUFFER_SIZE;
+	int capacity = STREAM_BUFFER_SIZE / sizeof(short);
+	int filled = 0;
+	bool rewound = false;
+	*end = false;
+
+	while(filled < capacity) {
+		int n = stb_vorbis_get_samples_short_interleaved(
+			s->vorbis, s->channels, dest + filled, capacity - filled
+		);
+		filled += n * s->channels;
+
+		if(filled < capacity) {
+			// Reached end of stream, restart if we're looping and 
+			// stream is not empty
+			if(!s->loop || (rewound && n == 0)) {
+				*end = true;
+				break;
+			}
+			stb_vorbis_seek_start(s->vorbis);
+			rewound = true;
+		}
+	}
+
+	return filled * sizeof(short);
+}
+
+static void* _stream_thread_func(void* userdata) {
+	pthread_mutex_lock(&stream_mutex);
+	while(stream_thread_running) {
+		bool decoded = false;
+		for(uint i = 0; i < MAX_SOURCES; ++i) {
+			Stream* s = &streams[i];
+			if(!s->active || s->finished 
+				|| s->write_idx - s->read_idx >= STREAM_CHUNKS)
+				continue;
+
+			// Claim the stream and decode without holding the lock,
+			// sound_stop_ex waits until the claim is released
+			decoding_stream = s;
+			uint idx = s->write_idx % STREAM_CHUNKS;
+			pthread_mutex_unlock(&stream_mutex);
+
+			bool end;
+			uint size = _stream_decode_chunk(s, idx, &end);
+
+			pthread_mutex_lock(&stream_mutex);
+			decoding_stream = NULL;
+			if(s->active) {
+				if(size > 0) {
+					s->chunk_size[idx] = size;
+					__sync_synchronize();
+					s->write_idx++;
+				}
+
+				// Publish only after the last chunk is visible
+				if(end) {
+					__sync_synchronize();
+					s->finished = true;
+				}
+			}
+			pthread_cond_broadcast(&stream_idle_cond);
+			decoded = true;
+		}
+
+		if(!decoded) {
+			struct timeval now;
+			struct timespec until;
+			gettimeofday(&now, NULL);
+			uint64 ns = (uint64)now.tv_usec * 1000 
+				+ STREAM_POLL_MS * 1000000ULL;
+			until.tv_sec = now.tv_sec + ns / 1000000000ULL;
+			until.tv_nsec = ns % 1000000000ULL;
+			pthread_cond_timedwait(&stream_cond, &stream_mutex, &until);
+		}
+	}
+	pthread_mutex_unlock(&stream_mutex);
+	return NULL;
+}
+
 void sound_init(void) {
 	audio_device = alcOpenDevice(NULL);
 	if(!audio_device)
@@ -70,9 +221,8 @@ void sound_init(void) {
 		LOG_ERROR("Unable to create audio context");
 	alcMakeContextCurrent(audio_context);
 
-	for(uint i = 0; i < MAX_SOUNDS; ++i)
-		sounds[i].active = false;
-	sound_count = 0;
+	sounds = darray_create(sizeof(Sound), 0);
+	free_sounds = darray_create(sizeof(uint), 0);
 
 	// Init sources
 	ALfloat	null_vec[] = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -82,13 +232,18 @@ void sound_init(void) {
 	source_handle_counter = 1;
 	memset(&sources, 0, sizeof(sources));
 
-	for(uint i = 0; i < MAX_SOURCES; ++i)
-		alGenSources(1, &sources[i].al_source);
+	// Create as many sources as device allows
+	for(al_source_count = 0; al_source_count < MAX_SOURCES; ++al_source_count) {
+		alGenSources(1, &sources[al_source_count].al_source);
+		if(alGetError() != AL_NO_ERROR)
+			break;
+	}
 
-	if(alGetError() != AL_NO_ERROR)
+	if(al_source_count == 0)
 		LOG_ERROR("Unable to create sources");
+	LOG_INFO("Created %u sound sources", al_source_count);
 
-	for(uint i = 0; i < MAX_SOURCES; ++i) {
+	for(uint i = 0; i < al_source_count; ++i) {
 		alSourcef(sources[i].al_source, AL_PITCH, 1.0f);
 		alSourcef(sources[i].al_source, AL_GAIN, 1.0f);
 		alSourcefv(sources[i].al_source, AL_POSITION, null_vec);
@@ -104,17 +259,49 @@ void sound_init(void) {
 	if(alGetError() != AL_NO_ERROR)
 		LOG_ERROR("Unable to set sources params");
 
+	cache_budget = DEFAULT_CACHE_BUDGET;
+	cache_bytes = 0;
+	cache_clock = 0;
+
 	#ifndef NO_DEVMODE
 	memset(&s_stats, 0, sizeof(s_stats));
 	#endif
 
+	// Start stream decoding thread
+	memset(&streams, 0, sizeof(streams));
+	pthread_mutex_init(&stream_mutex, NULL);
+	pthread_cond_init(&stream_cond, NULL);
+	pthread_cond_init(&stream_idle_cond, NULL);
+	decoding_stream = NULL;
+	stream_thread_running = true;
+	if(pthread_create(&stream_thread, NULL, _stream_thread_func, NULL) != 0)
+		LOG_ERROR("Unable to create sound stream thread");
+
 	LOG_INFO("Sound initialized");
 }
 
 void sound_close(void) {
-	for(uint i = 0; i < MAX_SOURCES; ++i)
+	pthread_mutex_lock(&stream_mutex);
+	stream_thread_running = false;
+	pthread_cond_signal(&stream_cond);
+	pthread_mutex_unlock(&stream_mutex);
+	if(pthread_join(stream_thread, NULL) != 0)
+		LOG_ERROR("Unable to join sound stream thread");
+	pthread_cond_destroy(&stream_cond);
+	pthread_cond_destroy(&stream_idle_cond);
+	pthread_mutex_destroy(&stream_mutex);
+
+	for(uint i = 0; i < MAX_SOURCES; ++i) {
+		if(streams[i].chunks)
+			MEM_FREE(streams[i].chunks);
+	}
+
+	for(uint i = 0; i < al_source_count; ++i)
 		alDeleteSources(1, &sources[i].al_source);
 
+	darray_free(&sounds);
+	darray_free(&free_sounds);
+
 	if(audio_context)
 		alcDestroyContext(audio_context);
 	if(audio_device)
@@ -126,62 +313,33 @@ void sound_close(void) {
 void _sound_update_stream(Source* src) {
 	assert(src);
 
-	Sound* sound = &sounds[src->sound];
-
-	ALint state;
-	alGetSourcei(src->al_source, AL_SOURCE_STATE, &state);
-	if(state == AL_PAUSED)
+	if(src->paused)
 		return;
 
+	Sound* sound = _sound_at(src->sound);
+	Stream* stream = src->stream;
+
+	// Collect buffers which were already played
 	ALint processed_buffers;
 	alGetSourcei(src->al_source, AL_BUFFERS_PROCESSED, &processed_buffers);
-	while(processed_buffers--) {
-		// Decode new data
-		int decoded_samples = stb_vorbis_get_samples_short_interleaved(
-			sound->stream,
-			sound->channels,
-			(short*)sound->decode_buffer,
-			STREAM_BUFFER_SIZE / sizeof(short)
-		);
-
-		int expected_samples = STREAM_BUFFER_SIZE / sizeof(short);
-		if(sound->channels == 2)
-			expected_samples /= 2;
-
-		if(decoded_samples < expected_samples) {
-			LOG_INFO("End of stream");
-			// Reached end of stream
-			if(src->loop) {
-				// Restart stream if we're looping
-				stb_vorbis_seek_start(sound->stream);
-				size_t end_idx = decoded_samples * sizeof(short);
-				if(sound->channels == 2)
-					end_idx *= 2;
-				memset(sound->decode_buffer + end_idx, 0,
-					STREAM_BUFFER_SIZE - end_idx);
-				/*
-				decoded_samples = stb_vorbis_get_samples_short_interleaved(
-					sound->stream,
-					sound->channels,
-					(short*)sound->decode_buffer + end_idx,
-					(STREAM_BUFFER_SIZE - end_idx) / sizeof(short)
-				);
-				*/
-			}
-			else {
-				sound_stop_ex(src->handle);
-				return;
-			}
-		}
+	if(processed_buffers > 0) {
+		alSourceUnqueueBuffers(src->al_source, processed_buffers, 
+			&src->idle_buffers[src->idle_count]);
+		src->idle_count += processed_buffers;
+		assert(src->idle_count <= STREAM_AL_BUFFERS);
+	}
 
-		// Update buffer queue
-		ALuint buffer;
-		alSourceUnqueueBuffers(src->al_source, 1, &buffer);
+	// Refill them with chunks decoded by stream thread
+	bool refilled = false;
+	while(src->idle_count && stream->read_idx != stream->write_idx) {
+		__sync_synchronize();
+		uint idx = stream->read_idx % STREAM_CHUNKS;
+		ALuint buffer = src->idle_buffers[--src->idle_count];
 		alBufferData(
 			buffer,
 			sound->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16,
-			sound->decode_buffer,
-			STREAM_BUFFER_SIZE,
+			stream->chunks + idx * STREAM_BUFFER_SIZE,
+			stream->chunk_size[idx],
 			sound->frequency
 		);
 		if(alGetError() != AL_NO_ERROR)
@@ -191,21 +349,55 @@ void _sound_update_stream(Source* src) {
 
 		if(alGetError() != AL_NO_ERROR)
 			LOG_ERROR("Streaming error: alSourceQueueBuffers");
+
+		__sync_synchronize();
+		stream->read_idx++;
+		refilled = true;
 	}
 
-	// Resume playing if there was buffer under-run
-	if(state == AL_STOPPED)
+	if(refilled)
+		pthread_cond_signal(&stream_cond);
+
+	if(src->idle_count == STREAM_AL_BUFFERS) {
+		// Everything was played, and there's nothing more to play
+		if(stream->finished && stream->read_idx == stream->write_idx) {
+			sound_stop_ex(src->handle);
+			return;
+		}
+	}
+
+	#ifndef NO_DEVMODE
+	if(src->started && src->idle_count && !stream->finished)
+		s_stats.stream_starved++;
+	#endif
+
+	if(src->idle_count == STREAM_AL_BUFFERS)
+		return;
+
+	ALint state;
+	alGetSourcei(src->al_source, AL_SOURCE_STATE, &state);
+	if(state != AL_PLAYING) {
+		// Queue was drained before we refilled it
+		#ifndef NO_DEVMODE
+		if(src->started)
+			s_stats.stream_underruns++;
+		#endif
 		alSourcePlay(src->al_source);
+		src->started = true;
+	}
 }
 
 void sound_update(void) {
 	#ifndef NO_DEVMODE
-	memset(&s_stats, 0, sizeof(s_stats));
-
-	for(uint i = 0; i < MAX_SOUNDS; ++i) {
-
-		if(sounds[i].active) {
-			if(sounds[i].is_stream)
+	// Other counters accumulate over the whole run
+	s_stats.sample_count = s_stats.stream_count = 0;
+	s_stats.playing_samples = s_stats.playing_streams = 0;
+	s_stats.cache_bytes = cache_bytes;
+
+	Sound* snds = DARRAY_DATA_PTR(sounds, Sound);
+	for(uint i = 0; i < sounds.size; ++i) {
+		if(snds[i].active) {
+			if(snds[i].is_stream)
 				s_stats.stream_count++;
 			else
 				s_stats.sample_count++;
@@ -214,7 +406,7 @@ void sound_update(void) {
 	#endif
 
 	for(uint i = 0; i < source_count; ++i) {
-		if(sounds[sources[i].sound].is_stream) {
+		if(_sound_at(sources[i].sound)->is_stream) {
 			#ifndef NO_DEVMODE
 			s_stats.playing_streams++;
 			#endif
@@ -245,17 +437,146 @@ ALenum _choose_sound_format(const RawSound* sound) {
 	return 0;
 }
 
+static SoundHandle _alloc_sound(Sound** sound) {
+	uint idx;
+	if(free_sounds.size) {
+		idx = *(uint*)darray_get(&free_sounds, free_sounds.size-1);
+		free_sounds.size--;
+	}
+	else {
+		idx = sounds.size;
+		if(idx > SOUND_INDEX_MASK)
+			LOG_ERROR("Sound pool overflow");
+		darray_append_nulls(&sounds, 1);
+	}
+
+	*sound = darray_get(&sounds, idx);
+	uint generation = (*sound)->generation + 1;
+	memset(*sound, 0, sizeof(Sound));
+	(*sound)->generation = generation;
+	(*sound)->active = true;
+	(*sound)->volume = 1.0f;
+	return SOUND_HANDLE(idx, (*sound)->generation);
+}
+
+static SoundHandle _load_compressed_sample(const char* filename) {
+	LOG_INFO("Loading compressed sound from file %s", filename);
+	FileHandle f = file_open(filename);
+	uint size = file_size(f);
+	void* ogg = MEM_ALLOC(size);
+	file_read(f, ogg, size);
+	file_close(f);
+
+	// Only parse headers to learn format and length
+	int error;
+	stb_vorbis* v = stb_vorbis_open_memory(ogg, size, &error, NULL);
+	if(v == NULL)
+		LOG_ERROR("Unable to open ogg vorbis file %s", filename);
+	stb_vorbis_info info = stb_vorbis_get_info(v);
+	uint length = stb_vorbis_stream_length_in_samples(v);
+	stb_vorbis_close(v);
+
+	Sound* sound;
+	SoundHandle result = _alloc_sound(&sound);
+	sound->is_stream = false;
+	sound->buffer = 0;
+	sound->ogg = ogg;
+	sound->ogg_size = size;
+	sound->pcm_size = 0;
+	sound->length = length;
+	sound->channels = info.channels;
+	sound->frequency = info.sample_rate;
+	sound->priority = SOUND_PRIORITY_SAMPLE;
+
+	return result;
+}
+
+static bool _is_sound_playing(SoundHandle handle) {
+	for(uint i = 0; i < source_count; ++i) {
+		if(sources[i].sound == handle)
+			return true;
+	}
+	return false;
+}
+
+// Frees least recently played decoded samples until there's 
+// enough budget for needed bytes, or nothing more can be freed
+static void _evict_samples(size_t needed) {
+	while(cache_bytes + needed > cache_budget) {
+		Sound* snds = DARRAY_DATA_PTR(sounds, Sound);
+		Sound* lru = NULL;
+		for(uint i = 0; i < sounds.size; ++i) {
+			Sound* sound = &snds[i];
+			if(!sound->active || !sound->ogg || !sound->buffer)
+				continue;
+			if(lru && sound->last_used >= lru->last_used)
+				continue;
+			if(_is_sound_playing(SOUND_HANDLE(i, sound->generation)))
+				continue;
+			lru = sound;
+		}
+
+		if(!lru)
+			return;
+
+		alDeleteBuffers(1, &lru->buffer);
+		lru->buffer = 0;
+		cache_bytes -= lru->pcm_size;
+		lru->pcm_size = 0;
+	}
+}
+
+static void _decode_sample(Sound* sound) {
+	assert(sound->ogg && !sound->buffer);
+
+	#ifndef NO_DEVMODE
+	uint t = time_ms_current();
+	#endif
+
+	int error;
+	stb_vorbis* v = stb_vorbis_open_memory(sound->ogg, sound->ogg_size, 
+		&error, NULL);
+	if(v == NULL)
+		LOG_ERROR("Unable to decode ogg vorbis sample");
+	uint n = sound->length * sound->channels;
+	short* pcm = MEM_ALLOC(n * sizeof(short));
+	int decoded = stb_vorbis_get_samples_short_interleaved(
+		v, sound->channels, pcm, n
+	);
+	stb_vorbis_close(v);
+	uint size = decoded * sound->channels * sizeof(short);
+
+	_evict_samples(size);
+
+	alGenBuffers(1, &sound->buffer);
+	if(alGetError() != AL_NO_ERROR)
+		LOG_ERROR("Unable to create sound buffer");
+	alBufferData(
+		sound->buffer,
+		sound->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16,
+		pcm, size, sound->frequency
+	);
+	MEM_FREE(pcm);
+
+	sound->pcm_size = size;
+	cache_bytes += size;
+
+	#ifndef NO_DEVMODE
+	s_stats.cache_decode_ms += time_ms_current() - t;
+	#endif
+}
+
+void sound_set_cache_budget(size_t bytes) {
+	cache_budget = bytes;
+	_evict_samples(0);
+}
+
 SoundHandle sound_load_sample(const char* filename) {
 	assert(filename);
 
-	// Find free space in sound pool
-	SoundHandle result = 0;
-	while(sounds[result].active && result < MAX_SOUNDS) {
-		result++;
-	}
-	sound_count++;
-	if(sound_count > MAX_SOUNDS || result == MAX_SOUNDS)
-		LOG_ERROR("Sound pool overflow");
+	const char* ext = strrchr(filename, '.');
+	if(ext && strcmp(ext, ".ogg") == 0)
+		return _load_compressed_sample(filename);
 
 	// Create open al buffer
 	LOG_INFO("Loading sound from file %s", filename);
@@ -268,11 +589,12 @@ SoundHandle sound_load_sample(const char* filename) {
 		wave->size, wave->frequency);
 	wav_free(wave);
 
-	sounds[result].is_stream = false;
-	sounds[result].stream_source_id = -1;
-	sounds[result].buffer = buffer;
-	sounds[result].volume = 1.0f;
-	sounds[result].active = true;
+	Sound* sound;
+	SoundHandle result = _alloc_sound(&sound);
+	sound->is_stream = false;
+	sound->buffer = buffer;
+	sound->ogg = NULL;
+	sound->priority = SOUND_PRIORITY_SAMPLE;
 
 	return result;
 }
@@ -280,15 +602,6 @@ SoundHandle sound_load_sample(const char* filename) {
 SoundHandle sound_load_stream(const char* filename) {
 	assert(filename);
 
-	// Find free space in sound pool
-	SoundHandle result = 0;
-	while(sounds[result].active && result < MAX_SOUNDS) {
-		result++;
-	}
-	sound_count++;
-	if(sound_count > MAX_SOUNDS || result == MAX_SOUNDS)
-		LOG_ERROR("Sound pool overflow");
-
 	// Initialize stream
 	LOG_INFO("Loading sound stream %s", filename);
 	int error;
@@ -303,64 +616,63 @@ SoundHandle sound_load_stream(const char* filename) {
 	assert(info.sample_rate == 22050 || info.sample_rate == 44100);
 	assert(info.channels == 1 || info.channels == 2);
 
-	// Allocate decoding buffer
-	void* decode_buffer = MEM_ALLOC(STREAM_BUFFER_SIZE);
-
-	sounds[result].is_stream = true;
-	sounds[result].stream = stream;
-	sounds[result].decode_buffer = decode_buffer;
-	sounds[result].stream_source_id = -1; // Will be assigned later
-	sounds[result].channels = info.channels;
-	sounds[result].frequency = info.sample_rate;
-	sounds[result].volume = 1.0f;
-	sounds[result].active = true;
+	Sound* sound;
+	SoundHandle result = _alloc_sound(&sound);
+	sound->is_stream = true;
+	sound->stream = stream;
+	sound->channels = info.channels;
+	sound->frequency = info.sample_rate;
+	sound->priority = SOUND_PRIORITY_STREAM;
 
 	return result;
 }
 
 void sound_free(SoundHandle handle) {
-	assert(handle < sound_count);
-	assert(sounds[handle].active);
+	Sound* sound = _get_sound(handle);
+	if(!sound)
+		return;
 
 	// If not finished playing ...
 	for(int i = 0; i < source_count; ++i) {
 		if(sources[i].sound == handle) {
 			// Stop
 			sound_stop_ex(sources[i].handle);
+			i--;
 		}
 	}
 
-	// Sound stream
-	if(sounds[handle].is_stream) {
-		MEM_FREE(sounds[handle].decode_buffer);
-		stb_vorbis_close(sounds[handle].stream);
-		sounds[handle].active = false;
-		return;
+	if(sound->is_stream) {
+		// Sound stream
+		stb_vorbis_close(sound->stream);
+	}
+	else {
+		// Sound sample, delete buffer
+		if(sound->buffer) {
+			alDeleteBuffers(1, &sound->buffer);
+			ALuint error = alGetError();
+			if(error != AL_NO_ERROR)
+				LOG_ERROR("Unable to delete sound buffer");
+		}
+		if(sound->ogg) {
+			MEM_FREE(sound->ogg);
+			cache_bytes -= sound->pcm_size;
+		}
 	}
 
-	// Sound sample
-
-	// Delete buffer
-	alDeleteBuffers(1, &sounds[handle].buffer);
-	ALuint error = alGetError();
-	if(error != AL_NO_ERROR)
-		LOG_ERROR("Unable to delete sound buffer");
-	sounds[handle].active = false;
+	sound->active = false;
+	uint idx = handle & SOUND_INDEX_MASK;
+	darray_append(&free_sounds, &idx);
 }
 
 void sound_play(SoundHandle handle) {
-	assert(handle < sound_count);
-	assert(sounds[handle].active);
-
-	sound_play_ex(handle, sounds[handle].is_stream);
+	Sound* sound = _get_sound(handle);
+	if(sound)
+		sound_play_ex(handle, sound->is_stream);
 }
 
-
 void sound_stop(SoundHandle handle) {
-	assert(handle < sound_count);
-	assert(sounds[handle].active);
-
-	if(sounds[handle].is_stream) {
+	Sound* sound = _get_sound(handle);
+	if(sound && sound->is_stream) {
 		for(uint i = 0; i < source_count; ++i) {
 			if(sources[i].sound == handle)
 				sound_stop_ex(sources[i].handle);
@@ -369,12 +681,14 @@ void sound_stop(SoundHandle handle) {
 }
 
 void sound_set_volume(SoundHandle handle, float volume) {
-	assert(handle < sound_count);
-	assert(sounds[handle].active);
 	assert(volume >= 0.0f && volume <= 1.0f);
 
-	sounds[handle].volume = volume;
-	if(sounds[handle].is_stream) {
+	Sound* sound = _get_sound(handle);
+	if(!sound)
+		return;
+
+	sound->volume = volume;
+	if(sound->is_stream) {
 		for(uint i = 0; i < source_count; ++i) {
 			if(sources[i].sound == handle)
 				sound_set_volume_ex(sources[i].handle, volume);
@@ -383,87 +697,145 @@ void sound_set_volume(SoundHandle handle, float volume) {
 }
 
 float sound_get_volume(SoundHandle handle) {
-	assert(handle < sound_count);
-	assert(sounds[handle].active);
+	Sound* sound = _get_sound(handle);
+	return sound ? sound->volume : 0.0f;
+}
 
-	return sounds[handle].volume;
+void sound_set_priority(SoundHandle handle, int priority) {
+	Sound* sound = _get_sound(handle);
+	if(sound)
+		sound->priority = priority;
 }
 
 float sound_get_length(SoundHandle handle) {
-	assert(handle < sound_count);
-	assert(sounds[handle].active);
+	Sound* sound = _get_sound(handle);
+	if(!sound)
+		return 0.0f;
 
-	if(sounds[handle].is_stream) {
+	if(sound->is_stream) {
 		// TODO
 		return 0.0f;
 	}
+	else if(sound->ogg) {
+		return (float)sound->length / (float)sound->frequency;
+	}
 	else {
 		ALint freq, channels, bits, size;
-		alGetBufferi(sounds[handle].buffer, AL_FREQUENCY, &freq);
-		alGetBufferi(sounds[handle].buffer, AL_CHANNELS, &channels);
-		alGetBufferi(sounds[handle].buffer, AL_BITS, &bits);
-		alGetBufferi(sounds[handle].buffer, AL_SIZE, &size);
+		alGetBufferi(sound->buffer, AL_FREQUENCY, &freq);
+		alGetBufferi(sound->buffer, AL_CHANNELS, &channels);
+		alGetBufferi(sound->buffer, AL_BITS, &bits);
+		alGetBufferi(sound->buffer, AL_SIZE, &size);
 
 		return (float)size / (float)(freq * channels * bits/8);
 	}
 }
 
-SourceHandle sound_play_ex(SoundHandle handle, bool loop) {
-	assert(handle < sound_count);
-	assert(sounds[handle].active);
+// Chooses a playing source to give up for a new sound with provided
+// priority: lowest priority first, then quietest, then oldest.
+// Returns NULL if every source is more important.
+static Source* _steal_source(int priority) {
+	Source* victim = NULL;
+	int victim_priority = 0;
+	for(uint i = 0; i < source_count; ++i) {
+		Source* src = &sources[i];
+		int p = _sound_at(src->sound)->priority;
+		if(p > priority)
+			continue;
+
+		if(!victim || p < victim_priority 
+			|| (p == victim_priority && (src->volume < victim->volume 
+			|| (src->volume == victim->volume && src->handle < victim->handle)))) {
+			victim = src;
+			victim_priority = p;
+		}
+	}
+	return victim;
+}
 
-	if(source_count == MAX_SOURCES) {
-		LOG_WARNING("Skipping sound");
+SourceHandle sound_play_ex(SoundHandle handle, bool loop) {
+	Sound* sound = _get_sound(handle);
+	if(!sound)
 		return 0;
+
+	if(source_count == al_source_count) {
+		Source* victim = _steal_source(sound->priority);
+		if(!victim) {
+			LOG_WARNING("Skipping sound");
+			return 0;
+		}
+		sound_stop_ex(victim->handle);
+		#ifndef NO_DEVMODE
+		s_stats.stolen_sources++;
+		#endif
 	}
 
 	Source* src = &sources[source_count++];
 	src->handle = source_handle_counter++;
 	src->sound = handle;
 	src->loop = loop;
-	src->volume = sounds[handle].volume;
+	src->volume = sound->volume;
 	src->pos = 0.0f;
+	src->paused = false;
+	src->started = false;
+
+	alSourcef(src->al_source, AL_GAIN, sound->volume);
 
-	if(sounds[handle].is_stream) {
+	if(sound->is_stream) {
 		for(int i = 0; i < source_count-1; ++i) {
 			assert(sources[i].sound != handle);
 		}
 
-		alGenBuffers(2, src->buffers);
+		alGenBuffers(STREAM_AL_BUFFERS, src->buffers);
 		if(alGetError() != AL_NO_ERROR)
 			LOG_ERROR("Unable to create sound buffers for stream");
-
-		Sound* sound = &sounds[handle];
-		assert(sound->decode_buffer);
-
-		for(uint i = 0; i < 2; ++i) {
-			stb_vorbis_get_samples_short_interleaved(
-				sound->stream,
-				sound->channels,
-				sound->decode_buffer,
-				STREAM_BUFFER_SIZE / sizeof(short)
-			);
-
-			alBufferData(
-				src->buffers[i],
-				sound->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16,
-				sound->decode_buffer,
-				STREAM_BUFFER_SIZE,
-				sound->frequency
-			);
+		memcpy(src->idle_buffers, src->buffers, sizeof(src->buffers));
+		src->idle_count = STREAM_AL_BUFFERS;
+
+		// Find free stream slot, there's always one since
+		// each stream needs a source
+		Stream* stream = NULL;
+		for(uint i = 0; i < MAX_SOURCES && !stream; ++i) {
+			if(!streams[i].active)
+				stream = &streams[i];
 		}
-
-		alSourceQueueBuffers(src->al_source, 2, src->buffers);
-
+		assert(stream);
+
+		if(!stream->chunks)
+			stream->chunks = MEM_ALLOC(STREAM_CHUNKS * STREAM_BUFFER_SIZE);
+
+		stb_vorbis_seek_start(sound->stream);
+
+		// Hand stream over to stream thread, source will start playing 
+		// on sound_update when first chunks are decoded
+		pthread_mutex_lock(&stream_mutex);
+		stream->vorbis = sound->stream;
+		stream->channels = sound->channels;
+		stream->loop = loop;
+		stream->finished = false;
+		stream->write_idx = stream->read_idx = 0;
+		stream->active = true;
+		pthread_cond_signal(&stream_cond);
+		pthread_mutex_unlock(&stream_mutex);
+
+		src->stream = stream;
 	}
 	else {
-		alSourcei(src->al_source, AL_BUFFER, sounds[handle].buffer);
+		if(sound->ogg) {
+			#ifndef NO_DEVMODE
+			if(sound->buffer)
+				s_stats.cache_hits++;
+			else
+				s_stats.cache_misses++;
+			#endif
+			if(!sound->buffer)
+				_decode_sample(sound);
+			sound->last_used = ++cache_clock;
+		}
+		alSourcei(src->al_source, AL_BUFFER, sound->buffer);
 		alSourcei(src->al_source, AL_LOOPING, loop);
+		alSourcePlay(src->al_source);
 	}
 
-	alSourcef(src->al_source, AL_GAIN, sounds[handle].volume);
-	alSourcePlay(src->al_source);
-
 
 	return src->handle;
 }
@@ -480,6 +852,7 @@ void sound_pause_ex(SourceHandle handle) {
 	Source* src = _find_source(handle);
 	assert(src);
 
+	src->paused = true;
 	alSourcePause(src->al_source);
 }
 
@@ -487,6 +860,7 @@ void sound_resume_ex(SourceHandle handle) {
 	Source* src = _find_source(handle);
 	assert(src);
 
+	src->paused = false;
 	ALint state;
 	alGetSourcei(src->al_source, AL_SOURCE_STATE, &state);
 	if(state == AL_PAUSED)
@@ -499,15 +873,25 @@ void sound_stop_ex(SourceHandle handle) {
 		return;
 
 	alSourceStop(src->al_source);
-	if(sounds[src->sound].is_stream) {
+	if(_sound_at(src->sound)->is_stream) {
+		// Take stream away from stream thread, after this it won't
+		// touch the decoder. If a chunk is being decoded right now,
+		// wait for it to finish.
+		pthread_mutex_lock(&stream_mutex);
+		src->stream->active = false;
+		while(decoding_stream == src->stream)
+			pthread_cond_wait(&stream_idle_cond, &stream_mutex);
+		pthread_mutex_unlock(&stream_mutex);
+		src->stream = NULL;
+
 		// Unqueue buffers
 		ALint processed_buffers;
 		alGetSourcei(src->al_source, AL_BUFFERS_PROCESSED, &processed_buffers);
-		ALuint buffers[2];
+		ALuint buffers[STREAM_AL_BUFFERS];
 		alSourceUnqueueBuffers(src->al_source, processed_buffers, buffers);
 		alSourcei(src->al_source, AL_BUFFER, 0);
 
-		alDeleteBuffers(2, src->buffers);
+		alDeleteBuffers(STREAM_AL_BUFFERS, src->buffers);
 		ALuint error = alGetError();
 		if(error != AL_NO_ERROR)
 			LOG_ERROR("Unable to delete sound stream buffers");
@@ -548,7 +932,7 @@ float sound_get_pos_ex(SourceHandle source) {
 	assert(src);
 
 	float pos = 0.0f;
-	if(sounds[src->sound].is_stream) {
+	if(_sound_at(src->sound)->is_stream) {
 		// TODO
 	}
 	else {
@@ -562,7 +946,7 @@ void sound_set_pos_ex(SourceHandle source, float pos) {
 	Source* src = _find_source(source);
 	assert(src);
 
-	if(sounds[src->sound].is_stream) {
+	if(_sound_at(src->sound)->is_stream) {
 		// TODO
 	}
 	else {
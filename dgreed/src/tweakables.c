@@ -10,13 +10,10 @@
 bool _parse_vars(const char* filename, DArray* dest) {
 	assert(filename);
 	
-	char* unparsed = txtfile_read(filename);
 	MMLObject mml;
-	if(!mml_deserialize(&mml, unparsed))
+	if(!mml_load(&mml, filename))
 		return false;
 
-	MEM_FREE(unparsed);
-
 	NodeIdx root = mml_root(&mml);	
 	if(strcmp(mml_get_name(&mml, root), "tweakables") != 0)
 		return false;
@@ -8,6 +8,51 @@ static DArray ui_elements;
 static DArray name_strings;
 static Dict ui_dict;
 
+// Expressions are compiled to a small stack machine code, element
+// references are resolved to indices at compile time. Expressions are
+// kept in evaluation order, so relayout can replay them.
+typedef enum {
+	OP_CONST,
+	OP_GET_VEC2,
+	OP_GET_RECT,
+	OP_SPR_SIZE,
+	OP_ADD,
+	OP_SUB,
+	OP_AVG,
+	OP_MIDDLE,
+	OP_X,
+	OP_Y,
+	OP_TL,
+	OP_TR,
+	OP_BL,
+	OP_BR,
+	OP_RADD
+} UIOpType;
+
+// 8 bytes
+typedef struct {
+	uint16 type;
+	uint16 argc;
+	uint arg;
+} UIOp;
+
+typedef struct {
+	uint el;
+	UIElementType kind;
+	bool superseded;
+	uint code_start, code_len;
+	uint deps_start, deps_len;
+} UIExpr;
+
+// Deeper expressions are rejected at compile time
+#define UI_EVAL_STACK 32
+
+static DArray ui_code;
+static DArray ui_consts;
+static DArray ui_deps;
+static DArray ui_exprs;
+static uint compile_deps_start;
+
 static bool _is_vec2_fun(MMLObject* mml, NodeIdx node) {
 	static const char* vec2_fun_names[] = {
 		"vec2", "get_vec2", "add", "sub", "avg", "middle", 
@@ -23,34 +68,83 @@ static bool _is_vec2_fun(MMLObject* mml, NodeIdx node) {
 	return false;
 }
 
-static RectF _rect_fun(MMLObject* mml, NodeIdx node, UIElement* context, UIElement* parent);
+static bool _is_rect_fun(MMLObject* mml, NodeIdx node) {
+	static const char* rectf_fun_names[] = {
+		"rect", "get_rect", "radd"
+	};
+
+	const char* name = mml_get_name(mml, node);
+
+	for(uint i = 0; i < ARRAY_SIZE(rectf_fun_names); ++i) {
+		if(strcmp(name, rectf_fun_names[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Element lookup, same rules for get_vec2 and get_rect:
+// children of context, children of parent, root elements
+static int _find_element(const char* name, uint context, int parent) {
+	UIElement* ctx = darray_get(&ui_elements, context);
+	const UIElement* el = uidesc_get_child(ctx, name);
+
+	if(!el && parent >= 0)
+		el = uidesc_get_child(darray_get(&ui_elements, parent), name);
+
+	if(!el)
+		el = dict_get(&ui_dict, name);
 
-static Vector2 _vec2_fun(MMLObject* mml, NodeIdx node, UIElement* context, UIElement* parent) {
+	return el ? el - (UIElement*)ui_elements.data : -1;
+}
+
+static void _emit(UIOpType type, uint argc, uint arg) {
+	UIOp op = {
+		.type = type,
+		.argc = argc,
+		.arg = arg
+	};
+	darray_append(&ui_code, &op);
+}
+
+static void _emit_const(RectF value) {
+	darray_append(&ui_consts, &value);
+	_emit(OP_CONST, 0, ui_consts.size-1);
+}
+
+static void _emit_get(UIOpType type, uint el) {
+	// Record dependency, once
+	uint* deps = DARRAY_DATA_PTR(ui_deps, uint);
+	bool found = false;
+	for(uint i = compile_deps_start; i < ui_deps.size && !found; ++i)
+		found = deps[i] == el;
+	if(!found)
+		darray_append(&ui_deps, &el);
+
+	_emit(type, 0, el);
+}
+
+static void _compile_rect(MMLObject* mml, NodeIdx node, uint context, int parent);
+
+static void _compile_vec2(MMLObject* mml, NodeIdx node, uint context, int parent) {
 	assert(_is_vec2_fun(mml, node));
 
 	const char* name = mml_get_name(mml, node);
 
 	if(strcmp(name, "vec2") == 0) {
-		return mml_getval_vec2(mml, node);
+		Vector2 v = mml_getval_vec2(mml, node);
+		_emit_const(rectf(v.x, v.y, 0.0f, 0.0f));
 	}
 	else if(strcmp(name, "get_vec2") == 0) {
-		// TODO: check local defs too
 		const char* element_name = mml_getval_str(mml, node);
+		int el = _find_element(element_name, context, parent);
 
-		const UIElement* el = uidesc_get_child(context, element_name);
-
-		if(!el && parent)
-			el = uidesc_get_child(parent, element_name);
-
-		if(!el)
-			el = dict_get(&ui_dict, element_name);
-
-		if(el && (el->members & UI_EL_VEC2)) {
-			return el->vec2;
+		UIElement* e = el >= 0 ? darray_get(&ui_elements, el) : NULL;
+		if(e && (e->members & UI_EL_VEC2)) {
+			_emit_get(OP_GET_VEC2, el);
 		}
 		else {
 			LOG_WARNING("Unable to get_vec2 %s", element_name);
-			return vec2(0.0f, 0.0f);
+			_emit_const(rectf_null());
 		}
 	}
 	else {
@@ -58,135 +152,244 @@ static Vector2 _vec2_fun(MMLObject* mml, NodeIdx node, UIElement* context, UIEle
 		bool avg = !add && (strcmp(name, "avg") == 0);
 		bool sub = !add && !avg && (strcmp(name, "sub") == 0);
 		if(add || avg || sub) {
-			// Iterate over children, add them
 			uint n = 0;
-			Vector2 sum = vec2(0.0f, 0.0f);
 			NodeIdx child = mml_get_first_child(mml, node);
 			for(; child != 0; child = mml_get_next(mml, child)) {
-				if(n > 0 && sub)
-					sum = vec2_sub(sum, _vec2_fun(mml, child, context, parent));
-				else
-					sum = vec2_add(sum, _vec2_fun(mml, child, context, parent));
+				_compile_vec2(mml, child, context, parent);
 				n++;
 			}
 
-			if(avg) {
-				sum = vec2_scale(sum, 1.0f / (float)n);
-			}
-
 			if(n) {
-				return sum;
+				_emit(add ? OP_ADD : (avg ? OP_AVG : OP_SUB), n, 0);
 			}
 			else {
 				LOG_WARNING("Unable to calculate sum/avg");
-				return vec2(0.0f, 0.0f);
+				_emit_const(rectf_null());
 			}
 		}
 		else if(strcmp(name, "middle") == 0) {
-			NodeIdx child = mml_get_first_child(mml, node);
-			RectF rect = _rect_fun(mml, child, context, parent);
-			return rectf_center(&rect);
+			_compile_rect(mml, mml_get_first_child(mml, node), context, parent);
+			_emit(OP_MIDDLE, 1, 0);
 		}
 		else if(strcmp(name, "spr_size") == 0) {
 			const char* spr_name = mml_getval_str(mml, node);
-			return sprsheet_get_size(spr_name);
-		}
-		else if(strcmp(name, "x") == 0) {
-			NodeIdx child = mml_get_first_child(mml, node);
-			Vector2 vec2 = _vec2_fun(mml, child, context, parent);
-			vec2.y = 0.0f;
-			return vec2;
+			_emit(OP_SPR_SIZE, 0, sprsheet_get_handle(spr_name));
 		}
-		else if(strcmp(name, "y") == 0) {
-			NodeIdx child = mml_get_first_child(mml, node);
-			Vector2 vec2 = _vec2_fun(mml, child, context, parent);
-			vec2.x = 0.0f;
-			return vec2;
+		else if(strcmp(name, "x") == 0 || strcmp(name, "y") == 0) {
+			_compile_vec2(mml, mml_get_first_child(mml, node), context, parent);
+			_emit(name[0] == 'x' ? OP_X : OP_Y, 1, 0);
 		}
 		else {
-			bool tl = strcmp(name, "tl") == 0;
-			bool tr = !tl && (strcmp(name, "tr") == 0);
-			bool bl = !tl && !tr && (strcmp(name, "bl") == 0);
-			bool br = !tl && !tr && !bl && (strcmp(name, "br") == 0);
-
-			if(tl || tr || bl || br) {
-				NodeIdx child = mml_get_first_child(mml, node);
-				RectF rect = _rect_fun(mml, child, context, parent);
-				if(tl)
-					return vec2(rect.left, rect.top);
-				if(tr)
-					return vec2(rect.right, rect.top);
-				if(bl)
-					return vec2(rect.left, rect.bottom);
-				if(br)
-					return vec2(rect.right, rect.bottom);
+			static const char* corner_names[] = {"tl", "tr", "bl", "br"};
+			for(uint i = 0; i < ARRAY_SIZE(corner_names); ++i) {
+				if(strcmp(name, corner_names[i]) == 0) {
+					NodeIdx child = mml_get_first_child(mml, node);
+					_compile_rect(mml, child, context, parent);
+					_emit(OP_TL + i, 1, 0);
+					return;
+				}
 			}
 
 			LOG_WARNING("Unable to eval vec2 function %s", name);
-			return vec2(0.0f, 0.0f);
+			_emit_const(rectf_null());
 		}
 	}
 }
 
-static bool _is_rect_fun(MMLObject* mml, NodeIdx node) {
-	static const char* rectf_fun_names[] = {
-		"rect", "get_rect", "radd"
-	};
-
-	const char* name = mml_get_name(mml, node);
-
-	for(uint i = 0; i < ARRAY_SIZE(rectf_fun_names); ++i) {
-		if(strcmp(name, rectf_fun_names[i]) == 0)
-			return true;
-	}
-	return false;
-}
-
-static RectF _rect_fun(MMLObject* mml, NodeIdx node, UIElement* context, UIElement* parent) {
+static void _compile_rect(MMLObject* mml, NodeIdx node, uint context, int parent) {
 	assert(_is_rect_fun(mml, node));
 
 	const char* name = mml_get_name(mml, node);
 	
 	if(strcmp(name, "rect") == 0) {
-		return mml_getval_rectf(mml, node);
+		_emit_const(mml_getval_rectf(mml, node));
 	}
 	else if(strcmp(name, "get_rect") == 0) {
-		// TODO: Check local defs too
 		const char* element_name = mml_getval_str(mml, node);
+		int el = _find_element(element_name, context, parent);
 
-		const UIElement* el = uidesc_get_child(context, element_name);
-
-		if(!el && parent)
-			el = uidesc_get_child(parent, element_name);
-
-		if(!el)
-			el = dict_get(&ui_dict, element_name);
-
-		if(el && (el->members & UI_EL_RECT)) {
-			return el->rect;
+		UIElement* e = el >= 0 ? darray_get(&ui_elements, el) : NULL;
+		if(e && (e->members & UI_EL_RECT)) {
+			_emit_get(OP_GET_RECT, el);
 		}
 		else {
 			LOG_WARNING("Unable to get_rect %s", element_name);
-			return rectf_null();
+			_emit_const(rectf_null());
 		}
 	}
 	else if(strcmp(name, "radd") == 0) {
-		uint n = 0;
-		Vector2 sum = vec2(0.0f, 0.0f);
+		uint n = 1;
 		NodeIdx child = mml_get_first_child(mml, node);
-		RectF rect = _rect_fun(mml, child, context, parent);
+		_compile_rect(mml, child, context, parent);
 		for(child = mml_get_next(mml, child); child != 0; child = mml_get_next(mml, child)) {
-			sum = vec2_add(sum, _vec2_fun(mml, child, context, parent));
+			_compile_vec2(mml, child, context, parent);
 			n++;
 		}
-		rect.left += sum.x; rect.right += sum.x;
-		rect.top += sum.y; rect.bottom += sum.y;
+		_emit(OP_RADD, n, 0);
+	}
+	else {
+		LOG_WARNING("Unable to eval rect function %s", name);
+		_emit_const(rectf_null());
+	}
+}
+
+// Returns how deep eval stack gets while running the code
+static uint _stack_depth(uint code_start, uint code_len) {
+	const UIOp* code = DARRAY_DATA_PTR(ui_code, UIOp);
+	uint sp = 0, max_sp = 0;
+	for(uint i = code_start; i < code_start + code_len; ++i) {
+		assert(sp >= code[i].argc);
+		sp = sp - code[i].argc + 1;
+		max_sp = MAX(max_sp, sp);
+	}
+	return max_sp;
+}
+
+// Runs compiled expression, vec2 values are kept in left, top
+static RectF _eval(const UIExpr* expr) {
+	RectF stack[UI_EVAL_STACK];
+	uint sp = 0;
+
+	const UIOp* code = DARRAY_DATA_PTR(ui_code, UIOp);
+	const RectF* consts = DARRAY_DATA_PTR(ui_consts, RectF);
+	const UIElement* els = DARRAY_DATA_PTR(ui_elements, UIElement);
+
+	for(uint i = expr->code_start; i < expr->code_start + expr->code_len; ++i) {
+		const UIOp* op = &code[i];
+		assert(sp >= op->argc);
+		RectF* args = &stack[sp - op->argc];
+		RectF res = rectf_null();
+
+		switch(op->type) {
+			case OP_CONST:
+				res = consts[op->arg];
+				break;
+			case OP_GET_VEC2:
+				res.left = els[op->arg].vec2.x;
+				res.top = els[op->arg].vec2.y;
+				break;
+			case OP_GET_RECT:
+				res = els[op->arg].rect;
+				break;
+			case OP_SPR_SIZE: {
+				Vector2 size = sprsheet_get_size_h(op->arg);
+				res.left = size.x;
+				res.top = size.y;
+				break;
+			}
+			case OP_ADD:
+			case OP_SUB:
+			case OP_AVG:
+				res = args[0];
+				for(uint j = 1; j < op->argc; ++j) {
+					float sign = op->type == OP_SUB ? -1.0f : 1.0f;
+					res.left += args[j].left * sign;
+					res.top += args[j].top * sign;
+				}
+				if(op->type == OP_AVG) {
+					res.left /= (float)op->argc;
+					res.top /= (float)op->argc;
+				}
+				res.right = res.bottom = 0.0f;
+				break;
+			case OP_MIDDLE: {
+				Vector2 c = rectf_center(&args[0]);
+				res.left = c.x;
+				res.top = c.y;
+				break;
+			}
+			case OP_X:
+				res.left = args[0].left;
+				break;
+			case OP_Y:
+				res.top = args[0].top;
+				break;
+			case OP_TL:
+			case OP_TR:
+			case OP_BL:
+			case OP_BR: {
+				bool right = op->type == OP_TR || op->type == OP_BR;
+				bool bottom = op->type == OP_BL || op->type == OP_BR;
+				res.left = right ? args[0].right : args[0].left;
+				res.top = bottom ? args[0].bottom : args[0].top;
+				break;
+			}
+			case OP_RADD:
+				res = args[0];
+				for(uint j = 1; j < op->argc; ++j) {
+					res.left += args[j].left; res.right += args[j].left;
+					res.top += args[j].top; res.bottom += args[j].top;
+				}
+				break;
+		}
+
+		sp -= op->argc;
+		assert(sp < UI_EVAL_STACK);
+		stack[sp++] = res;
+	}
+
+	assert(sp == 1);
+	return stack[0];
+}
+
+// Evaluates expression and stores result in element,
+// returns true if value has changed
+static bool _apply(const UIExpr* expr) {
+	RectF res = _eval(expr);
+	UIElement* el = darray_get(&ui_elements, expr->el);
+
+	if(expr->kind == UI_EL_VEC2) {
+		Vector2 v = vec2(res.left, res.top);
+		bool changed = v.x != el->vec2.x || v.y != el->vec2.y;
+		el->vec2 = v;
+		return changed;
+	}
+	else {
+		bool changed = memcmp(&res, &el->rect, sizeof(RectF)) != 0;
+		el->rect = res;
+		return changed;
+	}
+}
+
+static void _compile_expr(MMLObject* mml, NodeIdx node, uint el, int parent,
+		UIElementType kind) {
 
-		return rect;
+	UIExpr new = {
+		.el = el,
+		.kind = kind,
+		.superseded = false,
+		.code_start = ui_code.size,
+		.deps_start = ui_deps.size
+	};
+
+	compile_deps_start = ui_deps.size;
+	if(kind == UI_EL_VEC2)
+		_compile_vec2(mml, node, el, parent);
+	else
+		_compile_rect(mml, node, el, parent);
+
+	new.code_len = ui_code.size - new.code_start;
+
+	if(_stack_depth(new.code_start, new.code_len) > UI_EVAL_STACK) {
+		UIElement* e = darray_get(&ui_elements, el);
+		LOG_WARNING("Expression of %s is nested too deep", e->name);
+		ui_code.size = new.code_start;
+		ui_deps.size = new.deps_start;
+		_emit_const(rectf_null());
+		new.code_len = ui_code.size - new.code_start;
 	}
 
-	LOG_WARNING("Unable to eval rect function %s", name);
-	return rectf_null();
+	new.deps_len = ui_deps.size - new.deps_start;
+
+	// Only the last expression of the same kind matters for element
+	UIExpr* exprs = DARRAY_DATA_PTR(ui_exprs, UIExpr);
+	for(uint i = 0; i < ui_exprs.size; ++i) {
+		if(exprs[i].el == el && exprs[i].kind == kind)
+			exprs[i].superseded = true;
+	}
+
+	darray_append(&ui_exprs, &new);
+	_apply(&new);
 }
 
 static bool _is_spr_fun(MMLObject* mml, NodeIdx node) {
@@ -289,15 +492,15 @@ UIElement* _parse_def(MMLObject* mml, NodeIdx node, int i_parent) {
 			list_push_back(&new->child_list, &child->list); 
 		}
 		else {
-			// Eval a function
-			UIElement* parent = 
-				i_parent >= 0 ? darray_get(&ui_elements, i_parent) : NULL;
+			// Compile and eval a function
 			if(_is_vec2_fun(mml, element)) {
-				new->vec2 = _vec2_fun(mml, element, new, parent);
+				_compile_expr(mml, element, i, i_parent, UI_EL_VEC2);
+				new = darray_get(&ui_elements, i);
 				new->members |= UI_EL_VEC2;
 			}
 			else if(_is_rect_fun(mml, element)) {
-				new->rect = _rect_fun(mml, element, new, parent);
+				_compile_expr(mml, element, i, i_parent, UI_EL_RECT);
+				new = darray_get(&ui_elements, i);
 				new->members |= UI_EL_RECT;
 			}
 			else if(_is_spr_fun(mml, element)) {
@@ -326,11 +529,15 @@ static void _init(void) {
 	ui_elements = darray_create(sizeof(UIElement), 0);
 	name_strings = darray_create(sizeof(char), 0);
 	dict_init(&ui_dict);
+
+	ui_code = darray_create(sizeof(UIOp), 0);
+	ui_consts = darray_create(sizeof(RectF), 0);
+	ui_deps = darray_create(sizeof(uint), 0);
+	ui_exprs = darray_create(sizeof(UIExpr), 0);
 }
 
 void uidesc_init(const char* desc, Vector2 screen) {
 	assert(desc);
-	const char* mml_text = txtfile_read(desc);	
 
 	_init();
 
@@ -341,9 +548,8 @@ void uidesc_init(const char* desc, Vector2 screen) {
 	scr_el->members |= UI_EL_RECT;
 
 	MMLObject mml;
-	if(!mml_deserialize(&mml, mml_text))
+	if(!mml_load(&mml, desc))
 		LOG_ERROR("Unable to parse uidesc %s", desc);
-	MEM_FREE(mml_text);
 
 	_uidesc_load(&mml);
 
@@ -372,6 +578,10 @@ void uidesc_init_str(const char* mmldesc, Vector2 screen) {
 }
 
 void uidesc_close(void) {
+	darray_free(&ui_exprs);
+	darray_free(&ui_deps);
+	darray_free(&ui_consts);
+	darray_free(&ui_code);
 	dict_free(&ui_dict);
 	darray_free(&name_strings);
 	darray_free(&ui_elements);
@@ -398,3 +608,61 @@ UIElement* uidesc_get_child(UIElement* parent, const char* name) {
 	return NULL;
 }
 
+
+// Replays expressions in load order, re-evaluating only those which
+// read a changed element. Returns number of evaluated expressions.
+static uint _relayout(uint changed_el) {
+	byte* changed = MEM_ALLOC(ui_elements.size);
+	memset(changed, 0, ui_elements.size);
+	changed[changed_el] = 1;
+
+	uint n = 0;
+	const uint* deps = DARRAY_DATA_PTR(ui_deps, uint);
+	UIExpr* exprs = DARRAY_DATA_PTR(ui_exprs, UIExpr);
+	for(uint i = 0; i < ui_exprs.size; ++i) {
+		UIExpr* expr = &exprs[i];
+		if(expr->superseded)
+			continue;
+
+		bool dirty = false;
+		for(uint j = 0; j < expr->deps_len && !dirty; ++j)
+			dirty = changed[deps[expr->deps_start + j]];
+
+		if(dirty) {
+			n++;
+			if(_apply(expr))
+				changed[expr->el] = 1;
+		}
+	}
+
+	MEM_FREE(changed);
+	return n;
+}
+
+uint uidesc_set_screen(Vector2 screen) {
+	// Screen is always the first element
+	UIElement* scr_el = darray_get(&ui_elements, 0);
+	return uidesc_set_rect(scr_el, rectf(0.0f, 0.0f, screen.x, screen.y));
+}
+
+uint uidesc_set_rect(UIElement* el, RectF rect) {
+	assert(el);
+	
+	el->members |= UI_EL_RECT;
+	if(memcmp(&el->rect, &rect, sizeof(RectF)) == 0)
+		return 0;
+
+	el->rect = rect;
+	return _relayout(el - (UIElement*)ui_elements.data);
+}
+
+uint uidesc_set_vec2(UIElement* el, Vector2 vec2) {
+	assert(el);
+
+	el->members |= UI_EL_VEC2;
+	if(el->vec2.x == vec2.x && el->vec2.y == vec2.y)
+		return 0;
+
+	el->vec2 = vec2;
+	return _relayout(el - (UIElement*)ui_elements.data);
+}
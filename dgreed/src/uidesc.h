@@ -108,4 +108,13 @@ UIElement* uidesc_get(const char* name);
 // Returns children of UIElement, NULL if not found.
 UIElement* uidesc_get_child(UIElement* parent, const char* name);
 
+// Expressions are compiled on load and remember which elements they
+// read. These change screen size or a value of element and re-evaluate
+// only expressions which depend on it, directly or through other 
+// elements. Returns number of re-evaluated expressions.
+// Value set by hand stays until element's own expression is re-evaluated.
+uint uidesc_set_screen(Vector2 screen);
+uint uidesc_set_rect(UIElement* el, RectF rect);
+uint uidesc_set_vec2(UIElement* el, Vector2 vec2);
+
 #endif
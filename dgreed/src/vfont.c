@@ -1,4 +1,5 @@
 #include "vfont.h"
+#include "async.h"
 #include "darray.h"
 #include "datastruct.h"
 #include "memory.h"
@@ -25,6 +26,341 @@ extern void _vfont_render_text(const char* string, CachePage* page, RectF* dest)
 
 extern DArray vfont_fonts;
 
+#ifndef NO_DEVMODE
+static VFontStats v_stats;
+
+const VFontStats* vfont_stats(void) {
+	return &v_stats;
+}
+#endif
+
+#ifdef VFONT_GLYPH_CACHE
+
+// Glyph cache renderer interface
+extern uint _vfont_layout(const char* string, GlyphPos* out);
+extern int _vfont_baseline(void);
+extern void _vfont_glyph_box(int glyph, float x_shift, 
+	int* x0, int* y0, int* x1, int* y1);
+extern void _vfont_render_glyph(int glyph, float x_shift, byte* dest, 
+	uint w, uint h);
+
+// Each glyph is rasterized at this many horizontal subpixel offsets
+#define GLYPH_PHASES 4
+#define GLYPH_PADDING 1
+#define MAX_GLYPH_PAGES 4
+#define NO_PAGE (~0)
+
+// Skyline packer segment - top edge of used space
+typedef struct {
+	uint x, y, w;
+} SkylineNode;
+
+// Evicting a page bumps its epoch, glyphs placed in earlier 
+// epochs are stale and get rasterized again when needed
+typedef struct {
+	TexHandle tex;
+	uint width, height;
+	DArray skyline;
+	uint epoch;
+	float last_used;
+} GlyphPage;
+
+typedef struct {
+	RectF src;
+	int x0, y0;
+	uint page, epoch;
+} CachedGlyph;
+
+static bool glyph_mode = false;
+static DArray glyph_pages;
+static AATree glyph_cache;
+static MemPool cached_glyph_pool;
+
+// Returns y at which w by h rect fits on skyline starting at node i,
+// or -1 if it does not fit
+static int _skyline_fit(GlyphPage* page, uint i, uint w, uint h) {
+	SkylineNode* nodes = DARRAY_DATA_PTR(page->skyline, SkylineNode);
+	if(nodes[i].x + w > page->width)
+		return -1;
+
+	int y = 0;
+	int left = w;
+	while(left > 0) {
+		assert(i < page->skyline.size);
+		y = MAX(y, nodes[i].y);
+		if(y + h > page->height)
+			return -1;
+		left -= nodes[i++].w;
+	}
+	return y;
+}
+
+// Bottom-left skyline packing, chooses position with lowest resulting top
+static bool _skyline_alloc(GlyphPage* page, uint w, uint h, uint* x, uint* y) {
+	SkylineNode* nodes = DARRAY_DATA_PTR(page->skyline, SkylineNode);
+	int best = -1;
+	uint best_y = 0, best_w = 0;
+	for(uint i = 0; i < page->skyline.size; ++i) {
+		int fy = _skyline_fit(page, i, w, h);
+		if(fy < 0)
+			continue;
+		if(best < 0 || fy + h < best_y + h
+			|| (fy == best_y && nodes[i].w < best_w)) {
+			best = i;
+			best_y = fy;
+			best_w = nodes[i].w;
+		}
+	}
+
+	if(best < 0)
+		return false;
+
+	*x = nodes[best].x;
+	*y = best_y;
+
+	SkylineNode new = {.x = *x, .y = best_y + h, .w = w};
+	darray_insert(&page->skyline, best, &new);
+	nodes = DARRAY_DATA_PTR(page->skyline, SkylineNode);
+
+	// Cut away segments now covered by the new one
+	for(uint i = best + 1; i < page->skyline.size;) {
+		uint prev_end = nodes[i-1].x + nodes[i-1].w;
+		if(nodes[i].x >= prev_end)
+			break;
+		uint shrink = prev_end - nodes[i].x;
+		if(nodes[i].w > shrink) {
+			nodes[i].x += shrink;
+			nodes[i].w -= shrink;
+			break;
+		}
+		darray_remove(&page->skyline, i);
+	}
+
+	// Merge neighbour segments of the same height
+	for(uint i = 0; i + 1 < page->skyline.size;) {
+		if(nodes[i].y == nodes[i+1].y) {
+			nodes[i].w += nodes[i+1].w;
+			darray_remove(&page->skyline, i+1);
+		}
+		else {
+			i++;
+		}
+	}
+
+	return true;
+}
+
+static void _reset_glyph_page(GlyphPage* page) {
+	SkylineNode all = {.x = 0, .y = 0, .w = page->width};
+	page->skyline.size = 0;
+	darray_append(&page->skyline, &all);
+	page->epoch++;
+}
+
+static uint _alloc_glyph_page(uint w, uint h) {
+	uint pw = next_pow2(MAX(default_page_width * resolution_factor, w));
+	uint ph = next_pow2(MAX(default_page_height * resolution_factor, h));
+
+	GlyphPage new = {
+		.tex = tex_create(pw, ph),
+		.width = pw,
+		.height = ph,
+		.skyline = darray_create(sizeof(SkylineNode), 0),
+		.epoch = 0,
+		.last_used = 0.0f
+	};
+	_reset_glyph_page(&new);
+	darray_append(&glyph_pages, &new);
+
+	#ifndef NO_DEVMODE
+	v_stats.glyph_pages = glyph_pages.size;
+	#endif
+
+	LOG_INFO("Allocated %dx%d vfont glyph page.", pw, ph);
+
+	return glyph_pages.size - 1;
+}
+
+static void _evict_glyph_page(GlyphPage* page) {
+	_reset_glyph_page(page);
+
+	#ifndef NO_DEVMODE
+	v_stats.page_evictions++;
+	#endif
+}
+
+// Finds space for a glyph, evicting least recently used page if
+// all are full. Pages used this frame are never evicted.
+static uint _place_glyph(uint w, uint h, uint* x, uint* y) {
+	for(uint i = 0; i < glyph_pages.size; ++i) {
+		GlyphPage* page = darray_get(&glyph_pages, i);
+		if(_skyline_alloc(page, w, h, x, y))
+			return i;
+	}
+
+	uint idx = NO_PAGE;
+	if(glyph_pages.size >= MAX_GLYPH_PAGES) {
+		float now = time_ms();
+		GlyphPage* pages = DARRAY_DATA_PTR(glyph_pages, GlyphPage);
+		for(uint i = 0; i < glyph_pages.size; ++i) {
+			if(pages[i].last_used >= now || pages[i].width < w 
+				|| pages[i].height < h)
+				continue;
+			if(idx == NO_PAGE || pages[i].last_used < pages[idx].last_used)
+				idx = i;
+		}
+	}
+
+	if(idx != NO_PAGE)
+		_evict_glyph_page(darray_get(&glyph_pages, idx));
+	else
+		idx = _alloc_glyph_page(w, h);
+
+	if(!_skyline_alloc(darray_get(&glyph_pages, idx), w, h, x, y))
+		LOG_ERROR("Unable to fit glyph into vfont glyph page");
+	return idx;
+}
+
+static void _rasterize_glyph(CachedGlyph* cached, int glyph, 
+	float x_shift, uint w, uint h) {
+	uint pw = w + GLYPH_PADDING * 2;
+	uint ph = h + GLYPH_PADDING * 2;
+	uint x, y;
+	cached->page = _place_glyph(pw, ph, &x, &y);
+	GlyphPage* page = darray_get(&glyph_pages, cached->page);
+
+	byte* temp = MEM_ALLOC(w * h);
+	_vfont_render_glyph(glyph, x_shift, temp, w, h);
+
+	// Padding is blitted too, to clear leftovers of evicted glyphs
+	Color* pix = MEM_ALLOC(sizeof(Color) * pw * ph);
+	memset(pix, 0, sizeof(Color) * pw * ph);
+	for(uint gy = 0; gy < h; ++gy) {
+		for(uint gx = 0; gx < w; ++gx) {
+			byte c = temp[gy * w + gx];
+			Color* p = &pix[(gy + GLYPH_PADDING) * pw + gx + GLYPH_PADDING];
+		#if defined(TARGET_IOS) || defined(ANDROID)
+			// Premultiply alpha
+			*p = COLOR_RGBA(c, c, c, c);
+		#else
+			// Don't premultiply alpha
+			*p = COLOR_RGBA(255, 255, 255, c);
+		#endif
+		}
+	}
+	MEM_FREE(temp);
+
+	tex_blit(page->tex, pix, x, y, pw, ph);
+	MEM_FREE(pix);
+
+	cached->src = rectf(
+		x + GLYPH_PADDING, y + GLYPH_PADDING, 
+		x + GLYPH_PADDING + w, y + GLYPH_PADDING + h
+	);
+	cached->epoch = page->epoch;
+}
+
+static bool _is_glyph_valid(const CachedGlyph* cached) {
+	if(cached->page == NO_PAGE)
+		return true;
+	GlyphPage* page = darray_get(&glyph_pages, cached->page);
+	return page->epoch == cached->epoch;
+}
+
+static const CachedGlyph* _get_glyph(int glyph, float x) {
+	uint phase = (uint)((x - floorf(x)) * GLYPH_PHASES) % GLYPH_PHASES;
+	assert(vfont_selected_font < (1 << 13));
+	assert(glyph >= 0 && glyph < (1 << 16));
+	int key = (vfont_selected_font << 18) | (phase << 16) | glyph;
+
+	CachedGlyph* cached = aatree_find(&glyph_cache, key);
+	if(!cached || !_is_glyph_valid(cached)) {
+		#ifndef NO_DEVMODE
+		v_stats.glyph_misses++;
+		#endif
+
+		float x_shift = (float)phase / (float)GLYPH_PHASES;
+		int x0, y0, x1, y1;
+		_vfont_glyph_box(glyph, x_shift, &x0, &y0, &x1, &y1);
+
+		// Entries are reused instead of removed when their page is evicted
+		if(!cached) {
+			cached = mempool_alloc(&cached_glyph_pool);
+			aatree_insert(&glyph_cache, key, cached);
+		}
+		cached->src = rectf_null();
+		cached->x0 = x0;
+		cached->y0 = y0;
+		cached->page = NO_PAGE;
+
+		// Whitespace has nothing to rasterize
+		if(x1 > x0 && y1 > y0)
+			_rasterize_glyph(cached, glyph, x_shift, x1 - x0, y1 - y0);
+	}
+	#ifndef NO_DEVMODE
+	else {
+		v_stats.glyph_hits++;
+	}
+	#endif
+
+	if(cached->page != NO_PAGE) {
+		GlyphPage* page = darray_get(&glyph_pages, cached->page);
+		page->last_used = time_ms();
+	}
+
+	return cached;
+}
+
+static void _draw_glyphs(const char* string, uint layer, Vector2 origin,
+	Color tint, float scale) {
+	GlyphPos* glyphs = alloca(strlen(string) * sizeof(GlyphPos));
+	uint n = _vfont_layout(string, glyphs);
+	int baseline = _vfont_baseline();
+	float s = scale / resolution_factor;
+
+	for(uint i = 0; i < n; ++i) {
+		const CachedGlyph* g = _get_glyph(glyphs[i].glyph, glyphs[i].x);
+		if(g->page == NO_PAGE)
+			continue;
+
+		GlyphPage* page = darray_get(&glyph_pages, g->page);
+		RectF dest = {
+			.left = origin.x + (floorf(glyphs[i].x) + g->x0) * s,
+			.top = origin.y + (baseline + g->y0) * s
+		};
+		dest.right = dest.left + rectf_width(&g->src) * s;
+		dest.bottom = dest.top + rectf_height(&g->src) * s;
+		video_draw_rect(page->tex, layer, &g->src, &dest, tint);
+	}
+}
+
+static void _precache_glyphs(const char* string) {
+	GlyphPos* glyphs = alloca(strlen(string) * sizeof(GlyphPos));
+	uint n = _vfont_layout(string, glyphs);
+	for(uint i = 0; i < n; ++i)
+		_get_glyph(glyphs[i].glyph, glyphs[i].x);
+}
+
+static void _invalidate_glyphs(void) {
+	aatree_clear(&glyph_cache);
+	mempool_free_all(&cached_glyph_pool);
+	for(uint i = 0; i < glyph_pages.size; ++i) {
+		GlyphPage* page = darray_get(&glyph_pages, i);
+		_reset_glyph_page(page);
+	}
+}
+
+#endif
+
+void vfont_glyph_cache(bool enable) {
+#ifdef VFONT_GLYPH_CACHE
+	glyph_mode = enable;
+#else
+	if(enable)
+		LOG_WARNING("vfont renderer does not support glyph cache");
+#endif
+}
+
 static CachePage* _alloc_page(RectF* r) {
     assert(r->left == 0.0f && r->top == 0.0f);
     
@@ -114,7 +450,82 @@ static CachePage* _alloc_cache(RectF* r) {
     return _alloc_page(r);
 }
 
-static const CachedText* _precache(const char* string, const char* key, bool input) {
+#ifdef VFONT_ASYNC_RASTER
+
+extern Color* _vfont_rasterize_text(Font* font, const char* string, 
+	uint w, uint h);
+
+typedef struct {
+	Font font;
+	char text[VFONT_MAX_KEY];
+	uint w, h;
+	Color* pixels;
+	CachedText* cached; // NULL if text was invalidated meanwhile
+	TaskId task;
+} RasterJob;
+
+static MemPool raster_job_pool;
+static DArray raster_jobs;
+
+static void _raster_task(void* userdata) {
+	RasterJob* job = userdata;
+	job->pixels = _vfont_rasterize_text(&job->font, job->text, job->w, job->h);
+}
+
+static void _start_raster_job(CachedText* text, const char* string) {
+	RasterJob* job = mempool_alloc(&raster_job_pool);
+	job->font = *(Font*)darray_get(&vfont_fonts, vfont_selected_font);
+	strcpy(job->text, string);
+	job->w = (uint)rectf_width(&text->src);
+	job->h = (uint)rectf_height(&text->src);
+	job->pixels = NULL;
+	job->cached = text;
+	darray_append(&raster_jobs, &job);
+
+	job->task = async_run(_raster_task, job);
+}
+
+// Blits rasterized texts to cache pages, must be called from main thread
+static void _finish_raster_jobs(bool wait) {
+	RasterJob** jobs = DARRAY_DATA_PTR(raster_jobs, RasterJob*);
+	for(uint i = 0; i < raster_jobs.size;) {
+		RasterJob* job = jobs[i];
+		if(!async_is_finished(job->task)) {
+			if(!wait) {
+				i++;
+				continue;
+			}
+			async_wait(job->task);
+		}
+
+		CachedText* text = job->cached;
+		if(text) {
+			tex_blit(text->tex, job->pixels, 
+				(uint)text->src.left, (uint)text->src.top, job->w, job->h);
+			text->ready = true;
+		}
+
+		free(job->pixels);
+		mempool_free(&raster_job_pool, job);
+		darray_remove_fast(&raster_jobs, i);
+	}
+}
+
+static void _cancel_raster_job(CachedText* text) {
+	RasterJob** jobs = DARRAY_DATA_PTR(raster_jobs, RasterJob*);
+	for(uint i = 0; i < raster_jobs.size; ++i) {
+		if(jobs[i]->cached == text || !text)
+			jobs[i]->cached = NULL;
+	}
+}
+
+#endif
+
+static const CachedText* _precache(const char* string, const char* key, 
+	bool input, bool async) {
+	if(strlen(key) >= VFONT_MAX_KEY)
+		LOG_ERROR("Text is too long for vfont cache: %s", string);
+
     RectF bbox = _vfont_bbox(string);
     float w = rectf_width(&bbox);
     float h = rectf_height(&bbox);
@@ -177,9 +588,6 @@ static const CachedText* _precache(const char* string, const char* key, bool inp
     
     assert(page);
     
-    // Rasterize
-    _vfont_render_text(string, page, &bbox);
-    
     // Fill text cache entry
     Font* font = darray_get(&vfont_fonts, vfont_selected_font);
 
@@ -190,8 +598,18 @@ static const CachedText* _precache(const char* string, const char* key, bool inp
 	hnew->tex = page->tex;
 	hnew->src = bbox;
 	hnew->page = page; 
+	hnew->ready = true;
+
+	// Rasterize
+#ifdef VFONT_ASYNC_RASTER
+	if(async) {
+		hnew->ready = false;
+		_start_raster_job(hnew, string);
+	}
+	else
+#endif
+    _vfont_render_text(string, page, &bbox);
 
-	assert(strlen(key) < 128);
 	char* pkey = mempool_alloc(&key_str_pool);
 	strcpy(pkey, key);
 	dict_set(&cache, pkey, hnew); 
@@ -200,6 +618,11 @@ static const CachedText* _precache(const char* string, const char* key, bool inp
 }
 
 static const CachedText* _get_text(const char* string, bool input) {
+#ifdef VFONT_ASYNC_RASTER
+	if(raster_jobs.size)
+		_finish_raster_jobs(false);
+#endif
+
     // Construct cache key
 	_key(string);
     
@@ -209,7 +632,7 @@ static const CachedText* _get_text(const char* string, bool input) {
         return text;
         
     // Text was not in cache, rasterize
-    return _precache(string, key, input);
+    return _precache(string, key, input, false);
 }
 
 void vfont_init(void) {
@@ -225,12 +648,35 @@ void vfont_init_ex(uint cache_w, uint cache_h) {
 	free_rects = darray_create(sizeof(FreeRect), 0);
 
 	mempool_init_ex(&cached_text_pool, sizeof(CachedText), 8*1024);
-	mempool_init_ex(&key_str_pool, 128, 4*1024);
+	mempool_init_ex(&key_str_pool, VFONT_MAX_KEY, 4*1024);
+
+#ifdef VFONT_ASYNC_RASTER
+	mempool_init_ex(&raster_job_pool, sizeof(RasterJob), 4*1024);
+	raster_jobs = darray_create(sizeof(RasterJob*), 0);
+#endif
+
+#ifdef VFONT_GLYPH_CACHE
+	glyph_pages = darray_create(sizeof(GlyphPage), 0);
+	aatree_init(&glyph_cache);
+	mempool_init_ex(&cached_glyph_pool, sizeof(CachedGlyph), 8*1024);
+#endif
+
+#ifndef NO_DEVMODE
+	memset(&v_stats, 0, sizeof(v_stats));
+#endif
 
 	_vfont_init();
 }
 
 void vfont_close(void) {
+#ifdef VFONT_ASYNC_RASTER
+	// Fonts must outlive rasterization in progress
+	_cancel_raster_job(NULL);
+	_finish_raster_jobs(true);
+	darray_free(&raster_jobs);
+	mempool_drain(&raster_job_pool);
+#endif
+
 	_vfont_close();
 
 	darray_free(&free_rects);
@@ -246,6 +692,17 @@ void vfont_close(void) {
 
 	mempool_drain(&key_str_pool);
 	mempool_drain(&cached_text_pool);
+
+#ifdef VFONT_GLYPH_CACHE
+	for(uint i = 0; i < glyph_pages.size; ++i) {
+		GlyphPage* page = darray_get(&glyph_pages, i);
+		tex_free(page->tex);
+		darray_free(&page->skyline);
+	}
+	darray_free(&glyph_pages);
+	aatree_free(&glyph_cache);
+	mempool_drain(&cached_glyph_pool);
+#endif
 }
 
 void vfont_resolution_factor(float factor) {
@@ -257,8 +714,18 @@ void vfont_draw(const char* string, uint layer, Vector2 topleft, Color tint) {
     
     if(strcmp(string, "") == 0)
         return;
+
+#ifdef VFONT_GLYPH_CACHE
+	if(glyph_mode) {
+		Vector2 origin = vec2(floorf(topleft.x), floorf(topleft.y));
+		_draw_glyphs(string, layer, origin, tint, 1.0f);
+		return;
+	}
+#endif
     
     const CachedText* text = _get_text(string, false);
+    if(!text->ready)
+        return;
     RectF dest = rectf(floorf(topleft.x), floorf(topleft.y), 0.0f, 0.0f);
     dest.right = dest.left + rectf_width(&text->src) / resolution_factor;
     dest.bottom = dest.top + rectf_height(&text->src) / resolution_factor;
@@ -271,8 +738,19 @@ void vfont_draw_ex(const char* string, uint layer, Vector2 topleft, Color tint,
     
     if(strcmp(string, "") == 0)
         return;
+
+#ifdef VFONT_GLYPH_CACHE
+	if(glyph_mode) {
+		Vector2 original = vfont_size(string);
+		Vector2 offset = vec2_scale(original, (1.0f - scale) * 0.5f);
+		_draw_glyphs(string, layer, vec2_add(topleft, offset), tint, scale);
+		return;
+	}
+#endif
     
     const CachedText* text = _get_text(string, false);
+    if(!text->ready)
+        return;
 
     Vector2 original = vec2(rectf_width(&text->src),rectf_height(&text->src));
     original = vec2_scale(original, 1.0f / resolution_factor);
@@ -297,6 +775,14 @@ void vfont_draw_input(const char* string, uint layer, Vector2 topleft, Color tin
     
     if(strcmp(string, "") == 0)
         return;
+
+#ifdef VFONT_GLYPH_CACHE
+	// Glyphs of input text are cached like any other
+	if(glyph_mode) {
+		vfont_draw(string, layer, topleft, tint);
+		return;
+	}
+#endif
     
     static char prev_string[256] = "";
     if(strcmp(string, prev_string) == 0) {
@@ -342,14 +828,58 @@ void vfont_draw_number_ex(
 void vfont_precache(const char* string) {
     if(strcmp(string, "") == 0)
         return;
+#ifdef VFONT_GLYPH_CACHE
+	if(glyph_mode) {
+		_precache_glyphs(string);
+		return;
+	}
+#endif
     _get_text(string, false);
 }
 
+#ifdef VFONT_ASYNC_RASTER
+static void _precache_async(const char* string) {
+	_key(string);
+	if(!dict_get(&cache, key))
+		_precache(string, key, false, true);
+}
+#endif
+
+void vfont_precache_async(const char** strings, uint count) {
+	assert(strings);
+
+	for(uint i = 0; i < count; ++i) {
+		const char* string = strings[i];
+		if(strcmp(string, "") == 0)
+			continue;
+
+#if defined(VFONT_ASYNC_RASTER) && defined(VFONT_GLYPH_CACHE)
+		// Glyphs are cheap to rasterize one by one
+		if(glyph_mode) {
+			_precache_glyphs(string);
+			continue;
+		}
+#endif
+
+#ifdef VFONT_ASYNC_RASTER
+		_precache_async(string);
+#else
+		vfont_precache(string);
+#endif
+	}
+}
+
 void vfont_cache_invalidate(const char* string) {
     vfont_cache_invalidate_ex(string, true);
 }
 
 void vfont_cache_invalidate_ex(const char* string, bool strict) {
+#ifdef VFONT_GLYPH_CACHE
+	// Glyph pages are recycled on their own
+	if(glyph_mode)
+		return;
+#endif
+
 	_key(string);
     
     if(strcmp(string, "") == 0)
@@ -367,6 +897,11 @@ void vfont_cache_invalidate_ex(const char* string, bool strict) {
     CachedText* text = (CachedText*)text_entry->data;
 	assert(text);
 
+#ifdef VFONT_ASYNC_RASTER
+	if(!text->ready)
+		_cancel_raster_job(text);
+#endif
+
 	// Mark new free rect
 	FreeRect new = {
 		.page = text->page,
@@ -385,6 +920,10 @@ void vfont_cache_invalidate_ex(const char* string, bool strict) {
 }
 
 void vfont_invalidate_all(void) {
+#ifdef VFONT_ASYNC_RASTER
+	_cancel_raster_job(NULL);
+#endif
+
     free_rects.size = 0;
 
     dict_free(&cache);
@@ -397,6 +936,10 @@ void vfont_invalidate_all(void) {
         CachePage* page = darray_get(&cache_pages, i);
         page->occupied = rectf_null();
     }
+
+#ifdef VFONT_GLYPH_CACHE
+	_invalidate_glyphs();
+#endif
 }
 
 Vector2 vfont_size(const char* string) {
@@ -432,5 +975,14 @@ void vfont_draw_cache(uint layer, Vector2 topleft) {
 		video_draw_rect(page->tex, layer, NULL, &dest, COLOR_WHITE);
         topleft.y += page->height;
 	}
+
+#ifdef VFONT_GLYPH_CACHE
+    for(uint i = 0; i < glyph_pages.size; ++i) {
+		GlyphPage* page = darray_get(&glyph_pages, i);
+		RectF dest = rectf(topleft.x, topleft.y, 0.0f, 0.0f);
+		video_draw_rect(page->tex, layer, NULL, &dest, COLOR_WHITE);
+        topleft.y += page->height;
+	}
+#endif
 }
 
@@ -42,6 +42,16 @@ typedef struct {
 	stbtt_fontinfo font;
 } Font;
 
+// Renderer can rasterize individual glyphs
+#define VFONT_GLYPH_CACHE
+// Renderer can rasterize text on worker threads
+#define VFONT_ASYNC_RASTER
+
+typedef struct {
+	int glyph;
+	float x;
+} GlyphPos;
+
 #endif
 
 typedef struct {
@@ -50,14 +60,18 @@ typedef struct {
     TexHandle tex;
 } CachePage;
 
+// Cache keys are "text:font:size", text is always shorter than its key
+#define VFONT_MAX_KEY 128
+
 typedef struct {
-    char text[96];
+    char text[VFONT_MAX_KEY];
     const char* font_name;
     float size;
     
     TexHandle tex;
     RectF src;
     CachePage* page;
+    bool ready; // False while text is being rasterized in background
 } CachedText;
 
 typedef struct {
@@ -87,6 +101,9 @@ void vfont_draw_input(const char* string, uint layer, Vector2 topleft, Color tin
 void vfont_draw_number(int number, const char* postfix, uint layer, Vector2 topleft, Color tint);
 void vfont_draw_number_ex(int number, const char* postfix, uint layer, Vector2 topleft, Color tint, float scale);
 void vfont_precache(const char* string);
+// Rasterizes strings on worker threads with the selected font.
+// Until a string is ready, vfont_draw draws nothing for it.
+void vfont_precache_async(const char** strings, uint count);
 void vfont_cache_invalidate(const char* string);
 void vfont_cache_invalidate_ex(const char* string, bool strict);
 void vfont_invalidate_all(void);
@@ -96,4 +113,21 @@ Vector2 vfont_number_size(int number);
 
 void vfont_draw_cache(uint layer, Vector2 topleft);
 
+// Switches to glyph cache mode - every glyph is rasterized once into 
+// shared atlas pages and strings are laid out at draw time. Better for
+// often changing text like scores and timers. Only available with
+// stb_truetype renderer.
+void vfont_glyph_cache(bool enable);
+
+#ifndef NO_DEVMODE
+typedef struct {
+	uint glyph_hits;
+	uint glyph_misses;
+	uint glyph_pages;
+	uint page_evictions;
+} VFontStats;
+
+const VFontStats* vfont_stats(void);
+#endif
+
 #endif
@@ -10,8 +10,10 @@
 #define STBTT_iceil(x) ((int) ceilf(x))
 #define STBTT_sort(data,num_items,item_size,compare_func) \
 	sort_heapsort(data,num_items,item_size,compare_func)
-#define STBTT_malloc(x,u) MEM_ALLOC(x)
-#define STBTT_free(x,u) MEM_FREE(x)
+// Text can be rasterized on worker threads, where tracked
+// allocator can't be used
+#define STBTT_malloc(x,u) malloc(x)
+#define STBTT_free(x,u) free(x)
 #include "stb_truetype.h"
 
 DArray vfont_fonts;
@@ -69,24 +71,18 @@ RectF _vfont_bbox(const char* string) {
 	);
 }
 
-void _vfont_render_text(const char* string, CachePage* page, RectF* dest) {
-    Font* font = darray_get(&vfont_fonts, vfont_selected_font);
-
-    uint x = (uint)dest->left;
-    uint y = (uint)dest->top;
-    uint w = (uint)rectf_width(dest);
-    uint h = (uint)rectf_height(dest);
-
+// Thread safe, result must be freed with free()
+Color* _vfont_rasterize_text(Font* font, const char* string, uint w, uint h) {
  	float xpos = 0.0f;
 
 	int ascent, descent, line_gap, baseline;
 	stbtt_GetFontVMetrics(&font->font, &ascent, &descent, &line_gap);
 	baseline = (int) (ascent * font->scale);
 	
-    Color *pix = MEM_ALLOC(sizeof(Color) * w * h);
+    Color *pix = malloc(sizeof(Color) * w * h);
 	memset(pix, 0, w * h * sizeof(Color));
 
-	byte* temp = MEM_ALLOC(h * h * 2);
+	byte* temp = malloc(h * h * 2);
 
 	int i = 0;
     int n = strlen(string);
@@ -142,10 +138,85 @@ void _vfont_render_text(const char* string, CachePage* page, RectF* dest) {
 
 		xpos += ((advance + kerning) * font->scale);
 	}
-	MEM_FREE(temp);
-  
+	free(temp);
+
+	return pix;
+}
+
+void _vfont_render_text(const char* string, CachePage* page, RectF* dest) {
+    Font* font = darray_get(&vfont_fonts, vfont_selected_font);
+
+    uint x = (uint)dest->left;
+    uint y = (uint)dest->top;
+    uint w = (uint)rectf_width(dest);
+    uint h = (uint)rectf_height(dest);
+
+	Color* pix = _vfont_rasterize_text(font, string, w, h);
     tex_blit(page->tex, pix, x, y, w, h);
-    MEM_FREE(pix);
+    free(pix);
+}
+
+uint _vfont_layout(const char* string, GlyphPos* out) {
+    Font* font = darray_get(&vfont_fonts, vfont_selected_font);
+
+	float xpos = 0.0f;
+	uint count = 0;
+
+	int i = 0;
+    int n = strlen(string);
+	uint codepoint = 0;
+	int glyph;
+	while(i < n) {
+		int advance, lsb, next_glyph;
+		uint next_codepoint;
+		i += chartorune(&next_codepoint, string + i);
+		next_glyph = stbtt_FindGlyphIndex(&font->font, next_codepoint);
+
+		if(codepoint && next_codepoint)
+			xpos += font->scale * stbtt_GetGlyphKernAdvance(
+				&font->font, glyph, next_glyph
+			);
+
+		codepoint = next_codepoint;
+		glyph = next_glyph;
+
+		out[count].glyph = glyph;
+		out[count].x = xpos;
+		count++;
+
+		stbtt_GetGlyphHMetrics(&font->font, glyph, &advance, &lsb);
+		xpos += (advance * font->scale);
+	}
+
+	return count;
+}
+
+int _vfont_baseline(void) {
+    Font* font = darray_get(&vfont_fonts, vfont_selected_font);
+
+	int ascent, descent, line_gap;
+	stbtt_GetFontVMetrics(&font->font, &ascent, &descent, &line_gap);
+	return (int) (ascent * font->scale);
+}
+
+void _vfont_glyph_box(int glyph, float x_shift, 
+	int* x0, int* y0, int* x1, int* y1) {
+    Font* font = darray_get(&vfont_fonts, vfont_selected_font);
+
+	stbtt_GetGlyphBitmapBoxSubpixel(
+		&font->font, glyph, font->scale, font->scale, x_shift, 0, 
+		x0, y0, x1, y1
+	);
+}
+
+void _vfont_render_glyph(int glyph, float x_shift, byte* dest, 
+	uint w, uint h) {
+    Font* font = darray_get(&vfont_fonts, vfont_selected_font);
+
+	stbtt_MakeGlyphBitmapSubpixel(
+		&font->font, dest, w, h, w, font->scale, font->scale,
+		x_shift, 0.0f, glyph
+	);
 }
 
 void vfont_select(const char* font_name, float size) {
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <utils.h>
+#include <memory.h>
+#include <image.h>
+#include <mml.h>
+#include <darray.h>
+#include <datastruct.h>
+#include <maxrects.h>
+
+// Packs all img and anim sprites of a sprsheet into as few pow2 dig
+// atlases as possible and writes a new sprsheet description using them.
+//
+// Usage: mkatlas in.mml out.mml [max atlas size]
+// Atlases are named after out.mml and written into sprsheet prefix dir.
+
+// Transparent border around each sprite, filled with its edge pixels
+#define PADDING 1
+
+typedef struct {
+	Color* pixels;
+	uint w, h;
+} Image;
+
+typedef struct {
+	const char* name;
+	bool anim;
+	Image* img;
+
+	// Region of source texture which is copied to atlas
+	uint src_x, src_y, src_w, src_h;
+
+	// Img
+	bool has_cntr;
+	Vector2 cntr;
+
+	// Anim
+	uint frames, frame_w, frame_h;
+	uint grid_w, grid_h;
+
+	// Placement
+	uint page, x, y;
+} Item;
+
+typedef struct {
+	uint w, h;
+	DArray items;
+} Page;
+
+MMLObject desc;
+char prefix[128] = "";
+Dict images;
+DArray image_list;
+DArray items;
+DArray pages;
+
+static Image* _get_image(const char* tex_name) {
+	Image* img = (Image*)dict_get(&images, tex_name);
+	if(img)
+		return img;
+
+	char path[256];
+	assert(strlen(prefix) + strlen(tex_name) < 256);
+	strcpy(path, prefix);
+	strcat(path, tex_name);
+
+	img = MEM_ALLOC(sizeof(Image));
+	PixelFormat format;
+	img->pixels = image_load(path, &img->w, &img->h, &format);
+	if((format & PF_MASK_PIXEL_FORMAT) != PF_RGBA8888)
+		LOG_ERROR("Texture %s is not RGBA8888", path);
+
+	dict_insert(&images, tex_name, img);
+	darray_append(&image_list, &img);
+	return img;
+}
+
+static void _parse_item(NodeIdx node, bool anim) {
+	Item item = {
+		.name = mml_getval_str(&desc, node),
+		.anim = anim,
+		.has_cntr = false,
+		.frames = 1
+	};
+
+	const char* tex_name = NULL;
+	RectF src = rectf_null();
+	Vector2 offset = {0.0f, 0.0f};
+
+	NodeIdx child = mml_get_first_child(&desc, node);
+	for(; child != 0; child = mml_get_next(&desc, child)) {
+		const char* name = mml_get_name(&desc, child);
+
+		if(strcmp("tex", name) == 0)
+			tex_name = mml_getval_str(&desc, child);
+		if(strcmp("src", name) == 0)
+			src = mml_getval_rectf(&desc, child);
+		if(strcmp("cntr", name) == 0) {
+			item.cntr = mml_getval_vec2(&desc, child);
+			item.has_cntr = true;
+		}
+		if(strcmp("frames", name) == 0)
+			item.frames = mml_getval_uint(&desc, child);
+		if(strcmp("offset", name) == 0)
+			offset = mml_getval_vec2(&desc, child);
+		if(strcmp("grid", name) == 0) {
+			Vector2 grid = mml_getval_vec2(&desc, child);
+			item.grid_w = lrintf(grid.x);
+			item.grid_h = lrintf(grid.y);
+		}
+	}
+
+	if(!tex_name)
+		LOG_ERROR("No 'tex' field in sprite %s", item.name);
+
+	item.img = _get_image(tex_name);
+
+	// Empty src means whole texture
+	if(rectf_width(&src) == 0.0f || rectf_height(&src) == 0.0f)
+		src = rectf(0.0f, 0.0f, (float)item.img->w, (float)item.img->h);
+
+	item.src_x = lrintf(src.left);
+	item.src_y = lrintf(src.top);
+	item.src_w = lrintf(rectf_width(&src));
+	item.src_h = lrintf(rectf_height(&src));
+
+	if(anim) {
+		// Copy whole frame grid, work out grid size the way
+		// sprsheet does if it is not specified
+		item.frame_w = item.src_w;
+		item.frame_h = item.src_h;
+		if(item.grid_w * item.grid_h == 0) {
+			if(offset.x == 0.0f)
+				LOG_ERROR("No 'offset' field in anim %s", item.name);
+			item.grid_w = (uint)((item.img->w - src.left) / offset.x);
+			item.grid_w = MIN(item.grid_w, item.frames);
+			item.grid_h = (item.frames + item.grid_w - 1) / item.grid_w;
+		}
+		item.src_w = MIN(item.grid_w * item.frame_w, item.img->w - item.src_x);
+		item.src_h = MIN(item.grid_h * item.frame_h, item.img->h - item.src_y);
+	}
+
+	if(item.src_x + item.src_w > item.img->w ||
+		item.src_y + item.src_h > item.img->h)
+		LOG_ERROR("Sprite %s is outside of its texture", item.name);
+
+	darray_append(&items, &item);
+}
+
+static int _cmp_item_area(const void* a, const void* b) {
+	const Item* ia = *(const Item**)a;
+	const Item* ib = *(const Item**)b;
+	return (int)(ib->src_w * ib->src_h) - (int)(ia->src_w * ia->src_h);
+}
+
+// Tries to pack page items into w x h, in the same order greedy pass
+// placed them. Item positions are left untouched on failure.
+static bool _try_page_size(Page* page, uint w, uint h) {
+	uint n = page->items.size;
+	Item** it = DARRAY_DATA_PTR(page->items, Item*);
+	uint* xs = MEM_ALLOC(sizeof(uint) * n * 2);
+	uint* ys = xs + n;
+
+	MaxRects packer;
+	maxrects_init(&packer, w, h);
+	bool res = true;
+	for(uint i = 0; i < n && res; ++i) {
+		res = maxrects_insert(&packer, 
+			it[i]->src_w + PADDING * 2, it[i]->src_h + PADDING * 2,
+			&xs[i], &ys[i]);
+	}
+	maxrects_free(&packer);
+
+	if(res) {
+		page->w = w;
+		page->h = h;
+		for(uint i = 0; i < n; ++i) {
+			it[i]->x = xs[i] + PADDING;
+			it[i]->y = ys[i] + PADDING;
+		}
+	}
+
+	MEM_FREE(xs);
+	return res;
+}
+
+static void _pack(uint max_size) {
+	// Largest sprites first
+	DArray sorted = darray_create(sizeof(Item*), items.size);
+	for(uint i = 0; i < items.size; ++i) {
+		Item* item = darray_get(&items, i);
+		darray_append(&sorted, &item);
+	}
+	qsort(sorted.data, sorted.size, sizeof(Item*), _cmp_item_area);
+
+	// Fill pages one by one
+	Item** it = DARRAY_DATA_PTR(sorted, Item*);
+	uint placed = 0;
+	while(placed < sorted.size) {
+		Page page = {.w = max_size, .h = max_size};
+		page.items = darray_create(sizeof(Item*), 0);
+
+		MaxRects packer;
+		maxrects_init(&packer, max_size, max_size);
+		for(uint i = 0; i < sorted.size; ++i) {
+			if(it[i]->page != ~0)
+				continue;
+
+			uint x, y;
+			uint w = it[i]->src_w + PADDING * 2;
+			uint h = it[i]->src_h + PADDING * 2;
+			if(maxrects_insert(&packer, w, h, &x, &y)) {
+				it[i]->page = pages.size;
+				it[i]->x = x + PADDING;
+				it[i]->y = y + PADDING;
+				darray_append(&page.items, &it[i]);
+				placed++;
+			}
+		}
+		maxrects_free(&packer);
+
+		if(page.items.size == 0) {
+			uint i = 0;
+			while(it[i]->page != ~0)
+				i++;
+			LOG_ERROR("Sprite %s does not fit into %ux%u atlas",
+				it[i]->name, max_size, max_size);
+		}
+
+		// Shrink page to the smallest pow2 size which still fits,
+		// trying sizes from the smallest area up. If nothing smaller
+		// fits, page keeps full size and greedy placement.
+		bool shrunk = false;
+		for(uint area = 1; area < max_size * max_size && !shrunk; area *= 2) {
+			for(uint w = max_size; w > 0 && !shrunk; w /= 2) {
+				uint h = area / w;
+				if(h == 0 || h > max_size || w * h != area)
+					continue;
+				shrunk = _try_page_size(&page, w, h);
+			}
+		}
+
+		darray_append(&pages, &page);
+	}
+
+	darray_free(&sorted);
+}
+
+static void _blit_item(Color* dest, uint dest_w, const Item* item) {
+	const Image* img = item->img;
+	int w = item->src_w, h = item->src_h;
+
+	// Edge pixels are repeated into padding
+	for(int y = -PADDING; y < h + PADDING; ++y) {
+		int sy = item->src_y + MIN(MAX(y, 0), h-1);
+		for(int x = -PADDING; x < w + PADDING; ++x) {
+			int sx = item->src_x + MIN(MAX(x, 0), w-1);
+			dest[IDX_2D(item->x + x, item->y + y, dest_w)] =
+				img->pixels[IDX_2D(sx, sy, img->w)];
+		}
+	}
+}
+
+static void _add_node(MMLObject* mml, NodeIdx parent,
+	const char* name, const char* value) {
+	mml_append(mml, parent, mml_node(mml, name, value));
+}
+
+int dgreed_main(int argc, const char** argv) {
+	params_init(argc, argv);
+	if(params_count() < 2) {
+		printf("Usage: mkatlas in.mml out.mml [max atlas size]\n");
+		return -1;
+	}
+
+	const char* in_path = params_get(0);
+	const char* out_path = params_get(1);
+	uint max_size = 2048;
+	if(params_count() > 2)
+		sscanf(params_get(2), "%u", &max_size);
+	if(!is_pow2(max_size))
+		LOG_ERROR("Max atlas size must be a power of 2");
+
+	char* text = txtfile_read(in_path);
+	if(!mml_deserialize(&desc, text))
+		LOG_ERROR("Unable to parse sprsheet desc %s", in_path);
+	MEM_FREE(text);
+
+	NodeIdx root = mml_root(&desc);
+	if(strcmp(mml_get_name(&desc, root), "sprsheet") != 0)
+		LOG_ERROR("Invalid sprsheet desc %s", in_path);
+
+	NodeIdx prefix_node = mml_get_child(&desc, root, "prefix");
+	if(prefix_node) {
+		assert(strlen(mml_getval_str(&desc, prefix_node)) < 128);
+		strcpy(prefix, mml_getval_str(&desc, prefix_node));
+	}
+
+	dict_init(&images);
+	image_list = darray_create(sizeof(Image*), 0);
+	items = darray_create(sizeof(Item), 0);
+	pages = darray_create(sizeof(Page), 0);
+
+	NodeIdx child = mml_get_first_child(&desc, root);
+	for(; child != 0; child = mml_get_next(&desc, child)) {
+		const char* name = mml_get_name(&desc, child);
+		if(strcmp("img", name) == 0)
+			_parse_item(child, false);
+		if(strcmp("anim", name) == 0)
+			_parse_item(child, true);
+	}
+
+	for(uint i = 0; i < items.size; ++i) {
+		Item* item = darray_get(&items, i);
+		item->page = ~0;
+	}
+
+	_pack(max_size);
+
+	// Write atlases
+	char* base = path_change_ext(path_get_file(out_path), "");
+	char atlas_name[128];
+	char atlas_path[256];
+	for(uint i = 0; i < pages.size; ++i) {
+		Page* page = darray_get(&pages, i);
+		Color* pixels = MEM_ALLOC(sizeof(Color) * page->w * page->h);
+		memset(pixels, 0, sizeof(Color) * page->w * page->h);
+
+		Item** it = DARRAY_DATA_PTR(page->items, Item*);
+		for(uint j = 0; j < page->items.size; ++j)
+			_blit_item(pixels, page->w, it[j]);
+
+		sprintf(atlas_name, "%s_%u.dig", base, i);
+		assert(strlen(prefix) + strlen(atlas_name) < 256);
+		sprintf(atlas_path, "%s%s", prefix, atlas_name);
+		image_write_dig(atlas_path, page->w, page->h, PF_RGBA8888, pixels);
+		printf("%s: %ux%u, %u sprites\n", atlas_path, page->w, page->h,
+			page->items.size);
+
+		MEM_FREE(pixels);
+	}
+
+	// Write new description, keeping sprite order
+	MMLObject out;
+	mml_empty(&out);
+	NodeIdx out_root = mml_root(&out);
+	mml_set_name(&out, out_root, "sprsheet");
+	mml_setval_str(&out, out_root, mml_getval_str(&desc, root));
+
+	child = mml_get_first_child(&desc, root);
+	for(; child != 0; child = mml_get_next(&desc, child)) {
+		const char* name = mml_get_name(&desc, child);
+		if(strcmp("img", name) != 0 && strcmp("anim", name) != 0)
+			_add_node(&out, out_root, name, mml_getval_str(&desc, child));
+	}
+
+	char val[128];
+	for(uint i = 0; i < items.size; ++i) {
+		Item* item = darray_get(&items, i);
+		NodeIdx node = mml_node(&out, item->anim ? "anim" : "img", item->name);
+
+		sprintf(atlas_name, "%s_%u.dig", base, item->page);
+		_add_node(&out, node, "tex", atlas_name);
+
+		uint w = item->anim ? item->frame_w : item->src_w;
+		uint h = item->anim ? item->frame_h : item->src_h;
+		sprintf(val, "%u,%u,%u,%u", item->x, item->y, item->x + w, item->y + h);
+		_add_node(&out, node, "src", val);
+
+		if(item->has_cntr) {
+			// Center is in texture coordinates, move it with the sprite
+			sprintf(val, "%g,%g",
+				item->cntr.x - (float)item->src_x + (float)item->x,
+				item->cntr.y - (float)item->src_y + (float)item->y);
+			_add_node(&out, node, "cntr", val);
+		}
+
+		if(item->anim) {
+			sprintf(val, "%u", item->frames);
+			_add_node(&out, node, "frames", val);
+			sprintf(val, "%u,%u", w, h);
+			_add_node(&out, node, "offset", val);
+			sprintf(val, "%u,%u", item->grid_w, item->grid_h);
+			_add_node(&out, node, "grid", val);
+		}
+
+		mml_append(&out, out_root, node);
+	}
+
+	text = mml_serialize(&out);
+	txtfile_write(out_path, text);
+	MEM_FREE(text);
+
+	printf("Packed %u sprites from %u textures into %u atlases\n",
+		items.size, image_list.size, pages.size);
+
+	// Cleanup
+	mml_free(&out);
+	MEM_FREE(base);
+	for(uint i = 0; i < pages.size; ++i) {
+		Page* page = darray_get(&pages, i);
+		darray_free(&page->items);
+	}
+	Image** imgs = DARRAY_DATA_PTR(image_list, Image*);
+	for(uint i = 0; i < image_list.size; ++i) {
+		free(imgs[i]->pixels);
+		MEM_FREE(imgs[i]);
+	}
+	darray_free(&pages);
+	darray_free(&items);
+	darray_free(&image_list);
+	dict_free(&images);
+	mml_free(&desc);
+
+	return 0;
+}
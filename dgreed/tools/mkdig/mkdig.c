@@ -1,4 +1,5 @@
 #include <image.h>
+#include <gfx_utils.h>
 #include <stdio.h>
 #include <memory.h>
 #include <stdint.h>
@@ -81,6 +82,198 @@ static void* _to_la88(Color* data, uint w, uint h) {
 	return out;
 }
 
+static uint16 _rgb_to_565(int r, int g, int b) {
+	return RGB565_ENCODE((r * 31 + 127) / 255, (g * 63 + 127) / 255, (b * 31 + 127) / 255);
+}
+
+static void _565_to_rgb(uint16 c, int* rgb) {
+	int r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Encodes colours of 4x4 block. Endpoints are taken from inset
+// bounding box, flipped along the axis colours actually vary on.
+// In DXT1 transparent texels are encoded with 3 colour mode.
+static void _encode_dxt_colour(const Color* texels, bool dxt1, byte* out) {
+	int rgba[16][4];
+	int min[3] = {255, 255, 255}, max[3] = {0, 0, 0};
+	int mean[3] = {0, 0, 0};
+	int n = 0;
+	bool transparent = false;
+	for(uint i = 0; i < 16; ++i) {
+		byte r, g, b, a;
+		COLOR_DECONSTRUCT(texels[i], r, g, b, a);
+		rgba[i][0] = r; rgba[i][1] = g; rgba[i][2] = b; rgba[i][3] = a;
+		if(dxt1 && a < 128) {
+			transparent = true;
+			continue;
+		}
+		for(uint c = 0; c < 3; ++c) {
+			min[c] = MIN(min[c], rgba[i][c]);
+			max[c] = MAX(max[c], rgba[i][c]);
+			mean[c] += rgba[i][c];
+		}
+		n++;
+	}
+
+	// Fully transparent block
+	if(n == 0) {
+		memset(out, 0, 4);
+		memset(out + 4, 0xFF, 4);
+		return;
+	}
+
+	// Flip green and blue if they go against red (or green, if red is flat)
+	int lead = max[0] - min[0] > 0 ? 0 : 1;
+	int cov[3] = {0, 0, 0};
+	for(uint i = 0; i < 16; ++i) {
+		if(dxt1 && rgba[i][3] < 128)
+			continue;
+		int d = rgba[i][lead] * n - mean[lead];
+		for(uint c = 0; c < 3; ++c)
+			cov[c] += d * (rgba[i][c] * n - mean[c]) / 256;
+	}
+
+	int e0[3], e1[3];
+	for(uint c = 0; c < 3; ++c) {
+		int inset = (max[c] - min[c]) / 16;
+		int lo = min[c] + inset, hi = max[c] - inset;
+		bool flip = cov[c] < 0;
+		e0[c] = flip ? lo : hi;
+		e1[c] = flip ? hi : lo;
+	}
+
+	uint16 c0 = _rgb_to_565(e0[0], e0[1], e0[2]);
+	uint16 c1 = _rgb_to_565(e1[0], e1[1], e1[2]);
+
+	// Order endpoints to select 4 or 3 colour mode
+	bool four_colours = !(dxt1 && transparent);
+	if((four_colours && c0 < c1) || (!four_colours && c0 > c1)) {
+		uint16 t = c0; c0 = c1; c1 = t;
+	}
+
+	int palette[4][3];
+	_565_to_rgb(c0, palette[0]);
+	_565_to_rgb(c1, palette[1]);
+	uint n_colours = 4;
+	for(uint c = 0; c < 3; ++c) {
+		if(four_colours) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			n_colours = 3;
+		}
+	}
+
+	uint32 indices = 0;
+	for(uint i = 0; i < 16; ++i) {
+		uint best = 0;
+		if(!four_colours && rgba[i][3] < 128) {
+			best = 3;
+		}
+		else if(c0 != c1) {
+			int best_dist = MAX_INT32;
+			for(uint j = 0; j < n_colours; ++j) {
+				int dr = rgba[i][0] - palette[j][0];
+				int dg = rgba[i][1] - palette[j][1];
+				int db = rgba[i][2] - palette[j][2];
+				int dist = dr*dr + dg*dg + db*db;
+				if(dist < best_dist) {
+					best_dist = dist;
+					best = j;
+				}
+			}
+		}
+		indices |= best << (i * 2);
+	}
+
+	out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+	for(uint i = 0; i < 4; ++i)
+		out[4+i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static void _encode_dxt3_alpha(const Color* texels, byte* out) {
+	memset(out, 0, 8);
+	for(uint i = 0; i < 16; ++i) {
+		byte a = texels[i] >> 24;
+		out[i/2] |= ((a * 15 + 127) / 255) << ((i & 1) * 4);
+	}
+}
+
+static void _encode_dxt5_alpha(const Color* texels, byte* out) {
+	byte min = 255, max = 0;
+	for(uint i = 0; i < 16; ++i) {
+		byte a = texels[i] >> 24;
+		min = MIN(min, a);
+		max = MAX(max, a);
+	}
+
+	// 8 alpha mode, max first
+	int palette[8];
+	palette[0] = max;
+	palette[1] = min;
+	for(uint i = 1; i < 7; ++i)
+		palette[i+1] = ((7-i) * palette[0] + i * palette[1]) / 7;
+
+	uint64 indices = 0;
+	for(uint i = 0; i < 16; ++i) {
+		int a = texels[i] >> 24;
+		uint best = 0;
+		int best_dist = MAX_INT32;
+		for(uint j = 0; j < 8 && max != min; ++j) {
+			int dist = abs(a - palette[j]);
+			if(dist < best_dist) {
+				best_dist = dist;
+				best = j;
+			}
+		}
+		indices |= (uint64)best << (i * 3);
+	}
+
+	out[0] = max;
+	out[1] = min;
+	for(uint i = 0; i < 6; ++i)
+		out[2+i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static void* _to_dxt(Color* data, uint w, uint h, PixelFormat format) {
+	uint block_size = format == PF_DXT1 ? 8 : 16;
+	byte* out = malloc(image_level_size(w, h, format));
+	byte* block = out;
+
+	// Images smaller than a block (small mip levels) repeat edge texels
+	Color texels[16];
+	for(uint by = 0; by < h; by += 4) {
+		for(uint bx = 0; bx < w; bx += 4, block += block_size) {
+			for(uint y = 0; y < 4; ++y) {
+				for(uint x = 0; x < 4; ++x) {
+					uint sx = MIN(bx + x, w - 1), sy = MIN(by + y, h - 1);
+					texels[y * 4 + x] = data[IDX_2D(sx, sy, w)];
+				}
+			}
+
+			switch(format) {
+				case PF_DXT1:
+					_encode_dxt_colour(texels, true, block);
+					break;
+				case PF_DXT3:
+					_encode_dxt3_alpha(texels, block);
+					_encode_dxt_colour(texels, false, block + 8);
+					break;
+				default:
+					_encode_dxt5_alpha(texels, block);
+					_encode_dxt_colour(texels, false, block + 8);
+			}
+		}
+	}
+	return out;
+}
+
 static void* _to_pvrtc(const char* file_name, int bpp){
 	char params[128];
 	const char* temp_file = "./mkdig_temp.pvr";
@@ -137,6 +330,11 @@ static void* _format(
 		case PF_PVRTC2:
 			out = _to_pvrtc(file_name, 2);
 			break;
+		case PF_DXT1:
+		case PF_DXT3:
+		case PF_DXT5:
+			out = _to_dxt(data, w, h, format);
+			break;
 		default:
 			printf("format is not yet supported\n");
 			LOG_ERROR("unsupported format");
@@ -144,6 +342,41 @@ static void* _format(
 	return out;
 }
 
+// Builds mip chain with gamma correct box filter,
+// returns all levels converted to format, one after another
+static void* _format_mipmaps(Color* data, uint w, uint h, PixelFormat format) {
+	if(format == PF_PVRTC2 || format == PF_PVRTC4)
+		LOG_ERROR("Mipmaps are not supported for PVRTC");
+
+	uint levels = image_mip_levels(w, h, format | PF_MASK_MIPMAPS);
+	size_t size = 0;
+	for(uint i = 0; i < levels; ++i)
+		size += image_level_size(MAX(1, w >> i), MAX(1, h >> i), format);
+
+	byte* out = malloc(size);
+	size_t offset = 0;
+	Color* level = data;
+	for(uint i = 0; i < levels; ++i) {
+		uint lw = MAX(1, w >> i), lh = MAX(1, h >> i);
+		void* pixels = _format(level, lw, lh, format, NULL, false);
+		size_t level_size = image_level_size(lw, lh, format);
+		memcpy(out + offset, pixels, level_size);
+		offset += level_size;
+		free(pixels);
+
+		if(i + 1 < levels) {
+			Color* next = gfx_downscale_srgb(level, lw, lh);
+			if(level != data)
+				MEM_FREE(level);
+			level = next;
+		}
+	}
+	if(level != data)
+		MEM_FREE(level);
+
+	return out;
+}
+
 static void _premul_alpha(Color* data, uint w, uint h) {
 	byte r, g, b, a;
 	for(uint i = 0; i < w * h; ++i) {
@@ -167,7 +400,10 @@ static PixelFormat _str_to_format(const char* str) {
 		{"RGBA5551", PF_RGBA5551},
 		{"LA88", PF_LA88},
 		{"PVRTC2", PF_PVRTC2},
-		{"PVRTC4", PF_PVRTC4}
+		{"PVRTC4", PF_PVRTC4},
+		{"DXT1", PF_DXT1},
+		{"DXT3", PF_DXT3},
+		{"DXT5", PF_DXT5}
 	};
 
 	for(uint i = 0; i < sizeof(formats)/sizeof(formats[0]); ++i) {
@@ -190,17 +426,20 @@ int dgreed_main(int argc, const char** argv) {
 		printf("  -v\tverbose mode\n");
 		printf("  -p\tpremultiply alpha\n");
 		printf("  -h\thigh compression\n");
+		printf("  -m\tgenerate mipmaps\n");
 		printf("  -f\toutput pixel format (default RGBA4444)\n");
 		printf("  -o\toutput filename (default out.dig)\n\n");
 		printf("Pixel formats:\n");
 		printf("	RGB888, RGB565, RGBA8888,\n");
-		printf("	RGBA4444, RGBA5551, PVRTC2, PVRTC4\n");
+		printf("	RGBA4444, RGBA5551, PVRTC2, PVRTC4,\n");
+		printf("	DXT1, DXT3, DXT5\n");
 		printf("\n");
 		return -1;
 	}
 
 	bool high_comp = false;
 	bool premul = false;
+	bool mipmaps = false;
 	bool verbose __attribute__ ((unused)) = false;
 	PixelFormat format = PF_RGBA4444;
 	const char* in = NULL;
@@ -217,6 +456,8 @@ int dgreed_main(int argc, const char** argv) {
 			out = params_get(++i);
 		else if(strcmp(params_get(i), "-h") == 0)
 			high_comp = true;
+		else if(strcmp(params_get(i), "-m") == 0)
+			mipmaps = true;
 		else if(!in)
 			in = params_get(i);
 	}
@@ -235,7 +476,14 @@ int dgreed_main(int argc, const char** argv) {
 	if(premul)
 		_premul_alpha(data, w, h);
 
-	void* pixels = _format(data, w, h, format, in, premul);
+	void* pixels;
+	if(mipmaps) {
+		pixels = _format_mipmaps(data, w, h, format);
+		format |= PF_MASK_MIPMAPS;
+	}
+	else {
+		pixels = _format(data, w, h, format, in, premul);
+	}
 
 	if(premul)
 		format |= PF_MASK_PREMUL_ALPHA;
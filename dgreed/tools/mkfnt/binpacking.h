@@ -5,5 +5,5 @@ typedef struct {
 } Pos;
 
 // Returns null if packing is unsuccessfull, allocates array of offsets
-// otherwise. Shuffles up widths and heights!
+// otherwise. Uses MaxRects packer from dgreed.
 Pos* bpack(uint w, uint h, uint n, uint* widths, uint* heights);
@@ -8,6 +8,7 @@
 typedef struct {
 	stbtt_fontinfo info;
 	float scale;
+	void* ttf_buffer;
 } StbttFont;
 
 FntHandle fnt_init(const char* filename, uint px_size) {
@@ -26,7 +27,8 @@ FntHandle fnt_init(const char* filename, uint px_size) {
 	stbtt_InitFont(&font->info, ttf_buffer, stbtt_GetFontOffsetForIndex(ttf_buffer, 0)); 
 	font->scale = stbtt_ScaleForPixelHeight(&font->info, px_size);
 
-	MEM_FREE(ttf_buffer);
+	// stbtt reads glyph data straight from the buffer, keep it around
+	font->ttf_buffer = ttf_buffer;
 
 	return (FntHandle)font;
 }
@@ -35,6 +37,7 @@ void fnt_close(FntHandle fnt) {
 	assert(fnt);
 
 	StbttFont* font = (StbttFont*)fnt;
+	MEM_FREE(font->ttf_buffer);
 	MEM_FREE(font);
 }
 
@@ -58,8 +61,14 @@ byte* fnt_get_glyph(FntHandle fnt, int codepoint, GlyphMetrics* metrics) {
 	StbttFont* font = (StbttFont*)fnt;
 
 	int w, h, x_off, y_off;
-	byte* bitmap = stbtt_GetCodepointBitmap(&font->info, 0.0f, font->scale, 
-			codepoint, &w, &h, &x_off, &y_off);
+	byte* stbtt_bitmap = stbtt_GetCodepointBitmap(&font->info, 0.0f, 
+			font->scale, codepoint, &w, &h, &x_off, &y_off);
+
+	// stbtt allocates with malloc, callers free with MEM_FREE
+	byte* bitmap = MEM_ALLOC(MAX(1, w * h));
+	if(stbtt_bitmap)
+		memcpy(bitmap, stbtt_bitmap, w * h);
+	stbtt_FreeBitmap(stbtt_bitmap, NULL);
 
 	metrics->w = w;
 	metrics->h = h;
@@ -2,6 +2,7 @@
 #include <gfx_utils.h>
 #include <memory.h>
 #include <image.h>
+#include <async.h>
 
 #include "fnt.h"
 #include "binpacking.h"
@@ -15,6 +16,22 @@ FntMetrics font_metrics;
 Pos* glyph_pos;
 Color* baked_font;
 
+// Distance field mode: glyphs are rendered SDF_UPSCALE times larger,
+// distances are searched up to SDF_SPREAD output pixels away
+#define SDF_UPSCALE 4
+#define SDF_SPREAD 4
+
+bool sdf = false;
+
+typedef struct {
+	const byte* src;
+	int src_w, src_h;
+	// Position of dest topleft in src pixels
+	int x0, y0;
+	byte* dest;
+	uint w, h;
+} SdfJob;
+
 const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789.,\"\'/|\\!?+-=*()[]{}@#$%&_ ";
 int currencies[] = {
 	0x20AC, // Euro
@@ -67,7 +84,7 @@ void mkfnt_init(void) {
 }
 
 void mkfnt_render_glyphs(const char* filename, uint px_size) {
-	FntHandle font = fnt_init(filename, px_size);
+	FntHandle font = fnt_init(filename, sdf ? px_size * SDF_UPSCALE : px_size);
 
 	font_metrics = fnt_metrics(font);
 	
@@ -81,6 +98,94 @@ void mkfnt_render_glyphs(const char* filename, uint px_size) {
 	fnt_close(font);
 }
 
+static int _floor_div(int a, int b) {
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static bool _sdf_inside(const SdfJob* job, int x, int y) {
+	if(x < 0 || y < 0 || x >= job->src_w || y >= job->src_h)
+		return false;
+	return job->src[IDX_2D(x, y, job->src_w)] >= 128;
+}
+
+// Runs on async workers, only touches its own job
+static void _sdf_task(void* userdata) {
+	SdfJob* job = userdata;
+
+	const int r = SDF_SPREAD * SDF_UPSCALE;
+	for(uint y = 0; y < job->h; ++y) {
+		for(uint x = 0; x < job->w; ++x) {
+			// Sample at the center of output pixel
+			int sx = job->x0 + x * SDF_UPSCALE + SDF_UPSCALE / 2;
+			int sy = job->y0 + y * SDF_UPSCALE + SDF_UPSCALE / 2;
+			bool inside = _sdf_inside(job, sx, sy);
+
+			// Find nearest pixel of the other side
+			int best = r * r;
+			for(int dy = -r; dy <= r; ++dy) {
+				for(int dx = -r; dx <= r; ++dx) {
+					int d = dx*dx + dy*dy;
+					if(d < best && _sdf_inside(job, sx+dx, sy+dy) != inside)
+						best = d;
+				}
+			}
+
+			float dist = sqrtf((float)best) / (float)r;
+			float v = inside ? 0.5f + dist * 0.5f : 0.5f - dist * 0.5f;
+			job->dest[IDX_2D(x, y, job->w)] = (byte)lrintf(clamp(0.0f, 1.0f, v) * 255.0f);
+		}
+	}
+}
+
+// Replaces glyph bitmaps with distance fields at 1/SDF_UPSCALE resolution,
+// glyphs are processed in parallel
+void mkfnt_make_sdf(void) {
+	SdfJob* jobs = MEM_ALLOC(sizeof(SdfJob) * n_glyphs);
+	TaskId* tasks = MEM_ALLOC(sizeof(TaskId) * n_glyphs);
+
+	for(uint i = 0; i < n_glyphs; ++i) {
+		GlyphMetrics* m = &glyph_metrics[i];
+		int x_off = (int)m->x_off, y_off = (int)m->y_off;
+
+		int l = _floor_div(x_off, SDF_UPSCALE) - SDF_SPREAD;
+		int t = _floor_div(y_off, SDF_UPSCALE) - SDF_SPREAD;
+		int r = _floor_div(x_off + (int)m->w + SDF_UPSCALE - 1, SDF_UPSCALE) 
+			+ SDF_SPREAD;
+		int b = _floor_div(y_off + (int)m->h + SDF_UPSCALE - 1, SDF_UPSCALE) 
+			+ SDF_SPREAD;
+
+		SdfJob* job = &jobs[i];
+		job->src = glyph_bitmaps[i];
+		job->src_w = m->w;
+		job->src_h = m->h;
+		job->x0 = l * SDF_UPSCALE - x_off;
+		job->y0 = t * SDF_UPSCALE - y_off;
+		job->w = r - l;
+		job->h = b - t;
+		job->dest = MEM_ALLOC(job->w * job->h);
+
+		tasks[i] = async_run(_sdf_task, job);
+	}
+
+	for(uint i = 0; i < n_glyphs; ++i) {
+		async_wait(tasks[i]);
+
+		GlyphMetrics* m = &glyph_metrics[i];
+		MEM_FREE(glyph_bitmaps[i]);
+		glyph_bitmaps[i] = jobs[i].dest;
+
+		m->x_off = (jobs[i].x0 + (int)m->x_off) / SDF_UPSCALE;
+		m->y_off = (jobs[i].y0 + (int)m->y_off) / SDF_UPSCALE;
+		m->w = jobs[i].w;
+		m->h = jobs[i].h;
+		m->x_advance /= (float)SDF_UPSCALE;
+		m->x_bearing /= (float)SDF_UPSCALE;
+	}
+
+	MEM_FREE(tasks);
+	MEM_FREE(jobs);
+}
+
 bool mkfnt_try_arrange(uint size) {
 	uint* widths = MEM_ALLOC(sizeof(uint) * n_glyphs);
 	uint* heights = MEM_ALLOC(sizeof(uint) * n_glyphs);
@@ -150,7 +255,10 @@ void mkfnt_write_bft(const char* tex_path) {
 	MEM_FREE(bft_path);
 
 	// Magic file id
-	file_write_uint32(f, FOURCC('F', 'O', 'N', 'T'));
+	if(sdf)
+		file_write_uint32(f, FOURCC('F', 'S', 'D', 'F'));
+	else
+		file_write_uint32(f, FOURCC('F', 'O', 'N', 'T'));
 
 	// Font height
 	file_write_uint16(f, abs((font_metrics.ascent - font_metrics.descent)/100.0f));
@@ -204,17 +312,24 @@ void mkfnt_close(void) {
 
 int dgreed_main(int argc, const char** argv) {
 	params_init(argc, argv);
-	if(params_count() != 2) {
-		printf("Provide font file ant size\n");
+	sdf = params_find("-s") != ~0;
+	if(params_count() != (sdf ? 3 : 2)) {
+		printf("Provide font file ant size, -s for distance field\n");
 		return -1;
 	}
 
-	const char* filename = params_get(0);
+	// Flag can go anywhere, skip it
+	uint arg = params_find("-s") == 0 ? 1 : 0;
+	const char* filename = params_get(arg++);
+	if(params_find("-s") == arg)
+		arg++;
 	uint px_size;
-	sscanf(params_get(1), "%d", &px_size);
+	sscanf(params_get(arg), "%d", &px_size);
 
 	mkfnt_init();
 	mkfnt_render_glyphs(filename, px_size);
+	if(sdf)
+		mkfnt_make_sdf();
 
 	uint size = 128;
 	while(!mkfnt_try_arrange(size))
@@ -223,8 +338,9 @@ int dgreed_main(int argc, const char** argv) {
 	// Construct texture name
 	char* font_name = path_change_ext(filename, "");	
 	char texture_name[256];
-	assert(strlen(font_name) + 10 < 256);
-	sprintf(texture_name, "%s_%dpx.png", font_name, px_size);
+	assert(strlen(font_name) + 14 < 256);
+	sprintf(texture_name, sdf ? "%s_%dpx_sdf.png" : "%s_%dpx.png", 
+		font_name, px_size);
 	MEM_FREE(font_name);
 
 	mkfnt_bake(size, texture_name);
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "vfs.h"
+
+#include "malka/lua/lua.h"
+#include "malka/lua/lauxlib.h"
+#include "malka/lua/lobject.h"
+#include "malka/lua/lstate.h"
+#include "malka/lua/lundump.h"
+
+#define MAX_FILES 2048
+#define MAX_FILENAME 128
+
+typedef struct {
+	char* data;
+	uint32 size;
+	uint32 reserved;
+} Chunk;
+
+static char names[MAX_FILES][MAX_FILENAME];
+static Chunk chunks[MAX_FILES];
+
+static int _writer(lua_State* l, const void* p, size_t size, void* ud) {
+	(void)l;
+	Chunk* c = ud;
+	if(c->size + size > c->reserved) {
+		while(c->size + size > c->reserved)
+			c->reserved = c->reserved ? c->reserved * 2 : 4096;
+		c->data = realloc(c->data, c->reserved);
+	}
+	memcpy(c->data + c->size, p, size);
+	c->size += size;
+	return 0;
+}
+
+// Module name is file name without folders and extension,
+// that's what require gets as an argument
+static void _module_name(const char* path, char* out) {
+	const char* file = path;
+	for(const char* p = path; *p; ++p) {
+		if(*p == '/' || *p == '\\')
+			file = p + 1;
+	}
+	strncpy(out, file, MAX_FILENAME-1);
+	out[MAX_FILENAME-1] = '\0';
+	char* ext = strrchr(out, '.');
+	if(ext)
+		*ext = '\0';
+}
+
+int compile_scripts(const char* output, uint32 n_files, const char** files) {
+	uint32 names_strlen = 0;
+	uint32 total_size = 0;
+
+	if(n_files > MAX_FILES) {
+		fprintf(stderr, "error: too many scripts\n");
+		return -1;
+	}
+
+	// Compile and strip all scripts to memory
+	lua_State* l = luaL_newstate();
+	for(uint32 i = 0; i < n_files; ++i) {
+		if(luaL_loadfile(l, files[i]) != 0) {
+			fprintf(stderr, "error: %s\n", lua_tostring(l, -1));
+			lua_close(l);
+			return -1;
+		}
+		const Proto* f = clvalue(l->top - 1)->l.p;
+		luaU_dump(l, f, _writer, &chunks[i], 1);
+		lua_pop(l, 1);
+
+		_module_name(files[i], names[i]);
+		for(uint32 j = 0; j < i; ++j) {
+			if(strcmp(names[i], names[j]) == 0) {
+				fprintf(stderr, "error: duplicate module %s\n", names[i]);
+				lua_close(l);
+				return -1;
+			}
+		}
+
+		names_strlen += strlen(names[i]) + 1;
+		// Keep chunks 8-byte aligned, same as mkvfs
+		total_size += align_padding(chunks[i].size, 8);
+	}
+	lua_close(l);
+
+	int new_names_strlen = align_padding(names_strlen, 8);
+	int names_padding = new_names_strlen - names_strlen;
+	names_strlen = new_names_strlen;
+
+	assert(sizeof(VfsHeader) == 32);
+	VfsHeader hdr = {
+		.magic = FOURCC('Q', 'B', 'F', 'S'),
+		.size = 32 + names_strlen + 8 * n_files + total_size,
+		.n_files = n_files,
+		.names_pos = 32,
+		.offsets_pos = 32 + names_strlen,
+		.lengths_pos = 32 + names_strlen + 4 * n_files,
+		.data_pos = 32 + names_strlen + 8 * n_files,
+		.padding = 0
+	};
+
+	uint32* offsets = malloc(n_files * 4);
+	uint32* sizes = malloc(n_files * 4);
+	offsets[0] = hdr.data_pos;
+	for(uint32 i = 0; i < n_files; ++i) {
+		sizes[i] = chunks[i].size;
+		if(i)
+			offsets[i] = offsets[i-1] + align_padding(sizes[i-1], 8);
+	}
+
+	FILE* out = fopen(output, "wb");
+	if(!out) {
+		fprintf(stderr, "error: can't write %s\n", output);
+		return -1;
+	}
+
+	fwrite(&hdr, 1, sizeof(VfsHeader), out);
+	for(uint32 i = 0; i < n_files; ++i)
+		fwrite(names[i], 1, strlen(names[i])+1, out);
+	while(names_padding--)
+		fputc(0, out);
+	fwrite(offsets, 1, n_files * 4, out);
+	fwrite(sizes, 1, n_files * 4, out);
+	for(uint32 i = 0; i < n_files; ++i) {
+		fwrite(chunks[i].data, 1, sizes[i], out);
+		uint32 padding = align_padding(sizes[i], 8) - sizes[i];
+		while(padding--)
+			fputc(0, out);
+		free(chunks[i].data);
+	}
+
+	assert(ftell(out) == hdr.size);
+	fclose(out);
+
+	printf("%d scripts, bundle size: %d (%dk)\n", n_files, hdr.size, hdr.size / 1024);
+
+	free(offsets);
+	free(sizes);
+	return 0;
+}
+
+int main(int argc, const char** argv) {
+	if(argc < 3) {
+		printf("mkluab: compiles lua scripts into stripped bytecode vfs bundle\n");
+		printf("usage: mkluab output script1.lua [script2.lua ...]\n");
+		return 0;
+	}
+
+	return compile_scripts(argv[1], argc - 2, argv + 2);
+}
@@ -22,7 +22,9 @@ int process_manifest(const char* manifest, const char* output) {
 			names_strlen += strlen(filename) + 1;
 			fseek(h, 0, SEEK_END);
 			sizes[n_files++] = ftell(h);
-			total_size += ftell(h);
+			// Keep file data 8-byte aligned, so that binary formats
+			// can be used in place straight from the mmapped blob
+			total_size += align_padding(ftell(h), 8);
 			fclose(h);
 		}
 		else {
@@ -70,7 +72,7 @@ int process_manifest(const char* manifest, const char* output) {
 	// Write offsets & lengths
 	offsets[0] = hdr.data_pos;
 	for(uint i = 1; i < n_files; ++i) {
-		offsets[i] = offsets[i-1] + sizes[i-1];
+		offsets[i] = offsets[i-1] + align_padding(sizes[i-1], 8);
 	}
 	fwrite(offsets, 1, n_files * 4, out);
 	fwrite(sizes, 1, n_files * 4, out);
@@ -83,6 +85,11 @@ int process_manifest(const char* manifest, const char* output) {
 		void* buffer = malloc(sizes[i]);
 		fread(buffer, sizes[i], 1, h);
 		fwrite(buffer, sizes[i], 1, out);
+		uint padding = align_padding(sizes[i], 8) - sizes[i];
+		while(padding--) {
+			uint z = 0;
+			fwrite(&z, 1, 1, out);
+		}
 		fclose(h);
 		free(buffer);
 		i++;
@@ -1,6 +1,7 @@
 #!/usr/bin/env python2
 
 from string import whitespace
+import struct
 
 class Node:
 	def __init__(self):
@@ -171,6 +172,44 @@ def serialize2(tree):
 	result += ')'
 	return result
 
+def serialize_binary(tree):
+	'''Converts tree of nodes to binary mml (see MMLBinHeader in src/mml.h)'''
+
+	# Flatten tree depth-first, same node order as C parser produces
+	order, stack = [], [tree]
+	while stack:
+		node = stack.pop()
+		order.append(node)
+		stack.extend(reversed(node.children))
+	index = dict((id(node), i) for i, node in enumerate(order))
+
+	next_idx = {}
+	for node in order:
+		for a, b in zip(node.children, node.children[1:]):
+			next_idx[id(a)] = index[id(b)]
+
+	nodes, strs, str_size = [], [], 0
+	for node in order:
+		name_start = str_size
+		value_start = name_start + len(node.name) + 1
+		str_size = value_start + len(node.value) + 1
+		strs.append(node.name + '\0' + node.value + '\0')
+		first_child = index[id(node.children[0])] if node.children else 0
+		nodes.append(struct.pack('<4I', name_start, value_start,
+			first_child, next_idx.get(id(node), 0)))
+
+	padding = '\0' * ((4 - str_size % 4) % 4)
+	header = 'MMLB' + struct.pack('<3I', 1, len(order), str_size)
+	return header + ''.join(nodes) + ''.join(strs) + padding
+
+def compile_file(input, output):
+	'''Converts mml text file to binary mml file'''
+
+	tree = deserialize(open(input, 'r').read())
+	out = open(output, 'wb')
+	out.write(serialize_binary(tree))
+	out.close()
+
 def printtree(tree, prefix=''):
 	print prefix + tree.name + tree.value
 	for child in tree.children:
@@ -182,6 +221,11 @@ if __name__ == '__main__':
 	import unittest
 	import sys
 
+	# Asset compilation mode: mml.py -c input.mml output.mml
+	if len(sys.argv) == 4 and sys.argv[1] == '-c':
+		compile_file(sys.argv[2], sys.argv[3])
+		sys.exit(0)
+
 	class TestMml(unittest.TestCase):
 		input1 = '(name value)'
 		input2 = '''( name value
@@ -338,6 +382,21 @@ if __name__ == '__main__':
 			self.assert_(tree.value == tree2.value)
 			self.assert_(len(tree.children) == len(tree2.children))
 
+		def testserializebinary(self):
+			tree = deserialize(self.input3)
+			data = serialize_binary(tree)
+			self.assert_(data[:4] == 'MMLB')
+			self.assert_(len(data) % 4 == 0)
+			(version, n_nodes, str_size) = struct.unpack('<3I', data[4:16])
+			self.assert_(version == 1 and n_nodes == 3)
+			root = struct.unpack('<4I', data[16:32])
+			self.assert_(root == (0, 5, 1, 0))
+			name2 = struct.unpack('<4I', data[32:48])
+			self.assert_(name2[2] == 0 and name2[3] == 2)
+			strs = data[16 + 16*n_nodes:16 + 16*n_nodes + str_size]
+			self.assert_(strs.split('\0')[:6] == 
+				['name', 'value', 'name2', 'value2', 'name3', 'value3'])
+
 		def testfilterescape(self):
 			orig = 'a \\\\\\n bc \\t\\tdef\\n\\b'
 			filtered = filter_escape(orig)